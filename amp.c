@@ -0,0 +1,324 @@
+  /**********************************************************************
+   *                               amp.c                                *
+   *                                                                    *
+   *              Peak amplitudes of an event, as it is picked          *
+   *                                                                    *
+   *  This file contains functions InitAmp(), SetAmpRate(), StartAmp(), *
+   *  AmpSample(), EndAmp(), ResetAmp(), FreeAmp() and LogAmpStats().   *
+   *                                                                    *
+   *  With AmpWindow set, the amplitudes a magnitude program needs are  *
+   *  measured from the data the picker already has, so it doesn't      *
+   *  have to fetch the waveform again.  From the trigger on, for up    *
+   *  to AmpWindow seconds or until the event is over, each channel     *
+   *  follows the largest peak-to-peak swing of                         *
+   *                                                                    *
+   *     - the raw data, in counts, and                                 *
+   *     - a Wood-Anderson seismograph driven by the data, taken as     *
+   *       ground velocity: a second-order section with a natural       *
+   *       period of 0.8 s, damping 0.7 and magnification 2080, made    *
+   *       with the bilinear transform and run one sample at a time.    *
+   *       It is in counts times seconds; divided by the channel's      *
+   *       gain in counts/(m/s), it is the trace amplitude in m.        *
+   *                                                                    *
+   *  Half of each swing is sent as the amplitude, with twice the time  *
+   *  between its two extrema as the period, once the window is over    *
+   *  and the pick has been reported (and, with EarlyPick, confirmed).  *
+   *  Nothing is sent for an event whose pick is dropped or retracted.  *
+   *                                                                    *
+   *  Only the amplitudes of an active event are measured.  At the      *
+   *  trigger the simulation is started at rest for the level of the    *
+   *  data, and run over the samples before the trigger if the channel  *
+   *  keeps them for OnsetRefine, so it has settled by the onset.       *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <earthworm.h>
+#include <transport.h>
+#include "nn_pick_ew.h"
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+
+#define WA_PERIOD  0.8           /* Natural period of a Wood-Anderson (s) */
+#define WA_DAMPING 0.7           /* Fraction of critical damping */
+#define WA_GAIN    2080.         /* Static magnification */
+
+static double Window = 0.;                /* AmpWindow (s); 0 = off */
+static unsigned long nSent    = 0;        /* Amplitudes sent */
+static unsigned long nDropped = 0;        /* Events whose pick wasn't sent */
+static unsigned long nFailed  = 0;        /* Allocations that failed */
+
+/* Function prototypes
+   *******************/
+void ReportAmp( AMPSTATE *, STATION *, GPARM *, EWH * );  /* function in report.c */
+static double WaSample( AMPSTATE *, double );
+static void   Follow( AMPPEAK *, double, int, double );
+static void   Finish( AMPPEAK *, int, double );
+static void   SendAmp( STATION *, GPARM *, EWH * );
+
+
+  /***************************************************************
+   *                             InitAmp()                       *
+   ***************************************************************/
+
+void InitAmp( GPARM *Gparm )
+{
+   Window = Gparm->AmpWindow;
+}
+
+
+  /***************************************************************
+   *                           SetAmpRate()                      *
+   *                                                             *
+   *  Give a channel its amplitude state, if it has none, and    *
+   *  set the simulation for its sample rate.  Called for every  *
+   *  message picked; does nothing if the rate is unchanged.     *
+   ***************************************************************/
+
+void SetAmpRate( STATION *Sta, double samprate )
+{
+   AMPSTATE *A = Sta->Amp;
+   double   w0, K, d0;
+
+   if ( Window <= 0. ) return;
+   if ( (A != NULL) && (A->samprate == samprate) ) return;
+
+   if ( A == NULL )
+   {
+      if ( (A = (AMPSTATE *) calloc( 1, sizeof(AMPSTATE) )) == NULL )
+      {
+         if ( nFailed++ == 0 )
+            logit( "et", "pick_ew: Cannot allocate amplitude state for %s.%s.%s.%s; "
+                   "its amplitudes aren't measured\n", Sta->sta, Sta->chan, Sta->net,
+                   Sta->loc );
+         return;
+      }
+      Sta->Amp = A;
+   }
+
+/* G s / (s^2 + 2 h w0 s + w0^2), velocity in, displacement
+   out.  The bilinear transform is warped to be exact at w0.
+   *********************************************************/
+   w0 = 2. * M_PI / WA_PERIOD;
+   K  = w0 / tan( 0.5 * w0 / samprate );
+   d0 = K * K + 2. * WA_DAMPING * w0 * K + w0 * w0;
+   A->b0 = WA_GAIN * K / d0;
+   A->b2 = -A->b0;
+   A->a1 = (2. * w0 * w0 - 2. * K * K) / d0;
+   A->a2 = (K * K - 2. * WA_DAMPING * w0 * K + w0 * w0) / d0;
+   A->samprate = samprate;
+   A->nmax     = (int) (Window * samprate + 0.5);
+   A->active   = 0;
+}
+
+
+  /***************************************************************
+   *                            StartAmp()                       *
+   *                                                             *
+   *  Start measuring at a trigger, with the trigger sample,     *
+   *  which is the newest sample given to Sample().  tstart is   *
+   *  its time.                                                  *
+   ***************************************************************/
+
+void StartAmp( STATION *Sta, double tstart )
+{
+   AMPSTATE   *A  = Sta->Amp;
+   ONSETSTATE *On = Sta->On;
+   double     x   = Sta->old_sample;          /* The trigger sample */
+   double     y;
+
+/* Start at rest for the level of the data, then run
+   through the samples kept before the trigger, if any
+   ***************************************************/
+   if ( (On != NULL) && (On->n > 1) )
+   {
+      unsigned long first = (On->n > (unsigned long) On->hlen) ? On->n - On->hlen : 0;
+      unsigned long i;
+
+      if ( On->n - 1 - first > (unsigned long) On->npre )
+         first = On->n - 1 - On->npre;
+      A->s1 = -A->b0 * On->hist[first & (On->hlen - 1)];
+      A->s2 =  A->b2 * On->hist[first & (On->hlen - 1)];
+      for ( i = first; i < On->n - 1; i++ )
+         WaSample( A, On->hist[i & (On->hlen - 1)] );
+   }
+   else
+   {
+      A->s1 = -A->b0 * x;
+      A->s2 =  A->b2 * x;
+   }
+   y = WaSample( A, x );
+
+   memset( &A->raw, 0, sizeof(AMPPEAK) );
+   memset( &A->wa,  0, sizeof(AMPPEAK) );
+   A->raw.last = A->raw.ext = x;
+   A->wa.last  = A->wa.ext  = y;
+   A->tstart    = tstart;
+   A->nsamp     = 1;
+   A->pickindex = -1;
+   A->active    = 1;
+}
+
+
+  /***************************************************************
+   *                            AmpSample()                      *
+   *                                                             *
+   *  Measure one sample of an active event, and send the        *
+   *  amplitudes if the window is over and the pick is out.      *
+   *  Called by EventActive().                                   *
+   ***************************************************************/
+
+void AmpSample( double x, STATION *Sta, GPARM *Gparm, EWH *Ewh )
+{
+   AMPSTATE *A = Sta->Amp;
+
+   if ( !A->active ) return;
+
+   if ( A->nsamp < A->nmax )
+   {
+      double y = WaSample( A, x );
+
+      Follow( &A->raw, x, A->nsamp, A->samprate );
+      Follow( &A->wa,  y, A->nsamp, A->samprate );
+      A->nsamp++;
+   }
+   else if ( (A->pickindex >= 0) && !Sta->Ev->early )
+      SendAmp( Sta, Gparm, Ewh );
+}
+
+
+  /***************************************************************
+   *                             EndAmp()                        *
+   *                                                             *
+   *  The event is over.  Send what was measured if the pick     *
+   *  was reported and not retracted (how is EventActive()'s     *
+   *  return value).                                             *
+   ***************************************************************/
+
+void EndAmp( STATION *Sta, int how, GPARM *Gparm, EWH *Ewh )
+{
+   AMPSTATE *A = Sta->Amp;
+
+   if ( (A == NULL) || !A->active ) return;
+
+   if ( (A->pickindex >= 0) && (how != -1) )
+      SendAmp( Sta, Gparm, Ewh );
+   else
+   {
+      A->active = 0;
+      nDropped++;
+   }
+}
+
+
+  /***************************************************************
+   *                            ResetAmp()                       *
+   *                                                             *
+   *  Drop the measurement of an event cut off by a restart.     *
+   ***************************************************************/
+
+void ResetAmp( AMPSTATE *A )
+{
+   if ( A->active ) nDropped++;
+   A->active = 0;
+}
+
+
+  /***************************************************************
+   *                             FreeAmp()                       *
+   ***************************************************************/
+
+void FreeAmp( STATION *Sta )
+{
+   free( Sta->Amp );
+   Sta->Amp = NULL;
+}
+
+
+  /***************************************************************
+   *                           LogAmpStats()                     *
+   ***************************************************************/
+
+void LogAmpStats( void )
+{
+   if ( Window <= 0. ) return;
+
+   logit( "t", "pick_ew: Amplitudes: %lu sent, %lu events without a pick; "
+          "%lu allocations failed\n", nSent, nDropped, nFailed );
+}
+
+
+/* Send the amplitudes and stop measuring
+   **************************************/
+static void SendAmp( STATION *Sta, GPARM *Gparm, EWH *Ewh )
+{
+   AMPSTATE *A = Sta->Amp;
+
+   Finish( &A->raw, A->nsamp, A->samprate );
+   Finish( &A->wa,  A->nsamp, A->samprate );
+   A->active = 0;
+   ReportAmp( A, Sta, Gparm, Ewh );
+   nSent++;
+}
+
+
+/* Run one sample through the Wood-Anderson simulation
+   (transposed direct form II)
+   ***************************************************/
+static double WaSample( AMPSTATE *A, double x )
+{
+   double y = A->b0 * x + A->s1;
+
+   A->s1 = A->s2 - A->a1 * y;
+   A->s2 = A->b2 * x - A->a2 * y;
+   return y;
+}
+
+
+/* Follow the swings of a trace.  Sample i is value y.
+   At each turn, the swing from the last extremum is
+   compared with the largest so far.
+   ***************************************************/
+static void Follow( AMPPEAK *P, double y, int i, double samprate )
+{
+   int dir = (y > P->last) ? 1 : (y < P->last) ? -1 : 0;
+
+   if ( dir != 0 )
+   {
+      if ( (P->dir != 0) && (dir != P->dir) )     /* Turned at sample i-1 */
+      {
+         double pp = fabs( P->last - P->ext );
+
+         if ( pp > P->pp )
+         {
+            P->pp  = pp;
+            P->per = 2. * (i - 1 - P->iext) / samprate;
+            P->ipk = i - 1;
+         }
+         P->ext  = P->last;
+         P->iext = i - 1;
+      }
+      P->dir = dir;
+   }
+   P->last = y;
+}
+
+
+/* Count the swing still under way at the end of the
+   window, which ends at the last sample, n-1
+   *************************************************/
+static void Finish( AMPPEAK *P, int n, double samprate )
+{
+   double pp = fabs( P->last - P->ext );
+
+   if ( pp > P->pp )
+   {
+      P->pp  = pp;
+      P->per = 2. * (n - 1 - P->iext) / samprate;
+      P->ipk = n - 1;
+   }
+}
@@ -0,0 +1,399 @@
+  /**********************************************************************
+   *                             autosta.c                              *
+   *                                                                    *
+   *                 Automatic registration of new channels             *
+   *                                                                    *
+   *  This file contains functions InitAutoStations(), SetAutoRules(),  *
+   *  FindAutoStation(), EvictAutoStations(), ForEachAutoStation(),     *
+   *  LogAutoStats() and FreeAutoStations().                            *
+   *                                                                    *
+   *  With AutoRegister set, a message from a channel that isn't in     *
+   *  the station list creates a channel for it, provided its SCNL      *
+   *  matches a station list rule with a nonzero pick flag.  The        *
+   *  channel gets the rule's parameters and starts in restart mode.    *
+   *  These channels live in a hash table with room for AutoMax         *
+   *  channels.  Channels silent for AutoEvictSec seconds are dropped,  *
+   *  and when the table is full a new channel replaces the one that    *
+   *  has been silent longest, if that one is past AutoEvictSec.        *
+   *  Otherwise the new channel is refused.  SCNLs matching no rule     *
+   *  never allocate anything, so junk SCNLs can't use up memory.       *
+   *  The channels are also kept on a list in the order they were last  *
+   *  heard from, so the silent ones are found without a scan.  Before  *
+   *  a channel caught in an event is dropped, its early pick is taken  *
+   *  back and the amplitude of its reported pick is sent.              *
+   *                                                                    *
+   *  Only the picking thread looks up, adds and removes channels.      *
+   *  Adds and removes are done under AutoMutex, which                  *
+   *  ForEachAutoStation() holds while it walks the channels, so gap    *
+   *  reports and the restart table include them.                       *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <earthworm.h>
+#include <transport.h>
+#include "nn_pick_ew.h"
+
+typedef struct autosta {
+   STATION        Sta;
+   STAEVENT       Ev;        /* Event, gap and duplicate blocks of Sta */
+   GAPSTAT        Gap;
+   DUPKEYS        Dup;
+   time_t         lastseen;  /* When the last message arrived */
+   unsigned int   hash;
+   struct autosta *next;     /* Next channel in the same bucket */
+   struct autosta *older;    /* Neighbours in lastseen order */
+   struct autosta *newer;
+} AUTOSTA;
+
+static AUTOSTA **Bucket = NULL;
+static int       nBucket;
+static AUTOSTA  *Oldest = NULL;      /* Ends of the lastseen list */
+static AUTOSTA  *Newest = NULL;
+static int       nAuto = 0;          /* Channels in the table */
+static int       AutoMax = 0;        /* 0 = auto-registration off */
+static int       EvictSec;
+static GPARM    *Gp;                 /* For messages sent on eviction */
+static EWH      *Ew;
+static RULESET   Rules;              /* Current station list rules */
+static mutex_t   AutoMutex;
+
+static unsigned long nAdded    = 0;  /* Channels added */
+static unsigned long nEvicted  = 0;  /* Channels dropped for silence */
+static unsigned long nRefused  = 0;  /* Channels refused, table full */
+static unsigned long nNoRule   = 0;  /* Messages matching no rule */
+
+/* Function prototypes
+   *******************/
+void     InitVar( STATION * );
+STARULE *MatchRule( RULESET *, char *, char *, char *, char * );  /* in profile.c */
+void     FreeRuleSet( RULESET * );
+void     FreeReorder( STATION * );                              /* in reorder.c */
+void     FreeBank( STATION * );                                 /* in bank.c */
+void     FreeOnset( STATION * );                                /* in onset.c */
+void     FreeAmp( STATION * );                                  /* in amp.c */
+void     FreeNoise( STATION * );                                /* in noise.c */
+void     EndAmp( STATION *, int, GPARM *, EWH * );              /* in amp.c */
+void     RetractPick( CODA *, GPARM *, EWH * );                 /* in report.c */
+static unsigned int HashSCNL( STATION * );
+static void         Unlink( AUTOSTA * );
+static void         Settle( AUTOSTA * );
+static void         Touch( AUTOSTA * );
+static int          EvictOldest( time_t );
+
+
+  /***************************************************************
+   *                       InitAutoStations()                    *
+   *                                                             *
+   *  Set up the channel table.  Takes over the rules read with  *
+   *  the station list.  Returns -1 if an error is encountered.  *
+   ***************************************************************/
+
+int InitAutoStations( GPARM *Gparm, EWH *Ewh, RULESET *rs )
+{
+   Rules = *rs;
+   memset( rs, 0, sizeof(RULESET) );
+   Gp = Gparm;
+   Ew = Ewh;
+
+   AutoMax  = Gparm->AutoMax;
+   EvictSec = Gparm->AutoEvictSec;
+   if ( AutoMax == 0 ) return 0;
+
+   for ( nBucket = 64; nBucket < AutoMax; nBucket *= 2 );
+   if ( (Bucket = (AUTOSTA **) calloc( nBucket, sizeof(AUTOSTA *) )) == NULL )
+   {
+      logit( "et", "pick_ew: Cannot allocate the auto channel table\n" );
+      return -1;
+   }
+   CreateSpecificMutex( &AutoMutex );
+   if ( Rules.nrule == 0 )
+      logit( "et", "pick_ew: AutoRegister is set but the station list has no rules.\n" );
+   return 0;
+}
+
+
+  /***************************************************************
+   *                         SetAutoRules()                      *
+   *                                                             *
+   *  Switch to the rules of a reloaded station list.  Channels  *
+   *  already added keep their parameters.                       *
+   ***************************************************************/
+
+void SetAutoRules( RULESET *rs )
+{
+   if ( AutoMax > 0 ) RequestSpecificMutex( &AutoMutex );
+   FreeRuleSet( &Rules );
+   Rules = *rs;
+   memset( rs, 0, sizeof(RULESET) );
+   if ( AutoMax > 0 ) ReleaseSpecificMutex( &AutoMutex );
+}
+
+
+  /***************************************************************
+   *                       FindAutoStation()                     *
+   *                                                             *
+   *  Find the channel with key's SCNL, adding it if a rule      *
+   *  matches.  Returns NULL if there is no such channel and     *
+   *  none can be added.                                         *
+   ***************************************************************/
+
+STATION *FindAutoStation( STATION *key )
+{
+   unsigned int h;
+   AUTOSTA      *a;
+   STARULE      *r;
+   time_t       now;
+
+   if ( AutoMax == 0 ) return NULL;
+
+   time( &now );
+   h = HashSCNL( key );
+   for ( a = Bucket[h & (nBucket - 1)]; a != NULL; a = a->next )
+      if ( (a->hash == h) && (strcmp( a->Sta.sta,  key->sta )  == 0) &&
+           (strcmp( a->Sta.chan, key->chan ) == 0) && (strcmp( a->Sta.net, key->net ) == 0) &&
+           (strcmp( a->Sta.loc,  key->loc )  == 0) )
+      {
+         a->lastseen = now;
+         Touch( a );
+         return &a->Sta;
+      }
+
+/* Not seen before.  Does a rule want it?
+   **************************************/
+   r = MatchRule( &Rules, key->sta, key->chan, key->net, key->loc );
+   if ( (r == NULL) || (r->pickflag == 0) )
+   {
+      nNoRule++;
+      return NULL;
+   }
+
+   if ( (nAuto >= AutoMax) && !EvictOldest( now ) )
+   {
+      if ( nRefused++ % 1000 == 0 )
+         logit( "et", "pick_ew: Auto channel table full (%d); refused %s.%s.%s.%s "
+                "(%lu refused so far)\n", AutoMax, key->sta, key->chan, key->net,
+                key->loc, nRefused );
+      return NULL;
+   }
+
+   if ( (a = (AUTOSTA *) calloc( 1, sizeof(AUTOSTA) )) == NULL )
+   {
+      logit( "et", "pick_ew: Cannot allocate auto channel %s.%s.%s.%s\n",
+             key->sta, key->chan, key->net, key->loc );
+      return NULL;
+   }
+   strcpy( a->Sta.sta,  key->sta );
+   strcpy( a->Sta.chan, key->chan );
+   strcpy( a->Sta.net,  key->net );
+   strcpy( a->Sta.loc,  key->loc );
+   a->Sta.Parm = r->Parm;
+   a->Sta.Ev   = &a->Ev;
+   a->Sta.Gap  = &a->Gap;
+   a->Sta.Dup  = &a->Dup;
+   InitVar( &a->Sta );
+   a->lastseen = now;
+   a->hash     = h;
+
+   RequestSpecificMutex( &AutoMutex );
+   a->next = Bucket[h & (nBucket - 1)];
+   Bucket[h & (nBucket - 1)] = a;
+   Touch( a );
+   nAuto++;
+   ReleaseSpecificMutex( &AutoMutex );
+
+   nAdded++;
+   logit( "t", "pick_ew: Added channel %s.%s.%s.%s (%d of %d)\n",
+          key->sta, key->chan, key->net, key->loc, nAuto, AutoMax );
+   return &a->Sta;
+}
+
+
+  /***************************************************************
+   *                      EvictAutoStations()                    *
+   *                                                             *
+   *  Drop the channels that have been silent for AutoEvictSec   *
+   *  seconds.  Called now and then by the picking thread.       *
+   ***************************************************************/
+
+void EvictAutoStations( void )
+{
+   time_t now;
+   int    n = 0;
+
+   if ( (AutoMax == 0) || (nAuto == 0) ) return;
+
+   time( &now );
+   while ( (Oldest != NULL) && ((now - Oldest->lastseen) >= EvictSec) )
+   {
+      Settle( Oldest );
+      RequestSpecificMutex( &AutoMutex );
+      Unlink( Oldest );
+      ReleaseSpecificMutex( &AutoMutex );
+      n++;
+   }
+
+   if ( n > 0 )
+      logit( "t", "pick_ew: Dropped %d auto channels silent for %d s; %d left\n",
+             n, EvictSec, nAuto );
+}
+
+
+  /***************************************************************
+   *                      ForEachAutoStation()                   *
+   *                                                             *
+   *  Call fn for every auto channel, under AutoMutex.  fn must  *
+   *  not add or remove channels.                                *
+   ***************************************************************/
+
+void ForEachAutoStation( void (*fn)( STATION *, void * ), void *arg )
+{
+   AUTOSTA *a;
+
+   if ( (AutoMax == 0) || (Bucket == NULL) ) return;
+
+   RequestSpecificMutex( &AutoMutex );
+   for ( a = Oldest; a != NULL; a = a->newer )
+      fn( &a->Sta, arg );
+   ReleaseSpecificMutex( &AutoMutex );
+}
+
+
+  /***************************************************************
+   *                         LogAutoStats()                      *
+   ***************************************************************/
+
+void LogAutoStats( void )
+{
+   if ( AutoMax == 0 ) return;
+   logit( "t", "pick_ew: Auto channels %d of %d; added %lu, dropped %lu, "
+          "refused %lu; %lu msgs matched no rule\n",
+          nAuto, AutoMax, nAdded, nEvicted, nRefused, nNoRule );
+}
+
+
+  /***************************************************************
+   *                       FreeAutoStations()                    *
+   ***************************************************************/
+
+void FreeAutoStations( void )
+{
+   FreeRuleSet( &Rules );
+   if ( Bucket == NULL ) return;
+
+   while ( Oldest != NULL )
+      Unlink( Oldest );
+   free( Bucket );
+   Bucket = NULL;
+   CloseSpecificMutex( &AutoMutex );
+   AutoMax = 0;
+}
+
+
+/* Hash an SCNL (FNV-1a over the four codes)
+   *****************************************/
+static unsigned int HashSCNL( STATION *key )
+{
+   const char   *code[4];
+   unsigned int h = 2166136261u;
+   int          i;
+
+   code[0] = key->sta;
+   code[1] = key->chan;
+   code[2] = key->net;
+   code[3] = key->loc;
+   for ( i = 0; i < 4; i++ )
+   {
+      const char *c;
+
+      for ( c = code[i]; *c != '\0'; c++ )
+      {
+         h ^= (unsigned char) *c;
+         h *= 16777619u;
+      }
+      h ^= '.';
+      h *= 16777619u;
+   }
+   return h;
+}
+
+
+/* Remove and free a channel.  The caller holds AutoMutex.
+   ********************************************************/
+static void Unlink( AUTOSTA *a )
+{
+   AUTOSTA **pa;
+
+   for ( pa = &Bucket[a->hash & (nBucket - 1)]; *pa != a; pa = &(*pa)->next );
+   *pa = a->next;
+
+   if ( a->older != NULL ) a->older->newer = a->newer;
+   else                    Oldest = a->newer;
+   if ( a->newer != NULL ) a->newer->older = a->older;
+   else                    Newest = a->older;
+
+   FreeReorder( &a->Sta );
+   FreeBank( &a->Sta );
+   FreeOnset( &a->Sta );
+   FreeAmp( &a->Sta );
+   FreeNoise( &a->Sta );
+   free( a );
+   nAuto--;
+   nEvicted++;
+}
+
+
+/* Close out the event a channel about to be dropped is in the
+   middle of.  Its coda will never end, so an early pick is
+   taken back, and the amplitude of a pick that was reported
+   and stands is sent.
+   ***********************************************************/
+static void Settle( AUTOSTA *a )
+{
+   int how = 0;
+
+   if ( a->Ev.early )
+   {
+      RetractPick( &a->Ev.Coda, Gp, Ew );
+      a->Ev.early = 0;
+      how = -1;
+   }
+   EndAmp( &a->Sta, how, Gp, Ew );
+}
+
+
+/* Move a channel to the new end of the lastseen list.  Only
+   the picking thread uses the list.
+   *********************************************************/
+static void Touch( AUTOSTA *a )
+{
+   if ( a == Newest ) return;
+
+   if ( a->older != NULL ) a->older->newer = a->newer;
+   else if ( a == Oldest ) Oldest = a->newer;
+   if ( a->newer != NULL ) a->newer->older = a->older;
+
+   a->older = Newest;
+   a->newer = NULL;
+   if ( Newest != NULL ) Newest->newer = a;
+   Newest = a;
+   if ( Oldest == NULL ) Oldest = a;
+}
+
+
+/* Make room by dropping the channel silent longest, if it has
+   been silent at least EvictSec.  Returns 1 if one was dropped.
+   *************************************************************/
+static int EvictOldest( time_t now )
+{
+   if ( (Oldest == NULL) || ((now - Oldest->lastseen) < EvictSec) )
+      return 0;
+
+   Settle( Oldest );
+   RequestSpecificMutex( &AutoMutex );
+   Unlink( Oldest );
+   ReleaseSpecificMutex( &AutoMutex );
+   return 1;
+}
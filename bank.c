@@ -0,0 +1,219 @@
+  /**********************************************************************
+   *                              bank.c                                *
+   *                                                                    *
+   *                     Filter-bank trigger (PickEngine bank)          *
+   *                                                                    *
+   *  This file contains functions InitBank(), SetBankRate(),           *
+   *  BankSample(), ResetBank(), FreeBank() and LogBankStats().         *
+   *                                                                    *
+   *  The STA/LTA of the single RawDataFilt/CharFuncFilt function       *
+   *  sees one band.  With PickEngine bank, an event is started         *
+   *  instead when any of BankBands bandpass channels jumps out of      *
+   *  its recent range, in the manner of Lomax's FilterPicker.  Band    *
+   *  b has a period of 2^(b+1) sample intervals: two samples, then     *
+   *  four, and so on.  Each band is a one-pole high-pass and two       *
+   *  one-pole low-passes at its period.  The band's power is          *
+   *  smoothed over about one period, and compared to its long-term     *
+   *  mean and variance (time constant BankLongSec).  The bank          *
+   *  triggers when the power of a band is more than BankThresh         *
+   *  standard deviations above its mean.                               *
+   *                                                                    *
+   *  The state of a channel is one BANKSTATE, a set of arrays of       *
+   *  NBAND values, so the loop over the bands has a fixed trip count   *
+   *  the compiler turns into vector instructions: the eight bands      *
+   *  take four passes of two with SSE2, two of four with AVX.  Unused  *
+   *  bands ride along with zero coefficients.  The comparison with     *
+   *  the threshold is done on squares, with no square root or branch   *
+   *  in the loop.                                                      *
+   *                                                                    *
+   *  Only the trigger changes.  Sample() still updates the STA/LTA     *
+   *  state, and EventActive() validates the pick, finds its first      *
+   *  motion and measures the coda as with PickEngine ra.  The bank     *
+   *  is fed every sample, through Sample(), during restarts and        *
+   *  events too, so its state is current when the next search         *
+   *  begins.  It may not trigger until it has seen BankLongSec         *
+   *  seconds of data since the channel was last reset.                 *
+   *                                                                    *
+   *  A channel's state is allocated when its first message is          *
+   *  picked, and freed with the channel, like a reorder buffer.        *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <earthworm.h>
+#include <transport.h>
+#include "nn_pick_ew.h"
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+
+static int    nBands  = 0;           /* Bands in use; 0 = engine off */
+static double Thresh2 = 0.;          /* BankThresh squared */
+static double LongSec = 0.;
+static unsigned long nAlloc  = 0;    /* Channels with a filter bank */
+static unsigned long nFailed = 0;    /* Allocations that failed */
+
+/* Function prototypes
+   *******************/
+void ResetBank( BANKSTATE * );
+
+
+  /***************************************************************
+   *                            InitBank()                       *
+   ***************************************************************/
+
+void InitBank( GPARM *Gparm )
+{
+   if ( Gparm->PickEngine != ENGINE_BANK ) return;
+
+   nBands  = Gparm->BankBands;
+   Thresh2 = Gparm->BankThresh * Gparm->BankThresh;
+   LongSec = Gparm->BankLongSec;
+}
+
+
+  /***************************************************************
+   *                          SetBankRate()                      *
+   *                                                             *
+   *  Give a channel its filter bank, if it has none, and set    *
+   *  the coefficients for its sample rate.  Called for every    *
+   *  message picked; does nothing if the rate is unchanged.     *
+   *  If there is no memory, the channel stays on the STA/LTA    *
+   *  trigger.                                                   *
+   ***************************************************************/
+
+void SetBankRate( STATION *Sta, double samprate )
+{
+   BANKSTATE *B = Sta->Bank;
+   double    dt;
+   int       b;
+
+   if ( nBands == 0 ) return;
+   if ( (B != NULL) && (B->samprate == samprate) ) return;
+
+   if ( B == NULL )
+   {
+      if ( (B = (BANKSTATE *) calloc( 1, sizeof(BANKSTATE) )) == NULL )
+      {
+         if ( nFailed++ == 0 )
+            logit( "et", "pick_ew: Cannot allocate filter bank for %s.%s.%s.%s; "
+                   "it keeps the STA/LTA trigger\n", Sta->sta, Sta->chan, Sta->net,
+                   Sta->loc );
+         return;
+      }
+      Sta->Bank = B;
+      nAlloc++;
+   }
+
+/* New rate: start over with the new coefficients
+   **********************************************/
+   ResetBank( B );
+   dt = 1. / samprate;
+   for ( b = 0; b < NBAND; b++ )
+   {
+      double w = 2. * M_PI / (double) (2 << b);     /* 2 pi dt / period */
+
+      B->aH[b] = (b < nBands) ? 1. / (1. + w) : 0.;
+      B->aL[b] = (b < nBands) ? w / (1. + w)  : 0.;
+   }
+   B->aLong    = (LongSec > dt) ? dt / LongSec : 1.;
+   B->nwarm    = (int) (LongSec * samprate + 0.5);
+   if ( B->nwarm < 1 ) B->nwarm = 1;
+   B->samprate = samprate;
+}
+
+
+  /***************************************************************
+   *                           BankSample()                      *
+   *                                                             *
+   *  Run one sample through a channel's bands, and set trig if  *
+   *  any band is over the threshold.  Called by Sample().       *
+   ***************************************************************/
+
+void BankSample( double x, BANKSTATE *B )
+{
+   double over[NBAND];
+   double dx;
+   int    b;
+
+   if ( B->nsamp == 0 ) B->xold = x;      /* No step at the first sample */
+   dx = x - B->xold;
+   B->xold = x;
+   for ( b = 0; b < NBAND; b++ )
+   {
+      double e, d;
+
+      B->hp[b]  = B->aH[b] * (B->hp[b] + dx);
+      B->l1[b] += B->aL[b] * (B->hp[b] - B->l1[b]);
+      B->l2[b] += B->aL[b] * (B->l1[b] - B->l2[b]);
+      e = B->l2[b] * B->l2[b];
+      B->env[b] += B->aL[b] * (e - B->env[b]);
+
+      d = B->env[b] - B->mean[b];
+      B->mean[b] += B->aLong * d;
+      B->var[b]  += B->aLong * (d * d - B->var[b]);
+
+/* d > BankThresh * sqrt(var), without the square root or
+   a branch: over[] is positive for a band over the threshold
+   **********************************************************/
+      over[b] = d * fabs( d ) - Thresh2 * B->var[b];
+   }
+
+   if ( B->nsamp < B->nwarm )
+   {
+      B->nsamp++;
+      B->trig = 0;
+      return;
+   }
+   B->trig = 0;
+   for ( b = 0; b < NBAND; b++ )
+      B->trig |= (over[b] > 0.);
+}
+
+
+  /***************************************************************
+   *                           ResetBank()                       *
+   *                                                             *
+   *  Clear a channel's filter state, as after a restart.  The   *
+   *  coefficients are kept.                                     *
+   ***************************************************************/
+
+void ResetBank( BANKSTATE *B )
+{
+   int b;
+
+   for ( b = 0; b < NBAND; b++ )
+      B->hp[b] = B->l1[b] = B->l2[b] = B->env[b] = B->mean[b] = B->var[b] = 0.;
+   B->xold  = 0.;
+   B->nsamp = 0;
+   B->trig  = 0;
+}
+
+
+  /***************************************************************
+   *                            FreeBank()                       *
+   ***************************************************************/
+
+void FreeBank( STATION *Sta )
+{
+   if ( Sta->Bank == NULL ) return;
+   free( Sta->Bank );
+   Sta->Bank = NULL;
+   nAlloc--;
+}
+
+
+  /***************************************************************
+   *                          LogBankStats()                     *
+   ***************************************************************/
+
+void LogBankStats( void )
+{
+   if ( nBands == 0 ) return;
+
+   logit( "t", "pick_ew: Filter bank: %d bands on %lu channels; %lu allocations "
+          "failed\n", nBands, nAlloc, nFailed );
+}
@@ -0,0 +1,242 @@
+  /**********************************************************************
+   *                              binmsg.c                              *
+   *                                                                    *
+   *              Binary pick and coda message functions                *
+   *                                                                    *
+   *  This file contains functions InitBinary(), BinaryPick(),          *
+   *  BinaryCoda(), BinaryRetract(), BinaryAmp() and FlushBinary().     *
+   *                                                                    *
+   *  With BinaryOutput set, every reported pick and coda (and every    *
+   *  retracted EarlyPick and AmpWindow measurement) is also (or only)  *
+   *  written as a fixed-layout PKB_REC record.  Records are collected  *
+   *  into one message of up to BinaryBatch records, which is sent      *
+   *  when it is full or when its oldest record has waited              *
+   *  BinaryFlushMs milliseconds.  These functions are called only      *
+   *  from the picking thread.                                          *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <earthworm.h>
+#include <chron3.h>
+#include <transport.h>
+#include <time_ew.h>
+#include <swap.h>
+#include "nn_pick_ew.h"
+
+static char     *BinBuf = NULL;      /* Message being built */
+static PKB_HDR  *Hdr;
+static PKB_REC  *Rec;
+static int       nRec;               /* Records in BinBuf */
+static double    tFirst;             /* hrtime_ew() of the first record */
+static MSG_LOGO  BinLogo;
+static GPARM    *Gp;
+
+/* Function prototypes
+   *******************/
+int  PutOutMsg( MSG_LOGO *, int, long, char * );   /* function in outqueue.c */
+void FlushBinary( int );
+static PKB_REC *NewRecord( int, int, char *, char *, char *, char * );
+
+
+  /***************************************************************
+   *                          InitBinary()                       *
+   *                                                             *
+   *  Look up the binary message type and allocate the batch.    *
+   *  Returns the size of the largest binary message (0 if      *
+   *  binary output is off), or -1 on error.                     *
+   ***************************************************************/
+
+long InitBinary( GPARM *Gparm, EWH *Ewh )
+{
+   long size;
+
+   Gp = Gparm;
+   if ( Gparm->BinaryOutput == 0 ) return 0;
+
+   if ( (sizeof(PKB_HDR) != 16) || (sizeof(PKB_REC) != 112) )
+   {
+      logit( "e", "pick_ew: Binary pick structures are padded on this platform.\n" );
+      return -1;
+   }
+   if ( GetType( Gparm->BinaryMsgType, &Ewh->TypePickBin ) != 0 )
+   {
+      logit( "e", "pick_ew: Error getting %s.\n", Gparm->BinaryMsgType );
+      return -1;
+   }
+
+   size   = (long)sizeof(PKB_HDR) + Gparm->BinaryBatch * (long)sizeof(PKB_REC);
+   BinBuf = (char *) calloc( 1, (size_t) size );
+   if ( BinBuf == NULL )
+   {
+      logit( "e", "pick_ew: Cannot allocate the binary pick buffer.\n" );
+      return -1;
+   }
+   Hdr  = (PKB_HDR *) BinBuf;
+   Rec  = (PKB_REC *) (BinBuf + sizeof(PKB_HDR));
+   nRec = 0;
+
+   memcpy( Hdr->magic, PKB_MAGIC, 3 );
+   Hdr->version = PKB_VERSION;
+   Hdr->reclen  = (unsigned short) sizeof(PKB_REC);
+   Hdr->modid   = Gparm->MyModId;
+   Hdr->instid  = Ewh->MyInstId;
+#if defined(_SPARC)
+   SwapShort( (short *) &Hdr->reclen );
+#endif
+
+   BinLogo.type   = Ewh->TypePickBin;
+   BinLogo.mod    = Gparm->MyModId;
+   BinLogo.instid = Ewh->MyInstId;
+   return size;
+}
+
+
+  /***************************************************************
+   *                          BinaryPick()                       *
+   ***************************************************************/
+
+void BinaryPick( PICK *Pick, int PickIndex, STATION *Sta )
+{
+   PKB_REC *r = NewRecord( PKB_PICK, PickIndex, Sta->sta, Sta->chan,
+                           Sta->net, Sta->loc );
+   int     i;
+
+   r->FirstMotion = (Pick->FirstMotion == ' ') ? '?' : Pick->FirstMotion;
+   r->weight      = (signed char) Pick->weight;
+   r->time        = Pick->time - GSEC1970;
+   for ( i = 0; i < 3; i++ )
+      r->xpk[i] = Pick->xpk[i];
+   if ( Pick->prob >= 0. )
+   {
+      r->nprob   = 1;
+      r->prob[0] = (float) Pick->prob;
+   }
+#if defined(_SPARC)
+   SwapDouble( &r->time );
+   for ( i = 0; i < 3; i++ )
+      SwapDouble( &r->xpk[i] );
+   SwapFloat( &r->prob[0] );
+#endif
+   if ( ++nRec == Gp->BinaryBatch ) FlushBinary( 1 );
+}
+
+
+  /***************************************************************
+   *                          BinaryCoda()                       *
+   ***************************************************************/
+
+void BinaryCoda( CODA *Coda )
+{
+   PKB_REC *r = NewRecord( PKB_CODA, Coda->PickIndex, Coda->sta, Coda->chan,
+                           Coda->net, Coda->loc );
+   int     i;
+
+   for ( i = 0; i < 6; i++ )
+      r->aav[i] = Coda->aav[i];
+   r->len_out = Coda->len_out;
+#if defined(_SPARC)
+   for ( i = 0; i < 6; i++ )
+      SwapInt( &r->aav[i] );
+   SwapInt( &r->len_out );
+#endif
+   if ( ++nRec == Gp->BinaryBatch ) FlushBinary( 1 );
+}
+
+
+  /***************************************************************
+   *                         BinaryRetract()                     *
+   ***************************************************************/
+
+void BinaryRetract( CODA *Coda )
+{
+   NewRecord( PKB_RETRACT, Coda->PickIndex, Coda->sta, Coda->chan,
+              Coda->net, Coda->loc );
+   if ( ++nRec == Gp->BinaryBatch ) FlushBinary( 1 );
+}
+
+
+  /***************************************************************
+   *                           BinaryAmp()                       *
+   *                                                             *
+   *  time is that of the Wood-Anderson peak; xpk[0] and prob[0] *
+   *  are the raw amplitude and period, xpk[1] and prob[1] the   *
+   *  Wood-Anderson ones.                                        *
+   ***************************************************************/
+
+void BinaryAmp( AMPSTATE *Amp, STATION *Sta )
+{
+   PKB_REC *r = NewRecord( PKB_AMP, Amp->pickindex, Sta->sta, Sta->chan,
+                           Sta->net, Sta->loc );
+
+   r->time    = Amp->tstart + Amp->wa.ipk / Amp->samprate - GSEC1970;
+   r->xpk[0]  = 0.5 * Amp->raw.pp;
+   r->xpk[1]  = 0.5 * Amp->wa.pp;
+   r->prob[0] = (float) Amp->raw.per;
+   r->prob[1] = (float) Amp->wa.per;
+#if defined(_SPARC)
+   SwapDouble( &r->time );
+   SwapDouble( &r->xpk[0] );
+   SwapDouble( &r->xpk[1] );
+   SwapFloat( &r->prob[0] );
+   SwapFloat( &r->prob[1] );
+#endif
+   if ( ++nRec == Gp->BinaryBatch ) FlushBinary( 1 );
+}
+
+
+  /***************************************************************
+   *                          FlushBinary()                      *
+   *                                                             *
+   *  Send the batch if it's full, if its oldest record is older *
+   *  than BinaryFlushMs, or if force is set.                    *
+   ***************************************************************/
+
+void FlushBinary( int force )
+{
+   unsigned short nrec;
+   double         now;
+
+   if ( nRec == 0 ) return;
+
+   if ( !force && (nRec < Gp->BinaryBatch) )
+   {
+      hrtime_ew( &now );
+      if ( 1000. * (now - tFirst) < (double) Gp->BinaryFlushMs ) return;
+   }
+
+   nrec = (unsigned short) nRec;
+#if defined(_SPARC)
+   SwapShort( (short *) &nrec );
+#endif
+   Hdr->nrec = nrec;
+
+   if ( PutOutMsg( &BinLogo, OUT_PICK, (long)(sizeof(PKB_HDR) + nRec * sizeof(PKB_REC)),
+                   BinBuf ) != PUT_OK )
+      logit( "et", "pick_ew: Error sending %d binary picks/codas to output ring.\n", nRec );
+   nRec = 0;
+}
+
+
+/* Start a new record in the batch
+   *******************************/
+static PKB_REC *NewRecord( int kind, int PickIndex, char *sta, char *chan,
+                           char *net, char *loc )
+{
+   PKB_REC *r = &Rec[nRec];
+
+   if ( nRec == 0 ) hrtime_ew( &tFirst );
+
+   memset( r, 0, sizeof(PKB_REC) );
+   r->kind      = (unsigned char) kind;
+   r->PickIndex = PickIndex;
+   strncpy( r->sta,  sta,  sizeof(r->sta)  - 1 );
+   strncpy( r->chan, chan, sizeof(r->chan) - 1 );
+   strncpy( r->net,  net,  sizeof(r->net)  - 1 );
+   strncpy( r->loc,  loc,  sizeof(r->loc)  - 1 );
+#if defined(_SPARC)
+   SwapInt( &r->PickIndex );
+#endif
+   return r;
+}
@@ -0,0 +1,471 @@
+  /**********************************************************************
+   *                             classify.c                             *
+   *                                                                    *
+   *          Pick-quality classifier and training-feature dump         *
+   *                                                                    *
+   *  This file contains functions InitClassifier(), ClassifyPick()     *
+   *  and FreeClassifier().                                             *
+   *                                                                    *
+   *  The classifier is a gradient-boosted tree ensemble read from a    *
+   *  text model file.  At load time every tree is padded out to a      *
+   *  complete binary tree of the ensemble's maximum depth, so that     *
+   *  evaluating a tree is "depth" compare-and-index steps with no      *
+   *  data-dependent branches.                                          *
+   *                                                                    *
+   *  Model file format (lines starting with # are comments):           *
+   *                                                                    *
+   *     nfeature  14                                                   *
+   *     base      <initial score>                                      *
+   *     cut       <noise> <weight2> <weight1> <weight0>                *
+   *     tree      <number of nodes>                                    *
+   *     <id> split <feature> <threshold> <left id> <right id>          *
+   *     <id> leaf  <value>                                             *
+   *     ...one "tree" block per tree...                                *
+   *                                                                    *
+   *  A model may have fewer features than the picker computes, as one  *
+   *  trained before the SNR features were added (12); it uses the      *
+   *  first nfeature of them.                                           *
+   *                                                                    *
+   *  A split sends x <= threshold left and x > threshold right.        *
+   *  Node 0 is the root of each tree.  The summed score is compared    *
+   *  to the cuts: below "noise" the pick is rejected, otherwise the    *
+   *  weight is 3 minus the number of weight cuts reached.  The pick    *
+   *  probability is the logistic function of the score.                *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <earthworm.h>
+#include <chron3.h>
+#include <transport.h>
+#include "nn_pick_ew.h"
+
+#define MAX_LEN_STRING_MODEL 512
+
+typedef struct {            /* One node of a tree as read from the file */
+   int    leaf;             /* 1 if this is a leaf */
+   int    feat;             /* Split feature */
+   double value;            /* Split threshold or leaf value */
+   int    left;             /* Child ids */
+   int    right;
+} RAWNODE;
+
+typedef struct {            /* One tree as read from the file */
+   int     nnode;
+   RAWNODE *node;
+} RAWTREE;
+
+static CLASSIFIER *Cl = NULL;        /* Loaded classifier, or NULL */
+static FILE       *fpFeature = NULL; /* Feature dump file, or NULL */
+
+static const char *FeatName[NFEATURE] = {
+   "xpk0", "xpk1", "xpk2", "xdot", "xfrz", "eabs",
+   "smallzc", "bigzc", "xp0", "xp1", "xp2", "xon", "snr", "xpn" };
+
+/* Function prototypes
+   *******************/
+int  IsComment( char [] );                         /* function in stalist.c */
+void FreeClassifier( void );
+int  ShedSkip( int );                              /* function in shed.c */
+static int  LoadClassifier( char *, CLASSIFIER * );
+static int  TreeDepth( RAWTREE *, int, int );
+static void CompileTree( RAWTREE *, int, int, int, CLASSIFIER *, int *, double *, double * );
+static void FreeRawTrees( RAWTREE *, int );
+
+
+  /***************************************************************
+   *                       InitClassifier()                      *
+   *                                                             *
+   *  Load the pick classifier and open the feature dump file,   *
+   *  if either was configured.  Returns -1 on error.            *
+   ***************************************************************/
+
+int InitClassifier( GPARM *Gparm )
+{
+   if ( Gparm->ClassifierFile != NULL )
+   {
+      Cl = (CLASSIFIER *) calloc( 1, sizeof(CLASSIFIER) );
+      if ( Cl == NULL )
+      {
+         logit( "et", "pick_ew: Cannot allocate the pick classifier\n" );
+         return -1;
+      }
+      if ( LoadClassifier( Gparm->ClassifierFile, Cl ) == -1 )
+      {
+         FreeClassifier();
+         return -1;
+      }
+      logit( "", "pick_ew: Loaded pick classifier <%s>: %d trees, depth %d\n",
+             Gparm->ClassifierFile, Cl->ntree, Cl->depth );
+   }
+
+   if ( Gparm->FeatureFile != NULL )
+   {
+      fpFeature = fopen( Gparm->FeatureFile, "a" );
+      if ( fpFeature == NULL )
+      {
+         logit( "et", "pick_ew: Error opening pick feature file <%s>.\n",
+                Gparm->FeatureFile );
+         FreeClassifier();
+         return -1;
+      }
+      if ( ftell( fpFeature ) == 0 )
+      {
+         int i;
+         fprintf( fpFeature, "# scnl time noise weight" );
+         for ( i = 0; i < NFEATURE; i++ )
+            fprintf( fpFeature, " %s", FeatName[i] );
+         fprintf( fpFeature, "\n" );
+      }
+   }
+   return 0;
+}
+
+
+  /***************************************************************
+   *                       FreeClassifier()                      *
+   ***************************************************************/
+
+void FreeClassifier( void )
+{
+   if ( Cl != NULL )
+   {
+      free( Cl->feat );
+      free( Cl->thresh );
+      free( Cl->leaf );
+      free( Cl );
+      Cl = NULL;
+   }
+   if ( fpFeature != NULL )
+   {
+      fclose( fpFeature );
+      fpFeature = NULL;
+   }
+}
+
+
+  /***************************************************************
+   *                        ClassifyPick()                       *
+   *                                                             *
+   *  Called when the zero-crossing tests of a pick are done.    *
+   *  On entry *noise and *weight hold the result of the built-  *
+   *  in heuristic.  The features are written to the dump file   *
+   *  (labelled with the heuristic result) and, if a classifier  *
+   *  is loaded, *noise and *weight are replaced by its verdict, *
+   *  unless load shedding has the classifier off.               *
+   ***************************************************************/
+
+void ClassifyPick( STATION *Sta, int *noise, int *weight )
+{
+   STAEVENT *Ev   = Sta->Ev;
+   PICK     *Pick = &Ev->Pick;
+   double   feat[NFEATURE];
+   double   xfrz;
+   int      i;
+
+   if ( (Cl == NULL) && (fpFeature == NULL) ) return;
+
+/* Features seen at pick time
+   **************************/
+   xfrz = (Ev->xfrz > 0.) ? Ev->xfrz : 1.;
+
+   feat[FEAT_XPK0]    = Pick->xpk[0];
+   feat[FEAT_XPK1]    = Pick->xpk[1];
+   feat[FEAT_XPK2]    = Pick->xpk[2];
+   feat[FEAT_XDOT]    = Ev->xdot;
+   feat[FEAT_XFRZ]    = Ev->xfrz;
+   feat[FEAT_EABS]    = Sta->eabs;
+   feat[FEAT_SMALLZC] = (double) Ev->m;
+   feat[FEAT_BIGZC]   = (double) Ev->nzero;
+   feat[FEAT_XP0]     = Pick->xpk[0] / xfrz;
+   feat[FEAT_XP1]     = Pick->xpk[1] / xfrz;
+   feat[FEAT_XP2]     = Pick->xpk[2] / xfrz;
+   feat[FEAT_XON]     = fabs( Ev->xdot / xfrz );
+
+/* Features from the channel's noise spectrum (NoisePSD).
+   The first peak is scaled by the noise rms rather than by
+   the running mean of the filtered data, which the event
+   itself raises.
+   ********************************************************/
+   feat[FEAT_SNR]     = 0.;
+   feat[FEAT_XPN]     = 0.;
+   if ( (Sta->Noise != NULL) && (Sta->Noise->rms > 0.) )
+   {
+      feat[FEAT_SNR]  = Sta->Noise->snr;
+      feat[FEAT_XPN]  = Pick->xpk[0] / Sta->Noise->rms;
+   }
+
+/* Dump them for offline training
+   ******************************/
+   if ( fpFeature != NULL )
+   {
+      fprintf( fpFeature, "%s.%s.%s.%s %.3lf %d %d",
+               Sta->sta, Sta->chan, Sta->net, Sta->loc,
+               Pick->time - GSEC1970, *noise, *weight );
+      for ( i = 0; i < NFEATURE; i++ )
+         fprintf( fpFeature, " %.6g", feat[i] );
+      fprintf( fpFeature, "\n" );
+   }
+
+/* Evaluate the ensemble.  Each tree is a fixed number of
+   compare-and-index steps into the flat node arrays.
+   ******************************************************/
+   if ( (Cl != NULL) && !ShedSkip( SHED_CLASSIFY ) )
+   {
+      const int    *f = Cl->feat;
+      const double *t = Cl->thresh;
+      const double *l = Cl->leaf;
+      double       score = Cl->base;
+      int          d;
+
+      for ( i = 0; i < Cl->ntree; i++ )
+      {
+         int n = 0;
+         for ( d = 0; d < Cl->depth; d++ )
+            n = 2*n + 1 + (feat[f[n]] > t[n]);
+         score += l[n - Cl->nnode];
+         f += Cl->nnode;
+         t += Cl->nnode;
+         l += Cl->nleaf;
+      }
+
+      *noise  = (score < Cl->cut[0]);
+      *weight = 3 - (score >= Cl->cut[1]) - (score >= Cl->cut[2])
+                  - (score >= Cl->cut[3]);
+      Pick->prob = 1. / (1. + exp( -score ));
+   }
+}
+
+
+  /***************************************************************
+   *                       LoadClassifier()                      *
+   *                                                             *
+   *  Read a model file and compile it into flat arrays.         *
+   *  Returns -1 if an error is encountered.                     *
+   ***************************************************************/
+
+static int LoadClassifier( char *fname, CLASSIFIER *Model )
+{
+   char    string[MAX_LEN_STRING_MODEL];
+   FILE    *fp;
+   RAWTREE *tree = NULL;
+   int     ntree = 0;
+   int     nread = -1;             /* Nodes read so far in the current tree */
+   int     ncut  = 0;
+   int     nfeat = 0;
+   int     i;
+
+   if ( ( fp = fopen( fname, "r" ) ) == NULL )
+   {
+      logit( "et", "pick_ew: Error opening pick classifier file <%s>.\n", fname );
+      return -1;
+   }
+
+/* Read the trees as written
+   *************************/
+   while ( fgets( string, MAX_LEN_STRING_MODEL, fp ) != NULL )
+   {
+      char    word[32];
+      RAWNODE node;
+      int     id;
+
+      if ( IsComment( string ) ) continue;
+
+      if ( sscanf( string, "%31s", word ) != 1 ) continue;
+
+      if ( strcmp( word, "nfeature" ) == 0 )
+      {
+         if ( sscanf( string, "%*s %d", &nfeat ) != 1 ) goto bad_line;
+      }
+      else if ( strcmp( word, "base" ) == 0 )
+      {
+         if ( sscanf( string, "%*s %lf", &Model->base ) != 1 ) goto bad_line;
+      }
+      else if ( strcmp( word, "cut" ) == 0 )
+      {
+         ncut = sscanf( string, "%*s %lf %lf %lf %lf", &Model->cut[0],
+                        &Model->cut[1], &Model->cut[2], &Model->cut[3] );
+         if ( ncut != 4 ) goto bad_line;
+      }
+      else if ( strcmp( word, "tree" ) == 0 )
+      {
+         RAWTREE *tmp;
+         int     nnode;
+
+         if ( (nread >= 0) && (nread < tree[ntree-1].nnode) ) goto bad_line;
+         if ( (sscanf( string, "%*s %d", &nnode ) != 1) || (nnode < 1) )
+            goto bad_line;
+         tmp = (RAWTREE *) realloc( tree, (ntree+1) * sizeof(RAWTREE) );
+         if ( tmp == NULL ) goto no_memory;
+         tree = tmp;
+         tree[ntree].nnode = nnode;
+         tree[ntree].node  = (RAWNODE *) calloc( nnode, sizeof(RAWNODE) );
+         ntree++;
+         if ( tree[ntree-1].node == NULL ) goto no_memory;
+         for ( i = 0; i < nnode; i++ ) tree[ntree-1].node[i].feat = -1;
+         nread = 0;
+      }
+      else
+      {
+         if ( (nread < 0) || (nread >= tree[ntree-1].nnode) ) goto bad_line;
+
+         if ( sscanf( string, "%d %31s", &id, word ) != 2 ) goto bad_line;
+         if ( (id < 0) || (id >= tree[ntree-1].nnode) ) goto bad_line;
+
+         memset( &node, 0, sizeof(node) );
+         if ( strcmp( word, "leaf" ) == 0 )
+         {
+            node.leaf = 1;
+            if ( sscanf( string, "%*d %*s %lf", &node.value ) != 1 ) goto bad_line;
+         }
+         else if ( strcmp( word, "split" ) == 0 )
+         {
+            if ( sscanf( string, "%*d %*s %d %lf %d %d", &node.feat, &node.value,
+                         &node.left, &node.right ) != 4 ) goto bad_line;
+            if ( (node.feat < 0) || (node.feat >= ((nfeat > 0) ? nfeat : NFEATURE)) ||
+                 (node.left  <= id) || (node.left  >= tree[ntree-1].nnode) ||
+                 (node.right <= id) || (node.right >= tree[ntree-1].nnode) )
+               goto bad_line;
+         }
+         else goto bad_line;
+
+         tree[ntree-1].node[id] = node;
+         nread++;
+      }
+   }
+   fclose( fp );
+   fp = NULL;
+
+   if ( (nfeat < 1) || (nfeat > NFEATURE) )
+   {
+      logit( "et", "pick_ew: Pick classifier <%s> uses %d features; expected 1 to %d.\n",
+             fname, nfeat, NFEATURE );
+      goto error;
+   }
+   if ( (ntree == 0) || (nread < tree[ntree-1].nnode) || (ncut != 4) )
+   {
+      logit( "et", "pick_ew: Pick classifier <%s> is incomplete.\n", fname );
+      goto error;
+   }
+   if ( (Model->cut[1] < Model->cut[0]) || (Model->cut[2] < Model->cut[1]) ||
+        (Model->cut[3] < Model->cut[2]) )
+   {
+      logit( "et", "pick_ew: Pick classifier <%s> cuts must be increasing.\n", fname );
+      goto error;
+   }
+
+/* Every node id must have been defined.  Children always have
+   larger ids than their parent, so the trees can't have cycles.
+   ************************************************************/
+   Model->depth = 0;
+   for ( i = 0; i < ntree; i++ )
+   {
+      int j, d;
+      for ( j = 0; j < tree[i].nnode; j++ )
+         if ( !tree[i].node[j].leaf && (tree[i].node[j].feat < 0) )
+         {
+            logit( "et", "pick_ew: Pick classifier <%s>: tree %d node %d undefined.\n",
+                   fname, i, j );
+            goto error;
+         }
+      d = TreeDepth( &tree[i], 0, 0 );
+      if ( d > MAXTREEDEPTH )
+      {
+         logit( "et", "pick_ew: Pick classifier <%s>: tree %d is deeper than %d.\n",
+                fname, i, MAXTREEDEPTH );
+         goto error;
+      }
+      if ( d > Model->depth ) Model->depth = d;
+   }
+
+/* Compile into complete trees of equal depth
+   ******************************************/
+   Model->ntree  = ntree;
+   Model->nleaf  = 1 << Model->depth;
+   Model->nnode  = Model->nleaf - 1;
+   Model->feat   = (int *)    calloc( ntree * Model->nnode + 1, sizeof(int) );
+   Model->thresh = (double *) calloc( ntree * Model->nnode + 1, sizeof(double) );
+   Model->leaf   = (double *) calloc( ntree * Model->nleaf, sizeof(double) );
+   if ( (Model->feat == NULL) || (Model->thresh == NULL) || (Model->leaf == NULL) )
+      goto no_memory;
+
+   for ( i = 0; i < ntree; i++ )
+      CompileTree( &tree[i], 0, 0, 0, Model, Model->feat + i * Model->nnode,
+                   Model->thresh + i * Model->nnode, Model->leaf + i * Model->nleaf );
+
+   FreeRawTrees( tree, ntree );
+   return 0;
+
+bad_line:
+   logit( "et", "pick_ew: Error decoding pick classifier file <%s>.\n", fname );
+   logit( "e", "Offending line:\n" );
+   logit( "e", "%s\n", string );
+   goto error;
+
+no_memory:
+   logit( "et", "pick_ew: Cannot allocate the pick classifier\n" );
+
+error:
+   if ( fp != NULL ) fclose( fp );
+   FreeRawTrees( tree, ntree );
+   return -1;
+}
+
+
+/* Depth of the subtree rooted at node id
+   **************************************/
+static int TreeDepth( RAWTREE *tree, int id, int level )
+{
+   RAWNODE *node = &tree->node[id];
+   int     dl, dr;
+
+   if ( node->leaf || (level > MAXTREEDEPTH) ) return level;
+
+   dl = TreeDepth( tree, node->left,  level + 1 );
+   dr = TreeDepth( tree, node->right, level + 1 );
+   return (dl > dr) ? dl : dr;
+}
+
+
+/* Copy the subtree rooted at node id to position pos of the
+   complete tree.  A leaf above the full depth becomes a split
+   that always goes left, with the leaf value copied to every
+   leaf below it.
+   **********************************************************/
+static void CompileTree( RAWTREE *tree, int id, int pos, int level,
+                         CLASSIFIER *Model, int *feat, double *thresh, double *leaf )
+{
+   RAWNODE *node = &tree->node[id];
+
+   if ( level == Model->depth )
+   {
+      leaf[pos - Model->nnode] = node->value;
+      return;
+   }
+
+   if ( node->leaf )
+   {
+      feat[pos]   = 0;
+      thresh[pos] = HUGE_VAL;
+      CompileTree( tree, id, 2*pos + 1, level + 1, Model, feat, thresh, leaf );
+      CompileTree( tree, id, 2*pos + 2, level + 1, Model, feat, thresh, leaf );
+      return;
+   }
+
+   feat[pos]   = node->feat;
+   thresh[pos] = node->value;
+   CompileTree( tree, node->left,  2*pos + 1, level + 1, Model, feat, thresh, leaf );
+   CompileTree( tree, node->right, 2*pos + 2, level + 1, Model, feat, thresh, leaf );
+}
+
+
+static void FreeRawTrees( RAWTREE *tree, int ntree )
+{
+   int i;
+
+   for ( i = 0; i < ntree; i++ )
+      free( tree[i].node );
+   free( tree );
+}
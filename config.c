@@ -70,11 +70,62 @@ int GetConfig( char *config_file, GPARM *Gparm )
    for ( i = 0; i < ncommand; i++ ) init[i] = 0;
    Gparm->nGetLogo = 0;
    Gparm->GetLogo  = NULL;
+   Gparm->nInRing  = 0;
+   Gparm->InRing   = NULL;
    Gparm->PickIndexDir  = NULL;	/* optional directory for pick index placement */
+   Gparm->PickIndexBlock = 1000;	/* pick indexes reserved per index file write */
    Gparm->NoCoda = 0;		/* off by default, always calculate coda's */
    Gparm->NoCodaHorizontal = 0;		/* off by default, always calculate coda's on any channel */
+   Gparm->EarlyPick = 0;		/* hold picks until their coda is MinCodaLen long */
+   Gparm->PickEngine  = ENGINE_RA;	/* STA/LTA trigger */
+   Gparm->BankBands   = NBAND;
+   Gparm->BankThresh  = 10.;
+   Gparm->BankLongSec = 10.;
+   Gparm->OnsetPre    = 0.;		/* pick times not refined */
+   Gparm->OnsetPost   = 0.5;
+   Gparm->OnsetKurt   = 0.5;
+   strcpy( Gparm->RetractMsgType, "TYPE_PICK_RETRACT" );
+   Gparm->AmpWindow = 0.;		/* no amplitudes measured */
+   strcpy( Gparm->AmpMsgType, "TYPE_PICK_AMP" );
+   Gparm->NoiseNfft   = 0;		/* no noise spectra */
+   Gparm->NoiseDecim  = 4;
+   Gparm->NoiseBudget = 5.;
+   Gparm->SnrWeight   = 0.;		/* weights don't depend on the SNR */
+   Gparm->NoiseQCFile = NULL;	/* no noise QC file */
    Gparm->nStaFile = 0;
    Gparm->StaFile  = NULL;
+   Gparm->StaCacheFile = NULL;	/* always parse the station files */
+   Gparm->StaReloadInt = 0;	/* never reload the station files */
+   Gparm->AutoMax      = 0;	/* only pick channels in the station list */
+   Gparm->AutoEvictSec = 0;
+   Gparm->OutQueueSize   = 0;	/* no output queue; write to OutRing inline */
+   Gparm->OutBatch       = 32;	/* messages published per pass of the publisher */
+   Gparm->StatsInt       = 0;	/* no periodic statistics */
+   Gparm->GapReportInt   = 0;	/* one error message per gap */
+   Gparm->RestartFile    = NULL;	/* no restart state file */
+   Gparm->SnapFile       = NULL;	/* no filter-state snapshots */
+   Gparm->SnapInt        = 0;
+   Gparm->SnapMaxAge     = 0;
+   Gparm->ReorderHoldMs  = 0;	/* pick early messages right away */
+   Gparm->ReorderMax     = 0;
+   Gparm->DupCheck       = 0;	/* don't look for duplicate messages */
+   Gparm->ShardId        = 0;	/* one instance picks every channel */
+   Gparm->ShardCount     = 1;
+   for ( i = 0; i < NTHREADROLE; i++ )
+      Gparm->CpuSet[i]   = NULL;	/* threads run on any cpu */
+   for ( i = 0; i < NSHEDLEVEL; i++ )
+   {
+      Gparm->ShedEnter[i] = 0.;	/* never shed load */
+      Gparm->ShedLeave[i] = 0.;
+   }
+   Gparm->nShedChan      = 0;
+   Gparm->ShedChan       = NULL;
+   Gparm->BinaryOutput   = 0;	/* text picks and codas only */
+   strcpy( Gparm->BinaryMsgType, "TYPE_PICK_BIN" );
+   Gparm->BinaryBatch    = 32;	/* records per binary message */
+   Gparm->BinaryFlushMs  = 500;	/* longest a binary record waits for its batch */
+   Gparm->ClassifierFile = NULL;	/* no pick classifier; use built-in noise test */
+   Gparm->FeatureFile    = NULL;	/* no pick feature dump */
 
 /* Open the main configuration file
    ********************************/
@@ -142,15 +193,35 @@ int GetConfig( char *config_file, GPARM *Gparm )
             init[0] = 1;
          }
 
-         else if ( k_its( "InRing" ) )
+         else if ( k_its( "InRing" ) )     /* may be given more than once */
          {
             if ( (str = k_str()) != NULL )
             {
-               if( (Gparm->InKey = GetKey(str)) == -1 )
+               INRING *tmp;
+               long   key;
+
+               for ( i = 0; i < Gparm->nInRing; i++ )
+                  if ( strcmp( Gparm->InRing[i].name, str ) == 0 )
+                  {
+                     logit( "e", "pick_ew: InRing <%s> given twice. Exiting.\n", str );
+                     return -1;
+                  }
+               if ( (strlen( str ) >= RING_NAME_LEN) || ((key = GetKey(str)) == -1) )
                {
                   logit( "e", "pick_ew: Invalid InRing name <%s>. Exiting.\n", str );
                   return -1;
                }
+               tmp = (INRING *)realloc( Gparm->InRing, (Gparm->nInRing+1)*sizeof(INRING) );
+               if ( tmp == NULL )
+               {
+                  logit( "e", "pick_ew: Error reallocing Gparm->InRing. Exiting.\n" );
+                  return -1;
+               }
+               Gparm->InRing = tmp;
+               memset( &Gparm->InRing[Gparm->nInRing], 0, sizeof(INRING) );
+               strcpy( Gparm->InRing[Gparm->nInRing].name, str );
+               Gparm->InRing[Gparm->nInRing].key = key;
+               Gparm->nInRing++;
             }
             init[1] = 1;
          }
@@ -212,6 +283,105 @@ int GetConfig( char *config_file, GPARM *Gparm )
          {
             Gparm->NoCodaHorizontal = k_int();
          }
+ /*opt*/ else if ( k_its( "EarlyPick" ) )
+         {
+            Gparm->EarlyPick = k_int();
+         }
+ /*opt*/ else if ( k_its( "RetractMsgType" ) )
+         {
+            str = k_str();
+            if ( (str == NULL) || (strlen( str ) >= sizeof(Gparm->RetractMsgType)) )
+            {
+               logit( "e", "pick_ew: Invalid RetractMsgType.\n" );
+               return -1;
+            }
+            strcpy( Gparm->RetractMsgType, str );
+         }
+ /*opt*/ else if ( k_its( "AmpWindow" ) )
+         {
+            Gparm->AmpWindow = k_val();
+            if ( (Gparm->AmpWindow < 0.) || (Gparm->AmpWindow > 600.) )
+            {
+               logit( "e", "pick_ew: AmpWindow must be 0 to 600 s.\n" );
+               return -1;
+            }
+         }
+ /*opt*/ else if ( k_its( "AmpMsgType" ) )
+         {
+            str = k_str();
+            if ( (str == NULL) || (strlen( str ) >= sizeof(Gparm->AmpMsgType)) )
+            {
+               logit( "e", "pick_ew: Invalid AmpMsgType.\n" );
+               return -1;
+            }
+            strcpy( Gparm->AmpMsgType, str );
+         }
+ /*opt*/ else if ( k_its( "PickEngine" ) )
+         {
+            str = k_str();
+            if ( (str != NULL) && (strcmp( str, "ra" ) == 0) )
+               Gparm->PickEngine = ENGINE_RA;
+            else if ( (str != NULL) && (strcmp( str, "bank" ) == 0) )
+               Gparm->PickEngine = ENGINE_BANK;
+            else
+            {
+               logit( "e", "pick_ew: PickEngine must be ra or bank.\n" );
+               return -1;
+            }
+         }
+ /*opt*/ else if ( k_its( "FilterBank" ) )
+         {
+            Gparm->BankBands   = k_int();
+            Gparm->BankThresh  = k_val();
+            Gparm->BankLongSec = k_val();
+            if ( (Gparm->BankBands < 1) || (Gparm->BankBands > NBAND) ||
+                 !(Gparm->BankThresh > 0.) || !(Gparm->BankLongSec > 0.) )
+            {
+               logit( "e", "pick_ew: FilterBank needs 1-%d bands, a threshold > 0 "
+                      "and a long-term window > 0 s.\n", NBAND );
+               return -1;
+            }
+         }
+ /*opt*/ else if ( k_its( "OnsetRefine" ) )
+         {
+            Gparm->OnsetPre  = k_val();
+            Gparm->OnsetPost = k_val();
+            Gparm->OnsetKurt = k_val();
+            if ( !(Gparm->OnsetPre > 0.) || !(Gparm->OnsetPost > 0.) ||
+                 !(Gparm->OnsetKurt > 0.) || (Gparm->OnsetKurt >= Gparm->OnsetPre) ||
+                 (Gparm->OnsetPre + Gparm->OnsetPost > 60.) )
+            {
+               logit( "e", "pick_ew: OnsetRefine needs times before and after the "
+                      "trigger > 0, at most 60 s in all, and a kurtosis window > 0 "
+                      "and shorter than the time before.\n" );
+               return -1;
+            }
+         }
+ /*opt*/ else if ( k_its( "NoisePSD" ) )
+         {
+            Gparm->NoiseNfft   = k_int();
+            Gparm->NoiseDecim  = k_int();
+            Gparm->NoiseBudget = k_val();
+            if ( (Gparm->NoiseNfft < 16) || (Gparm->NoiseNfft > 4096) ||
+                 ((Gparm->NoiseNfft & (Gparm->NoiseNfft - 1)) != 0) ||
+                 (Gparm->NoiseDecim < 1) || (Gparm->NoiseDecim > 100) ||
+                 !(Gparm->NoiseBudget > 0.) || (Gparm->NoiseBudget > 100.) )
+            {
+               logit( "e", "pick_ew: NoisePSD needs a segment length that is a power "
+                      "of two from 16 to 4096, a decimation of 1-100 and a cpu budget "
+                      "of 0-100 percent.\n" );
+               return -1;
+            }
+         }
+ /*opt*/ else if ( k_its( "SnrWeight" ) )
+         {
+            Gparm->SnrWeight = k_val();
+         }
+ /*opt*/ else if ( k_its( "NoiseQCFile" ) )
+         {
+            if ( (str = k_str()) != NULL )
+               Gparm->NoiseQCFile = strdup( str );
+         }
  /*opt*/ else if ( k_its( "PickIndexDir" ) )
          {
             Gparm->PickIndexDir = strdup(k_str());
@@ -236,23 +406,239 @@ int GetConfig( char *config_file, GPARM *Gparm )
 #endif
          }
 
+ /*opt*/ else if ( k_its( "PickIndexBlock" ) )
+         {
+            Gparm->PickIndexBlock = k_int();
+            if ( Gparm->PickIndexBlock < 1 )
+            {
+               logit( "e", "pick_ew: PickIndexBlock must be at least 1.\n" );
+               return -1;
+            }
+         }
+ /*opt*/ else if ( k_its( "OutQueueSize" ) )
+         {
+            Gparm->OutQueueSize = k_int();
+            if ( Gparm->OutQueueSize < 0 )
+            {
+               logit( "e", "pick_ew: OutQueueSize must not be negative.\n" );
+               return -1;
+            }
+         }
+ /*opt*/ else if ( k_its( "OutBatch" ) )
+         {
+            Gparm->OutBatch = k_int();
+            if ( Gparm->OutBatch < 1 )
+            {
+               logit( "e", "pick_ew: OutBatch must be at least 1.\n" );
+               return -1;
+            }
+         }
+ /*opt*/ else if ( k_its( "StatsInt" ) )
+         {
+            Gparm->StatsInt = k_int();
+         }
+ /*opt*/ else if ( k_its( "StaCacheFile" ) )
+         {
+            if ( (str = k_str()) != NULL )
+               Gparm->StaCacheFile = strdup( str );
+         }
+ /*opt*/ else if ( k_its( "StaReloadInt" ) )
+         {
+            Gparm->StaReloadInt = k_int();
+         }
+ /*opt*/ else if ( k_its( "AutoRegister" ) )
+         {
+            Gparm->AutoMax      = k_int();
+            Gparm->AutoEvictSec = k_int();
+            if ( (Gparm->AutoMax < 0) || (Gparm->AutoEvictSec < 1) )
+            {
+               logit( "e", "pick_ew: AutoRegister needs a channel limit >= 0 "
+                      "and an eviction time >= 1 s.\n" );
+               return -1;
+            }
+         }
+ /*opt*/ else if ( k_its( "GapReportInt" ) )
+         {
+            Gparm->GapReportInt = k_int();
+            if ( Gparm->GapReportInt < 0 )
+            {
+               logit( "e", "pick_ew: GapReportInt must be 0 or more.\n" );
+               return -1;
+            }
+         }
+ /*opt*/ else if ( k_its( "RestartStateFile" ) )
+         {
+            if ( (str = k_str()) != NULL )
+               Gparm->RestartFile = strdup( str );
+         }
+ /*opt*/ else if ( k_its( "FilterSnapshot" ) )
+         {
+            str = k_str();
+            Gparm->SnapInt    = k_int();
+            Gparm->SnapMaxAge = k_int();
+            if ( (str == NULL) || (Gparm->SnapInt < 1) || (Gparm->SnapMaxAge < 0) )
+            {
+               logit( "e", "pick_ew: FilterSnapshot needs a file name, an interval "
+                      ">= 1 s and a maximum age >= 0 s.\n" );
+               return -1;
+            }
+            Gparm->SnapFile = strdup( str );
+         }
+ /*opt*/ else if ( k_its( "ReorderHold" ) )
+         {
+            Gparm->ReorderHoldMs = k_int();
+            Gparm->ReorderMax    = k_int();
+            if ( (Gparm->ReorderHoldMs < 0) ||
+                 ((Gparm->ReorderHoldMs > 0) && (Gparm->ReorderMax < 1)) )
+            {
+               logit( "e", "pick_ew: ReorderHold needs a hold time >= 0 ms and "
+                      "at least 1 message per channel.\n" );
+               return -1;
+            }
+         }
+ /*opt*/ else if ( k_its( "DupCheck" ) )
+         {
+            Gparm->DupCheck = k_int();
+         }
+ /*opt*/ else if ( k_its( "ShardId" ) )
+         {
+            Gparm->ShardId = k_int();
+         }
+ /*opt*/ else if ( k_its( "ShardCount" ) )
+         {
+            Gparm->ShardCount = k_int();
+         }
+ /*opt*/ else if ( k_its( "CpuSet" ) )
+         {
+            static const char *role[NTHREADROLE] = { "picker", "reader", "publisher", "reload",
+                                                     "onset", "noise" };
+            char *list;
+
+            str  = k_str();
+            list = k_str();
+            for ( i = 0; (str != NULL) && (i < NTHREADROLE); i++ )
+               if ( strcmp( str, role[i] ) == 0 ) break;
+            if ( (str == NULL) || (list == NULL) || (i == NTHREADROLE) )
+            {
+               logit( "e", "pick_ew: CpuSet needs picker, reader, publisher, reload, "
+                      "onset or noise, and a cpu list.\n" );
+               return -1;
+            }
+            free( Gparm->CpuSet[i] );
+            Gparm->CpuSet[i] = strdup( list );
+         }
+ /*opt*/ else if ( k_its( "ShedLevel" ) )
+         {
+            int    level = k_int();
+            double enter = k_val();
+            double leave = k_val();
+
+            if ( (level < 1) || (level >= NSHEDLEVEL) || !(leave > 0.) || !(enter > leave) )
+            {
+               logit( "e", "pick_ew: ShedLevel needs a level of 1 to %d, and a start "
+                      "lag greater than the end lag, which must be > 0.\n", NSHEDLEVEL-1 );
+               return -1;
+            }
+            Gparm->ShedEnter[level] = enter;
+            Gparm->ShedLeave[level] = leave;
+         }
+ /*opt*/ else if ( k_its( "ShedChannel" ) )
+         {
+            SCNLPAT *tmp;
+            char    *sta  = k_str();
+            char    *chan = k_str();
+            char    *net  = k_str();
+            char    *loc  = k_str();
+
+            if ( (sta == NULL) || (chan == NULL) || (net == NULL) || (loc == NULL) ||
+                 (strlen( sta ) > 5) || (strlen( chan ) > 3) ||
+                 (strlen( net ) > 2) || (strlen( loc ) > 2) )
+            {
+               logit( "e", "pick_ew: ShedChannel needs station, channel, network "
+                      "and location patterns.\n" );
+               return -1;
+            }
+            tmp = (SCNLPAT *)realloc( Gparm->ShedChan, (Gparm->nShedChan+1)*sizeof(SCNLPAT) );
+            if ( tmp == NULL )
+            {
+               logit( "e", "pick_ew: Error reallocing Gparm->ShedChan. Exiting.\n" );
+               return -1;
+            }
+            Gparm->ShedChan = tmp;
+            strcpy( tmp[Gparm->nShedChan].sta,  sta );
+            strcpy( tmp[Gparm->nShedChan].chan, chan );
+            strcpy( tmp[Gparm->nShedChan].net,  net );
+            strcpy( tmp[Gparm->nShedChan].loc,  loc );
+            Gparm->nShedChan++;
+         }
+ /*opt*/ else if ( k_its( "BinaryOutput" ) )
+         {
+            Gparm->BinaryOutput = k_int();
+            if ( (Gparm->BinaryOutput < 0) || (Gparm->BinaryOutput > 2) )
+            {
+               logit( "e", "pick_ew: BinaryOutput must be 0, 1 or 2.\n" );
+               return -1;
+            }
+         }
+ /*opt*/ else if ( k_its( "BinaryMsgType" ) )
+         {
+            str = k_str();
+            if ( (str == NULL) || (strlen( str ) >= sizeof(Gparm->BinaryMsgType)) )
+            {
+               logit( "e", "pick_ew: Invalid BinaryMsgType.\n" );
+               return -1;
+            }
+            strcpy( Gparm->BinaryMsgType, str );
+         }
+ /*opt*/ else if ( k_its( "BinaryBatch" ) )
+         {
+            Gparm->BinaryBatch = k_int();
+            if ( (Gparm->BinaryBatch < 1) || (Gparm->BinaryBatch > 1000) )
+            {
+               logit( "e", "pick_ew: BinaryBatch must be 1-1000.\n" );
+               return -1;
+            }
+         }
+ /*opt*/ else if ( k_its( "BinaryFlushMs" ) )
+         {
+            Gparm->BinaryFlushMs = k_int();
+         }
+ /*opt*/ else if ( k_its( "PickClassifier" ) )
+         {
+            if ( (str = k_str()) != NULL )
+               Gparm->ClassifierFile = strdup( str );
+         }
+ /*opt*/ else if ( k_its( "PickFeatureFile" ) )
+         {
+            if ( (str = k_str()) != NULL )
+               Gparm->FeatureFile = strdup( str );
+         }
  
- /*opt*/ else if ( k_its( "GetLogo" ) )
+ /*opt*/ else if ( k_its( "GetLogo" ) )  /* for the InRing above it, if any */
          {
             MSG_LOGO *tlogo = NULL;
-            int       nlogo = Gparm->nGetLogo;
-            tlogo = (MSG_LOGO *)realloc( Gparm->GetLogo, (nlogo+1)*sizeof(MSG_LOGO) );
+            MSG_LOGO **plogo = &Gparm->GetLogo;
+            int      *pnlogo = &Gparm->nGetLogo;
+            int       nlogo;
+
+            if ( Gparm->nInRing > 0 )
+            {
+               plogo  = &Gparm->InRing[Gparm->nInRing-1].logo;
+               pnlogo = &Gparm->InRing[Gparm->nInRing-1].nlogo;
+            }
+            nlogo = *pnlogo;
+            tlogo = (MSG_LOGO *)realloc( *plogo, (nlogo+1)*sizeof(MSG_LOGO) );
             if( tlogo == NULL )
             {
                logit( "e", "pick_ew: GetLogo: error reallocing %zu bytes.\n",
                       (nlogo+1)*sizeof(MSG_LOGO) );
                return -1;
             }
-            Gparm->GetLogo = tlogo;
+            *plogo = tlogo;
             
             if( (str=k_str()) != NULL)       /* read instid */
             {
-               if( GetInst( str, &(Gparm->GetLogo[nlogo].instid) ) != 0 ) 
+               if( GetInst( str, &(tlogo[nlogo].instid) ) != 0 ) 
                {
                   logit( "e", "pick_ew: Invalid installation name <%s>"
                          " in <GetLogo> cmd!\n", str );
@@ -260,7 +646,7 @@ int GetConfig( char *config_file, GPARM *Gparm )
                }
                if( (str=k_str()) != NULL )    /* read module id */
                {
-                  if( GetModId( str, &(Gparm->GetLogo[nlogo].mod) ) != 0 ) 
+                  if( GetModId( str, &(tlogo[nlogo].mod) ) != 0 ) 
                   {
                      logit( "e", "pick_ew: Invalid module name <%s>"
                             " in <GetLogo> cmd!\n", str );
@@ -276,12 +662,12 @@ int GetConfig( char *config_file, GPARM *Gparm )
                                 str );
                         return -1;
                      }
-                     if( GetType( str, &(Gparm->GetLogo[nlogo].type) ) != 0 ) {
+                     if( GetType( str, &(tlogo[nlogo].type) ) != 0 ) {
                         logit( "e", "pick_ew: Invalid message type <%s>"
                                " in <GetLogo> cmd!\n", str );
                         return -1;
                      }
-                     Gparm->nGetLogo++;
+                     (*pnlogo)++;
                   } /* end if msgtype */
                } /* end if modid */  
             } /* end if instid */  
@@ -329,6 +715,31 @@ int GetConfig( char *config_file, GPARM *Gparm )
       logit( "e", "command(s) in <%s>. Exiting.\n", config_file );
       return -1;
    }
+
+   if ( (Gparm->ShardCount < 1) || (Gparm->ShardId < 0) ||
+        (Gparm->ShardId >= Gparm->ShardCount) )
+   {
+      logit( "e", "pick_ew: ShardId must be 0 to ShardCount-1, and ShardCount >= 1.\n" );
+      return -1;
+   }
+
+/* Higher shedding levels must start at greater lags
+   *************************************************/
+   {
+      double prev = 0.;
+
+      for ( i = 1; i < NSHEDLEVEL; i++ )
+      {
+         if ( Gparm->ShedEnter[i] == 0. ) continue;
+         if ( Gparm->ShedEnter[i] <= prev )
+         {
+            logit( "e", "pick_ew: ShedLevel %d must start at a greater lag than "
+                   "the levels below it.\n", i );
+            return -1;
+         }
+         prev = Gparm->ShedEnter[i];
+      }
+   }
    return 0;
 }
 
@@ -348,13 +759,80 @@ void LogConfig( GPARM *Gparm )
    for( i=0; i<Gparm->nStaFile; i++ ) {
       logit( "", "StaFile[%d]:    %s\n",  i, Gparm->StaFile[i].name );
    }
-   logit( "", "InKey:           %6ld\n",  Gparm->InKey );
+   if ( Gparm->StaCacheFile != NULL )
+      logit( "", "StaCacheFile:    %s\n",   Gparm->StaCacheFile );
+   logit( "", "StaReloadInt:    %6d\n",   Gparm->StaReloadInt );
+   if ( Gparm->AutoMax > 0 )
+      logit( "", "AutoRegister:    %6d %d\n", Gparm->AutoMax, Gparm->AutoEvictSec );
+   for( i=0; i<Gparm->nInRing; i++ ) {
+      int j;
+      logit( "", "InRing[%d]:      %s (key %ld)\n", i, Gparm->InRing[i].name,
+             Gparm->InRing[i].key );
+      for( j=0; j<Gparm->InRing[i].nlogo; j++ )
+         logit( "", "   GetLogo[%d]:  i%u m%u t%u\n", j,
+                Gparm->InRing[i].logo[j].instid, Gparm->InRing[i].logo[j].mod,
+                Gparm->InRing[i].logo[j].type );
+   }
    logit( "", "OutKey:          %6ld\n",  Gparm->OutKey );
    logit( "", "HeartbeatInt:    %6d\n",   Gparm->HeartbeatInt );
    logit( "", "RestartLength:   %6d\n",   Gparm->RestartLength );
    logit( "", "MaxGap:          %6d\n",   Gparm->MaxGap );
    logit( "", "Debug:           %6d\n",   Gparm->Debug );
+   if ( Gparm->EarlyPick )
+      logit( "", "EarlyPick:       %6d %s\n", Gparm->EarlyPick, Gparm->RetractMsgType );
+   if ( Gparm->AmpWindow > 0. )
+      logit( "", "AmpWindow:       %6.1lf %s\n", Gparm->AmpWindow, Gparm->AmpMsgType );
+   logit( "", "PickEngine:      %s\n", (Gparm->PickEngine == ENGINE_BANK) ? "bank" : "ra" );
+   if ( Gparm->PickEngine == ENGINE_BANK )
+      logit( "", "FilterBank:      %6d %.1lf %.1lf\n", Gparm->BankBands,
+             Gparm->BankThresh, Gparm->BankLongSec );
+   if ( Gparm->OnsetPre > 0. )
+      logit( "", "OnsetRefine:     %.2lf %.2lf %.2lf\n", Gparm->OnsetPre,
+             Gparm->OnsetPost, Gparm->OnsetKurt );
+   if ( Gparm->NoiseNfft > 0 )
+      logit( "", "NoisePSD:        %6d %d %.1lf\n", Gparm->NoiseNfft, Gparm->NoiseDecim,
+             Gparm->NoiseBudget );
+   if ( Gparm->SnrWeight != 0. )
+      logit( "", "SnrWeight:       %6.1lf\n", Gparm->SnrWeight );
+   if ( Gparm->NoiseQCFile != NULL )
+      logit( "", "NoiseQCFile:     %s\n",    Gparm->NoiseQCFile );
+   logit( "", "PickIndexBlock:  %6d\n",   Gparm->PickIndexBlock );
+   logit( "", "OutQueueSize:    %6d\n",   Gparm->OutQueueSize );
+   logit( "", "OutBatch:        %6d\n",   Gparm->OutBatch );
+   logit( "", "StatsInt:        %6d\n",   Gparm->StatsInt );
+   logit( "", "GapReportInt:    %6d\n",   Gparm->GapReportInt );
+   if ( Gparm->RestartFile != NULL )
+      logit( "", "RestartStateFile: %s\n",  Gparm->RestartFile );
+   if ( Gparm->SnapFile != NULL )
+      logit( "", "FilterSnapshot:  %s %d %d\n", Gparm->SnapFile, Gparm->SnapInt,
+             Gparm->SnapMaxAge );
+   if ( Gparm->ReorderHoldMs > 0 )
+      logit( "", "ReorderHold:     %6d %d\n", Gparm->ReorderHoldMs, Gparm->ReorderMax );
+   logit( "", "DupCheck:        %6d\n",   Gparm->DupCheck );
+   if ( Gparm->ShardCount > 1 )
+      logit( "", "Shard:           %6d of %d\n", Gparm->ShardId, Gparm->ShardCount );
+   for ( i = 0; i < NTHREADROLE; i++ )
+      if ( Gparm->CpuSet[i] != NULL )
+         logit( "", "CpuSet[%d]:       %s\n", i, Gparm->CpuSet[i] );
+   for ( i = 1; i < NSHEDLEVEL; i++ )
+      if ( Gparm->ShedEnter[i] > 0. )
+         logit( "", "ShedLevel:       %6d %.1lf %.1lf\n", i, Gparm->ShedEnter[i],
+                Gparm->ShedLeave[i] );
+   for ( i = 0; i < Gparm->nShedChan; i++ )
+      logit( "", "ShedChannel:     %s %s %s %s\n", Gparm->ShedChan[i].sta,
+             Gparm->ShedChan[i].chan, Gparm->ShedChan[i].net, Gparm->ShedChan[i].loc );
+   logit( "", "BinaryOutput:    %6d\n",   Gparm->BinaryOutput );
+   if ( Gparm->BinaryOutput )
+   {
+      logit( "", "BinaryMsgType:   %s\n",    Gparm->BinaryMsgType );
+      logit( "", "BinaryBatch:     %6d\n",   Gparm->BinaryBatch );
+      logit( "", "BinaryFlushMs:   %6d\n",   Gparm->BinaryFlushMs );
+   }
    logit( "", "MyModId:         %6u\n",   Gparm->MyModId );
+   if ( Gparm->ClassifierFile != NULL )
+      logit( "", "PickClassifier:  %s\n",    Gparm->ClassifierFile );
+   if ( Gparm->FeatureFile != NULL )
+      logit( "", "PickFeatureFile: %s\n",    Gparm->FeatureFile );
    logit( "", "nGetLogo:        %6d\n",   Gparm->nGetLogo );
    for( i=0; i<Gparm->nGetLogo; i++ ) {
       logit( "", "GetLogo[%d]:   i%u m%u t%u\n", i,
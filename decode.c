@@ -0,0 +1,313 @@
+  /**********************************************************************
+   *                              decode.c                              *
+   *                                                                    *
+   *                      Decoding of waveform messages                 *
+   *                                                                    *
+   *  This file contains functions InitDecode(), DecodeRoom(),          *
+   *  MakeHeaderLocal(), DecodeMsg() and FreeDecode().                  *
+   *                                                                    *
+   *  Only the header of a message is put in local byte order when it   *
+   *  arrives; that is all the lookup and the duplicate check need.     *
+   *  The samples of a message that is going to be picked are then     *
+   *  swapped if need be, and converted to doubles, the type the        *
+   *  picker works in, in a single pass.  The loops are simple enough   *
+   *  for the compiler to vectorize.  Integer (i2, s2, i4, s4) and      *
+   *  floating point (f4, t4, f8, t8) samples are understood.           *
+   *  Floating point samples are checked as they are converted: a       *
+   *  message with a NaN or infinite sample is dropped, so it can't     *
+   *  poison the channel's filters.  The channel then sees a gap.       *
+   *                                                                    *
+   *  The decoded message has the layout of a TYPE_TRACEBUF2 message:   *
+   *  the header, then nsamp doubles.  It is written to a buffer whose  *
+   *  samples start on a 64-byte boundary, with room in front of the    *
+   *  header for the MaxGap-1 samples Interpolate() may add.  Those     *
+   *  are written there, and the header moved down, so the samples of   *
+   *  a message never have to be moved.                                 *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <earthworm.h>
+#include <transport.h>
+#include <trace_buf.h>
+#include <swap.h>
+#include "nn_pick_ew.h"
+
+#if defined( _SPARC )
+#define LOCAL_BIG_ENDIAN  1
+#elif defined( _INTEL )
+#define LOCAL_BIG_ENDIAN  0
+#else
+#error "_INTEL or _SPARC must be set before compiling"
+#endif
+
+#define DATA_ALIGN  64
+#define MAX_NSAMP   ((MAX_TRACEBUF_SIZ - (int) sizeof(TRACE2_HEADER)) / 2)
+
+#define DT_INT2     0       /* i2, s2 */
+#define DT_INT4     1       /* i4, s4 */
+#define DT_FLOAT4   2       /* f4, t4 */
+#define DT_FLOAT8   3       /* f8, t8 */
+
+#define SWAP2(v)  ((unsigned short) (((v) << 8) | ((v) >> 8)))
+#define SWAP4(v)  (((v) >> 24) | (((v) >> 8) & 0xff00u) | \
+                   (((v) << 8) & 0xff0000u) | ((v) << 24))
+
+#define TODOUBLE(x)  ((double) (x))
+#define INT2SWAP(x)  ((double) (short) SWAP2( x ))
+#define INT4SWAP(x)  ((double) (int) SWAP4( x ))
+
+/* Convert the n samples at d to doubles at out, four at a time so
+   the compiler can do each group of four with vector instructions
+   ****************************************************************/
+#define DECODE( CONV )                    \
+   for ( i = 0; i + 4 <= n; i += 4 )      \
+   {                                      \
+      out[i]   = CONV( d[i] );            \
+      out[i+1] = CONV( d[i+1] );          \
+      out[i+2] = CONV( d[i+2] );          \
+      out[i+3] = CONV( d[i+3] );          \
+   }                                      \
+   for ( ; i < n; i++ )                   \
+      out[i] = CONV( d[i] )
+
+/* The same, also summing sample * 0 in four lanes.  The sums are
+   zero if every sample is finite; Inf * 0 and NaN * 0 are NaN.
+   ***************************************************************/
+#define DECODE_CHECK( CONV )                              \
+   for ( i = 0; i + 4 <= n; i += 4 )                      \
+   {                                                      \
+      out[i]   = CONV( d[i] );   chk[0] += out[i]   * 0.; \
+      out[i+1] = CONV( d[i+1] ); chk[1] += out[i+1] * 0.; \
+      out[i+2] = CONV( d[i+2] ); chk[2] += out[i+2] * 0.; \
+      out[i+3] = CONV( d[i+3] ); chk[3] += out[i+3] * 0.; \
+   }                                                      \
+   for ( ; i < n; i++ )                                   \
+   {                                                      \
+      out[i] = CONV( d[i] );                              \
+      chk[0] += out[i] * 0.;                              \
+   }
+
+static char *WaveMem = NULL;         /* As allocated */
+static unsigned long nNotFinite = 0; /* Messages dropped for NaN/Inf samples */
+
+/* Function prototypes
+   *******************/
+size_t        DecodeRoom( GPARM * );
+static void   SwapHeader( TRACE_HEADER * );
+static double Float4Swap( unsigned int );
+
+
+  /***************************************************************
+   *                          InitDecode()                       *
+   *                                                             *
+   *  Allocate the buffer decoded messages are written to.       *
+   *  Returns NULL if out of memory.                             *
+   ***************************************************************/
+
+char *InitDecode( GPARM *Gparm )
+{
+   size_t room = DecodeRoom( Gparm );
+   size_t len  = room + sizeof(TRACE2_HEADER) + MAX_NSAMP * sizeof(double);
+   size_t off;
+
+   if ( (WaveMem = (char *) malloc( len + DATA_ALIGN )) == NULL )
+      return NULL;
+
+/* Put the samples, not the header, on the boundary
+   ************************************************/
+   off = DATA_ALIGN - ((size_t) (WaveMem + room + sizeof(TRACE2_HEADER)) % DATA_ALIGN);
+   return WaveMem + room + off % DATA_ALIGN;
+}
+
+
+  /***************************************************************
+   *                          DecodeRoom()                       *
+   *                                                             *
+   *  The number of bytes a decoded message needs in front of    *
+   *  its header, for the samples Interpolate() may add.         *
+   ***************************************************************/
+
+size_t DecodeRoom( GPARM *Gparm )
+{
+   return (Gparm->MaxGap > 1) ? (Gparm->MaxGap - 1) * sizeof(double) : 0;
+}
+
+
+  /***************************************************************
+   *                        MakeHeaderLocal()                    *
+   *                                                             *
+   *  Put the header of a TYPE_TRACEBUF or TYPE_TRACEBUF2        *
+   *  message in local byte order, leaving the samples alone,    *
+   *  and check it against the message length.  Returns -1 if    *
+   *  the data type is unknown, -2 if the sample count or rate   *
+   *  is bad.                                                    *
+   ***************************************************************/
+
+int MakeHeaderLocal( char *TraceBuf, long MsgLen )
+{
+   TRACE_HEADER *th = (TRACE_HEADER *) TraceBuf;
+   char         *type = th->datatype;
+   int          size;
+   int          big;
+
+   if ( (type[0] == 's') || (type[0] == 't') )
+      big = 1;
+   else if ( (type[0] == 'i') || (type[0] == 'f') )
+      big = 0;
+   else
+      return -1;
+
+   size = type[1] - '0';
+   if ( (type[2] != '\0') ||
+        !(((type[0] == 's' || type[0] == 'i') && (size == 2 || size == 4)) ||
+          ((type[0] == 't' || type[0] == 'f') && (size == 4 || size == 8))) )
+      return -1;
+
+   if ( big != LOCAL_BIG_ENDIAN )
+      SwapHeader( th );
+
+   if ( (th->nsamp < 1) || (th->nsamp > MAX_NSAMP) ||
+        ((long) sizeof(TRACE_HEADER) + (long) th->nsamp * size > MsgLen) ||
+        !(th->samprate > 0.) )
+      return -2;
+   return 0;
+}
+
+
+  /***************************************************************
+   *                           DecodeMsg()                       *
+   *                                                             *
+   *  Write the header of a message, and its samples as          *
+   *  doubles, to WaveBuf.  The header must have been put in     *
+   *  local byte order and checked by MakeHeaderLocal().         *
+   *  Returns -1 if a sample is NaN or infinite; the message     *
+   *  must then be dropped.                                      *
+   ***************************************************************/
+
+int DecodeMsg( char *TraceBuf, char *WaveBuf )
+{
+   TRACE2_HEADER *th  = (TRACE2_HEADER *) TraceBuf;
+   char          *in  = TraceBuf + sizeof(TRACE2_HEADER);
+   double        *out = (double *) (WaveBuf + sizeof(TRACE2_HEADER));
+   int           n    = th->nsamp;
+   int           swap = ((th->datatype[0] == 's') || (th->datatype[0] == 't')) !=
+                        LOCAL_BIG_ENDIAN;
+   int           kind;
+   int           i;
+   double        chk[4] = { 0., 0., 0., 0. };
+
+   if ( (th->datatype[0] == 's') || (th->datatype[0] == 'i') )
+      kind = (th->datatype[1] == '2') ? DT_INT2 : DT_INT4;
+   else
+      kind = (th->datatype[1] == '4') ? DT_FLOAT4 : DT_FLOAT8;
+
+   memcpy( WaveBuf, TraceBuf, sizeof(TRACE2_HEADER) );
+
+   switch ( kind )
+   {
+   case DT_INT2:
+      if ( swap )
+      {
+         const unsigned short *d = (const unsigned short *) in;
+         DECODE( INT2SWAP );
+      }
+      else
+      {
+         const short *d = (const short *) in;
+         DECODE( TODOUBLE );
+      }
+      break;
+
+   case DT_INT4:
+      if ( swap )
+      {
+         const unsigned int *d = (const unsigned int *) in;
+         DECODE( INT4SWAP );
+      }
+      else
+      {
+         const int *d = (const int *) in;
+         DECODE( TODOUBLE );
+      }
+      break;
+
+   case DT_FLOAT4:
+      if ( swap )
+      {
+         const unsigned int *d = (const unsigned int *) in;
+         DECODE_CHECK( Float4Swap );
+      }
+      else
+      {
+         const float *d = (const float *) in;
+         DECODE_CHECK( TODOUBLE );
+      }
+      break;
+
+   case DT_FLOAT8:
+      if ( swap )
+      {
+         const unsigned char *d = (const unsigned char *) in;
+         for ( i = 0; i < n; i++ )
+         {
+            unsigned char *o = (unsigned char *) &out[i];
+            int           j;
+
+            for ( j = 0; j < 8; j++ )
+               o[j] = d[8*i + 7 - j];
+            chk[0] += out[i] * 0.;
+         }
+      }
+      else
+      {
+         const double *d = (const double *) in;
+         DECODE_CHECK( TODOUBLE );
+      }
+      break;
+   }
+
+   if ( (chk[0] + chk[1] + chk[2] + chk[3]) == 0. ) return 0;
+
+   if ( nNotFinite++ % 1000 == 0 )
+      logit( "et", "pick_ew: NaN or infinite sample from %s.%s.%s.%s; message dropped "
+             "(%lu so far)\n", th->sta, th->chan, th->net, th->loc, nNotFinite );
+   return -1;
+}
+
+
+  /***************************************************************
+   *                          FreeDecode()                       *
+   ***************************************************************/
+
+void FreeDecode( void )
+{
+   free( WaveMem );
+   WaveMem = NULL;
+}
+
+
+/* Swap the numeric fields of a header.  TYPE_TRACEBUF
+   and TYPE_TRACEBUF2 headers have them in the same place.
+   *******************************************************/
+static void SwapHeader( TRACE_HEADER *th )
+{
+   SwapInt( &th->pinno );
+   SwapInt( &th->nsamp );
+   SwapDouble( &th->starttime );
+   SwapDouble( &th->endtime );
+   SwapDouble( &th->samprate );
+}
+
+
+/* One byte-swapped float sample
+   *****************************/
+static double Float4Swap( unsigned int v )
+{
+   float f;
+
+   v = SWAP4( v );
+   memcpy( &f, &v, sizeof(f) );
+   return (double) f;
+}
@@ -0,0 +1,174 @@
+  /**********************************************************************
+   *                             dupcheck.c                             *
+   *                                                                    *
+   *                    Dropping of duplicate messages                  *
+   *                                                                    *
+   *  This file contains functions InitDupCheck(), IsDuplicate() and    *
+   *  LogDupStats().                                                    *
+   *                                                                    *
+   *  When a channel arrives by two acquisition paths, each message     *
+   *  shows up twice in InRing.  With DupCheck set, every channel       *
+   *  remembers the start time, sample count and a checksum of the      *
+   *  samples of its last NDUPKEY messages, and a message matching one  *
+   *  of them is dropped as soon as its channel has been looked up,     *
+   *  before any of its samples are used.  Dropped duplicates are       *
+   *  counted by logo, so the log shows which feeds they came from.     *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <earthworm.h>
+#include <transport.h>
+#include <trace_buf.h>
+#include "nn_pick_ew.h"
+
+#define MAXDUPLOGO 32       /* Logos counted separately */
+
+typedef struct {
+   MSG_LOGO      logo;
+   unsigned long nmsg;      /* Messages checked */
+   unsigned long ndup;      /* Duplicates dropped */
+} DUPLOGO;
+
+static int           DupCheck = 0;
+static DUPLOGO       Logo[MAXDUPLOGO];
+static int           nLogo = 0;
+static int           LastLogo = 0;   /* Logo of the previous message */
+static unsigned long nOtherMsg = 0;  /* Counts of logos that didn't fit */
+static unsigned long nOtherDup = 0;
+
+/* Function prototypes
+   *******************/
+static unsigned int Checksum( const unsigned char *, long );
+static DUPLOGO     *FindLogo( MSG_LOGO * );
+
+
+  /***************************************************************
+   *                         InitDupCheck()                      *
+   ***************************************************************/
+
+void InitDupCheck( GPARM *Gparm )
+{
+   DupCheck = Gparm->DupCheck;
+}
+
+
+  /***************************************************************
+   *                         IsDuplicate()                       *
+   *                                                             *
+   *  Returns 1 if the channel has had this message already.     *
+   *  Otherwise the message is remembered and 0 is returned.     *
+   *  The header of TraceBuf must be in local byte order.  The   *
+   *  samples are checksummed as they came.                      *
+   ***************************************************************/
+
+int IsDuplicate( STATION *Sta, char *TraceBuf, long MsgLen, MSG_LOGO *logo )
+{
+   TRACE2_HEADER *th = (TRACE2_HEADER *) TraceBuf;
+   DUPKEYS       *dk = Sta->Dup;
+   DUPLOGO       *lc;
+   long          nbyte;
+   unsigned int  sum;
+   int           i;
+
+   if ( !DupCheck ) return 0;
+
+/* Checksum the samples, as far as the message goes
+   ************************************************/
+   nbyte = (long) th->nsamp * (th->datatype[1] - '0');
+   if ( nbyte > MsgLen - (long) sizeof(TRACE2_HEADER) )
+      nbyte = MsgLen - (long) sizeof(TRACE2_HEADER);
+   sum = Checksum( (unsigned char *) (TraceBuf + sizeof(TRACE2_HEADER)), nbyte );
+
+   lc = FindLogo( logo );
+   if ( lc != NULL ) lc->nmsg++;
+   else              nOtherMsg++;
+
+   for ( i = 0; i < NDUPKEY; i++ )
+      if ( (dk->starttime[i] == th->starttime) && (dk->nsamp[i] == th->nsamp) &&
+           (dk->sum[i] == sum) )
+      {
+         if ( lc != NULL ) lc->ndup++;
+         else              nOtherDup++;
+         return 1;
+      }
+
+   dk->starttime[dk->next] = th->starttime;
+   dk->nsamp[dk->next]     = th->nsamp;
+   dk->sum[dk->next]       = sum;
+   dk->next = (dk->next + 1) % NDUPKEY;
+   return 0;
+}
+
+
+  /***************************************************************
+   *                          LogDupStats()                      *
+   ***************************************************************/
+
+void LogDupStats( void )
+{
+   int i;
+
+   if ( !DupCheck ) return;
+
+   for ( i = 0; i < nLogo; i++ )
+      logit( "t", "pick_ew: Duplicates from i:%d m:%d t:%d: %lu of %lu msgs\n",
+             (int) Logo[i].logo.instid, (int) Logo[i].logo.mod, (int) Logo[i].logo.type,
+             Logo[i].ndup, Logo[i].nmsg );
+   if ( nOtherMsg > 0 )
+      logit( "t", "pick_ew: Duplicates from other logos: %lu of %lu msgs\n",
+             nOtherDup, nOtherMsg );
+}
+
+
+/* A Fletcher-style checksum, four bytes at a time
+   ***********************************************/
+static unsigned int Checksum( const unsigned char *p, long n )
+{
+   unsigned int a = 1, b = 0;
+   long         i;
+
+   for ( i = 0; i + 4 <= n; i += 4 )
+   {
+      unsigned int w;
+
+      memcpy( &w, p + i, 4 );
+      a += w;
+      b += a;
+   }
+   for ( ; i < n; i++ )
+   {
+      a += p[i];
+      b += a;
+   }
+   return a ^ ((b << 13) | (b >> 19));
+}
+
+
+/* Find the counters of a logo, adding them if there
+   is room.  Returns NULL if the table is full.
+   *************************************************/
+static DUPLOGO *FindLogo( MSG_LOGO *logo )
+{
+   int i;
+
+   if ( (LastLogo < nLogo) && (Logo[LastLogo].logo.type == logo->type) &&
+        (Logo[LastLogo].logo.mod == logo->mod) &&
+        (Logo[LastLogo].logo.instid == logo->instid) )
+      return &Logo[LastLogo];
+
+   for ( i = 0; i < nLogo; i++ )
+      if ( (Logo[i].logo.type == logo->type) && (Logo[i].logo.mod == logo->mod) &&
+           (Logo[i].logo.instid == logo->instid) )
+         break;
+
+   if ( i == nLogo )
+   {
+      if ( nLogo == MAXDUPLOGO ) return NULL;
+      Logo[nLogo].logo = *logo;
+      Logo[nLogo].nmsg = Logo[nLogo].ndup = 0;
+      nLogo++;
+   }
+   LastLogo = i;
+   return &Logo[i];
+}
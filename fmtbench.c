@@ -0,0 +1,100 @@
+  /**********************************************************************
+   *                             fmtbench.c                             *
+   *                                                                    *
+   *        Times the pick and coda formatters against sprintf()        *
+   *                                                                    *
+   *  Formats the same set of picks and codas many times with           *
+   *  FormatPick()/FormatCoda() (format.c) and with the old sprintf()   *
+   *  code (fmtref.c), and prints the time per message for each.        *
+   *                                                                    *
+   *  Usage:  fmtbench [number of passes, default 200]                  *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <earthworm.h>
+#include <time_ew.h>
+#include <chron3.h>
+#include <transport.h>
+#include "nn_pick_ew.h"
+
+#define NMSG  1000              /* Picks and codas in the set */
+
+/* Function prototypes
+   *******************/
+int FormatPick( char *, int, PICK *, int, STATION *, GPARM *, EWH * );  /* format.c */
+int FormatCoda( char *, int, CODA *, GPARM *, EWH * );
+int RefFormatPick( char *, PICK *, int, STATION *, GPARM *, EWH * );    /* fmtref.c */
+int RefFormatCoda( char *, CODA *, GPARM *, EWH * );
+
+static STATION Sta[NMSG];
+static PICK    Pick[NMSG];
+static CODA    Coda[NMSG];
+
+
+int main( int argc, char *argv[] )
+{
+   GPARM  Gparm;
+   EWH    Ewh;
+   char   line[LINELEN * 2];
+   long   npass = (argc > 1) ? atol( argv[1] ) : 200L;
+   long   nbytes = 0;
+   long   p;
+   int    i, j;
+   double t0, t1, t2, t3, t4;
+
+   if ( npass < 1 ) npass = 1;
+   memset( &Gparm, 0, sizeof(Gparm) );
+   memset( &Ewh,   0, sizeof(Ewh) );
+   Ewh.TypePickScnl = 8;  Ewh.TypeCodaScnl = 9;  Ewh.MyInstId = 255;
+   Gparm.MyModId = 12;
+
+/* Typical picks and codas; fixed, so runs compare
+   ***********************************************/
+   srand( 1 );
+   for ( i = 0; i < NMSG; i++ )
+   {
+      sprintf( Sta[i].sta, "S%04d", i );
+      strcpy( Sta[i].chan, "HHZ" );
+      strcpy( Sta[i].net,  "NC" );
+      strcpy( Sta[i].loc,  "--" );
+      Pick[i].time        = GSEC1970 + 1700000000. + i * 3.37;
+      Pick[i].FirstMotion = " UD?"[i % 4];
+      Pick[i].weight      = i % 4;
+      for ( j = 0; j < 3; j++ ) Pick[i].xpk[j] = (rand() % 200000) / 10. - 5000.;
+      strcpy( Coda[i].sta,  Sta[i].sta );
+      strcpy( Coda[i].chan, Sta[i].chan );
+      strcpy( Coda[i].net,  Sta[i].net );
+      strcpy( Coda[i].loc,  Sta[i].loc );
+      Coda[i].PickIndex = 100000 + i;
+      for ( j = 0; j < 6; j++ ) Coda[i].aav[j] = rand() % 20000;
+      Coda[i].len_out = rand() % 144;
+   }
+
+   hrtime_ew( &t0 );
+   for ( p = 0; p < npass; p++ )
+      for ( i = 0; i < NMSG; i++ )
+         nbytes += RefFormatPick( line, &Pick[i], 100000 + i, &Sta[i], &Gparm, &Ewh );
+   hrtime_ew( &t1 );
+   for ( p = 0; p < npass; p++ )
+      for ( i = 0; i < NMSG; i++ )
+         nbytes += FormatPick( line, LINELEN, &Pick[i], 100000 + i, &Sta[i], &Gparm, &Ewh );
+   hrtime_ew( &t2 );
+   for ( p = 0; p < npass; p++ )
+      for ( i = 0; i < NMSG; i++ )
+         nbytes += RefFormatCoda( line, &Coda[i], &Gparm, &Ewh );
+   hrtime_ew( &t3 );
+   for ( p = 0; p < npass; p++ )
+      for ( i = 0; i < NMSG; i++ )
+         nbytes += FormatCoda( line, LINELEN, &Coda[i], &Gparm, &Ewh );
+   hrtime_ew( &t4 );
+
+   printf( "fmtbench: %ld picks and %ld codas each way (%ld bytes)\n",
+           npass * NMSG, npass * NMSG, nbytes );
+   printf( "  pick  sprintf %7.1f ns   FormatPick %7.1f ns\n",
+           1.e9 * (t1 - t0) / (npass * NMSG), 1.e9 * (t2 - t1) / (npass * NMSG) );
+   printf( "  coda  sprintf %7.1f ns   FormatCoda %7.1f ns\n",
+           1.e9 * (t3 - t2) / (npass * NMSG), 1.e9 * (t4 - t3) / (npass * NMSG) );
+   return 0;
+}
@@ -0,0 +1,97 @@
+  /**********************************************************************
+   *                              fmtref.c                              *
+   *                                                                    *
+   *        Reference pick and coda formatting, for fmttest/fmtbench    *
+   *                                                                    *
+   *  This file contains functions RefFormatPick() and RefFormatCoda(). *
+   *                                                                    *
+   *  They are the sprintf() code ReportPick() and ReportCoda() used    *
+   *  before format.c, unchanged except that they write into a buffer   *
+   *  given by the caller and return the length.  fmttest checks that   *
+   *  FormatPick() and FormatCoda() produce the same bytes; fmtbench    *
+   *  times both.  Not part of pick_ew.                                 *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <earthworm.h>
+#include <chron3.h>
+#include <transport.h>
+#include "nn_pick_ew.h"
+
+
+     /**************************************************************
+      *     RefFormatPick() - Old TYPE_PICK_SCNL line, sprintf()   *
+      **************************************************************/
+
+int RefFormatPick( char *line, PICK *Pick, int PickIndex, STATION *Sta,
+                   GPARM *Gparm, EWH *Ewh )
+{
+   struct Greg g;
+   int         tsec, thun;
+   char        firstMotion = Pick->FirstMotion;
+
+/* Convert julian seconds to date and time.
+   Round pick time to nearest hundred'th
+   of a second.
+   ***************************************/
+   datime( Pick->time, &g );
+   tsec = (int)floor( (double) g.second );
+   thun = (int)((100.*(g.second - tsec)) + 0.5);
+   if ( thun == 100 )
+      tsec++, thun = 0;
+
+/* First motions aren't allowed to be blank
+   ****************************************/
+   if ( firstMotion == ' ' ) firstMotion = '?';
+
+/* Convert pick to space-delimited text string.
+   Milliseconds are always set to zero.
+   ********************************************/
+   sprintf( line,              "%d",  (int) Ewh->TypePickScnl );
+   sprintf( line+strlen(line), " %d", (int) Gparm->MyModId );
+   sprintf( line+strlen(line), " %d", (int) Ewh->MyInstId );
+   sprintf( line+strlen(line), " %d", PickIndex );
+   sprintf( line+strlen(line), " %s", Sta->sta );
+   sprintf( line+strlen(line), ".%s", Sta->chan );
+   sprintf( line+strlen(line), ".%s", Sta->net );
+   sprintf( line+strlen(line), ".%s", Sta->loc );
+
+   sprintf( line+strlen(line), " %c%d", firstMotion, Pick->weight );
+
+   sprintf( line+strlen(line), " %4d%02d%02d%02d%02d%02d.%02d0",
+            g.year, g.month, g.day, g.hour, g.minute, tsec, thun );
+
+   sprintf( line+strlen(line), " %d", (int)(Pick->xpk[0] + 0.5) );
+   sprintf( line+strlen(line), " %d", (int)(Pick->xpk[1] + 0.5) );
+   sprintf( line+strlen(line), " %d", (int)(Pick->xpk[2] + 0.5) );
+   strcat( line, "\n" );
+   return (int) strlen( line );
+}
+
+
+     /**************************************************************
+      *     RefFormatCoda() - Old TYPE_CODA_SCNL line, sprintf()   *
+      **************************************************************/
+
+int RefFormatCoda( char *line, CODA *Coda, GPARM *Gparm, EWH *Ewh )
+{
+   sprintf( line,              "%d",  (int) Ewh->TypeCodaScnl );
+   sprintf( line+strlen(line), " %d", (int) Gparm->MyModId );
+   sprintf( line+strlen(line), " %d", (int) Ewh->MyInstId );
+   sprintf( line+strlen(line), " %d", Coda->PickIndex );
+   sprintf( line+strlen(line), " %s", Coda->sta );
+   sprintf( line+strlen(line), ".%s", Coda->chan );
+   sprintf( line+strlen(line), ".%s", Coda->net );
+   sprintf( line+strlen(line), ".%s", Coda->loc );
+   sprintf( line+strlen(line), " %d", Coda->aav[0] );
+   sprintf( line+strlen(line), " %d", Coda->aav[1] );
+   sprintf( line+strlen(line), " %d", Coda->aav[2] );
+   sprintf( line+strlen(line), " %d", Coda->aav[3] );
+   sprintf( line+strlen(line), " %d", Coda->aav[4] );
+   sprintf( line+strlen(line), " %d", Coda->aav[5] );
+   sprintf( line+strlen(line), " %d", Coda->len_out );
+   strcat( line, "\n" );
+   return (int) strlen( line );
+}
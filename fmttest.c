@@ -0,0 +1,220 @@
+  /**********************************************************************
+   *                              fmttest.c                             *
+   *                                                                    *
+   *         Golden-output test of the pick and coda formatters         *
+   *                                                                    *
+   *  Formats the same picks and codas with FormatPick()/FormatCoda()   *
+   *  (format.c) and with the old sprintf() code (fmtref.c), and        *
+   *  compares the bytes.  A fixed list of edge cases is run first:     *
+   *  INT_MIN and INT_MAX, negative and half-way amplitudes, blank      *
+   *  first motions and times that round up to the next second, minute *
+   *  or year.  Then random ones, from a fixed seed so a failure can    *
+   *  be repeated.  Prints the first difference and exits with status   *
+   *  1 if any message differs.                                         *
+   *                                                                    *
+   *  Usage:  fmttest [number of random messages, default 1000000]      *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <earthworm.h>
+#include <chron3.h>
+#include <transport.h>
+#include "nn_pick_ew.h"
+
+/* Function prototypes
+   *******************/
+int FormatPick( char *, int, PICK *, int, STATION *, GPARM *, EWH * );  /* format.c */
+int FormatCoda( char *, int, CODA *, GPARM *, EWH * );
+int RefFormatPick( char *, PICK *, int, STATION *, GPARM *, EWH * );    /* fmtref.c */
+int RefFormatCoda( char *, CODA *, GPARM *, EWH * );
+static unsigned int Rand( void );
+static int    RandInt( void );
+static double RandAmp( void );
+static void   RandName( char *, int, int );
+static int    CheckPick( PICK *, int, STATION *, GPARM *, EWH * );
+static int    CheckCoda( CODA *, GPARM *, EWH * );
+
+static unsigned long long Seed = 20261018ULL;
+static long nChecked = 0;
+
+/* Edge cases
+   **********/
+static const int EdgeInt[] = { 0, 1, -1, 9, 10, -10, 99999, INT_MAX, INT_MIN,
+                               INT_MIN + 1, 1000000000, -999999999 };
+static const double EdgeAmp[] = { 0., 0.49999, 0.5, -0.5, -0.49, -0.51, 1.5, -1.5,
+                                  2147483646.4, -2147483647.9, 123456.789 };
+static const double EdgeTime[] = { 0., 0.004999, 0.995, 59.995, 3599.996,
+                                   86399.9951, 946684799.995,
+                                   1700000000.125, 1700000000.135, 4102444799.999 };
+
+
+int main( int argc, char *argv[] )
+{
+   STATION Sta;
+   GPARM   Gparm;
+   EWH     Ewh;
+   PICK    Pick;
+   CODA    Coda;
+   long    nrand = (argc > 1) ? atol( argv[1] ) : 1000000L;
+   long    n;
+   int     i, j;
+   int     nbad = 0;
+
+   memset( &Sta,   0, sizeof(Sta) );
+   memset( &Gparm, 0, sizeof(Gparm) );
+   memset( &Ewh,   0, sizeof(Ewh) );
+   memset( &Pick,  0, sizeof(Pick) );
+   memset( &Coda,  0, sizeof(Coda) );
+
+/* Edge cases, one field at a time
+   *******************************/
+   strcpy( Sta.sta, "STA01" );  strcpy( Sta.chan, "HHZ" );
+   strcpy( Sta.net, "NC" );     strcpy( Sta.loc, "--" );
+   strcpy( Coda.sta, "STA01" ); strcpy( Coda.chan, "HHZ" );
+   strcpy( Coda.net, "NC" );    strcpy( Coda.loc, "--" );
+   Ewh.TypePickScnl = 8;  Ewh.TypeCodaScnl = 9;  Ewh.MyInstId = 255;
+   Gparm.MyModId = 0;
+   Pick.time = GSEC1970 + 1700000000.;
+   Pick.FirstMotion = ' ';
+
+   for ( i = 0; i < (int) (sizeof(EdgeInt) / sizeof(int)); i++ )
+   {
+      nbad += CheckPick( &Pick, EdgeInt[i], &Sta, &Gparm, &Ewh );
+      for ( j = 0; j < 6; j++ ) Coda.aav[j] = EdgeInt[(i + j) % 12];
+      Coda.len_out   = -EdgeInt[i] / 2;
+      Coda.PickIndex = EdgeInt[i];
+      nbad += CheckCoda( &Coda, &Gparm, &Ewh );
+   }
+   for ( i = 0; i < (int) (sizeof(EdgeAmp) / sizeof(double)); i++ )
+   {
+      for ( j = 0; j < 3; j++ ) Pick.xpk[j] = EdgeAmp[(i + j) % 11];
+      Pick.FirstMotion = "U D?"[i % 4];
+      Pick.weight = i % 5;
+      nbad += CheckPick( &Pick, i, &Sta, &Gparm, &Ewh );
+   }
+   for ( i = 0; i < (int) (sizeof(EdgeTime) / sizeof(double)); i++ )
+   {
+      Pick.time = GSEC1970 + EdgeTime[i];
+      nbad += CheckPick( &Pick, i, &Sta, &Gparm, &Ewh );
+   }
+
+/* Random picks and codas
+   **********************/
+   for ( n = 0; (n < nrand) && (nbad == 0); n++ )
+   {
+      RandName( Sta.sta,  1, 5 );
+      RandName( Sta.chan, 3, 3 );
+      RandName( Sta.net,  2, 2 );
+      RandName( Sta.loc,  2, 2 );
+      Ewh.TypePickScnl = (unsigned char) Rand();
+      Ewh.TypeCodaScnl = (unsigned char) Rand();
+      Ewh.MyInstId     = (unsigned char) Rand();
+      Gparm.MyModId    = (unsigned char) Rand();
+      Pick.FirstMotion = " UD?"[Rand() % 4];
+      Pick.weight      = (Rand() % 8 == 0) ? RandInt() : (int) (Rand() % 5);
+      Pick.time        = GSEC1970 + (Rand() % 2000000000u) + (Rand() % 100000) / 1.e5;
+      for ( j = 0; j < 3; j++ ) Pick.xpk[j] = RandAmp();
+      nbad += CheckPick( &Pick, RandInt(), &Sta, &Gparm, &Ewh );
+
+      strcpy( Coda.sta,  Sta.sta );
+      strcpy( Coda.chan, Sta.chan );
+      strcpy( Coda.net,  Sta.net );
+      strcpy( Coda.loc,  Sta.loc );
+      Coda.PickIndex = RandInt();
+      for ( j = 0; j < 6; j++ ) Coda.aav[j] = RandInt();
+      Coda.len_out = (Rand() % 4 == 0) ? RandInt() : (int) (Rand() % 289) - 144;
+      nbad += CheckCoda( &Coda, &Gparm, &Ewh );
+   }
+
+   printf( "fmttest: %ld messages compared, %d differ\n", nChecked, nbad );
+   return (nbad == 0) ? 0 : 1;
+}
+
+
+/* Format a pick both ways and compare.  Returns 1 if they differ.
+   ***************************************************************/
+static int CheckPick( PICK *Pick, int PickIndex, STATION *Sta, GPARM *Gparm, EWH *Ewh )
+{
+   char ref[LINELEN * 2], got[LINELEN];
+   int  nref, ngot;
+
+   nref = RefFormatPick( ref, Pick, PickIndex, Sta, Gparm, Ewh );
+   ngot = FormatPick( got, LINELEN, Pick, PickIndex, Sta, Gparm, Ewh );
+   nChecked++;
+   if ( (ngot == nref) && (memcmp( ref, got, nref + 1 ) == 0) ) return 0;
+
+   printf( "fmttest: pick differs\n  old (%d): %s  new (%d): %s", nref, ref, ngot,
+           (ngot < 0) ? "(didn't fit)\n" : got );
+   return 1;
+}
+
+
+/* Format a coda both ways and compare.  Returns 1 if they differ.
+   ***************************************************************/
+static int CheckCoda( CODA *Coda, GPARM *Gparm, EWH *Ewh )
+{
+   char ref[LINELEN * 2], got[LINELEN];
+   int  nref, ngot;
+
+   nref = RefFormatCoda( ref, Coda, Gparm, Ewh );
+   ngot = FormatCoda( got, LINELEN, Coda, Gparm, Ewh );
+   nChecked++;
+   if ( (ngot == nref) && (memcmp( ref, got, nref + 1 ) == 0) ) return 0;
+
+   printf( "fmttest: coda differs\n  old (%d): %s  new (%d): %s", nref, ref, ngot,
+           (ngot < 0) ? "(didn't fit)\n" : got );
+   return 1;
+}
+
+
+/* 32 random bits (64-bit linear congruential generator)
+   *****************************************************/
+static unsigned int Rand( void )
+{
+   Seed = Seed * 6364136223846793005ULL + 1442695040888963407ULL;
+   return (unsigned int) (Seed >> 32);
+}
+
+
+/* A random int: any value, or one of a few digits, or an edge
+   ************************************************************/
+static int RandInt( void )
+{
+   switch ( Rand() % 4 )
+   {
+      case 0:  return (int) Rand();
+      case 1:  return (int) (Rand() % 2001) - 1000;
+      case 2:  return EdgeInt[Rand() % 12];
+      default: return (int) (Rand() % 100000);
+   }
+}
+
+
+/* A random amplitude whose rounding stays in the range of an int
+   **************************************************************/
+static double RandAmp( void )
+{
+   switch ( Rand() % 3 )
+   {
+      case 0:  return (Rand() % 200000) / 100. - 1000.;
+      case 1:  return (double) (int) Rand() / 2. + (Rand() % 2) * 0.5;
+      default: return EdgeAmp[Rand() % 11];
+   }
+}
+
+
+/* A random SCNL field of min to max letters and digits
+   ****************************************************/
+static void RandName( char *s, int min, int max )
+{
+   static const char c[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-";
+   int n = min + (int) (Rand() % (max - min + 1));
+   int i;
+
+   for ( i = 0; i < n; i++ )
+      s[i] = c[Rand() % (sizeof(c) - 1)];
+   s[n] = '\0';
+}
@@ -0,0 +1,280 @@
+  /**********************************************************************
+   *                              format.c                              *
+   *                                                                    *
+   *             Pick and coda message formatting functions             *
+   *                                                                    *
+   *  This file contains functions FormatPick(), FormatCoda(),          *
+   *  FormatRetract() and FormatAmp().                                  *
+   *                                                                    *
+   *  Each message is written left to right in one pass into a buffer   *
+   *  supplied by the caller.  Integers are converted by hand, so the   *
+   *  output doesn't depend on the locale and no static storage is      *
+   *  used.  The text is byte-for-byte what the old sprintf() calls     *
+   *  produced.  The functions return the length of the message, or     *
+   *  -1 if it doesn't fit in the buffer.                               *
+   **********************************************************************/
+
+#include <math.h>
+#include <string.h>
+#include <earthworm.h>
+#include <chron3.h>
+#include <transport.h>
+#include "nn_pick_ew.h"
+
+typedef struct {
+   char *p;                 /* Next free byte */
+   char *end;               /* One past the last usable byte */
+   int  err;                /* 1 if the buffer overflowed */
+} OUTBUF;
+
+static void PutChar( OUTBUF *, char );
+static void PutStr( OUTBUF *, const char * );
+static void PutInt( OUTBUF *, int, int, char );
+static void PutTime( OUTBUF *, double );
+static void PutHun( OUTBUF *, double );
+
+
+     /**************************************************************
+      *          FormatPick() - Format one TYPE_PICK_SCNL line     *
+      **************************************************************/
+
+int FormatPick( char *buf, int buflen, PICK *Pick, int PickIndex, STATION *Sta,
+                GPARM *Gparm, EWH *Ewh )
+{
+   OUTBUF      out;
+   char        firstMotion = Pick->FirstMotion;
+
+/* First motions aren't allowed to be blank
+   ****************************************/
+   if ( firstMotion == ' ' ) firstMotion = '?';
+
+/* Milliseconds are always set to zero.
+   ************************************/
+   out.p   = buf;
+   out.end = buf + buflen - 1;         /* Room for the terminating null */
+   out.err = 0;
+
+   PutInt( &out, (int) Ewh->TypePickScnl, 0, ' ' );
+   PutChar( &out, ' ' );  PutInt( &out, (int) Gparm->MyModId, 0, ' ' );
+   PutChar( &out, ' ' );  PutInt( &out, (int) Ewh->MyInstId, 0, ' ' );
+   PutChar( &out, ' ' );  PutInt( &out, PickIndex, 0, ' ' );
+   PutChar( &out, ' ' );  PutStr( &out, Sta->sta );
+   PutChar( &out, '.' );  PutStr( &out, Sta->chan );
+   PutChar( &out, '.' );  PutStr( &out, Sta->net );
+   PutChar( &out, '.' );  PutStr( &out, Sta->loc );
+   PutChar( &out, ' ' );  PutChar( &out, firstMotion );
+   PutInt( &out, Pick->weight, 0, ' ' );
+   PutChar( &out, ' ' );  PutTime( &out, Pick->time );
+   PutChar( &out, '0' );
+   PutChar( &out, ' ' );  PutInt( &out, (int)(Pick->xpk[0] + 0.5), 0, ' ' );
+   PutChar( &out, ' ' );  PutInt( &out, (int)(Pick->xpk[1] + 0.5), 0, ' ' );
+   PutChar( &out, ' ' );  PutInt( &out, (int)(Pick->xpk[2] + 0.5), 0, ' ' );
+   PutChar( &out, '\n' );
+
+   if ( out.err ) return -1;
+   *out.p = '\0';
+   return (int)(out.p - buf);
+}
+
+
+     /**************************************************************
+      *          FormatCoda() - Format one TYPE_CODA_SCNL line     *
+      **************************************************************/
+
+int FormatCoda( char *buf, int buflen, CODA *Coda, GPARM *Gparm, EWH *Ewh )
+{
+   OUTBUF out;
+   int    i;
+
+   out.p   = buf;
+   out.end = buf + buflen - 1;
+   out.err = 0;
+
+   PutInt( &out, (int) Ewh->TypeCodaScnl, 0, ' ' );
+   PutChar( &out, ' ' );  PutInt( &out, (int) Gparm->MyModId, 0, ' ' );
+   PutChar( &out, ' ' );  PutInt( &out, (int) Ewh->MyInstId, 0, ' ' );
+   PutChar( &out, ' ' );  PutInt( &out, Coda->PickIndex, 0, ' ' );
+   PutChar( &out, ' ' );  PutStr( &out, Coda->sta );
+   PutChar( &out, '.' );  PutStr( &out, Coda->chan );
+   PutChar( &out, '.' );  PutStr( &out, Coda->net );
+   PutChar( &out, '.' );  PutStr( &out, Coda->loc );
+   for ( i = 0; i < 6; i++ )
+   {
+      PutChar( &out, ' ' );  PutInt( &out, Coda->aav[i], 0, ' ' );
+   }
+   PutChar( &out, ' ' );  PutInt( &out, Coda->len_out, 0, ' ' );
+   PutChar( &out, '\n' );
+
+   if ( out.err ) return -1;
+   *out.p = '\0';
+   return (int)(out.p - buf);
+}
+
+
+     /**************************************************************
+      *     FormatRetract() - Format one retracted-pick line       *
+      *                                                            *
+      *  The pick index and SCNL of an EarlyPick whose coda was    *
+      *  too short, in the layout of the start of a pick line.     *
+      **************************************************************/
+
+int FormatRetract( char *buf, int buflen, CODA *Coda, GPARM *Gparm, EWH *Ewh )
+{
+   OUTBUF out;
+
+   out.p   = buf;
+   out.end = buf + buflen - 1;
+   out.err = 0;
+
+   PutInt( &out, (int) Ewh->TypePickRetract, 0, ' ' );
+   PutChar( &out, ' ' );  PutInt( &out, (int) Gparm->MyModId, 0, ' ' );
+   PutChar( &out, ' ' );  PutInt( &out, (int) Ewh->MyInstId, 0, ' ' );
+   PutChar( &out, ' ' );  PutInt( &out, Coda->PickIndex, 0, ' ' );
+   PutChar( &out, ' ' );  PutStr( &out, Coda->sta );
+   PutChar( &out, '.' );  PutStr( &out, Coda->chan );
+   PutChar( &out, '.' );  PutStr( &out, Coda->net );
+   PutChar( &out, '.' );  PutStr( &out, Coda->loc );
+   PutChar( &out, '\n' );
+
+   if ( out.err ) return -1;
+   *out.p = '\0';
+   return (int)(out.p - buf);
+}
+
+
+     /**************************************************************
+      *       FormatAmp() - Format one peak-amplitude line         *
+      *                                                            *
+      *  The pick index and SCNL, the raw amplitude (counts) and   *
+      *  period (s), the Wood-Anderson amplitude and period, and   *
+      *  the time of the Wood-Anderson peak.                       *
+      **************************************************************/
+
+int FormatAmp( char *buf, int buflen, AMPSTATE *Amp, int PickIndex, STATION *Sta,
+               GPARM *Gparm, EWH *Ewh )
+{
+   OUTBUF out;
+
+   out.p   = buf;
+   out.end = buf + buflen - 1;
+   out.err = 0;
+
+   PutInt( &out, (int) Ewh->TypePickAmp, 0, ' ' );
+   PutChar( &out, ' ' );  PutInt( &out, (int) Gparm->MyModId, 0, ' ' );
+   PutChar( &out, ' ' );  PutInt( &out, (int) Ewh->MyInstId, 0, ' ' );
+   PutChar( &out, ' ' );  PutInt( &out, PickIndex, 0, ' ' );
+   PutChar( &out, ' ' );  PutStr( &out, Sta->sta );
+   PutChar( &out, '.' );  PutStr( &out, Sta->chan );
+   PutChar( &out, '.' );  PutStr( &out, Sta->net );
+   PutChar( &out, '.' );  PutStr( &out, Sta->loc );
+   PutChar( &out, ' ' );  PutHun( &out, 0.5 * Amp->raw.pp );
+   PutChar( &out, ' ' );  PutHun( &out, Amp->raw.per );
+   PutChar( &out, ' ' );  PutHun( &out, 0.5 * Amp->wa.pp );
+   PutChar( &out, ' ' );  PutHun( &out, Amp->wa.per );
+   PutChar( &out, ' ' );  PutTime( &out, Amp->tstart + Amp->wa.ipk / Amp->samprate );
+   PutChar( &out, '\n' );
+
+   if ( out.err ) return -1;
+   *out.p = '\0';
+   return (int)(out.p - buf);
+}
+
+
+/* Append one character
+   ********************/
+static void PutChar( OUTBUF *out, char c )
+{
+   if ( out->p < out->end )
+      *out->p++ = c;
+   else
+      out->err = 1;
+}
+
+
+/* Append a null-terminated string
+   *******************************/
+static void PutStr( OUTBUF *out, const char *s )
+{
+   while ( *s != '\0' )
+   {
+      if ( out->p >= out->end )
+      {
+         out->err = 1;
+         return;
+      }
+      *out->p++ = *s++;
+   }
+}
+
+
+/* Append an integer, as printf's "%<width>d" (pad ' ')
+   or "%0<width>d" (pad '0') would
+   ****************************************************/
+static void PutInt( OUTBUF *out, int value, int width, char pad )
+{
+   char         digits[12];
+   int          ndig = 0;
+   int          neg  = (value < 0);
+   unsigned int u    = neg ? 0u - (unsigned int) value : (unsigned int) value;
+   int          len;
+
+   do
+   {
+      digits[ndig++] = (char)('0' + u % 10);
+      u /= 10;
+   } while ( u != 0 );
+
+   len = ndig + neg;
+   if ( out->end - out->p < ((width > len) ? width : len) )
+   {
+      out->err = 1;
+      return;
+   }
+
+   if ( pad == ' ' )
+      for ( ; len < width; len++ ) *out->p++ = ' ';
+   if ( neg ) *out->p++ = '-';
+   if ( pad == '0' )
+      for ( ; len < width; len++ ) *out->p++ = '0';
+   while ( ndig > 0 )
+      *out->p++ = digits[--ndig];
+}
+
+
+/* Append julian seconds as yyyymmddhhmmss.ss,
+   rounded to the nearest hundredth of a second
+   ********************************************/
+static void PutTime( OUTBUF *out, double t )
+{
+   struct Greg g;
+   int         tsec, thun;
+
+   datime( t, &g );
+   tsec = (int)floor( (double) g.second );
+   thun = (int)((100.*(g.second - tsec)) + 0.5);
+   if ( thun == 100 )
+      tsec++, thun = 0;
+
+   PutInt( out, g.year,   4, ' ' );
+   PutInt( out, g.month,  2, '0' );
+   PutInt( out, g.day,    2, '0' );
+   PutInt( out, g.hour,   2, '0' );
+   PutInt( out, g.minute, 2, '0' );
+   PutInt( out, tsec,     2, '0' );
+   PutChar( out, '.' );  PutInt( out, thun, 2, '0' );
+}
+
+
+/* Append a value >= 0 with two decimals, as "%.2lf"
+   would.  Values too big for an int are capped.
+   *************************************************/
+static void PutHun( OUTBUF *out, double x )
+{
+   double h = floor( 100. * x + 0.5 );
+
+   if ( !(h >= 0.) ) h = 0.;
+   if ( h > 2147483647. ) h = 2147483647.;
+   PutInt( out, (int) (h / 100.), 0, ' ' );
+   PutChar( out, '.' );
+   PutInt( out, (int) fmod( h, 100. ), 2, '0' );
+}
@@ -0,0 +1,437 @@
+  /**********************************************************************
+   *                               gap.c                                *
+   *                                                                    *
+   *            Gap reporting and the channel restart table             *
+   *                                                                    *
+   *  This file contains functions ReportGap(), GapSummary(),           *
+   *  InitRestartTable(), UpdateRestartTable(), GetRestartState() and   *
+   *  StopRestartTable().                                               *
+   *                                                                    *
+   *  With GapReportInt set to 0, every gap over MaxGap is announced    *
+   *  with its own TYPE_ERROR message, as before.  Otherwise gaps are   *
+   *  only counted per channel, and every GapReportInt seconds one      *
+   *  summary message gives the number of gaps, channels and missing   *
+   *  samples.  The per-channel counts go to the log file.  Channels    *
+   *  added by AutoRegister are counted with the station list's.        *
+   *                                                                    *
+   *  At the same interval the picking thread copies the restart state  *
+   *  and gap counts of every channel, the auto channels included,      *
+   *  into the restart table, which GetRestartState() looks up.  If     *
+   *  RestartFile is set, a writer thread writes each new copy of the   *
+   *  table to that file, so the picking thread never waits for the     *
+   *  disk.                                                             *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <earthworm.h>
+#include <transport.h>
+#include "nn_pick_ew.h"
+
+#define THREAD_STACK  65536
+
+typedef struct {                     /* Gap summary over the channels */
+   int     nchan;                    /* Channels with gaps */
+   int     ngap;                     /* Gaps on all channels */
+   double  nmiss;                    /* Samples missing on all channels */
+   STATION *worst;                   /* Channel with the most gaps */
+   int     interval;                 /* GapReportInt */
+} GAPSUM;
+
+static RESTARTSTATE *Table = NULL;   /* Restart table, guarded by TableMutex */
+static int     nTable  = 0;          /* Channels in the table */
+static int     maxTable = 0;         /* Channels allocated */
+static time_t  tTable;               /* When the table was updated */
+static int     Dirty = 0;            /* Updated since last written */
+static int     RestartLength;
+static char    *RestartFile = NULL;
+static mutex_t TableMutex;
+static int     HaveTable = 0;        /* InitRestartTable() was called */
+static int     TableShort = 0;       /* Table couldn't grow for all channels */
+static volatile int Stop    = 0;     /* Set to ask the writer to quit */
+static volatile int Running = 0;     /* Set while the writer runs */
+static ew_thread_t  WriterTid;
+
+/* Function prototypes
+   *******************/
+int  PutOutMsg( MSG_LOGO *, int, long, char * );   /* function in outqueue.c */
+void PinThread( int );                             /* function in placement.c */
+void ForEachAutoStation( void (*)( STATION *, void * ), void * );  /* in autosta.c */
+static void    SumGaps( STATION *, void * );
+static void    ClearGaps( STATION *, void * );
+static void    AddRestart( STATION *, void * );
+static void    SendError( char *, GPARM *, EWH * );
+static void    WriteRestartFile( RESTARTSTATE *, int, time_t );
+static thr_ret RestartWriter( void * );
+
+
+  /***************************************************************
+   *                          ReportGap()                        *
+   *                                                             *
+   *  Count one gap of GapSize samples on a channel.             *
+   ***************************************************************/
+
+void ReportGap( STATION *Sta, int GapSize, GPARM *Gparm, EWH *Ewh )
+{
+   time_t now;
+
+   time( &now );
+   Sta->Gap->ngap++;
+   Sta->Gap->nmiss += GapSize - 1;
+   Sta->Gap->ngap_total++;
+   Sta->Gap->nmiss_total += GapSize - 1;
+   Sta->Gap->lastgap = (double) now;
+
+/* Announce the gap right away
+   ***************************/
+   if ( Gparm->GapReportInt == 0 )
+   {
+      char errmsg[80];
+
+      sprintf( errmsg,
+            "%ld %d Found %4d sample gap. Restarting channel %s.%s.%s.%s\n",
+            (long) now, PK_RESTART, GapSize, Sta->sta, Sta->chan, Sta->net, Sta->loc );
+      SendError( errmsg, Gparm, Ewh );
+   }
+}
+
+
+  /***************************************************************
+   *                          GapSummary()                       *
+   *                                                             *
+   *  Log the gaps counted since the last summary, send one      *
+   *  summary error message and clear the interval counts.       *
+   ***************************************************************/
+
+void GapSummary( STATION *StaArray, int Nsta, GPARM *Gparm, EWH *Ewh )
+{
+   int     i;
+   GAPSUM  sum;
+   time_t  now;
+   char    errmsg[256];
+
+   if ( Gparm->GapReportInt == 0 ) return;
+
+   memset( &sum, 0, sizeof(sum) );
+   sum.interval = Gparm->GapReportInt;
+   for ( i = 0; i < Nsta; i++ )
+      SumGaps( &StaArray[i], &sum );
+   ForEachAutoStation( SumGaps, &sum );
+   if ( sum.nchan == 0 ) return;
+
+   time( &now );
+   sprintf( errmsg, "%ld %d %d sample gaps (%.0lf samples) on %d channels in %d s; "
+            "most on %s.%s.%s.%s (%d). Channels restarted.\n",
+            (long) now, PK_RESTART, sum.ngap, sum.nmiss, sum.nchan, Gparm->GapReportInt,
+            sum.worst->sta, sum.worst->chan, sum.worst->net, sum.worst->loc,
+            sum.worst->Gap->ngap );
+   SendError( errmsg, Gparm, Ewh );
+
+   for ( i = 0; i < Nsta; i++ )
+      ClearGaps( &StaArray[i], NULL );
+   ForEachAutoStation( ClearGaps, NULL );
+}
+
+
+  /***************************************************************
+   *                      InitRestartTable()                     *
+   *                                                             *
+   *  Set up the restart table, and start the thread that        *
+   *  writes it to RestartFile, if there is one.                 *
+   ***************************************************************/
+
+void InitRestartTable( GPARM *Gparm )
+{
+   RestartLength = Gparm->RestartLength;
+   RestartFile   = Gparm->RestartFile;
+   CreateSpecificMutex( &TableMutex );
+   HaveTable = 1;
+
+   if ( RestartFile == NULL ) return;
+
+   Stop = 0;
+   Running = 1;
+   if ( StartThreadWithArg( RestartWriter, NULL, (unsigned) THREAD_STACK, &WriterTid ) == -1 )
+   {
+      logit( "et", "pick_ew: Cannot start the restart file thread; "
+             "no restart file\n" );
+      Running = 0;
+   }
+}
+
+
+  /***************************************************************
+   *                     UpdateRestartTable()                    *
+   *                                                             *
+   *  Copy the restart state of every channel into the restart   *
+   *  table.  Called by the picking thread; doesn't touch the    *
+   *  disk.                                                      *
+   ***************************************************************/
+
+void UpdateRestartTable( STATION *StaArray, int Nsta )
+{
+   int i;
+   int lost;
+
+   if ( !HaveTable ) return;
+
+   RequestSpecificMutex( &TableMutex );
+   nTable     = 0;
+   TableShort = 0;
+   for ( i = 0; i < Nsta; i++ )
+      AddRestart( &StaArray[i], NULL );
+   ForEachAutoStation( AddRestart, NULL );
+   lost = TableShort;
+   time( &tTable );
+   Dirty = 1;
+   ReleaseSpecificMutex( &TableMutex );
+
+   if ( lost > 0 )
+      logit( "et", "pick_ew: Cannot grow the restart table; %d channels left out.\n",
+             lost );
+}
+
+
+  /***************************************************************
+   *                       GetRestartState()                     *
+   *                                                             *
+   *  Copy one channel's entry of the restart table, as of the   *
+   *  last UpdateRestartTable().  Thread safe.  Returns -1 if    *
+   *  the channel isn't in the table.                            *
+   ***************************************************************/
+
+int GetRestartState( char *sta, char *chan, char *net, char *loc, RESTARTSTATE *rs )
+{
+   int i;
+   int rc = -1;
+
+   if ( !HaveTable ) return -1;
+
+   RequestSpecificMutex( &TableMutex );
+   for ( i = 0; i < nTable; i++ )
+      if ( (strcmp( Table[i].sta,  sta  ) == 0) &&
+           (strcmp( Table[i].chan, chan ) == 0) &&
+           (strcmp( Table[i].net,  net  ) == 0) &&
+           (strcmp( Table[i].loc,  loc  ) == 0) )
+      {
+         *rs = Table[i];
+         rc  = 0;
+         break;
+      }
+   ReleaseSpecificMutex( &TableMutex );
+   return rc;
+}
+
+
+  /***************************************************************
+   *                      StopRestartTable()                     *
+   *                                                             *
+   *  Let the writer thread write the last table and exit,       *
+   *  waiting up to a few seconds for it.                        *
+   ***************************************************************/
+
+void StopRestartTable( void )
+{
+   int i;
+
+   if ( !HaveTable ) return;
+
+   if ( Running )
+   {
+      Stop = 1;
+      for ( i = 0; (i < 500) && Running; i++ )
+         sleep_ew( 10 );
+      if ( Running )
+      {
+         logit( "et", "pick_ew: Restart file thread didn't stop; killing it.\n" );
+         KillThread( WriterTid );
+         Running = 0;
+         HaveTable = 0;
+         return;
+      }
+   }
+   CloseSpecificMutex( &TableMutex );
+   free( Table );
+   Table = NULL;
+   nTable = maxTable = 0;
+   HaveTable = 0;
+}
+
+
+/* Write a copy of the restart table to RestartFile.  The
+   file is written under a temporary name and renamed, so
+   readers never see a partial table.
+   ******************************************************/
+static void WriteRestartFile( RESTARTSTATE *rs, int n, time_t t )
+{
+   static const char *StateName[] = { "nodata", "restart", "picking" };
+   char tmpname[1024];
+   FILE *fp;
+   int  i;
+
+   sprintf( tmpname, "%.1000s.tmp", RestartFile );
+   if ( (fp = fopen( tmpname, "w" )) == NULL )
+   {
+      logit( "et", "pick_ew: Error opening restart file <%s>.\n", tmpname );
+      return;
+   }
+
+   fprintf( fp, "# %ld  RestartLength %d\n", (long) t, RestartLength );
+   fprintf( fp, "# scnl state samples_since_restart gaps missing_samples last_gap\n" );
+   for ( i = 0; i < n; i++ )
+      fprintf( fp, "%s.%s.%s.%s %s %d %d %.0lf %.0lf\n",
+               rs[i].sta, rs[i].chan, rs[i].net, rs[i].loc, StateName[rs[i].state],
+               rs[i].ns_restart, rs[i].ngap_total, rs[i].nmiss_total, rs[i].lastgap );
+   fclose( fp );
+
+#if defined(_WINNT)
+   remove( RestartFile );
+#endif
+   if ( rename( tmpname, RestartFile ) != 0 )
+      logit( "et", "pick_ew: Error renaming <%s> to <%s>.\n", tmpname, RestartFile );
+}
+
+
+/* The restart file thread.  Copies the table each time the
+   picking thread updates it, and writes the copy to the file.
+   When asked to stop, writes the last update first.
+   ***********************************************************/
+static thr_ret RestartWriter( void *arg )
+{
+   RESTARTSTATE *copy = NULL;
+   int          maxcopy = 0;
+
+   (void) arg;
+   PinThread( THR_PUBLISHER );
+
+   while ( 1 )
+   {
+      int    n = 0;
+      int    stopping = Stop;
+      int    dirty;
+      time_t t = 0;
+
+      RequestSpecificMutex( &TableMutex );
+      dirty = Dirty;
+      if ( dirty )
+      {
+         if ( nTable > maxcopy )
+         {
+            RESTARTSTATE *c = (RESTARTSTATE *) realloc( copy, nTable * sizeof(RESTARTSTATE) );
+
+            if ( c != NULL )
+            {
+               copy    = c;
+               maxcopy = nTable;
+            }
+         }
+         if ( nTable <= maxcopy )
+         {
+            n = nTable;
+            t = tTable;
+            if ( n > 0 ) memcpy( copy, Table, n * sizeof(RESTARTSTATE) );
+            Dirty = 0;
+         }
+         else
+            dirty = 0;                        /* Out of memory; try again */
+      }
+      ReleaseSpecificMutex( &TableMutex );
+
+      if ( dirty )
+         WriteRestartFile( copy, n, t );
+      else if ( stopping )
+         break;
+      else
+         sleep_ew( 100 );
+   }
+
+   free( copy );
+   Running = 0;
+   return THR_NULL_RET;
+}
+
+
+/* Add a channel's gaps to a summary, and log them
+   ***********************************************/
+static void SumGaps( STATION *Sta, void *arg )
+{
+   GAPSUM *sum = (GAPSUM *) arg;
+
+   if ( Sta->Gap->ngap == 0 ) return;
+
+   if ( sum->nchan++ == 0 )
+      logit( "t", "pick_ew: Gaps > MaxGap in the last %d s:\n", sum->interval );
+   logit( "", "   %s.%s.%s.%s  %d gaps  %.0lf samples\n",
+          Sta->sta, Sta->chan, Sta->net, Sta->loc, Sta->Gap->ngap, Sta->Gap->nmiss );
+
+   sum->ngap  += Sta->Gap->ngap;
+   sum->nmiss += Sta->Gap->nmiss;
+   if ( (sum->worst == NULL) || (Sta->Gap->ngap > sum->worst->Gap->ngap) )
+      sum->worst = Sta;
+}
+
+
+/* Start a channel's gap counts over
+   *********************************/
+static void ClearGaps( STATION *Sta, void *arg )
+{
+   (void) arg;
+   Sta->Gap->ngap  = 0;
+   Sta->Gap->nmiss = 0.;
+}
+
+
+/* Copy a channel's restart state to the end of the
+   table, growing it if need be.  Called with
+   TableMutex held.
+   ************************************************/
+static void AddRestart( STATION *Sta, void *arg )
+{
+   RESTARTSTATE *rs;
+
+   (void) arg;
+   if ( nTable == maxTable )
+   {
+      int          n = (maxTable > 0) ? 2 * maxTable : 256;
+      RESTARTSTATE *t = (RESTARTSTATE *) realloc( Table, n * sizeof(RESTARTSTATE) );
+
+      if ( t == NULL )
+      {
+         TableShort++;
+         return;
+      }
+      Table    = t;
+      maxTable = n;
+   }
+
+   rs = &Table[nTable++];
+   strcpy( rs->sta,  Sta->sta );
+   strcpy( rs->chan, Sta->chan );
+   strcpy( rs->net,  Sta->net );
+   strcpy( rs->loc,  Sta->loc );
+   if ( Sta->first )
+      rs->state = RS_NODATA;
+   else if ( Sta->ns_restart < RestartLength )
+      rs->state = RS_RESTART;
+   else
+      rs->state = RS_PICKING;
+   rs->ns_restart  = Sta->ns_restart;
+   rs->ngap_total  = Sta->Gap->ngap_total;
+   rs->nmiss_total = Sta->Gap->nmiss_total;
+   rs->lastgap     = Sta->Gap->lastgap;
+}
+
+
+/* Send one error message to the output ring
+   *****************************************/
+static void SendError( char *errmsg, GPARM *Gparm, EWH *Ewh )
+{
+   MSG_LOGO logo;
+
+   logo.type   = Ewh->TypeError;
+   logo.mod    = Gparm->MyModId;
+   logo.instid = Ewh->MyInstId;
+   PutOutMsg( &logo, OUT_ERROR, (long) strlen( errmsg ), errmsg );
+}
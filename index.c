@@ -32,59 +32,381 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <earthworm.h>
+#include <transport.h>
+#include "nn_pick_ew.h"
+
+#if defined(_WINNT)
+ #include <windows.h>
+#else
+ #include <sys/types.h>
+ #include <sys/mman.h>
+ #include <fcntl.h>
+ #include <unistd.h>
+#endif
 
   /***************************************************************
-   *                         GetPickIndex()                      *
+   *  Pick indexes are reserved in blocks.  The index file holds  *
+   *  the last index of the reserved block as fixed-width text,   *
+   *  so old tools can still read it with fscanf().  The file is  *
+   *  memory mapped, and normally written by the index thread:   *
+   *  half of a block is used, GetPickIndex() asks for the next   *
+   *  one, and the index thread writes the new block end into     *
+   *  the mapping and flushes it to disk.  The next block is      *
+   *  normally on disk well before its first index is handed      *
+   *  out, so picking doesn't wait for the disk.  If it isn't,    *
+   *  because picks came faster than the flushes, GetPickIndex()  *
+   *  writes and flushes it itself before it returns the index,   *
+   *  and logs that it did.  After a crash the next index is one  *
+   *  past the last reserved block, so no index is reused.  Only  *
+   *  if the flush fails does an index go out that isn't on       *
+   *  disk; these are logged.  GetPickIndex() may be called from  *
+   *  several threads.                                            *
    *                                                             *
-   *           Get initial pick index number from disk file      *
+   *  With ShardCount set, the n'th index of the file becomes     *
+   *  pick id n*ShardCount+ShardId, so the picks of different     *
+   *  shards never share an id.                                   *
    ***************************************************************/
 
-int GetPickIndex( unsigned char modid , char *dir)
+#define INDEX_LEN        11          /* "%10d\n" */
+#define MAX_PICK_INDEX   2147483640  /* Indexes roll over to 0 above this */
+#define THREAD_STACK     65536
+
+static mutex_t IndexMutex;           /* Serializes GetPickIndex(); guards Wanted, Durable */
+static mutex_t FileMutex;            /* Serializes writes to the file; taken first */
+static char   *IndexMap = NULL;      /* Mapped index file */
+static int     LastIndex;            /* Last index handed out */
+static int     Reserved;             /* Last index of the reserved block */
+static int     Wanted;               /* Block end the index thread is to write */
+static int     Durable;              /* Block end known to be on disk */
+static int     Rolled = 0;           /* Set when the indexes roll over, until written */
+static volatile int Stop    = 0;     /* Set to ask the index thread to quit */
+static volatile int Running = 0;     /* Set while the index thread runs */
+static ew_thread_t  IndexTid;
+static unsigned long nSync  = 0;     /* Blocks written by GetPickIndex() */
+static unsigned long nAhead = 0;     /* Indexes handed out that weren't on disk */
+static int     BlockSize;            /* Indexes reserved per disk write */
+static int     ShardId;              /* Pick ids are index*ShardCount+ShardId */
+static int     ShardCount;
+static unsigned char ModId;          /* For log messages */
+#if defined(_WINNT)
+static HANDLE  hIndexFile = INVALID_HANDLE_VALUE;
+static HANDLE  hIndexMap  = NULL;
+#endif
+
+/* Function prototypes
+   *******************/
+void           ClosePickIndex( void );
+void           PinThread( int );              /* function in placement.c */
+static void    ReserveBlock( void );
+static int     FlushBlock( void );
+static int     WriteBlock( int );
+static thr_ret IndexWriter( void * );
+
+
+  /***************************************************************
+   *                        InitPickIndex()                      *
+   *                                                             *
+   *  Read the pick index file and map it into memory.           *
+   *  Returns -1 if an error is encountered.                     *
+   ***************************************************************/
+
+int InitPickIndex( GPARM *Gparm )
 {
-   FILE      *fpIndex;
-   char       fname[1024];        /* Name of pick index file */
-   static int PickIndex = -1;
+   char fname[1024];             /* Name of pick index file */
+   char text[INDEX_LEN + 21];    /* Previous contents of the file */
+   int  nread = 0;
 
 /* Build name of pick index file
    *****************************/
-   if (dir == NULL) 
+   if ( Gparm->PickIndexDir == NULL )
+      sprintf( fname, "pick_ew_%03d.ndx", (int) Gparm->MyModId );
+   else
+      sprintf( fname, "%s/pick_ew_%03d.ndx", Gparm->PickIndexDir,
+               (int) Gparm->MyModId );
+
+   ModId     = Gparm->MyModId;
+   BlockSize = Gparm->PickIndexBlock;
+   ShardId   = Gparm->ShardId;
+   ShardCount = Gparm->ShardCount;
+   LastIndex = -1;
+
+/* Open or create the file, read the last reserved index,
+   and map a fixed-width copy of it into memory
+   ******************************************************/
+#if defined(_WINNT)
    {
-      sprintf( fname, "pick_ew_%03d.ndx", (int) modid );
-   } else {
-      sprintf( fname, "%s/pick_ew_%03d.ndx", dir, (int) modid );
-   }
+      DWORD n = 0;
 
-/* Get initial pick index from file
-   ********************************/
-   if ( PickIndex == -1 )
+      hIndexFile = CreateFile( fname, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+                               NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+      if ( hIndexFile == INVALID_HANDLE_VALUE )
+      {
+         logit( "et", "pick_ew: Error opening pick index file <%s>.\n", fname );
+         return -1;
+      }
+      if ( ReadFile( hIndexFile, text, sizeof(text) - 1, &n, NULL ) )
+         nread = (int) n;
+      SetFilePointer( hIndexFile, INDEX_LEN, NULL, FILE_BEGIN );
+      SetEndOfFile( hIndexFile );
+      hIndexMap = CreateFileMapping( hIndexFile, NULL, PAGE_READWRITE, 0, INDEX_LEN, NULL );
+      if ( hIndexMap != NULL )
+         IndexMap = (char *) MapViewOfFile( hIndexMap, FILE_MAP_WRITE, 0, 0, INDEX_LEN );
+   }
+#else
    {
-      fpIndex = fopen( fname, "r" );        /* Fails if file doesn't exist */
+      int fd;
 
-      if ( fpIndex != NULL )
+      if ( (fd = open( fname, O_RDWR | O_CREAT, 0644 )) == -1 )
       {
-         fscanf( fpIndex, "%d", &PickIndex );
-         fclose( fpIndex );
+         logit( "et", "pick_ew: Error opening pick index file <%s>.\n", fname );
+         return -1;
       }
+      nread = (int) read( fd, text, sizeof(text) - 1 );
+      if ( ftruncate( fd, INDEX_LEN ) == 0 )
+      {
+         IndexMap = (char *) mmap( NULL, INDEX_LEN, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED, fd, 0 );
+         if ( IndexMap == (char *) MAP_FAILED ) IndexMap = NULL;
+      }
+      close( fd );
    }
+#endif
+
+   if ( IndexMap == NULL )
+   {
+      logit( "et", "pick_ew: Cannot map pick index file <%s>.\n", fname );
+      ClosePickIndex();
+      return -1;
+   }
+
+   if ( nread > 0 )
+   {
+      text[nread] = '\0';
+      if ( sscanf( text, "%d", &LastIndex ) != 1 ) LastIndex = -1;
+   }
+   Reserved = Wanted = Durable = LastIndex;
+
+/* The first block is reserved now, before any picks; the
+   index thread reserves the others
+   ******************************************************/
+   CreateSpecificMutex( &IndexMutex );
+   CreateSpecificMutex( &FileMutex );
+   ReserveBlock();
+   if ( WriteBlock( Wanted ) == 0 ) Durable = Wanted;
+
+   Stop = 0;
+   Running = 1;
+   if ( StartThreadWithArg( IndexWriter, NULL, (unsigned) THREAD_STACK, &IndexTid ) == -1 )
+   {
+      logit( "et", "pick_ew: Cannot start the pick index thread.\n" );
+      Running = 0;
+      ClosePickIndex();
+      return -1;
+   }
+
+   logit( "", "pick_ew: Pick index file <%s>; last index %d; block size %d\n",
+          fname, LastIndex, BlockSize );
+   return 0;
+}
+
+
+  /***************************************************************
+   *                         GetPickIndex()                      *
+   *                                                             *
+   *  Return the next pick index.  Thread safe.  If its block   *
+   *  isn't on disk yet, write it before returning.              *
+   ***************************************************************/
+
+int GetPickIndex( void )
+{
+   int PickIndex;
+   int index, ahead;
+
+   RequestSpecificMutex( &IndexMutex );
 
 /* Update the pick index
    *********************/
-   /*********************/
-   if ( ++PickIndex == 1000000000 ) {
-	logit("et", "WARNING: pick_ew id for module id %d reached 1 billion picks\n", (int) modid);
+   if ( ++LastIndex == 1000000000 ) {
+	logit("et", "WARNING: pick_ew id for module id %d reached 1 billion picks\n", (int) ModId);
    }
-   if ( PickIndex > 2147483640 ) {
-	logit("et", "WARNING: pick_ew id for module id %d is rolling over\n", (int) modid);
-	PickIndex = 0;
+   if ( LastIndex > (MAX_PICK_INDEX - ShardId) / ShardCount ) {
+	logit("et", "WARNING: pick_ew id for module id %d is rolling over\n", (int) ModId);
+	LastIndex = 0;
+	Reserved  = -1;
+	Rolled    = 1;
    }
 
-/* Write the pick index to disk
-   ****************************/
-   fpIndex = fopen( fname, "w" );
-   fprintf( fpIndex, "%4d\n", PickIndex );
-   fclose( fpIndex );
+/* Ask for the next block once half of this one is used.
+   The index thread writes it to disk.
+   *****************************************************/
+   if ( LastIndex >= Reserved - BlockSize / 2 )
+      ReserveBlock();
+   ahead = Rolled || (LastIndex > Durable);
+   index = LastIndex;
+
+   PickIndex = LastIndex * ShardCount + ShardId;
+   ReleaseSpecificMutex( &IndexMutex );
 
+/* The index thread is behind.  Don't hand out an
+   index that could be reused after a crash.
+   **********************************************/
+   if ( ahead )
+   {
+      int rc = FlushBlock();
+
+      RequestSpecificMutex( &IndexMutex );
+      ahead = Rolled || (index > Durable);
+      if ( rc == 1 ) nSync++;
+      if ( ahead ) nAhead++;
+      if ( (rc == 1) && ((nSync <= 10) || (nSync % 100 == 0)) )
+         logit( "et", "pick_ew: Pick index thread behind; block written by the "
+                "picking thread (%lu times)\n", nSync );
+      if ( ahead && ((nAhead <= 10) || (nAhead % 100 == 0)) )
+         logit( "et", "pick_ew: Pick index %d isn't on disk; it may be reused after "
+                "a crash (%lu so far)\n", PickIndex, nAhead );
+      ReleaseSpecificMutex( &IndexMutex );
+   }
    return PickIndex;
 }
+
+
+  /***************************************************************
+   *                        ClosePickIndex()                     *
+   ***************************************************************/
+
+void ClosePickIndex( void )
+{
+   int i;
+
+/* Stop the index thread, and write the last block asked for
+   *********************************************************/
+   if ( Running )
+   {
+      Stop = 1;
+      for ( i = 0; (i < 500) && Running; i++ )
+         sleep_ew( 10 );
+      if ( Running )
+      {
+         logit( "et", "pick_ew: Pick index thread didn't stop; killing it.\n" );
+         KillThread( IndexTid );
+         Running = 0;
+      }
+   }
+   if ( (IndexMap != NULL) && ((Wanted != Durable) || Rolled) &&
+        (WriteBlock( Wanted ) == 0) )
+      Durable = Wanted;
+   if ( (nSync > 0) || (nAhead > 0) )
+      logit( "t", "pick_ew: %lu pick index blocks written by the picking thread; "
+             "%lu indexes handed out that weren't on disk\n", nSync, nAhead );
+
+#if defined(_WINNT)
+   if ( IndexMap   != NULL ) UnmapViewOfFile( IndexMap );
+   if ( hIndexMap  != NULL ) CloseHandle( hIndexMap );
+   if ( hIndexFile != INVALID_HANDLE_VALUE ) CloseHandle( hIndexFile );
+   hIndexMap  = NULL;
+   hIndexFile = INVALID_HANDLE_VALUE;
+#else
+   if ( IndexMap != NULL ) munmap( IndexMap, INDEX_LEN );
+#endif
+   IndexMap = NULL;
+}
+
+
+/* Reserve the block after the one reserved last, for the
+   index thread to write.  Called with IndexMutex held.
+   ********************************************************/
+static void ReserveBlock( void )
+{
+   int first = (LastIndex > Reserved) ? LastIndex : Reserved + 1;
+
+   if ( first > MAX_PICK_INDEX - BlockSize + 1 )
+      Reserved = MAX_PICK_INDEX;
+   else
+      Reserved = first + BlockSize - 1;
+   Wanted = Reserved;
+}
+
+
+/* Write the block asked for last, unless it is on disk
+   already.  Returns 1 if it was written, 0 if there was
+   nothing to do, -1 if the flush failed.  Blocks are
+   written in the order they were asked for, so the file
+   never goes back to an earlier one.
+   *****************************************************/
+static int FlushBlock( void )
+{
+   int end, rolled;
+
+   RequestSpecificMutex( &FileMutex );
+   RequestSpecificMutex( &IndexMutex );
+   end    = Wanted;
+   rolled = Rolled;
+   ReleaseSpecificMutex( &IndexMutex );
+
+   if ( (end == Durable) && !rolled )
+   {
+      ReleaseSpecificMutex( &FileMutex );
+      return 0;
+   }
+   if ( WriteBlock( end ) == -1 )
+   {
+      ReleaseSpecificMutex( &FileMutex );
+      return -1;
+   }
+
+   RequestSpecificMutex( &IndexMutex );
+   Durable = end;
+   if ( rolled ) Rolled = 0;             /* end was reserved after the roll over */
+   ReleaseSpecificMutex( &IndexMutex );
+   ReleaseSpecificMutex( &FileMutex );
+   return 1;
+}
+
+
+/* Write a block end to the index file and flush it.
+   Returns -1 if the flush failed.
+   *************************************************/
+static int WriteBlock( int end )
+{
+   char text[INDEX_LEN + 12];
+   int  rc = 0;
+
+   sprintf( text, "%10d\n", end );
+   memcpy( IndexMap, text, INDEX_LEN );
+
+#if defined(_WINNT)
+   if ( !FlushViewOfFile( IndexMap, INDEX_LEN ) || !FlushFileBuffers( hIndexFile ) )
+      rc = -1;
+#else
+   if ( msync( IndexMap, INDEX_LEN, MS_SYNC ) == -1 )
+      rc = -1;
+#endif
+   if ( rc == -1 )
+      logit( "et", "pick_ew: Error flushing pick index file.\n" );
+   return rc;
+}
+
+
+/* The index thread.  Writes each block GetPickIndex() asks
+   for; the picking thread goes on while it is flushed.
+   ********************************************************/
+static thr_ret IndexWriter( void *arg )
+{
+   (void) arg;
+   PinThread( THR_PUBLISHER );
+
+   while ( !Stop )
+   {
+      int rc = FlushBlock();
+
+      if ( rc == 0 )
+         sleep_ew( 10 );
+      else if ( rc == -1 )
+         sleep_ew( 1000 );                  /* Try again later */
+   }
+   Running = 0;
+   return THR_NULL_RET;
+}
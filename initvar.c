@@ -17,6 +17,13 @@
 #include <transport.h>
 #include "nn_pick_ew.h"
 
+/* Function prototypes
+   *******************/
+void ResetBank( BANKSTATE * );              /* function in bank.c */
+void ResetOnset( ONSETSTATE * );            /* function in onset.c */
+void ResetAmp( AMPSTATE * );                /* function in amp.c */
+void ResetNoise( NOISESTATE * );            /* function in noise.c */
+
 
    /*******************************************************************
     *                            InitVar()                            *
@@ -27,39 +34,53 @@
 void InitVar( STATION *Sta )
 {
    int i;
-   PICK *Pick = &Sta->Pick;         /* Pointer to pick structure */
-   CODA *Coda = &Sta->Coda;         /* Pointer to coda structure */
+   STAEVENT *Ev = Sta->Ev;          /* Pointer to event variables */
+   PICK *Pick = &Ev->Pick;          /* Pointer to pick structure */
+   CODA *Coda = &Ev->Coda;          /* Pointer to coda structure */
 
-   Sta->cocrit     = 0.; /* Threshold at which to terminate coda */
-   Sta->crtinc     = 0.; /* Increment added to ecrit at each zero crossing */
+   Sta->active     = 0;  /* No pick or coda active */
    Sta->eabs       = 0.; /* Running mean absolute value (aav) of rdat */
-   Sta->ecrit      = 0.; /* Criterion level to determine if event is over */
    Sta->elta       = 0.; /* Long-term average of edat */
-   Sta->enddata    = 0L; /* Sample at end of previous message */
+   Sta->enddata    = 0.; /* Sample at end of previous message */
    Sta->endtime    = 0.; /* Time at end of previous message */
    Sta->eref       = 0.; /* STA/LTA reference level */
    Sta->esta       = 0.; /* Short-term average of edat */
-   Sta->evlen      = 0;  /* Event length in samp */
    Sta->first      = 1;  /* No messages with this channel have been detected */
-   Sta->isml       = 0;  /* Small zero-crossing counter */
-   Sta->k          = 0;  /* Index to array of windows to push onto stack */
-   Sta->m          = 0;  /* 0 if no event; otherwise, zero-crossing counter */
-   Sta->ndrt       = 0;  /* Coda length index within window */
-   Sta->next       = 0;  /* Counter of zero crossings early in P-phase */
    Sta->ns_restart = 0;  /* Restart sample count */
-   Sta->nzero      = 0;  /* Big zero-crossing counter */
-   Sta->old_sample = 0;  /* Old value of integer data */
+   Sta->old_sample = 0.; /* Old value of data */
    Sta->rdat       = 0.; /* Filtered data value */
-   Sta->rbig       = 0.; /* Threshold for big zero crossings */
-   Sta->rlast      = 0.; /* Size of last big zero crossing */
    Sta->rold       = 0.; /* Previous value of filtered data */
-   Sta->rsrdat     = 0.; /* Running sum of rdat in coda calculation */
-   Sta->tmax       = 0.; /* Instantaneous maximum in current half cycle */
-   Sta->xdot       = 0;  /* First difference at pick time */
-   Sta->xfrz       = 0.; /* Used in first motion calculation */
+   if ( Sta->Bank != NULL )
+      ResetBank( Sta->Bank );  /* Filter bank, if any */
+   if ( Sta->On != NULL )
+      ResetOnset( Sta->On );   /* Onset history, if any */
+   if ( Sta->Amp != NULL )
+      ResetAmp( Sta->Amp );    /* Amplitude measurement, if any */
+   if ( Sta->Noise != NULL )
+      ResetNoise( Sta->Noise );  /* Noise segment, if any; the PSD is kept */
+
+/* Event variables
+   ***************/
+   Ev->cocrit      = 0.; /* Threshold at which to terminate coda */
+   Ev->crtinc      = 0.; /* Increment added to ecrit at each zero crossing */
+   Ev->ecrit       = 0.; /* Criterion level to determine if event is over */
+   Ev->evlen       = 0;  /* Event length in samp */
+   Ev->isml        = 0;  /* Small zero-crossing counter */
+   Ev->k           = 0;  /* Index to array of windows to push onto stack */
+   Ev->m           = 0;  /* 0 if no event; otherwise, zero-crossing counter */
+   Ev->ndrt        = 0;  /* Coda length index within window */
+   Ev->next        = 0;  /* Counter of zero crossings early in P-phase */
+   Ev->nzero       = 0;  /* Big zero-crossing counter */
+   Ev->rbig        = 0.; /* Threshold for big zero crossings */
+   Ev->rlast       = 0.; /* Size of last big zero crossing */
+   Ev->rsrdat      = 0.; /* Running sum of rdat in coda calculation */
+   Ev->tmax        = 0.; /* Instantaneous maximum in current half cycle */
+   Ev->xdot        = 0.; /* First difference at pick time */
+   Ev->xfrz        = 0.; /* Used in first motion calculation */
+   Ev->early       = 0;  /* No early pick out */
 
    for ( i = 0; i < 10; i++ )
-      Sta->sarray[i] = 0;         /* First 10 points of first motion */
+      Ev->sarray[i] = 0.;         /* First 10 points of first motion */
 
 /* Pick variables
    **************/
@@ -71,6 +92,7 @@ void InitVar( STATION *Sta )
    Pick->FirstMotion = '?'; /* First motion  ?=Not determined  U=Up  D=Down */
                             /* u=Questionably up  d=Questionably down */
    Pick->weight = 0;        /* Pick weight (0-3) */
+   Pick->prob   = -1.;      /* Classifier event probability */
    Pick->status = 0;
 
 /* Coda variables
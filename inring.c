@@ -0,0 +1,475 @@
+  /**********************************************************************
+   *                              inring.c                              *
+   *                                                                    *
+   *                  Reading waveforms from the input rings            *
+   *                                                                    *
+   *  This file contains functions InitInRings(), StartInRings(),       *
+   *  GetInMsg(), InRingsTerminated(), StopInRings() and                *
+   *  LogInRingStats().                                                 *
+   *                                                                    *
+   *  pick_ew reads from every ring named by an InRing command, each    *
+   *  with its own logos (the GetLogo commands that follow the InRing   *
+   *  command, or else those given before any InRing command).  With    *
+   *  one ring, GetInMsg() reads it directly, as pick_ew always did.    *
+   *  With more, each ring has a reader thread that copies its          *
+   *  messages into a FIFO of INQ_LEN slots, and GetInMsg() hands the   *
+   *  picking thread one message from each ring in turn, so a busy      *
+   *  ring cannot starve a quiet one.  A reader whose FIFO is full      *
+   *  waits; its messages stay in the ring until there is room.  A      *
+   *  reader that finds its ring empty sleeps 1 ms, and longer, up to   *
+   *  5 ms, while the ring stays empty; so does the picking thread      *
+   *  when GetInMsg() has nothing for it.  A terminate flag set on any  *
+   *  of the rings stops pick_ew.                                       *
+   *                                                                    *
+   *  For each ring, the messages and bytes read are counted, and the   *
+   *  lag of the data (time read less the end time of the message) and  *
+   *  the time messages wait in the FIFO are kept.                      *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <earthworm.h>
+#include <transport.h>
+#include <trace_buf.h>
+#include <time_ew.h>
+#include <swap.h>
+#include "nn_pick_ew.h"
+
+#if defined( _SPARC )
+#define LOCAL_BIG_ENDIAN  1
+#elif defined( _INTEL )
+#define LOCAL_BIG_ENDIAN  0
+#else
+#error "_INTEL or _SPARC must be set before compiling"
+#endif
+
+#define THREAD_STACK  65536
+#define INQ_LEN       64        /* Messages a reader can get ahead by */
+
+typedef struct {
+   MSG_LOGO logo;
+   long     len;
+   double   tread;              /* hrtime_ew() when read from the ring */
+   char     *msg;
+} INSLOT;
+
+typedef struct {
+   unsigned long nmsg;          /* Messages read */
+   double        nbyte;         /* Bytes read */
+   unsigned long nmiss;         /* Reads reporting lapped or skipped messages */
+   unsigned long ntoobig;       /* Messages too big to read */
+   unsigned long nlag;          /* Messages with a lag */
+   double        lagsum;        /* Sum of data lags (s) */
+   double        lagmax;        /* Largest data lag (s) */
+   double        waitmax;       /* Longest wait in the FIFO (s) */
+   int           maxdepth;      /* Largest FIFO depth seen */
+} INSTATS;
+
+typedef struct {
+   INRING        *ring;
+   INSLOT        *slot;         /* FIFO; only with reader threads */
+   char          *slotbuf;
+   int           head;          /* Oldest message in the FIFO */
+   int           count;         /* Messages in the FIFO */
+   mutex_t       mutex;         /* Guards head, count and stats */
+   volatile int  running;
+   ew_thread_t   tid;
+   INSTATS       stats;
+   unsigned long lastmsg;       /* Counts at the last LogInRingStats() */
+   double        lastbyte;
+} READER;
+
+static READER  *Reader = NULL;
+static int      nReader = 0;
+static int      Threaded = 0;        /* Set if there are reader threads */
+static int      NextRing = 0;        /* Ring GetInMsg() looks at first */
+static double   LastLog;
+static MSG_LOGO *DefLogo;            /* Logos of rings without their own */
+static volatile int Stop = 0;
+
+/* Function prototypes
+   *******************/
+void           PinThread( int );              /* function in placement.c */
+static thr_ret ReadThread( void * );
+static int     ReadRing( READER *, MSG_LOGO *, long *, char * );
+static double  MsgEndTime( char * );
+
+
+  /***************************************************************
+   *                          InitInRings()                      *
+   *                                                             *
+   *  Attach to the input rings.  Rings without logos of their   *
+   *  own get the GetLogo logos of Gparm, which must be set.     *
+   *  Returns -1 if an error is encountered.                     *
+   ***************************************************************/
+
+int InitInRings( GPARM *Gparm )
+{
+   int i;
+
+   nReader = Gparm->nInRing;
+   Reader  = (READER *) calloc( nReader, sizeof(READER) );
+   if ( Reader == NULL )
+   {
+      logit( "et", "pick_ew: Cannot allocate %d input ring readers\n", nReader );
+      return -1;
+   }
+
+   DefLogo = Gparm->GetLogo;
+   for ( i = 0; i < nReader; i++ )
+   {
+      INRING *r = &Gparm->InRing[i];
+
+      if ( r->nlogo == 0 )
+      {
+         r->nlogo = Gparm->nGetLogo;
+         r->logo  = Gparm->GetLogo;
+      }
+      tport_attach( &r->region, r->key );
+      Reader[i].ring = r;
+   }
+   Threaded = (nReader > 1);
+   return 0;
+}
+
+
+  /***************************************************************
+   *                         StartInRings()                      *
+   *                                                             *
+   *  Flush the input rings and, with more than one, start the   *
+   *  reader threads.  Returns -1 if an error is encountered.    *
+   ***************************************************************/
+
+int StartInRings( void )
+{
+   MSG_LOGO      logo;
+   long          len;
+   unsigned char seq;
+   char          *buf;
+   int           i;
+
+   if ( (buf = (char *) malloc( MAX_TRACEBUF_SIZ )) == NULL )
+   {
+      logit( "et", "pick_ew: Cannot allocate input ring flush buffer\n" );
+      return -1;
+   }
+   for ( i = 0; i < nReader; i++ )
+   {
+      INRING *r = Reader[i].ring;
+
+      while ( tport_copyfrom( &r->region, r->logo, (short) r->nlogo, &logo, &len,
+                              buf, MAX_TRACEBUF_SIZ, &seq ) != GET_NONE );
+   }
+   free( buf );
+   hrtime_ew( &LastLog );
+
+   if ( !Threaded ) return 0;
+
+   Stop = 0;
+   for ( i = 0; i < nReader; i++ )
+   {
+      READER *rd = &Reader[i];
+      int    s;
+
+      rd->slot    = (INSLOT *) calloc( INQ_LEN, sizeof(INSLOT) );
+      rd->slotbuf = (char *) malloc( (size_t) INQ_LEN * MAX_TRACEBUF_SIZ );
+      if ( (rd->slot == NULL) || (rd->slotbuf == NULL) )
+      {
+         logit( "et", "pick_ew: Cannot allocate the FIFO of input ring %s\n",
+                rd->ring->name );
+         return -1;
+      }
+      for ( s = 0; s < INQ_LEN; s++ )
+         rd->slot[s].msg = rd->slotbuf + (size_t) s * MAX_TRACEBUF_SIZ;
+      CreateSpecificMutex( &rd->mutex );
+
+      rd->running = 1;
+      if ( StartThreadWithArg( ReadThread, rd, (unsigned) THREAD_STACK, &rd->tid ) == -1 )
+      {
+         logit( "et", "pick_ew: Cannot start the reader of input ring %s\n",
+                rd->ring->name );
+         rd->running = 0;
+         return -1;
+      }
+   }
+   logit( "", "pick_ew: Reading %d input rings, FIFOs of %d messages\n",
+          nReader, INQ_LEN );
+   return 0;
+}
+
+
+  /***************************************************************
+   *                           GetInMsg()                        *
+   *                                                             *
+   *  Get the next waveform message, taking one from each ring   *
+   *  in turn.  Returns 1 if a message was copied to TraceBuf    *
+   *  (which holds MAX_TRACEBUF_SIZ bytes), 0 if there was none. *
+   ***************************************************************/
+
+int GetInMsg( MSG_LOGO *logo, long *MsgLen, char *TraceBuf )
+{
+   int i;
+
+   for ( i = 0; i < nReader; i++ )
+   {
+      READER *rd = &Reader[NextRing];
+      INSLOT *sl;
+      double now, wait;
+      int    n;
+
+      NextRing = (NextRing + 1) % nReader;
+
+      if ( !Threaded )
+      {
+         if ( ReadRing( rd, logo, MsgLen, TraceBuf ) ) return 1;
+         continue;
+      }
+      RequestSpecificMutex( &rd->mutex );
+      n = rd->count;
+      ReleaseSpecificMutex( &rd->mutex );
+      if ( n == 0 ) continue;
+
+/* Only this thread empties slots, and the reader
+   doesn't touch the ones counted
+   **********************************************/
+      sl = &rd->slot[rd->head];
+      *logo   = sl->logo;
+      *MsgLen = sl->len;
+      memcpy( TraceBuf, sl->msg, (size_t) sl->len );
+      hrtime_ew( &now );
+      wait = now - sl->tread;
+
+      RequestSpecificMutex( &rd->mutex );
+      rd->head = (rd->head + 1) % INQ_LEN;
+      rd->count--;
+      if ( wait > rd->stats.waitmax ) rd->stats.waitmax = wait;
+      ReleaseSpecificMutex( &rd->mutex );
+      return 1;
+   }
+   return 0;
+}
+
+
+  /***************************************************************
+   *                       InRingsTerminated()                   *
+   *                                                             *
+   *  Returns 1 if the terminate flag, or our pid, has been set  *
+   *  on any of the input rings.                                 *
+   ***************************************************************/
+
+int InRingsTerminated( int pid )
+{
+   int i;
+
+   for ( i = 0; i < nReader; i++ )
+   {
+      int flag = tport_getflag( &Reader[i].ring->region );
+
+      if ( (flag == TERMINATE) || (flag == pid) ) return 1;
+   }
+   return 0;
+}
+
+
+  /***************************************************************
+   *                          StopInRings()                      *
+   *                                                             *
+   *  Stop the reader threads and detach from the input rings.   *
+   ***************************************************************/
+
+void StopInRings( void )
+{
+   int i, j;
+
+   Stop = 1;
+   for ( i = 0; i < nReader; i++ )
+   {
+      READER *rd = &Reader[i];
+
+      for ( j = 0; (j < 500) && rd->running; j++ )
+         sleep_ew( 10 );
+      if ( rd->running )
+      {
+         logit( "et", "pick_ew: Reader of input ring %s didn't stop; killing it.\n",
+                rd->ring->name );
+         KillThread( rd->tid );
+         continue;
+      }
+      if ( Threaded && (rd->slot != NULL) )
+         CloseSpecificMutex( &rd->mutex );
+      free( rd->slot );
+      free( rd->slotbuf );
+      tport_detach( &rd->ring->region );
+      if ( rd->ring->logo != DefLogo )
+         free( rd->ring->logo );
+      rd->ring->logo = NULL;
+   }
+   free( Reader );
+   Reader  = NULL;
+   nReader = 0;
+}
+
+
+  /***************************************************************
+   *                         LogInRingStats()                    *
+   *                                                             *
+   *  Log the counters of each ring, with its rates since the    *
+   *  last call.                                                 *
+   ***************************************************************/
+
+void LogInRingStats( void )
+{
+   double now, dt;
+   int    i;
+
+   hrtime_ew( &now );
+   dt = now - LastLog;
+   LastLog = now;
+   if ( dt <= 0. ) dt = 1.;
+
+   for ( i = 0; i < nReader; i++ )
+   {
+      READER  *rd = &Reader[i];
+      INSTATS s;
+
+      if ( Threaded ) RequestSpecificMutex( &rd->mutex );
+      s = rd->stats;
+      rd->stats.lagmax  = 0.;
+      rd->stats.waitmax = 0.;
+      if ( Threaded ) ReleaseSpecificMutex( &rd->mutex );
+
+      logit( "t", "pick_ew: %s: %lu msgs, %.1lf msg/s, %.1lf kB/s; lag mean %.2lf s, "
+             "max %.2lf s; FIFO wait max %.1lf ms, depth max %d; %lu misses, "
+             "%lu too big\n", rd->ring->name, s.nmsg, (s.nmsg - rd->lastmsg) / dt,
+             (s.nbyte - rd->lastbyte) / dt / 1000., (s.nlag > 0) ? s.lagsum / s.nlag : 0.,
+             s.lagmax, 1000. * s.waitmax, s.maxdepth, s.nmiss, s.ntoobig );
+      rd->lastmsg  = s.nmsg;
+      rd->lastbyte = s.nbyte;
+   }
+}
+
+
+/* A reader thread.  Copies the messages of its ring into
+   its FIFO, waiting while the FIFO is full.
+   ******************************************************/
+static thr_ret ReadThread( void *arg )
+{
+   READER *rd = (READER *) arg;
+   int    idle = IDLE_MIN_MS;           /* Next sleep if the ring is empty */
+
+   PinThread( THR_READER );
+   while ( !Stop )
+   {
+      INSLOT *sl;
+      int    tail;
+
+      RequestSpecificMutex( &rd->mutex );
+      tail = (rd->count < INQ_LEN) ? (rd->head + rd->count) % INQ_LEN : -1;
+      ReleaseSpecificMutex( &rd->mutex );
+
+      if ( tail == -1 )
+      {
+         sleep_ew( 10 );
+         continue;
+      }
+
+/* Only this thread fills slots, and the picking
+   thread doesn't touch the ones not yet counted
+   *********************************************/
+      sl = &rd->slot[tail];
+      if ( !ReadRing( rd, &sl->logo, &sl->len, sl->msg ) )
+      {
+         sleep_ew( idle );
+         if ( idle < IDLE_MAX_MS ) idle++;
+         continue;
+      }
+      idle = IDLE_MIN_MS;
+      hrtime_ew( &sl->tread );
+
+      RequestSpecificMutex( &rd->mutex );
+      rd->count++;
+      if ( rd->count > rd->stats.maxdepth ) rd->stats.maxdepth = rd->count;
+      ReleaseSpecificMutex( &rd->mutex );
+   }
+   rd->running = 0;
+   return THR_NULL_RET;
+}
+
+
+/* Read one message from a ring, logging and counting what
+   went wrong.  Returns 1 if a message was read.
+   *******************************************************/
+static int ReadRing( READER *rd, MSG_LOGO *logo, long *MsgLen, char *buf )
+{
+   INRING        *r = rd->ring;
+   unsigned char seq;
+   double        now, end;
+   int           rc;
+
+   rc = tport_copyfrom( &r->region, r->logo, (short) r->nlogo, logo, MsgLen,
+                        buf, MAX_TRACEBUF_SIZ, &seq );
+
+   if ( rc == GET_NONE ) return 0;
+
+   if ( rc == GET_NOTRACK )
+      logit( "et", "pick_ew: %s: Tracking error (NTRACK_GET exceeded)\n", r->name );
+
+   if ( rc == GET_MISS_LAPPED )
+      logit( "et", "pick_ew: %s: Missed msgs (lapped on ring) "
+             "before i:%d m:%d t:%d seq:%d\n", r->name,
+             (int)logo->instid, (int)logo->mod, (int)logo->type, (int)seq );
+
+   if ( rc == GET_MISS_SEQGAP )
+      logit( "et", "pick_ew: %s: Gap in sequence# before i:%d m:%d t:%d seq:%d\n",
+             r->name, (int)logo->instid, (int)logo->mod, (int)logo->type, (int)seq );
+
+   if ( rc == GET_TOOBIG )
+      logit( "et", "pick_ew: %s: Retrieved msg is too big: i:%d m:%d t:%d len:%ld\n",
+             r->name, (int)logo->instid, (int)logo->mod, (int)logo->type, *MsgLen );
+
+   hrtime_ew( &now );
+   end = (rc == GET_TOOBIG) ? 0. : MsgEndTime( buf );
+
+   if ( Threaded ) RequestSpecificMutex( &rd->mutex );
+   if ( (rc == GET_MISS_LAPPED) || (rc == GET_MISS_SEQGAP) )
+      rd->stats.nmiss++;
+   if ( rc == GET_TOOBIG )
+      rd->stats.ntoobig++;
+   else
+   {
+      rd->stats.nmsg++;
+      rd->stats.nbyte += *MsgLen;
+      if ( end > 0. )
+      {
+         rd->stats.nlag++;
+         rd->stats.lagsum += now - end;
+         if ( now - end > rd->stats.lagmax ) rd->stats.lagmax = now - end;
+      }
+   }
+   if ( Threaded ) ReleaseSpecificMutex( &rd->mutex );
+
+   return (rc != GET_TOOBIG);
+}
+
+
+/* The end time of a tracebuf message, whatever its byte
+   order.  Returns 0 if the data type isn't known.
+   *****************************************************/
+static double MsgEndTime( char *msg )
+{
+   TRACE_HEADER *th = (TRACE_HEADER *) msg;
+   double       end = th->endtime;
+   int          big;
+
+   if ( (th->datatype[0] == 's') || (th->datatype[0] == 't') )
+      big = 1;
+   else if ( (th->datatype[0] == 'i') || (th->datatype[0] == 'f') )
+      big = 0;
+   else
+      return 0.;
+
+   if ( big != LOCAL_BIG_ENDIAN )
+      SwapDouble( &end );
+   return end;
+}
@@ -110,6 +110,7 @@
 #include "trace_buf.h"
 #include "swap.h"
 #include "trheadconv.h"
+#include "time_ew.h"
 #include "nn_pick_ew.h"
 
 #define PROGRAM_NAME "nn_pick_ew"
@@ -118,14 +119,90 @@
    *******************/
 int  GetConfig( char *, GPARM * );
 void LogConfig( GPARM * );
-int  GetStaList( STATION **, int *, GPARM * );
+int  GetStaList( STATION **, int *, RULESET *, GPARM * );
 void LogStaList( STATION *, int );
 void PickRA( STATION *, char *, GPARM *, EWH * );
 int  CompareSCNL( const void *, const void * );
 int  Restart( STATION *, GPARM *, int, int );
-void Interpolate( STATION *, char *, int );
+char *Interpolate( STATION *, char *, int );
 int  GetEwh( EWH * );
-void Sample( int, STATION * );
+void Sample( double, STATION * );
+int  InitClassifier( GPARM * );
+void FreeClassifier( void );
+int  InitPickIndex( GPARM * );
+void ClosePickIndex( void );
+int  InitOutQueue( GPARM *, long );
+int  PutOutMsg( MSG_LOGO *, int, long, char * );
+void StopOutQueue( void );
+void LogOutQueueStats( void );
+long InitBinary( GPARM *, EWH * );
+void FlushBinary( int );
+void ReportGap( STATION *, int, GPARM *, EWH * );
+void GapSummary( STATION *, int, GPARM *, EWH * );
+void InitRestartTable( GPARM * );
+void UpdateRestartTable( STATION *, int );
+void StopRestartTable( void );
+int  StartStaReload( GPARM *, EWH *, STATION *, int );
+int  SwapStaList( STATION **, int * );
+void StopStaReload( void );
+int  InitAutoStations( GPARM *, EWH *, RULESET * );
+STATION *FindAutoStation( STATION * );
+void EvictAutoStations( void );
+void LogAutoStats( void );
+void FreeAutoStations( void );
+int  InitSnapshot( STATION *, int, GPARM * );
+void ResumeChannel( STATION *, double, double, GPARM * );
+void WriteSnapshot( STATION *, int, GPARM * );
+void CloseSnapshot( void );
+void InitReorder( GPARM * );
+void ReorderMsg( STATION *, char *, GPARM *, EWH * );
+void ReleaseExpired( GPARM *, EWH * );
+void FreeReorder( STATION * );
+void LogReorderStats( void );
+void PickMsg( STATION *, char *, GPARM *, EWH * );
+void InitDupCheck( GPARM * );
+int  IsDuplicate( STATION *, char *, long, MSG_LOGO * );
+void LogDupStats( void );
+char *InitDecode( GPARM * );
+int  MakeHeaderLocal( char *, long );
+int  DecodeMsg( char *, char * );
+void FreeDecode( void );
+int  InitInRings( GPARM * );
+int  StartInRings( void );
+int  GetInMsg( MSG_LOGO *, long *, char * );
+int  InRingsTerminated( int );
+void StopInRings( void );
+void LogInRingStats( void );
+void InitShard( GPARM * );
+int  ShardMsg( char *, int );
+void LogShardStats( void );
+int  InitPlacement( GPARM * );
+void PinThread( int );
+void InitShed( GPARM * );
+void UpdateShed( double );
+int  ShedChannel( STATION * );
+void LogShedStats( void );
+void RetractPick( CODA *, GPARM *, EWH * );
+void LogEarlyStats( void );
+void InitBank( GPARM * );
+void SetBankRate( STATION *, double );
+void FreeBank( STATION * );
+void LogBankStats( void );
+void InitOnset( GPARM * );
+void SetOnsetRate( STATION *, double );
+void FreeOnset( STATION * );
+void StopOnset( void );
+void LogOnsetStats( void );
+void InitAmp( GPARM * );
+void SetAmpRate( STATION *, double );
+void FreeAmp( STATION * );
+void LogAmpStats( void );
+void InitNoise( GPARM * );
+void SetNoiseRate( STATION *, double );
+void FreeNoise( STATION * );
+void RequestNoiseQC( void );
+void StopNoise( void );
+void LogNoiseStats( void );
 
 
 /* version introduced with 1.0.1  */
@@ -135,7 +212,31 @@ void Sample( int, STATION * );
 /* version 1.0.5 2014-06-04 no longer rolls over pick-id at 999999, only at MAX INT */
 /* version 1.0.6 2015-02-17 made DeadSta check be ignored if value is set <= 0.0 */
 /* version 1.0.7 2018-05-03 attempt to create PickIndexDir if specified and non-existent */
-#define PICKEW_VERSION "1.0.7 2018-05-03"
+/* version 1.1.0 2026-10-18 optional tree-ensemble pick classifier and pick feature dump */
+/* version 1.1.1 2026-10-18 pick indexes reserved in blocks through a memory-mapped index file */
+/* version 1.1.2 2026-10-18 optional output queue with a publisher thread; StatsInt */
+/* version 1.1.3 2026-10-18 optional batched binary pick/coda messages (BinaryOutput) */
+/* version 1.1.4 2026-10-18 gap reports aggregated every GapReportInt; RestartStateFile */
+/* version 1.1.5 2026-10-18 single-pass station list loader; StaCacheFile; startup timing */
+/* version 1.1.6 2026-10-18 live station list reload (StaReloadInt) */
+/* version 1.1.7 2026-10-18 shared parameter sets, station list profiles and SCNL rules */
+/* version 1.1.8 2026-10-18 channels matching station list rules added on first sight (AutoRegister) */
+/* version 1.1.9 2026-10-18 station table split into per-sample, event-time and gap blocks */
+/* version 1.1.10 2026-10-18 filter-state snapshots for warm restarts (FilterSnapshot) */
+/* version 1.1.11 2026-10-18 per-channel reorder buffer; duplicates and overlaps dropped (ReorderHold) */
+/* version 1.1.12 2026-10-18 duplicate messages from redundant feeds dropped by channel (DupCheck) */
+/* version 1.1.13 2026-10-18 one-pass sample decode to doubles; f4/t4/f8/t8 data accepted */
+/* version 1.1.14 2026-10-18 gaps interpolated in front of the samples instead of shifting them */
+/* version 1.1.15 2026-10-18 several InRings, each with its own logos and reader thread */
+/* version 1.1.16 2026-10-18 channels split among instances by SCNL hash (ShardId, ShardCount) */
+/* version 1.1.17 2026-10-18 threads pinned to cpus by kind (CpuSet); NUMA topology logged */
+/* version 1.1.18 2026-10-18 load shedding by data lag (ShedLevel, ShedChannel) */
+/* version 1.1.19 2026-10-18 picks sent before their coda, retracted if it's short (EarlyPick) */
+/* version 1.1.20 2026-10-18 filter-bank trigger, any of up to 8 bands (PickEngine bank) */
+/* version 1.1.21 2026-10-18 pick times refined by kurtosis and AIC on a thread (OnsetRefine) */
+/* version 1.1.22 2026-10-18 peak and Wood-Anderson amplitudes of each event (AmpWindow) */
+/* version 1.1.23 2026-10-18 noise PSD per channel on a thread, pick SNR (NoisePSD, SnrWeight) */
+#define PICKEW_VERSION "1.1.23 2026-10-18"
    
       /***********************************************************
        *              The main program starts here.              *
@@ -149,21 +250,27 @@ int main( int argc, char **argv )
    int           i;                /* Loop counter */
    STATION       *StaArray = NULL; /* Station array */
    char          *TraceBuf;        /* Pointer to waveform buffer */
+   char          *WaveBuf;         /* Decoded message, samples as doubles */
    TRACE_HEADER  *TraceHead;       /* Pointer to trace header w/o loc code */
    TRACE2_HEADER *Trace2Head;      /* Pointer to header with loc code */
-   int          *TraceLong;       /* Long pointer to waveform data */
-   short         *TraceShort;      /* Short pointer to waveform data */
    long          MsgLen;           /* Size of retrieved message */
    MSG_LOGO      logo;             /* Logo of retrieved msg */
    MSG_LOGO      hrtlogo;          /* Logo of outgoing heartbeats */
+   int           OutShared = 0;    /* Set if OutRing is also an InRing */
    int           Nsta = 0;         /* Number of stations in list */
+   int           idle;             /* Sleep (ms) if no message is waiting */
    time_t        then;             /* Previous heartbeat time */
+   time_t        thenStats;        /* Previous statistics log time */
+   time_t        thenGap;          /* Previous gap summary time */
+   time_t        thenSnap;         /* Previous filter snapshot time */
    long          InBufl;           /* Maximum message size in bytes */
+   long          OutMsgMax;        /* Largest message we write */
+   double        tLoad, tNow;      /* For timing startup */
    GPARM         Gparm;            /* Configuration file parameters */
+   RULESET       Rules;            /* SCNL rules from the station list */
    EWH           Ewh;              /* Parameters from earthworm.h */
    char          *configfile;      /* Pointer to name of config file */
    pid_t         myPid;            /* Process id of this process */
-   unsigned char seq;        /* msg sequence number from tport_copyfrom() */
 
 /* Check command line arguments
    ****************************/
@@ -187,6 +294,7 @@ int main( int argc, char **argv )
       logit( "e", PROGRAM_NAME ": GetConfig() failed. Exiting.\n" );
       return -1;
    }
+   hrtime_ew( &Gparm.StartTime );
 
 /* Look up info in the earthworm.h tables
    **************************************/
@@ -196,6 +304,33 @@ int main( int argc, char **argv )
       return -1;
    }
 
+/* Set up the binary pick/coda message, if requested
+   **************************************************/
+   if ( (OutMsgMax = InitBinary( &Gparm, &Ewh )) < 0 )
+   {
+      logit( "e", PROGRAM_NAME ": InitBinary() failed. Exiting.\n" );
+      return -1;
+   }
+   if ( OutMsgMax < LINELEN ) OutMsgMax = LINELEN;
+
+/* Look up the type of pick retractions, if picks go out early
+   ************************************************************/
+   if ( Gparm.EarlyPick && (Gparm.BinaryOutput != 2) &&
+        (GetType( Gparm.RetractMsgType, &Ewh.TypePickRetract ) != 0) )
+   {
+      logit( "e", PROGRAM_NAME ": Error getting %s. Exiting.\n", Gparm.RetractMsgType );
+      return -1;
+   }
+
+/* And of peak amplitudes, if they are measured
+   ********************************************/
+   if ( (Gparm.AmpWindow > 0.) && (Gparm.BinaryOutput != 2) &&
+        (GetType( Gparm.AmpMsgType, &Ewh.TypePickAmp ) != 0) )
+   {
+      logit( "e", PROGRAM_NAME ": Error getting %s. Exiting.\n", Gparm.AmpMsgType );
+      return -1;
+   }
+
 /* Specify logos of incoming waveforms and outgoing heartbeats
    ***********************************************************/
    if( Gparm.nGetLogo == 0 ) 
@@ -233,12 +368,50 @@ int main( int argc, char **argv )
 /* Log the configuration parameters
    ********************************/
    LogConfig( &Gparm );
+   InitReorder( &Gparm );
+   InitDupCheck( &Gparm );
+   InitShard( &Gparm );
+   InitShed( &Gparm );
+   InitBank( &Gparm );
+   InitAmp( &Gparm );
+
+/* Pin the picking thread before the station table and the other
+   buffers it uses are allocated, so their memory is on its node
+   **************************************************************/
+   if ( InitPlacement( &Gparm ) == -1 )
+   {
+      logit( "e", PROGRAM_NAME ": InitPlacement() failed. Exiting.\n" );
+      return -1;
+   }
+   PinThread( THR_PICKER );
+
+/* Load the pick classifier and open the feature dump, if requested
+   ****************************************************************/
+   if ( InitClassifier( &Gparm ) == -1 )
+   {
+      logit( "e", PROGRAM_NAME ": InitClassifier() failed. Exiting.\n" );
+      free( Gparm.GetLogo );
+      free( Gparm.StaFile );
+      return -1;
+   }
+
+/* Open the pick index file
+   *************************/
+   if ( InitPickIndex( &Gparm ) == -1 )
+   {
+      logit( "e", PROGRAM_NAME ": InitPickIndex() failed. Exiting.\n" );
+      FreeClassifier();
+      free( Gparm.GetLogo );
+      free( Gparm.StaFile );
+      return -1;
+   }
 
 /* Allocate the waveform buffer
    ****************************/
-   InBufl = MAX_TRACEBUF_SIZ*2 + sizeof(int)*(Gparm.MaxGap-1);
+   InBufl = MAX_TRACEBUF_SIZ;
    TraceBuf = (char *) malloc( (size_t) InBufl );
-   if ( TraceBuf == NULL )
+   WaveBuf  = InitDecode( &Gparm );
+   if ( (TraceBuf == NULL) || (WaveBuf == NULL) )
    {
       logit( "et", PROGRAM_NAME ": Cannot allocate waveform buffer\n" );
       free( Gparm.GetLogo );
@@ -250,13 +423,12 @@ int main( int argc, char **argv )
    *****************************************************/
    TraceHead  = (TRACE_HEADER *)TraceBuf;
    Trace2Head = (TRACE2_HEADER *)TraceBuf;
-   TraceLong  = (int *) (TraceBuf + sizeof(TRACE_HEADER));
-   TraceShort = (short *) (TraceBuf + sizeof(TRACE_HEADER));
 
 /* Read the station list and return the number of stations found.
    Allocate the station list array.
    *************************************************************/
-   if ( GetStaList( &StaArray, &Nsta, &Gparm ) == -1 )
+   hrtime_ew( &tLoad );
+   if ( GetStaList( &StaArray, &Nsta, &Rules, &Gparm ) == -1 )
    {
       logit( "e", PROGRAM_NAME ": GetStaList() failed. Exiting.\n" );
       free( Gparm.GetLogo );
@@ -265,7 +437,7 @@ int main( int argc, char **argv )
       return -1;
    }
 
-   if ( Nsta == 0 )
+   if ( (Nsta == 0) && (Gparm.AutoMax == 0) )
    {
       logit( "et", PROGRAM_NAME ": Empty station list(s). Exiting." );
       free( Gparm.GetLogo );
@@ -277,102 +449,152 @@ int main( int argc, char **argv )
 /* Sort the station list by SCNL
    *****************************/
    qsort( StaArray, Nsta, sizeof(STATION), CompareSCNL );
+   hrtime_ew( &tNow );
+   logit( "t", PROGRAM_NAME ": Station table of %d channels built in %.3lf s\n",
+          Nsta, tNow - tLoad );
 
 /* Log the station list
    ********************/
    LogStaList( StaArray, Nsta );
 
+/* Load the filter state saved by the last run.
+   Snapshots are optional, so errors are logged only.
+   **************************************************/
+   InitSnapshot( StaArray, Nsta, &Gparm );
+
+/* Set up the table of channels added by rule
+   ******************************************/
+   if ( InitAutoStations( &Gparm, &Ewh, &Rules ) == -1 )
+   {
+      logit( "e", PROGRAM_NAME ": InitAutoStations() failed. Exiting.\n" );
+      return -1;
+   }
+
 /* Attach to existing transport rings
    **********************************/
-   if ( Gparm.OutKey != Gparm.InKey )
+   if ( InitInRings( &Gparm ) == -1 )
    {
-      tport_attach( &Gparm.InRegion,  Gparm.InKey );
+      logit( "e", PROGRAM_NAME ": InitInRings() failed. Exiting.\n" );
+      return -1;
+   }
+   for ( i = 0; i < Gparm.nInRing; i++ )
+      if ( Gparm.InRing[i].key == Gparm.OutKey )
+      {
+         Gparm.OutRegion = Gparm.InRing[i].region;
+         OutShared = 1;
+         break;
+      }
+   if ( !OutShared )
       tport_attach( &Gparm.OutRegion, Gparm.OutKey );
+
+/* Start the output queue and its publisher thread
+   ***********************************************/
+   if ( InitOutQueue( &Gparm, OutMsgMax ) == -1 )
+   {
+      logit( "e", PROGRAM_NAME ": InitOutQueue() failed. Exiting.\n" );
+      return -1;
    }
-   else
+
+/* Start the onset refinement and noise spectrum threads,
+   and the restart file writer
+   ******************************************************/
+   InitOnset( &Gparm );
+   InitNoise( &Gparm );
+   InitRestartTable( &Gparm );
+
+/* Start watching the station files for changes
+   *********************************************/
+   if ( StartStaReload( &Gparm, &Ewh, StaArray, Nsta ) == -1 )
    {
-      tport_attach( &Gparm.InRegion, Gparm.InKey );
-      Gparm.OutRegion = Gparm.InRegion;
+      logit( "e", PROGRAM_NAME ": StartStaReload() failed. Exiting.\n" );
+      StopRestartTable();
+      StopNoise();
+      StopOnset();
+      StopOutQueue();
+      return -1;
    }
 
-/* Flush the input ring
-   ********************/
-   while ( tport_copyfrom( &Gparm.InRegion, Gparm.GetLogo, (short)Gparm.nGetLogo, 
-                         &logo, &MsgLen, TraceBuf, MAX_TRACEBUF_SIZ, &seq) != 
-                         GET_NONE );
+/* Flush the input rings and start their readers
+   **********************************************/
+   if ( StartInRings() == -1 )
+   {
+      logit( "e", PROGRAM_NAME ": StartInRings() failed. Exiting.\n" );
+      StopStaReload();
+      StopRestartTable();
+      StopNoise();
+      StopOnset();
+      StopOutQueue();
+      return -1;
+   }
 
 /* Get the time when we start reading messages.
    This is for issuing heartbeats.
    *******************************************/
    time( &then );
+   thenStats = then;
+   thenGap   = then;
+   thenSnap  = then;
+   hrtime_ew( &tNow );
+   logit( "t", PROGRAM_NAME ": Startup took %.3lf s; reading waveforms\n",
+          tNow - Gparm.StartTime );
 
 /* Loop to read waveform messages and invoke the picker
    ****************************************************/
-   while ( tport_getflag( &Gparm.InRegion ) != TERMINATE  &&
-           tport_getflag( &Gparm.InRegion ) != myPid )
+   idle = IDLE_MIN_MS;
+   while ( !InRingsTerminated( (int) myPid ) )
    {
-      char    type[3];
       STATION key;              /* Key for binary search */
       STATION *Sta;             /* Pointer to the station being processed */
-      int     rc;               /* Return code from tport_copyfrom() */
       time_t  now;              /* Current time */
-      double  GapSizeD;         /* Number of missing samples (double) */
-      int    GapSize;          /* Number of missing samples (integer) */
-      int wave_swap_return;	/* return from WaveMsg2MakeLocal */
+      int wave_swap_return;	/* return from MakeHeaderLocal */
 
-/* Get tracebuf or tracebuf2 message from ring
-   *******************************************/
-      rc = tport_copyfrom( &Gparm.InRegion, Gparm.GetLogo, (short)Gparm.nGetLogo, 
-                           &logo, &MsgLen, TraceBuf, MAX_TRACEBUF_SIZ, &seq );
+/* Switch to a reloaded station list, if one is ready
+   ***************************************************/
+      SwapStaList( &StaArray, &Nsta );
+
+/* Pick held messages that have waited long enough
+   ************************************************/
+      ReleaseExpired( &Gparm, &Ewh );
 
-      if ( rc == GET_NONE )
+/* Get tracebuf or tracebuf2 message from the next ring
+   with one waiting.  Read errors are logged there.
+   ****************************************************/
+      if ( !GetInMsg( &logo, &MsgLen, TraceBuf ) )
       {
-         sleep_ew( 100 );
+         FlushBinary( 0 );
+         sleep_ew( idle );
+         if ( idle < IDLE_MAX_MS ) idle++;
          continue;
       }
+      idle = IDLE_MIN_MS;
 
-      if ( rc == GET_NOTRACK )
-         logit( "et", PROGRAM_NAME ": Tracking error (NTRACK_GET exceeded)\n");
-
-      if ( rc == GET_MISS_LAPPED )
-         logit( "et", PROGRAM_NAME ": Missed msgs (lapped on ring) "
-                "before i:%d m:%d t:%d seq:%d\n",
-                (int)logo.instid, (int)logo.mod, (int)logo.type, (int)seq );
-
-      if ( rc == GET_MISS_SEQGAP )
-         logit( "et", PROGRAM_NAME ": Gap in sequence# before i:%d m:%d t:%d seq:%d\n",
-                (int)logo.instid, (int)logo.mod, (int)logo.type, (int)seq );
-
-      if ( rc == GET_TOOBIG )
-      {
-         logit( "et", PROGRAM_NAME ": Retrieved msg is too big: i:%d m:%d t:%d len:%ld\n",
-                (int)logo.instid, (int)logo.mod, (int)logo.type, MsgLen );
+/* Drop channels another shard picks, going by the
+   SCNL in the header, before anything else is done
+   ************************************************/
+      if ( !ShardMsg( TraceBuf, logo.type != Ewh.TypeTracebuf ) )
          continue;
-      }
 
-/* If necessary, swap bytes in tracebuf message
-   ********************************************/
-      if ( logo.type == Ewh.TypeTracebuf )
+/* If necessary, swap bytes in the tracebuf header.
+   The samples are swapped when they are decoded.
+   A TYPE_TRACEBUF header has no location code.
+   *************************************************/
+      if ( (wave_swap_return = MakeHeaderLocal( TraceBuf, MsgLen )) < 0 )
       {
-         if ( (wave_swap_return = WaveMsgMakeLocal( TraceHead )) < 0 )
-         {
-            logit( "et", PROGRAM_NAME ": WaveMsgMakeLocal() error.\n" );
-            continue;
-         }
+         logit( "et", PROGRAM_NAME ": MakeHeaderLocal error. %.6s.%.8s.%.8s.%.2s error=%d\n",
+                Trace2Head->sta, Trace2Head->chan, Trace2Head->net,
+                (logo.type == Ewh.TypeTracebuf) ? "--" : Trace2Head->loc, wave_swap_return );
+         continue;
       }
-      else
-         if ( (wave_swap_return = WaveMsg2MakeLocal( Trace2Head )) < 0 )
-         {
-            logit( "et", PROGRAM_NAME ": WaveMsg2MakeLocal error. %s.%s.%s.%s error=%d\n",
-		Trace2Head->sta, Trace2Head->net, Trace2Head->chan, Trace2Head->loc, wave_swap_return );
-            continue;
-         }
 
 /* Convert TYPE_TRACEBUF messages to TYPE_TRACEBUF2
    ************************************************/
       if ( logo.type == Ewh.TypeTracebuf )
          Trace2Head = TrHeadConv( TraceHead );
 
+/* Step the load-shedding level with the data lag
+   **********************************************/
+      UpdateShed( Trace2Head->endtime );
+
 /* Look up SCNL number in the station list
    ***************************************/
       {
@@ -390,9 +612,28 @@ int main( int argc, char **argv )
       Sta = (STATION *) bsearch( &key, StaArray, Nsta, sizeof(STATION),
                                  CompareSCNL );
 
-      if ( Sta == NULL )      /* SCNL not found */
+      if ( Sta == NULL )      /* SCNL not found; add it if a rule matches */
+         Sta = FindAutoStation( &key );
+
+      if ( Sta == NULL )
+         continue;
+
+/* Under overload, drop the channels that may be shed
+   **************************************************/
+      if ( ShedChannel( Sta ) )
          continue;
 
+/* Drop a second copy of a message the channel has had already
+   ************************************************************/
+      if ( IsDuplicate( Sta, TraceBuf, MsgLen, &logo ) )
+         continue;
+
+/* The channel's state came from the filter snapshot.  Keep it
+   if the data resumes soon enough after the snapshot.
+   ***********************************************************/
+      if ( Sta->first == 2 )
+         ResumeChannel( Sta, Trace2Head->starttime, Trace2Head->samprate, &Gparm );
+
 /* Do this the first time we get a message with this SCNL
    ******************************************************/
       if ( Sta->first == 1 )
@@ -402,69 +643,17 @@ int main( int argc, char **argv )
          continue;
       }
 
-/* If the samples are shorts, make them longs (actually just int's now since long could be 8 bytes!)
-   ******************************************/
-      strcpy( type, Trace2Head->datatype );
-
-      if ( (strcmp(type,"i2")==0) || (strcmp(type,"s2")==0) )
-      {
-         for ( i = Trace2Head->nsamp - 1; i > -1; i-- )
-            TraceLong[i] = (int)TraceShort[i];
-      }
-
-/* Compute the number of samples since the end of the previous message.
-   If (GapSize == 1), no data has been lost between messages.
-   If (1 < GapSize <= Gparm.MaxGap), data will be interpolated.
-   If (GapSize > Gparm.MaxGap), the picker will go into restart mode.
-   *******************************************************************/
-      GapSizeD = Trace2Head->samprate * (Trace2Head->starttime - Sta->endtime);
-
-      if ( GapSizeD < 0. )          /* Invalid. Time going backwards. */
-         GapSize = 0;
-      else
-         GapSize  = (int) (GapSizeD + 0.5);
-
-/* Interpolate missing samples and prepend them to the current message
-   *******************************************************************/
-      if ( (GapSize > 1) && (GapSize <= Gparm.MaxGap) )
-         Interpolate( Sta, TraceBuf, GapSize );
-
-/* Announce large sample gaps
-   **************************/
-      if ( GapSize > Gparm.MaxGap )
-      {
-         int      lineLen;
-         time_t   errTime;
-         char     errmsg[80];
-         MSG_LOGO logo;
-
-         time( &errTime );
-         sprintf( errmsg,
-               "%ld %d Found %4d sample gap. Restarting channel %s.%s.%s.%s\n",
-               (long) errTime, PK_RESTART, GapSize, Sta->sta, Sta->chan, Sta->net, Sta->loc );
-         lineLen = strlen( errmsg );
-         logo.type   = Ewh.TypeError;
-         logo.mod    = Gparm.MyModId;
-         logo.instid = Ewh.MyInstId;
-         tport_putmsg( &Gparm.OutRegion, &logo, lineLen, errmsg );
-      }
-
-/* For big gaps, enter restart mode. In restart mode, calculate
-   STAs and LTAs without picking.  Start picking again after a
-   specified number of samples has been processed.
-   *************************************************************/
-      if ( Restart( Sta, &Gparm, Trace2Head->nsamp, GapSize ) )
-      {
-         for ( i = 0; i < Trace2Head->nsamp; i++ )
-            Sample( TraceLong[i], Sta );
-      }
-      else
-         PickRA( Sta, TraceBuf, &Gparm, &Ewh );
-
-/* Save time and amplitude of the end of the current message
+/* Swap the samples if need be and convert them to doubles,
+   whatever their type, in one pass.  Drop the message if a
+   sample isn't a finite number.
    *********************************************************/
-      Sta->enddata = TraceLong[Trace2Head->nsamp - 1];
-      Sta->endtime = Trace2Head->endtime;
+      if ( DecodeMsg( TraceBuf, WaveBuf ) == -1 )
+         continue;
+
+/* Pick the message now, hold it until the messages before it
+   arrive, or drop it if its data has been picked already
+   ************************************************************/
+      ReorderMsg( Sta, WaveBuf, &Gparm, &Ewh );
 
 /* Send a heartbeat to the transport ring
    **************************************/
@@ -475,33 +664,116 @@ int main( int argc, char **argv )
          char line[40];
 
          then = now;
+         EvictAutoStations();
 
          sprintf( line, "%ld %d\n", (long) now, (int) myPid );
          lineLen = strlen( line );
 
-         if ( tport_putmsg( &Gparm.OutRegion, &hrtlogo, lineLen, line ) !=
-              PUT_OK )
+         if ( PutOutMsg( &hrtlogo, OUT_HEARTBEAT, lineLen, line ) != PUT_OK )
          {
-            logit( "et", PROGRAM_NAME ": Error sending heartbeat. Exiting." );
-            break;
+            if ( Gparm.OutQueueSize == 0 )
+            {
+               logit( "et", PROGRAM_NAME ": Error sending heartbeat. Exiting." );
+               break;
+            }
+            logit( "et", PROGRAM_NAME ": Output queue full; heartbeat dropped.\n" );
          }
       }
+
+/* Send binary picks/codas that have waited long enough
+   ****************************************************/
+      FlushBinary( 0 );
+
+/* Log statistics
+   **************/
+      if ( (Gparm.StatsInt > 0) && ((now - thenStats) >= Gparm.StatsInt) )
+      {
+         thenStats = now;
+         LogInRingStats();
+         LogShardStats();
+         LogShedStats();
+         LogEarlyStats();
+         LogBankStats();
+         LogOnsetStats();
+         LogAmpStats();
+         LogNoiseStats();
+         LogOutQueueStats();
+         LogAutoStats();
+         LogReorderStats();
+         LogDupStats();
+      }
+
+/* Summarize gaps and update the restart table and noise QC file
+   **************************************************************/
+      if ( (now - thenGap) >= ((Gparm.GapReportInt > 0) ? Gparm.GapReportInt :
+                                                          Gparm.HeartbeatInt) )
+      {
+         thenGap = now;
+         GapSummary( StaArray, Nsta, &Gparm, &Ewh );
+         UpdateRestartTable( StaArray, Nsta );
+         RequestNoiseQC();
+      }
+
+/* Save the filter state
+   *********************/
+      if ( (Gparm.SnapFile != NULL) && ((now - thenSnap) >= Gparm.SnapInt) )
+      {
+         thenSnap = now;
+         WriteSnapshot( StaArray, Nsta, &Gparm );
+      }
    }
 
+/* Publish whatever is still queued
+   ********************************/
+   FlushBinary( 1 );
+   GapSummary( StaArray, Nsta, &Gparm, &Ewh );
+   UpdateRestartTable( StaArray, Nsta );
+   RequestNoiseQC();
+   WriteSnapshot( StaArray, Nsta, &Gparm );
+   CloseSnapshot();
+   LogInRingStats();
+   LogShardStats();
+   LogShedStats();
+   LogEarlyStats();
+   LogBankStats();
+   LogOnsetStats();
+   LogAmpStats();
+   LogNoiseStats();
+   LogOutQueueStats();
+   StopOutQueue();
+   StopOnset();
+   StopNoise();
+   StopRestartTable();
+   StopStaReload();
+   LogAutoStats();
+   LogReorderStats();
+   LogDupStats();
+   FreeAutoStations();
+
 /* Detach from the ring buffers
    ****************************/
-   if ( Gparm.OutKey != Gparm.InKey )
-   {
-      tport_detach( &Gparm.InRegion );
+   StopInRings();
+   if ( !OutShared )
       tport_detach( &Gparm.OutRegion );
-   }
-   else
-      tport_detach( &Gparm.InRegion );
 
    logit( "t", "Termination requested. Exiting.\n" );
+   FreeClassifier();
+   ClosePickIndex();
    free( Gparm.GetLogo );
+   free( Gparm.InRing );
+   free( Gparm.ShedChan );
    free( Gparm.StaFile );
+   for ( i = 0; i < Nsta; i++ )
+   {
+      FreeReorder( &StaArray[i] );
+      FreeBank( &StaArray[i] );
+      FreeOnset( &StaArray[i] );
+      FreeAmp( &StaArray[i] );
+      FreeNoise( &StaArray[i] );
+   }
    free( StaArray );
+   free( TraceBuf );
+   FreeDecode();
    return 0;
 }
 
@@ -562,3 +834,81 @@ int GetEwh( EWH *Ewh )
    }
    return 0;
 }
+
+
+      /*******************************************************
+       *                      PickMsg()                      *
+       *                                                     *
+       *  Run one message of a channel through the picker.   *
+       *  The message must have been decoded (samples are   *
+       *  doubles), with room for MaxGap-1 more samples in   *
+       *  front of its header.                               *
+       *******************************************************/
+
+void PickMsg( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh )
+{
+   TRACE2_HEADER *Trace2Head = (TRACE2_HEADER *) WaveBuf;
+   double        *TraceData;
+   double        GapSizeD;         /* Number of missing samples (double) */
+   int           GapSize;          /* Number of missing samples (integer) */
+   int           i;
+
+/* Compute the number of samples since the end of the previous message.
+   If (GapSize == 1), no data has been lost between messages.
+   If (1 < GapSize <= Gparm->MaxGap), data will be interpolated.
+   If (GapSize > Gparm->MaxGap), the picker will go into restart mode.
+   *******************************************************************/
+   GapSizeD = Trace2Head->samprate * (Trace2Head->starttime - Sta->endtime);
+
+   if ( GapSizeD < 0. )          /* Invalid. Time going backwards. */
+      GapSize = 0;
+   else
+      GapSize  = (int) (GapSizeD + 0.5);
+
+/* Interpolate missing samples and prepend them to the current message
+   *******************************************************************/
+   if ( (GapSize > 1) && (GapSize <= Gparm->MaxGap) )
+   {
+      WaveBuf    = Interpolate( Sta, WaveBuf, GapSize );
+      Trace2Head = (TRACE2_HEADER *) WaveBuf;
+   }
+   TraceData = (double *) (WaveBuf + sizeof(TRACE2_HEADER));
+
+/* Count large sample gaps, announcing them now
+   or in the next summary
+   *********************************************/
+   if ( GapSize > Gparm->MaxGap )
+      ReportGap( Sta, GapSize, Gparm, Ewh );
+
+/* A big gap ends the event.  Take back a pick that went out
+   early, as its coda won't get any longer.
+   **********************************************************/
+   if ( (GapSize > Gparm->MaxGap) && Sta->active && Sta->Ev->early )
+      RetractPick( &Sta->Ev->Coda, Gparm, Ewh );
+
+/* Keep the channel's filter bank, onset history, amplitude
+   and noise state, if it has them, set for the sample rate
+   of its data
+   *********************************************************/
+   SetBankRate( Sta, Trace2Head->samprate );
+   SetOnsetRate( Sta, Trace2Head->samprate );
+   SetAmpRate( Sta, Trace2Head->samprate );
+   SetNoiseRate( Sta, Trace2Head->samprate );
+
+/* For big gaps, enter restart mode. In restart mode, calculate
+   STAs and LTAs without picking.  Start picking again after a
+   specified number of samples has been processed.
+   *************************************************************/
+   if ( Restart( Sta, Gparm, Trace2Head->nsamp, GapSize ) )
+   {
+      for ( i = 0; i < Trace2Head->nsamp; i++ )
+         Sample( TraceData[i], Sta );
+   }
+   else
+      PickRA( Sta, WaveBuf, Gparm, Ewh );
+
+/* Save time and amplitude of the end of the current message
+   *********************************************************/
+   Sta->enddata = TraceData[Trace2Head->nsamp - 1];
+   Sta->endtime = Trace2Head->endtime;
+}
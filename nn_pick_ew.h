@@ -55,6 +55,7 @@ typedef struct {
    double xpk[3];           /* Absolute value of first three extrema after ipic */
    char   FirstMotion;      /* First motion  ?=Not determined  U=Up  D=Down */
    int    weight;           /* Pick weight (0-3) */
+   double prob;             /* Classifier event probability (-1 if none) */
    int    status;           /* Pick status :
                                0 = picker is in idle mode
                                1 = pick active but not complete
@@ -103,27 +104,83 @@ typedef struct {
    double Erefs;            /* Event termination parameter */
 } PARM;
 
-/* Station list parameters
-   ***********************/
+/* Named parameter sets and wildcard SCNL rules from the station
+   list.  The PARMs they point to are shared (see profile.c).
+   *************************************************************/
+#define PROFILE_LEN 32
+
+typedef struct {
+   char   name[PROFILE_LEN];  /* Profile name */
+   PARM   *Parm;
+} PROFILE;
+
+typedef struct {
+   int    pickflag;         /* Pick flag given with the rule */
+   char   sta[6];           /* SCNL patterns; '*' and '?' are wildcards */
+   char   chan[4];
+   char   net[3];
+   char   loc[3];
+   PARM   *Parm;            /* Parameters for matching channels */
+} STARULE;
+
+typedef struct {
+   int     nprof, maxprof;
+   PROFILE *prof;
+   int     nrule, maxrule;
+   STARULE *rule;           /* In station list order; first match wins */
+} RULESET;
+
+/* Gap counters of one channel.  These survive restarts.
+   *****************************************************/
+typedef struct {
+   int    ngap;             /* Gaps > MaxGap since the last gap summary */
+   double nmiss;            /* Samples missing in those gaps */
+   int    ngap_total;       /* Gaps > MaxGap since startup */
+   double nmiss_total;      /* Samples missing in those gaps */
+   double lastgap;          /* Time of the last gap > MaxGap (0 if none) */
+} GAPSTAT;
+
+/* Restart state of one channel, as kept in the restart table
+   (see gap.c) and written to RestartFile
+   **********************************************************/
+#define RS_NODATA   0       /* No data yet */
+#define RS_RESTART  1       /* Fewer than RestartLength samples since restart */
+#define RS_PICKING  2
+
+typedef struct {
+   char   sta[6];
+   char   chan[4];
+   char   net[3];
+   char   loc[3];
+   int    state;            /* RS_NODATA, RS_RESTART or RS_PICKING */
+   int    ns_restart;       /* Samples since restart */
+   int    ngap_total;       /* Gaps > MaxGap since startup */
+   double nmiss_total;      /* Samples missing in those gaps */
+   double lastgap;          /* Time of the last gap > MaxGap (0 if none) */
+} RESTARTSTATE;
+
+/* The last few messages of one channel, to spot duplicates
+   (see dupcheck.c)
+   **********************************************************/
+#define NDUPKEY 4
+
+typedef struct {
+   double starttime[NDUPKEY];   /* Start time of the message */
+   int    nsamp[NDUPKEY];       /* Samples in it */
+   unsigned int sum[NDUPKEY];   /* Checksum of the samples */
+   int    next;                 /* Slot to use next */
+} DUPKEYS;
+
+/* Event-time variables of one channel.  Only touched while
+   a pick or coda is active, and when one is reported.
+   *********************************************************/
 typedef struct {
-   char   sta[6];           /* Station name */
-   char   chan[4];          /* Component code */
-   char   net[3];           /* Network code */
-   char   loc[3];           /* Location code */
    CODA   Coda;             /* Coda structure */
    PICK   Pick;             /* Pick structure */
-   PARM   Parm;             /* Configuration file parameters */
    double cocrit;           /* Threshold at which to terminate coda measurement */
    double crtinc;           /* Increment added to ecrit at each zero crossing */
-   double eabs;             /* Running mean absolute value (aav) of rdat */
    double ecrit;            /* Criterion level to determine if event is over */
-   double elta;             /* Long-term average of edat */
-   int    enddata;          /* Last data value of previous message */
-   double endtime;          /* Stop time of previous message */
-   double eref;             /* STA/LTA reference level */
-   double esta;             /* Short-term average of edat */
    int    evlen;            /* Event length in samp */
-   int    first;            /* 1 the first time this channel is found */
    int    isml;             /* Small zero-crossing counter */
    int    k;                /* Index to array of windows to push onto stack */
    int    m;                /* 0 if no event; otherwise, zero-crossing counter */
@@ -131,30 +188,355 @@ typedef struct {
    int    ndrt;             /* Coda length index within window */
    int    next;             /* Counter of zero crossings early in P-phase */
    int    nzero;            /* Big zero-crossing counter */
-   int    old_sample;       /* Old value of integer data */
-   int    ns_restart;       /* Number of samples since restart */
-   double rdat;             /* Filtered data value */
    double rbig;             /* Threshold for big zero crossings */
    double rlast;            /* Size of last big zero crossing */
-   double rold;             /* Previous value of filtered data */
    double rsrdat;           /* Running sum of rdat in coda calculation */
-   int    sarray[10];       /* First 10 points after pick for 1'st motion determ */
+   double sarray[10];       /* First 10 points after pick for 1'st motion determ */
    double tmax;             /* Instantaneous maximum in current half cycle */
-   int    xdot;             /* First difference at pick time */
+   double xdot;             /* First difference at pick time */
    double xfrz;             /* Used in first motion calculation */
+   int    early;            /* 1 while an EarlyPick is out and its coda
+                               isn't MinCodaLen long yet */
+} STAEVENT;
+
+/* Filter-bank trigger state of one channel (PickEngine bank; see
+   bank.c).  Each array holds one value per band, so a loop over
+   the bands works on whole vector registers.  Bands past the ones
+   in use have zero coefficients and never trigger.
+   ****************************************************************/
+#define NBAND 8
+
+typedef struct bank {
+   double aH[NBAND];        /* High-pass coefficient of each band */
+   double aL[NBAND];        /* Low-pass and envelope coefficient */
+   double hp[NBAND];        /* High-passed data */
+   double l1[NBAND];        /* After the first low-pass */
+   double l2[NBAND];        /* After the second: the band's signal */
+   double env[NBAND];       /* Smoothed power of the band */
+   double mean[NBAND];      /* Long-term mean of env */
+   double var[NBAND];       /* Long-term variance of env */
+   double aLong;            /* Coefficient of the long-term averages */
+   double xold;             /* Previous sample */
+   double samprate;         /* Rate the coefficients are for; 0 = not set */
+   int    nsamp;            /* Samples since reset, up to nwarm */
+   int    nwarm;            /* Samples before the bank may trigger */
+   int    trig;             /* 1 if a band is over the threshold */
+} BANKSTATE;
+
+/* Onset refinement state of one channel (OnsetRefine; see onset.c).
+   The last samples are kept in a ring.  At a trigger, a window of
+   them around the trigger is copied to win for the refinement
+   thread, which leaves the refined onset in ionset.
+   *****************************************************************/
+#define ONSET_IDLE    0     /* No window handed over */
+#define ONSET_QUEUED  1     /* Waiting for the refinement thread */
+#define ONSET_RUNNING 2     /* Being refined */
+#define ONSET_DONE    3     /* Refined; ionset is set */
+#define ONSET_DROPPED 4     /* Being refined; the result isn't wanted */
+#define ONSET_ORPHAN  5     /* Being refined; the thread frees the state */
+
+typedef struct onset {
+   double *hist;            /* Last hlen raw samples, a ring */
+   double *win;             /* Window around the trigger */
+   int    hlen;             /* Length of hist, a power of two */
+   int    npre;             /* Samples before the trigger in a window */
+   int    npost;            /* Samples after it */
+   int    nkurt;            /* Samples in the kurtosis window */
+   double samprate;         /* Rate the lengths are for; 0 = not set */
+   unsigned long n;         /* Samples since reset */
+   unsigned long trig;      /* n just after the trigger sample */
+   int    pending;          /* 1 if the trigger's window isn't handed over yet */
+   int    nwin;             /* Samples in win */
+   int    itrig;            /* Index of the trigger sample in win */
+   int    ionset;           /* Index of the refined onset in win; -1 = none */
+   int    state;            /* ONSET_IDLE ... ONSET_ORPHAN, guarded by a mutex */
+} ONSETSTATE;
+
+/* Amplitude measurement of one channel (AmpWindow; see amp.c).
+   The largest peak-to-peak swing of the raw data and of the
+   Wood-Anderson simulation are followed while an event is active.
+   ***************************************************************/
+typedef struct {
+   double last;             /* Previous value */
+   double ext;              /* Last extremum */
+   double pp;               /* Largest peak-to-peak swing so far */
+   double per;              /* Period of that swing (s) */
+   int    dir;              /* Direction of the trace: 1 up, -1 down, 0 not known */
+   int    iext;             /* Sample of the last extremum */
+   int    ipk;              /* Sample of the end of the largest swing */
+} AMPPEAK;
+
+typedef struct amp {
+   double b0, b2, a1, a2;   /* Wood-Anderson biquad, velocity in (b1 is 0) */
+   double s1, s2;           /* Its state */
+   double samprate;         /* Rate the coefficients are for; 0 = not set */
+   double tstart;           /* Time of the first sample measured */
+   int    active;           /* 1 while measuring */
+   int    nsamp;            /* Samples measured */
+   int    nmax;             /* Samples in AmpWindow */
+   int    pickindex;        /* Index of the event's reported pick; -1 = none */
+   AMPPEAK raw;             /* Raw data */
+   AMPPEAK wa;              /* Wood-Anderson simulation */
+} AMPSTATE;
+
+/* Background noise of one channel (NoisePSD; see noise.c).  Samples
+   outside events are decimated into Welch segments, which the noise
+   thread averages into a power spectral density.  The decimated
+   samples of an event are summed for the signal-to-noise ratio of
+   its pick.  The states of all channels are listed for the noise
+   thread, which writes the NoiseQCFile.
+   *****************************************************************/
+#define NOISE_IDLE    0     /* No segment handed over */
+#define NOISE_QUEUED  1     /* Waiting for the noise thread */
+#define NOISE_RUNNING 2     /* Being transformed */
+#define NOISE_DROPPED 3     /* Being transformed; not to be averaged */
+#define NOISE_ORPHAN  4     /* Being transformed; the thread frees the state */
+
+typedef struct noise {
+   double *seg;             /* Decimated samples of the segment being filled */
+   double *job;             /* Segment handed to the noise thread */
+   double *psd;             /* Averaged PSD, nfft/2+1 bins (counts^2/Hz) */
+   double samprate;         /* Rate of the raw data; 0 = not set */
+   double acc;              /* Sum of the raw samples being decimated */
+   double level;            /* Mean of the last full segment */
+   double evpow;            /* Sum of squares of the event's samples, less level */
+   double noisevar;         /* Noise power: the PSD summed over its band */
+   double snr;              /* SNR of the last pick (dB) */
+   double rms;              /* Noise rms at the last pick (counts); 0 = SNR not known */
+   double qcsnr;            /* snr, or 0 if not known, for the QC file; guarded */
+   struct noise *prev;      /* Neighbours in the list of channels, guarded */
+   struct noise *next;
+   char   scnl[20];         /* sta.chan.net.loc, for the QC file */
+   int    nacc;             /* Raw samples in acc */
+   int    nseg;             /* Samples in seg */
+   int    nev;              /* Decimated samples in evpow */
+   int    inevent;          /* 1 while the channel's event is active */
+   int    navg;             /* Segments averaged into psd */
+   int    state;            /* NOISE_IDLE ... NOISE_ORPHAN, guarded by a mutex */
+} NOISESTATE;
+
+/* Station list parameters.
+   The table is an array of these, kept small so that the state
+   touched for every sample (the first 64 bytes) and the lookup
+   key of neighbouring channels share few cache lines.  Event-time
+   variables and gap counters live in separate blocks allocated
+   with the table (see statable.c).
+   ***************************************************************/
+typedef struct station {
+   PARM   *Parm;            /* Picking parameters, shared (see profile.c) */
+   double rdat;             /* Filtered data value */
+   double rold;             /* Previous value of filtered data */
+   double esta;             /* Short-term average of edat */
+   double elta;             /* Long-term average of edat */
+   double eref;             /* STA/LTA reference level */
+   double eabs;             /* Running mean absolute value (aav) of rdat */
+   double old_sample;       /* Old value of data */
+   char   sta[6];           /* Station name */
+   char   chan[4];          /* Component code */
+   char   net[3];           /* Network code */
+   char   loc[3];           /* Location code */
+   int    first;            /* 1 the first time this channel is found */
+   int    ns_restart;       /* Number of samples since restart */
+   double enddata;          /* Last data value of previous message */
+   double endtime;          /* Stop time of previous message */
+   int    active;           /* 1 while a pick or coda is active */
+   STAEVENT *Ev;            /* Event-time variables */
+   GAPSTAT  *Gap;           /* Gap counters */
+   DUPKEYS  *Dup;           /* Recent messages */
+   struct reorder *Ro;      /* Messages held back, or NULL (see reorder.c) */
+   struct bank *Bank;       /* Filter-bank state, or NULL (see bank.c) */
+   struct onset *On;        /* Onset refinement state, or NULL (see onset.c) */
+   struct amp *Amp;         /* Amplitude measurement, or NULL (see amp.c) */
+   struct noise *Noise;     /* Noise spectrum and SNR, or NULL (see noise.c) */
 } STATION;
 
+/* Reorder buffer of one channel.  Messages that arrive ahead of
+   the channel's data wait here, in time order, for the ones
+   missing before them.
+   **************************************************************/
+typedef struct {
+   double arrival;          /* hrtime_ew() when the message arrived */
+   char   *msg;             /* Copy of the message */
+   char   *mem;             /* As allocated, with room in front of msg */
+} HELDMSG;
+
+typedef struct reorder {
+   struct station *Sta;     /* Channel the buffer belongs to */
+   int     nheld;           /* Messages held */
+   HELDMSG *held;           /* ReorderMax of them, earliest first */
+   struct reorder *prev;    /* List of buffers holding messages */
+   struct reorder *next;
+} REORDER;
+
+/* Pick classifier features, computed when a pick is validated
+   ************************************************************/
+#define FEAT_XPK0     0     /* First three extrema after the pick */
+#define FEAT_XPK1     1
+#define FEAT_XPK2     2
+#define FEAT_XDOT     3     /* First difference at pick time */
+#define FEAT_XFRZ     4     /* 1.6 * eabs at pick time */
+#define FEAT_EABS     5     /* Running mean absolute value now */
+#define FEAT_SMALLZC  6     /* Small zero-crossing count (m) */
+#define FEAT_BIGZC    7     /* Big zero-crossing count (nzero) */
+#define FEAT_XP0      8     /* xpk[0..2] / xfrz */
+#define FEAT_XP1      9
+#define FEAT_XP2     10
+#define FEAT_XON     11     /* |xdot| / xfrz */
+#define FEAT_SNR     12     /* Signal-to-noise ratio (dB); 0 if not known */
+#define FEAT_XPN     13     /* xpk[0] / noise rms; 0 if not known */
+#define NFEATURE     14     /* Number of classifier features */
+
+#define MAXTREEDEPTH 10     /* Deepest tree the classifier will compile */
+
+/* Pick classifier: a gradient-boosted tree ensemble compiled into
+   complete binary trees of equal depth, stored as flat arrays.
+   Interior node n of a tree has children 2n+1 (x <= thresh) and
+   2n+2 (x > thresh), so evaluation needs no branches.
+   ***************************************************************/
+typedef struct {
+   int     ntree;           /* Number of trees in the ensemble */
+   int     depth;           /* Depth of every (padded) tree */
+   int     nnode;           /* Interior nodes per tree (2^depth - 1) */
+   int     nleaf;           /* Leaves per tree (2^depth) */
+   int    *feat;            /* Feature index of each interior node */
+   double *thresh;          /* Split threshold of each interior node */
+   double *leaf;            /* Leaf values */
+   double  base;            /* Score before any tree is added */
+   double  cut[4];          /* Score cuts: noise, weight 2, weight 1, weight 0 */
+} CLASSIFIER;
+
+/* Output message priorities, highest first
+   ****************************************/
+#define OUT_PICK      0
+#define OUT_CODA      1
+#define OUT_ERROR     2
+#define OUT_HEARTBEAT 3
+#define NOUTPRIO      4
+
+/* Output queue counters
+   *********************/
+typedef struct {
+   int           depth;             /* Messages queued or being published */
+   int           maxdepth;          /* Largest depth seen */
+   unsigned long queued[NOUTPRIO];  /* Messages accepted, per priority */
+   unsigned long published[NOUTPRIO];  /* Messages written to the ring */
+   unsigned long dropped[NOUTPRIO]; /* Messages lost because the queue was full */
+   unsigned long failed[NOUTPRIO];  /* Messages tport_putmsg() refused */
+   unsigned long npublished;        /* Sum of published[] */
+   double        latsum;            /* Sum of queue-to-ring latencies (s) */
+   double        latmax;            /* Largest queue-to-ring latency (s) */
+} OUTQSTATS;
+
+/* Binary pick/coda message (BinaryMsgType).
+   A 16-byte header followed by nrec 112-byte records, all fields
+   little-endian.  The structures below have exactly this layout
+   (no padding), so little-endian readers can use them directly.
+   ***************************************************************/
+#define PKB_MAGIC      "PKB"
+#define PKB_VERSION    1
+#define PKB_PICK       1    /* Record kinds */
+#define PKB_CODA       2
+#define PKB_RETRACT    3    /* An EarlyPick whose coda was too short */
+#define PKB_AMP        4    /* Peak amplitudes of a pick's event (AmpWindow) */
+#define PKB_MAXPROB    4
+
+typedef struct {
+   char           magic[3];      /* "PKB" */
+   unsigned char  version;       /* PKB_VERSION */
+   unsigned short nrec;          /* Number of records that follow */
+   unsigned short reclen;        /* sizeof(PKB_REC) */
+   unsigned char  modid;         /* Module and installation of the picker */
+   unsigned char  instid;
+   unsigned char  pad[6];
+} PKB_HDR;
+
+typedef struct {
+   unsigned char  kind;          /* PKB_PICK, PKB_CODA, PKB_RETRACT or PKB_AMP */
+   char           FirstMotion;   /* U, D or ? (picks) */
+   signed char    weight;        /* Pick weight 0-3 (picks) */
+   unsigned char  nprob;         /* Number of valid prob[] entries */
+   int            PickIndex;     /* Pick index; a coda has its pick's index */
+   char           sta[6];        /* Null-terminated SCNL */
+   char           chan[4];
+   char           net[3];
+   char           loc[3];
+   double         time;          /* Pick time, seconds since 1970 (picks);
+                                    time of the Wood-Anderson peak (amps) */
+   double         xpk[3];        /* First three extrema after the pick (picks);
+                                    raw and Wood-Anderson amplitudes (amps) */
+   int            aav[6];        /* Coda average absolute values (codas) */
+   int            len_out;       /* Coda length in seconds, maybe * -1 (codas) */
+   float          prob[PKB_MAXPROB];  /* Classifier probabilities (picks);
+                                         raw and Wood-Anderson periods (amps) */
+   unsigned char  pad[12];
+} PKB_REC;
+
+/* Picking engines: what starts an event in search mode
+   ****************************************************/
+#define ENGINE_RA     0     /* STA/LTA of the single characteristic function */
+#define ENGINE_BANK   1     /* Any band of a filter bank (see bank.c) */
+
+/* Kinds of thread that can be pinned with CpuSet
+   ***********************************************/
+#define THR_PICKER    0
+#define THR_READER    1
+#define THR_PUBLISHER 2
+#define THR_RELOAD    3
+#define THR_ONSET     4
+#define THR_NOISE     5
+#define NTHREADROLE   6
+
+/* Sleep of a thread polling for input while there is
+   none; it grows by a millisecond per empty poll
+   ****************************************************/
+#define IDLE_MIN_MS   1     /* First sleep (ms) */
+#define IDLE_MAX_MS   5     /* Longest sleep (ms) */
+
+/* Load-shedding levels.  Each level also does what the ones
+   below it do (see shed.c).
+   **********************************************************/
+#define SHED_CODA      1    /* Codas not measured */
+#define SHED_CLASSIFY  2    /* Pick classifier not run */
+#define SHED_CHANNELS  3    /* ShedChannel channels not picked */
+#define NSHEDLEVEL     4    /* Including level 0, normal operation */
+
+typedef struct {
+   char   sta[6];           /* SCNL patterns; '*' and '?' are wildcards */
+   char   chan[4];
+   char   net[3];
+   char   loc[3];
+} SCNLPAT;
+
+#define RING_NAME_LEN 32
+typedef struct {
+   char      name[RING_NAME_LEN];  /* As given to InRing */
+   long      key;
+   int       nlogo;              /* Logos to read; 0 = those of GPARM */
+   MSG_LOGO *logo;
+   SHM_INFO  region;
+} INRING;
+
 #define STAFILE_LEN 64
 typedef struct {
    char   name[STAFILE_LEN]; /* Name of station file */
    int    nsta;              /* number of channels configure in this file */
+   double mtime;             /* Modification time when last read */
+   unsigned int size;        /* Size in bytes when last read */
+   unsigned int hash;        /* FNV-1a hash of the contents when last read */
 } STAFILE;
 
 typedef struct {
    STAFILE  *StaFile;       /* Name of file(s) with SCNL info */
    char *PickIndexDir;      /* an optional directory to place pick index files, to get them out of the param dir */
+   int       PickIndexBlock;/* Pick indexes reserved per index file write */
    int       nStaFile;      /* Number of StaFile commands given */
-   long      InKey;         /* Key to ring where waveforms live */
+   char     *StaCacheFile;  /* Optional compiled station table */
+   int       StaReloadInt;  /* Check StaFiles for changes this often (s); 0 = never */
+   int       AutoMax;       /* Most channels added by rule; 0 = don't add any */
+   int       AutoEvictSec;  /* Drop added channels silent this long (s) */
+   double    StartTime;     /* hrtime_ew() at startup */
+   int       nInRing;       /* Number of InRing commands given */
+   INRING   *InRing;        /* Rings where waveforms live */
    long      OutKey;        /* Key to ring where picks will live */
    int       HeartbeatInt;  /* Heartbeat interval in seconds */
    int       RestartLength; /* Number of samples to process for restart */
@@ -162,11 +544,51 @@ typedef struct {
    int       Debug;         /* If 1, print debug messages */
    int       NoCoda;        /* If 1, just do picks, no coda's */
    int       NoCodaHorizontal;        /* If 1, just do coda's on vertical (Z) components */
+   int       EarlyPick;     /* If 1, send picks before their coda is MinCodaLen long */
+   int       PickEngine;    /* ENGINE_RA or ENGINE_BANK */
+   int       BankBands;     /* Bands of the filter bank (1 to NBAND) */
+   double    BankThresh;    /* Trigger at this many standard deviations */
+   double    BankLongSec;   /* Time constant of the long-term statistics (s) */
+   double    OnsetPre;      /* Refine onsets from this long before the trigger (s); 0 = off */
+   double    OnsetPost;     /* to this long after it (s) */
+   double    OnsetKurt;     /* Length of the kurtosis window (s) */
+   char      RetractMsgType[32];  /* Message type name for retracted early picks */
+   double    AmpWindow;     /* Measure amplitudes this long after a trigger (s); 0 = off */
+   char      AmpMsgType[32];  /* Message type name for amplitudes */
+   int       NoiseNfft;     /* Samples per noise PSD segment, after decimation; 0 = off */
+   int       NoiseDecim;    /* Raw samples per decimated sample */
+   double    NoiseBudget;   /* Most cpu the noise thread may use (percent) */
+   double    SnrWeight;     /* Lower the weight of picks with a lower SNR (dB); 0 = don't */
+   char     *NoiseQCFile;   /* Optional file to write channel noise levels to */
+   int       OutQueueSize;  /* Output queue slots; 0 = write to OutRing inline */
+   int       OutBatch;      /* Messages the publisher writes per pass */
+   int       StatsInt;      /* Interval for logging statistics (s); 0 = never */
+   int       GapReportInt;  /* Interval of gap summary messages (s); 0 = one per gap */
+   char     *RestartFile;   /* Optional file to write channel restart states to */
+   char     *SnapFile;      /* Optional filter-state snapshot file */
+   int       SnapInt;       /* Snapshot interval (s) */
+   int       SnapMaxAge;    /* Resume channels whose data restarts within this (s) */
+   int       ReorderHoldMs; /* Longest a message waits for earlier ones (ms); 0 = never */
+   int       ReorderMax;    /* Most messages held per channel */
+   int       DupCheck;      /* If 1, drop messages a channel has had already */
+   int       ShardId;       /* This instance picks the channels hashing to ShardId */
+   int       ShardCount;    /* of ShardCount; 1 = pick them all */
+   char     *CpuSet[NTHREADROLE];  /* CPU lists of the thread kinds; NULL = not pinned */
+   double    ShedEnter[NSHEDLEVEL];  /* Data lag (s) at which a shedding level starts; 0 = unused */
+   double    ShedLeave[NSHEDLEVEL];  /* Data lag (s) below which it ends */
+   int       nShedChan;     /* Number of ShedChannel commands given */
+   SCNLPAT  *ShedChan;      /* Channels not picked at level SHED_CHANNELS */
+   int       BinaryOutput;  /* 0 = text only, 1 = text and binary, 2 = binary only */
+   char      BinaryMsgType[32];  /* Message type name for binary picks/codas */
+   int       BinaryBatch;   /* Records per binary message */
+   int       BinaryFlushMs; /* Longest a record waits for its batch to fill */
+   char     *ClassifierFile;/* Optional pick classifier model file */
+   char     *FeatureFile;   /* Optional file to dump pick features to */
    unsigned char MyModId;   /* Module id of this program */
-   SHM_INFO  InRegion;      /* Info structure for input region */
    SHM_INFO  OutRegion;     /* Info structure for output region */
    int       nGetLogo;      /* Number of logos in GetLogo   */
-   MSG_LOGO *GetLogo;       /* Logos of requested waveforms */
+   MSG_LOGO *GetLogo;       /* Logos of requested waveforms, for
+                               rings without GetLogo commands of their own */
 } GPARM;
 
 typedef struct {
@@ -179,4 +601,7 @@ typedef struct {
    unsigned char TypeCodaScnl;
    unsigned char TypeTracebuf;    /* Waveform buffer for data input (no loc code) */
    unsigned char TypeTracebuf2;   /* Waveform buffer for data input (w/loc code) */
+   unsigned char TypePickBin;     /* Binary picks and codas (if BinaryOutput) */
+   unsigned char TypePickRetract; /* Retracted early picks (if EarlyPick) */
+   unsigned char TypePickAmp;     /* Peak amplitudes (if AmpWindow) */
 } EWH;
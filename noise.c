@@ -0,0 +1,771 @@
+  /**********************************************************************
+   *                              noise.c                               *
+   *                                                                    *
+   *             Background noise spectrum and pick SNR                 *
+   *                                                                    *
+   *  This file contains functions InitNoise(), SetNoiseRate(),         *
+   *  NoiseSample(), PickSnr(), SnrWeight(), ResetNoise(),              *
+   *  FreeNoise(), RequestNoiseQC(), StopNoise() and LogNoiseStats().   *
+   *                                                                    *
+   *  With NoisePSD set, each channel keeps a power spectral density    *
+   *  of its background noise, updated as the data comes in.  The raw   *
+   *  samples are averaged NoiseDecim at a time, and the decimated      *
+   *  samples seen while no event is active are cut into segments of    *
+   *  NoiseNfft, overlapping by half (Welch's method).  A full segment  *
+   *  is copied out and queued for the noise thread, which removes its  *
+   *  mean, applies a Hann window, transforms it and folds its          *
+   *  periodogram into the channel's PSD: a running mean over the       *
+   *  first NOISE_NAVG segments, an exponential average after that.     *
+   *  An event throws away the segment it cut into.                     *
+   *                                                                    *
+   *  The picking thread never waits for the noise thread.  If the      *
+   *  last segment of a channel hasn't been taken yet, or the queue is  *
+   *  full, the new one is skipped.  A segment being transformed when   *
+   *  its channel starts over isn't averaged, and a channel freed then  *
+   *  leaves its state to the noise thread to free.  The noise thread   *
+   *  runs at low priority and sleeps for the rest of each second once  *
+   *  it has been busy for NoiseBudget percent of it.                   *
+   *                                                                    *
+   *  The decimated samples of an event, from its trigger on, are       *
+   *  summed as they come in.  When the pick is validated, their mean   *
+   *  square about the level of the last segment, over the noise power  *
+   *  (the PSD summed over its band), is the pick's SNR.  It is a       *
+   *  classifier feature and lowers the weight of picks under           *
+   *  SnrWeight dB.  When the picking thread asks for it, the noise     *
+   *  thread writes each channel's noise rms, octave-band levels and    *
+   *  last SNR to the NoiseQCFile.                                      *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <earthworm.h>
+#include <transport.h>
+#include <time_ew.h>
+#include "nn_pick_ew.h"
+
+#if defined( _LINUX )
+ #include <unistd.h>
+ #include <sys/resource.h>
+ #include <sys/syscall.h>
+#elif defined( _WINNT )
+ #include <windows.h>
+#endif
+
+#ifndef M_PI
+#define M_PI  3.14159265358979323846
+#endif
+
+#define THREAD_STACK  65536
+#define NOISE_QLEN    1024       /* Segments waiting for the noise thread */
+#define NOISE_NAVG    32         /* Segments in the PSD's exponential average */
+#define NOISE_NICE    19         /* Nice value of the noise thread on Linux */
+#define NQCBAND       6          /* Octave bands in the NoiseQCFile */
+
+static int      Enabled = 0;
+static int      Nfft    = 0;                 /* NoiseNfft */
+static int      Decim   = 1;                 /* NoiseDecim */
+static double   Budget  = 0.;                /* Busy seconds allowed per second */
+static double   WeightDb = 0.;               /* SnrWeight */
+static double   *Win  = NULL;                /* Hann window */
+static double   WinSS = 0.;                  /* Sum of its squares */
+static double   *Cos  = NULL;                /* Twiddle factors, Nfft/2 of each */
+static double   *Sin  = NULL;
+static double   *Re   = NULL;                /* Work arrays of the noise thread */
+static double   *Im   = NULL;
+static double   *Spec = NULL;
+static NOISESTATE *Queue[NOISE_QLEN];        /* Waiting segments; NULL if taken back */
+static int      qHead = 0;
+static int      qCount = 0;
+static NOISESTATE *Chans = NULL;             /* List of the channels' states */
+static int      nChan = 0;                   /* States in it */
+static char     *QcFile = NULL;              /* NoiseQCFile */
+static char     *QcBuf = NULL;               /* QC file text (noise thread) */
+static int      QcSize = 0;
+static mutex_t  NoiseMutex;                  /* Guards Queue, state, the list and the PSDs */
+static volatile int QcDue   = 0;             /* Set to ask the thread to write the QC file */
+static volatile int Stop    = 0;             /* Set to ask the thread to quit */
+static volatile int Running = 0;             /* Set while the thread runs */
+static ew_thread_t  NoiseTid;
+static double   tStart = 0.;                 /* hrtime_ew() when the thread started */
+
+static unsigned long nQueued  = 0;           /* Segments queued */
+static unsigned long nBusy    = 0;           /* Skipped: last one not taken yet */
+static unsigned long nFull    = 0;           /* Skipped: queue full */
+static unsigned long nDone    = 0;           /* Segments averaged (noise thread) */
+static unsigned long nThrottled = 0;         /* Times the thread used up its budget */
+static unsigned long nSnr     = 0;           /* Picks with an SNR */
+static unsigned long nNoSnr   = 0;           /* Picks without one (no PSD yet) */
+static unsigned long nLowered = 0;           /* Pick weights lowered */
+static unsigned long nFailed  = 0;           /* Allocations that failed */
+static double        BusySum  = 0.;          /* Time the thread spent working (s) */
+
+/* Function prototypes
+   *******************/
+void           PinThread( int );              /* function in placement.c */
+void           ResetNoise( NOISESTATE * );
+static void    CancelNoise( NOISESTATE * );
+static void    SubmitNoise( NOISESTATE * );
+static void    NoNoiseMem( STATION * );
+static void    FreeState( NOISESTATE * );
+static int     Welch( NOISESTATE * );
+static void    WriteNoiseQC( void );
+static void    Fft( double *, double *, int );
+static void    LowerPriority( void );
+static thr_ret Welcher( void * );
+
+
+  /***************************************************************
+   *                            InitNoise()                      *
+   *                                                             *
+   *  Set up the window and twiddle factors, and start the       *
+   *  noise thread.  If it can't be started, there are no noise  *
+   *  spectra, so the picking thread never does the work.        *
+   ***************************************************************/
+
+void InitNoise( GPARM *Gparm )
+{
+   int i;
+
+   if ( Gparm->NoiseNfft <= 0 ) return;
+
+   Nfft     = Gparm->NoiseNfft;
+   Decim    = Gparm->NoiseDecim;
+   Budget   = Gparm->NoiseBudget / 100.;
+   WeightDb = Gparm->SnrWeight;
+   QcFile   = Gparm->NoiseQCFile;
+
+   Win  = (double *) malloc( Nfft * sizeof(double) );
+   Cos  = (double *) malloc( (Nfft / 2) * sizeof(double) );
+   Sin  = (double *) malloc( (Nfft / 2) * sizeof(double) );
+   Re   = (double *) malloc( Nfft * sizeof(double) );
+   Im   = (double *) malloc( Nfft * sizeof(double) );
+   Spec = (double *) malloc( (Nfft / 2 + 1) * sizeof(double) );
+   if ( (Win == NULL) || (Cos == NULL) || (Sin == NULL) || (Re == NULL) ||
+        (Im == NULL) || (Spec == NULL) )
+   {
+      logit( "et", "pick_ew: Cannot allocate the noise spectrum work arrays; "
+             "no noise spectra\n" );
+      return;
+   }
+
+   WinSS = 0.;
+   for ( i = 0; i < Nfft; i++ )
+   {
+      Win[i] = 0.5 - 0.5 * cos( 2. * M_PI * i / Nfft );
+      WinSS += Win[i] * Win[i];
+   }
+   for ( i = 0; i < Nfft / 2; i++ )
+   {
+      Cos[i] =  cos( 2. * M_PI * i / Nfft );
+      Sin[i] = -sin( 2. * M_PI * i / Nfft );
+   }
+
+   CreateSpecificMutex( &NoiseMutex );
+   Stop = 0;
+   Running = 1;
+   hrtime_ew( &tStart );
+   if ( StartThreadWithArg( Welcher, NULL, (unsigned) THREAD_STACK, &NoiseTid ) == -1 )
+   {
+      logit( "et", "pick_ew: Cannot start the noise spectrum thread; "
+             "no noise spectra\n" );
+      Running = 0;
+      return;
+   }
+   Enabled = 1;
+}
+
+
+  /***************************************************************
+   *                          SetNoiseRate()                     *
+   *                                                             *
+   *  Give a channel its noise state, if it has none.  Called    *
+   *  for every message picked; does nothing if the rate is      *
+   *  unchanged.  At a new rate the PSD starts over.             *
+   ***************************************************************/
+
+void SetNoiseRate( STATION *Sta, double samprate )
+{
+   NOISESTATE *Ns = Sta->Noise;
+
+   if ( !Enabled ) return;
+   if ( (Ns != NULL) && (Ns->samprate == samprate) ) return;
+
+   if ( Ns == NULL )
+   {
+      if ( (Ns = (NOISESTATE *) calloc( 1, sizeof(NOISESTATE) )) == NULL )
+      {
+         NoNoiseMem( Sta );
+         return;
+      }
+      Ns->seg = (double *) malloc( Nfft * sizeof(double) );
+      Ns->job = (double *) malloc( Nfft * sizeof(double) );
+      Ns->psd = (double *) calloc( Nfft / 2 + 1, sizeof(double) );
+      if ( (Ns->seg == NULL) || (Ns->job == NULL) || (Ns->psd == NULL) )
+      {
+         free( Ns->seg );
+         free( Ns->job );
+         free( Ns->psd );
+         free( Ns );
+         NoNoiseMem( Sta );
+         return;
+      }
+      sprintf( Ns->scnl, "%s.%s.%s.%s", Sta->sta, Sta->chan, Sta->net, Sta->loc );
+      RequestSpecificMutex( &NoiseMutex );
+      Ns->next = Chans;
+      if ( Chans != NULL ) Chans->prev = Ns;
+      Chans = Ns;
+      nChan++;
+      ReleaseSpecificMutex( &NoiseMutex );
+      Sta->Noise = Ns;
+   }
+
+/* New rate: start over
+   ********************/
+   CancelNoise( Ns );
+   ResetNoise( Ns );
+   RequestSpecificMutex( &NoiseMutex );
+   memset( Ns->psd, 0, (Nfft / 2 + 1) * sizeof(double) );
+   Ns->navg     = 0;
+   Ns->noisevar = 0.;
+   Ns->qcsnr    = 0.;
+   Ns->samprate = samprate;
+   ReleaseSpecificMutex( &NoiseMutex );
+}
+
+
+  /***************************************************************
+   *                          NoiseSample()                      *
+   *                                                             *
+   *  Decimate one raw sample.  Each decimated sample goes to    *
+   *  the channel's segment if no event is active, or to the     *
+   *  event's sums if one is.  Called by Sample().               *
+   ***************************************************************/
+
+void NoiseSample( double x, STATION *Sta )
+{
+   NOISESTATE *Ns = Sta->Noise;
+   double     y;
+
+   Ns->acc += x;
+   if ( ++Ns->nacc < Decim ) return;
+   y = Ns->acc / Decim;
+   Ns->acc  = 0.;
+   Ns->nacc = 0;
+
+   if ( Sta->active )
+   {
+      if ( !Ns->inevent )                 /* The segment so far is cut off */
+      {
+         Ns->inevent = 1;
+         Ns->evpow   = 0.;
+         Ns->nev     = 0;
+         Ns->nseg    = 0;
+      }
+      Ns->evpow += (y - Ns->level) * (y - Ns->level);
+      Ns->nev++;
+      return;
+   }
+
+   Ns->inevent = 0;
+   Ns->seg[Ns->nseg++] = y;
+   if ( Ns->nseg == Nfft )
+   {
+      SubmitNoise( Ns );
+      memmove( Ns->seg, Ns->seg + Nfft / 2, (Nfft / 2) * sizeof(double) );
+      Ns->nseg = Nfft / 2;
+   }
+}
+
+
+  /***************************************************************
+   *                            PickSnr()                        *
+   *                                                             *
+   *  Work out the SNR of a pick being validated, from the       *
+   *  event's samples so far and the channel's noise power.      *
+   *  Leaves it, and the noise rms, in the channel's state; the  *
+   *  rms is 0 if the channel has no PSD yet.                    *
+   ***************************************************************/
+
+void PickSnr( STATION *Sta )
+{
+   NOISESTATE *Ns = Sta->Noise;
+   double     noisevar;
+
+   if ( Ns == NULL ) return;
+
+   RequestSpecificMutex( &NoiseMutex );
+   noisevar = Ns->noisevar;
+   if ( !(noisevar > 0.) || (Ns->nev == 0) )
+   {
+      Ns->snr = 0.;
+      Ns->rms = 0.;
+      nNoSnr++;
+   }
+   else
+   {
+      Ns->rms = sqrt( noisevar );
+      Ns->snr = 10. * log10( (Ns->evpow / Ns->nev) / noisevar + 1.e-3 );
+      nSnr++;
+   }
+   Ns->qcsnr = Ns->snr;
+   ReleaseSpecificMutex( &NoiseMutex );
+}
+
+
+  /***************************************************************
+   *                           SnrWeight()                       *
+   *                                                             *
+   *  Returns the weight of a pick, one worse if its SNR is      *
+   *  known and under SnrWeight dB.                              *
+   ***************************************************************/
+
+int SnrWeight( STATION *Sta, int weight )
+{
+   NOISESTATE *Ns = Sta->Noise;
+
+   if ( (WeightDb == 0.) || (Ns == NULL) || (Ns->rms == 0.) ) return weight;
+   if ( (Ns->snr >= WeightDb) || (weight >= 3) ) return weight;
+   nLowered++;
+   return weight + 1;
+}
+
+
+  /***************************************************************
+   *                           ResetNoise()                      *
+   *                                                             *
+   *  Drop a channel's partial segment and event sums, as after  *
+   *  a restart.  Its PSD is kept: the noise doesn't change      *
+   *  with a gap in the data.                                    *
+   ***************************************************************/
+
+void ResetNoise( NOISESTATE *Ns )
+{
+   Ns->acc     = 0.;
+   Ns->nacc    = 0;
+   Ns->nseg    = 0;
+   Ns->evpow   = 0.;
+   Ns->nev     = 0;
+   Ns->inevent = 0;
+}
+
+
+  /***************************************************************
+   *                            FreeNoise()                      *
+   *                                                             *
+   *  Take a channel's state off the list and free it, or, if    *
+   *  the noise thread is transforming its segment, leave it     *
+   *  to the thread.                                             *
+   ***************************************************************/
+
+void FreeNoise( STATION *Sta )
+{
+   NOISESTATE *Ns = Sta->Noise;
+   int        orphan = 0;
+
+   if ( Ns == NULL ) return;
+   Sta->Noise = NULL;
+   CancelNoise( Ns );
+
+   RequestSpecificMutex( &NoiseMutex );
+   if ( Ns->prev != NULL ) Ns->prev->next = Ns->next;
+   else                    Chans = Ns->next;
+   if ( Ns->next != NULL ) Ns->next->prev = Ns->prev;
+   nChan--;
+   if ( Ns->state == NOISE_DROPPED )
+   {
+      Ns->state = NOISE_ORPHAN;
+      orphan = 1;
+   }
+   ReleaseSpecificMutex( &NoiseMutex );
+   if ( !orphan ) FreeState( Ns );
+}
+
+
+  /***************************************************************
+   *                         RequestNoiseQC()                    *
+   *                                                             *
+   *  Ask the noise thread to rewrite the NoiseQCFile.  Called   *
+   *  by the picking thread, which doesn't wait for it.          *
+   ***************************************************************/
+
+void RequestNoiseQC( void )
+{
+   if ( Enabled && (QcFile != NULL) ) QcDue = 1;
+}
+
+
+  /***************************************************************
+   *                            StopNoise()                      *
+   *                                                             *
+   *  Ask the noise thread to exit, waiting up to a few seconds  *
+   *  for it.  It writes the NoiseQCFile first if asked to.      *
+   ***************************************************************/
+
+void StopNoise( void )
+{
+   int i;
+
+   if ( !Enabled || !Running ) return;
+
+   Stop = 1;
+   for ( i = 0; (i < 500) && Running; i++ )
+      sleep_ew( 10 );
+   if ( Running )
+   {
+      logit( "et", "pick_ew: Noise spectrum thread didn't stop; killing it.\n" );
+      KillThread( NoiseTid );
+      Running = 0;
+   }
+}
+
+
+  /***************************************************************
+   *                          LogNoiseStats()                    *
+   ***************************************************************/
+
+void LogNoiseStats( void )
+{
+   double now;
+
+   if ( !Enabled ) return;
+
+   hrtime_ew( &now );
+   logit( "t", "pick_ew: Noise PSD: %lu segments queued, %lu averaged; skipped %lu "
+          "(channel busy), %lu (queue full); thread %.2lf%% busy, over budget %lu "
+          "times\n", nQueued, nDone, nBusy, nFull,
+          (now > tStart) ? 100. * BusySum / (now - tStart) : 0., nThrottled );
+   logit( "", "pick_ew: Noise PSD: %lu picks with an SNR, %lu without; %lu weights "
+          "lowered; %lu allocations failed\n", nSnr, nNoSnr, nLowered, nFailed );
+}
+
+
+/* Copy a full segment out and queue it, unless the
+   last one is still waiting or the queue is full
+   ************************************************/
+static void SubmitNoise( NOISESTATE *Ns )
+{
+   double mean = 0.;
+   int    i;
+
+   for ( i = 0; i < Nfft; i++ )
+      mean += Ns->seg[i];
+   Ns->level = mean / Nfft;
+
+   RequestSpecificMutex( &NoiseMutex );
+   if ( Ns->state != NOISE_IDLE )
+      nBusy++;
+   else if ( qCount == NOISE_QLEN )
+      nFull++;
+   else
+   {
+      memcpy( Ns->job, Ns->seg, Nfft * sizeof(double) );
+      Queue[(qHead + qCount++) % NOISE_QLEN] = Ns;
+      Ns->state = NOISE_QUEUED;
+      nQueued++;
+   }
+   ReleaseSpecificMutex( &NoiseMutex );
+}
+
+
+/* Take back a channel's queued segment, or see that the
+   one being transformed isn't averaged.  Doesn't wait.
+   *****************************************************/
+static void CancelNoise( NOISESTATE *Ns )
+{
+   int i;
+
+   if ( !Enabled ) return;
+
+   RequestSpecificMutex( &NoiseMutex );
+   if ( Ns->state == NOISE_QUEUED )
+   {
+      for ( i = 0; i < qCount; i++ )
+         if ( Queue[(qHead + i) % NOISE_QLEN] == Ns )
+            Queue[(qHead + i) % NOISE_QLEN] = NULL;
+      Ns->state = NOISE_IDLE;
+   }
+   else if ( Ns->state == NOISE_RUNNING )
+      Ns->state = Running ? NOISE_DROPPED : NOISE_IDLE;
+   ReleaseSpecificMutex( &NoiseMutex );
+}
+
+
+/* Count, and log the first, failure to allocate a channel's state
+   ****************************************************************/
+static void NoNoiseMem( STATION *Sta )
+{
+   if ( nFailed++ == 0 )
+      logit( "et", "pick_ew: Cannot allocate noise state for %s.%s.%s.%s; "
+             "its picks have no SNR\n", Sta->sta, Sta->chan, Sta->net, Sta->loc );
+}
+
+
+/* Free a channel's state
+   **********************/
+static void FreeState( NOISESTATE *Ns )
+{
+   free( Ns->seg );
+   free( Ns->job );
+   free( Ns->psd );
+   free( Ns );
+}
+
+
+/* Fold the periodogram of a channel's queued segment into its
+   PSD, unless the channel dropped it meanwhile.  Scaled so that
+   the one-sided PSD summed over the bins times the bin width is
+   the variance of the segment.  Returns the channel's state when
+   done: NOISE_ORPHAN if the thread is to free it.
+   *************************************************************/
+static int Welch( NOISESTATE *Ns )
+{
+   double fd = Ns->samprate / Decim;         /* Rate of the decimated data */
+   double mean = 0.;
+   double alpha, var;
+   int    i, k, state;
+
+   for ( i = 0; i < Nfft; i++ )
+      mean += Ns->job[i];
+   mean /= Nfft;
+   for ( i = 0; i < Nfft; i++ )
+   {
+      Re[i] = (Ns->job[i] - mean) * Win[i];
+      Im[i] = 0.;
+   }
+   Fft( Re, Im, Nfft );
+   for ( k = 0; k <= Nfft / 2; k++ )
+      Spec[k] = ((k == 0) || (k == Nfft / 2) ? 1. : 2.) *
+                (Re[k] * Re[k] + Im[k] * Im[k]) / (fd * WinSS);
+
+   RequestSpecificMutex( &NoiseMutex );
+   state = Ns->state;
+   if ( state == NOISE_RUNNING )
+   {
+      alpha = 1. / ((Ns->navg < NOISE_NAVG) ? Ns->navg + 1 : NOISE_NAVG);
+      var   = 0.;
+      for ( k = 0; k <= Nfft / 2; k++ )
+      {
+         Ns->psd[k] += alpha * (Spec[k] - Ns->psd[k]);
+         if ( k > 0 ) var += Ns->psd[k];
+      }
+      Ns->noisevar = var * fd / Nfft;
+      Ns->navg++;
+   }
+   if ( state != NOISE_ORPHAN ) Ns->state = NOISE_IDLE;
+   ReleaseSpecificMutex( &NoiseMutex );
+   return state;
+}
+
+
+/* Write the noise of every channel to NoiseQCFile: its rms,
+   its level in octave bands down from the Nyquist frequency
+   of the decimated data, and the SNR of its last pick.  The
+   lines are made under the lock, then the file is written
+   under a temporary name and renamed, like the restart state
+   file.  Runs on the noise thread.
+   **********************************************************/
+static void WriteNoiseQC( void )
+{
+   char       tmpname[1024];
+   FILE       *fp;
+   NOISESTATE *Ns;
+   int        len, b, k;
+
+/* Room for a line per channel
+   ***************************/
+   RequestSpecificMutex( &NoiseMutex );
+   k = 256 * (nChan + 1);
+   ReleaseSpecificMutex( &NoiseMutex );
+   if ( k > QcSize )
+   {
+      char *buf = (char *) realloc( QcBuf, 2 * k );
+
+      if ( buf == NULL )
+      {
+         logit( "et", "pick_ew: Cannot allocate the noise QC file buffer.\n" );
+         return;
+      }
+      QcBuf  = buf;
+      QcSize = 2 * k;
+   }
+
+   len = sprintf( QcBuf, "# %ld  NoisePSD %d %d\n", (long) time( NULL ), Nfft, Decim );
+   len += sprintf( QcBuf + len, "# scnl segments rms last_snr_db  %d x freq_hz:psd_db "
+                   "(dB re 1 count^2/Hz)\n", NQCBAND );
+
+   RequestSpecificMutex( &NoiseMutex );
+   for ( Ns = Chans; (Ns != NULL) && (len < QcSize - 256); Ns = Ns->next )
+   {
+      double df = Ns->samprate / Decim / Nfft;
+
+      len += sprintf( QcBuf + len, "%s %d %.4g %.1lf", Ns->scnl, Ns->navg,
+                      sqrt( Ns->noisevar ), Ns->qcsnr );
+
+/* Average the bins of each octave
+   *******************************/
+      for ( b = 0; b < NQCBAND; b++ )
+      {
+         int    hi = (Nfft / 2) >> b;
+         int    lo = hi / 2;
+         int    n  = 0;
+         double band = 0.;
+         double f = df * hi / sqrt( 2. );             /* Center of the octave */
+
+         for ( k = (lo > 1) ? lo : 1; k < hi; k++, n++ )
+            band += Ns->psd[k];
+         band = (n > 0) ? band / n : 0.;
+         len += sprintf( QcBuf + len, " %.3g:%.1lf", f,
+                         (band > 0.) ? 10. * log10( band ) : -999. );
+      }
+      len += sprintf( QcBuf + len, "\n" );
+   }
+   ReleaseSpecificMutex( &NoiseMutex );
+
+   sprintf( tmpname, "%.1000s.tmp", QcFile );
+   if ( (fp = fopen( tmpname, "w" )) == NULL )
+   {
+      logit( "et", "pick_ew: Error opening noise QC file <%s>.\n", tmpname );
+      return;
+   }
+   fwrite( QcBuf, 1, len, fp );
+   fclose( fp );
+
+#if defined(_WINNT)
+   remove( QcFile );
+#endif
+   if ( rename( tmpname, QcFile ) != 0 )
+      logit( "et", "pick_ew: Error renaming <%s> to <%s>.\n", tmpname, QcFile );
+}
+
+
+/* In-place radix-2 complex FFT of n points, n a power of two
+   **********************************************************/
+static void Fft( double *re, double *im, int n )
+{
+   int i, j, k, len;
+
+   for ( i = 1, j = 0; i < n; i++ )           /* Bit-reversed order */
+   {
+      int bit = n >> 1;
+
+      for ( ; j & bit; bit >>= 1 )
+         j ^= bit;
+      j ^= bit;
+      if ( i < j )
+      {
+         double t;
+
+         t = re[i]; re[i] = re[j]; re[j] = t;
+         t = im[i]; im[i] = im[j]; im[j] = t;
+      }
+   }
+
+   for ( len = 2; len <= n; len <<= 1 )
+   {
+      int step = n / len;
+
+      for ( i = 0; i < n; i += len )
+         for ( k = 0; k < len / 2; k++ )
+         {
+            double wr = Cos[k * step], wi = Sin[k * step];
+            double *ar = &re[i + k], *ai = &im[i + k];
+            double *br = &re[i + k + len / 2], *bi = &im[i + k + len / 2];
+            double tr = wr * *br - wi * *bi;
+            double ti = wr * *bi + wi * *br;
+
+            *br = *ar - tr;
+            *bi = *ai - ti;
+            *ar += tr;
+            *ai += ti;
+         }
+   }
+}
+
+
+/* Run the noise thread at the lowest priority the system
+   lets it have, so it only gets cpu the others don't want
+   *******************************************************/
+static void LowerPriority( void )
+{
+#if defined( _LINUX )
+   if ( setpriority( PRIO_PROCESS, (id_t) syscall( SYS_gettid ), NOISE_NICE ) != 0 )
+      logit( "et", "pick_ew: Cannot lower the priority of the noise spectrum thread.\n" );
+#elif defined( _WINNT )
+   SetThreadPriority( GetCurrentThread(), THREAD_PRIORITY_LOWEST );
+#endif
+}
+
+
+/* The noise thread.  Averages the queued segments, oldest
+   first, and sleeps out the rest of each second once it has
+   worked for its budget of it.
+   *********************************************************/
+static thr_ret Welcher( void *arg )
+{
+   double winstart, busy = 0.;
+
+   (void) arg;
+   PinThread( THR_NOISE );
+   LowerPriority();
+   hrtime_ew( &winstart );
+
+   while ( !Stop )
+   {
+      NOISESTATE *Ns = NULL;
+      double     t0, t1;
+
+      if ( QcDue )
+      {
+         QcDue = 0;
+         WriteNoiseQC();
+      }
+
+      RequestSpecificMutex( &NoiseMutex );
+      while ( (qCount > 0) && (Ns == NULL) )
+      {
+         Ns = Queue[qHead];
+         qHead = (qHead + 1) % NOISE_QLEN;
+         qCount--;
+      }
+      if ( Ns != NULL ) Ns->state = NOISE_RUNNING;
+      ReleaseSpecificMutex( &NoiseMutex );
+
+      if ( Ns == NULL )
+      {
+         sleep_ew( 50 );
+         continue;
+      }
+
+      hrtime_ew( &t0 );
+      if ( Welch( Ns ) == NOISE_ORPHAN ) FreeState( Ns );
+      hrtime_ew( &t1 );
+      nDone++;
+      BusySum += t1 - t0;
+
+/* Keep to the budget
+   ******************/
+      busy += t1 - t0;
+      if ( t1 - winstart >= 1. )
+      {
+         winstart = t1;
+         busy = 0.;
+      }
+      else if ( busy >= Budget )
+      {
+         nThrottled++;
+         sleep_ew( (int) (1000. * (winstart + 1. - t1)) + 1 );
+         hrtime_ew( &winstart );
+         busy = 0.;
+      }
+   }
+   if ( QcDue )
+   {
+      QcDue = 0;
+      WriteNoiseQC();
+   }
+   Running = 0;
+   return THR_NULL_RET;
+}
@@ -0,0 +1,612 @@
+  /**********************************************************************
+   *                              onset.c                               *
+   *                                                                    *
+   *                 Onset refinement after a trigger                   *
+   *                                                                    *
+   *  This file contains functions InitOnset(), SetOnsetRate(),         *
+   *  OnsetSample(), ArmOnset(), RefineOnset(), ResetOnset(),           *
+   *  FreeOnset(), StopOnset() and LogOnsetStats().                     *
+   *                                                                    *
+   *  The trigger of ScanForEvent() is the first sample at which the    *
+   *  short-term average is over the long-term one, which is some time  *
+   *  after the onset.  With OnsetRefine, each channel keeps its last   *
+   *  raw samples in a ring.  OnsetPost seconds after a trigger, the    *
+   *  samples from OnsetPre seconds before it to then are copied out    *
+   *  and queued for the refinement thread, which looks for the onset   *
+   *  in two passes over the window:                                    *
+   *                                                                    *
+   *     1  The kurtosis of the last OnsetKurt seconds, kept with       *
+   *        running sums of the first four powers, so each sample       *
+   *        costs the same whatever the window.  Kurtosis peaks when    *
+   *        the impulsive start of the arrival fills the window, a      *
+   *        little after the onset.  Only peaks from one kurtosis       *
+   *        window before the trigger on are looked at.                 *
+   *     2  The AIC of splitting the window in two at each sample       *
+   *        (Maeda's form, from running sums of the samples and their   *
+   *        squares), over the kurtosis window that ends at the peak.   *
+   *        The onset is the sample where the AIC is least.             *
+   *                                                                    *
+   *  When the pick is reported, the pick time is moved back to the     *
+   *  refined onset.  An onset after the trigger, or none at all,       *
+   *  leaves the pick time alone.  The refinement runs only after a     *
+   *  trigger, and not on the picking thread: by the time the pick is   *
+   *  reported its window has usually been refined.  If not, the        *
+   *  picking thread refines a window still in the queue itself, but    *
+   *  never waits for the one being refined: that pick keeps its        *
+   *  trigger time and the result is dropped.  A channel whose window   *
+   *  is being refined when its state is freed leaves the state to the  *
+   *  thread to free.                                                   *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <earthworm.h>
+#include <transport.h>
+#include "nn_pick_ew.h"
+
+#define THREAD_STACK  65536
+#define ONSET_QLEN    256        /* Windows waiting for the refinement thread */
+
+static int      Enabled = 0;
+static double   Pre, Post, Kurt;             /* OnsetPre, OnsetPost, OnsetKurt (s) */
+static ONSETSTATE *Queue[ONSET_QLEN];        /* Waiting windows; NULL if taken back */
+static int      qHead = 0;
+static int      qCount = 0;
+static mutex_t  OnsetMutex;                  /* Guards Queue and the states */
+static volatile int Stop    = 0;             /* Set to ask the thread to quit */
+static volatile int Running = 0;             /* Set while the thread runs */
+static ew_thread_t  OnsetTid;
+
+static unsigned long nQueued  = 0;           /* Windows queued */
+static unsigned long nFull    = 0;           /* Not refined: queue full */
+static unsigned long nInline  = 0;           /* Refined by the picking thread */
+static unsigned long nLate    = 0;           /* Not refined: still being refined */
+static unsigned long nBusy    = 0;           /* Not refined: last window in use */
+static unsigned long nMoved   = 0;           /* Pick times moved */
+static unsigned long nKept    = 0;           /* Pick times kept */
+static unsigned long nFailed  = 0;           /* Allocations that failed */
+static double        ShiftSum = 0.;          /* Sum of the moves (s) */
+static double        ShiftMax = 0.;          /* Largest move (s) */
+
+/* Function prototypes
+   *******************/
+void           PinThread( int );              /* function in placement.c */
+void           CancelOnset( ONSETSTATE * );
+void           FreeOnset( STATION * );
+static void    SubmitOnset( ONSETSTATE * );
+static int     OnsetBusy( ONSETSTATE * );
+static void    NoOnsetMem( STATION * );
+static int     FindOnset( double *, int, int, int );
+static thr_ret Refiner( void * );
+
+
+  /***************************************************************
+   *                            InitOnset()                      *
+   *                                                             *
+   *  Start the refinement thread.  If it can't be started,      *
+   *  the picking thread refines the windows itself.             *
+   ***************************************************************/
+
+void InitOnset( GPARM *Gparm )
+{
+   if ( Gparm->OnsetPre <= 0. ) return;
+
+   Pre     = Gparm->OnsetPre;
+   Post    = Gparm->OnsetPost;
+   Kurt    = Gparm->OnsetKurt;
+   Enabled = 1;
+   CreateSpecificMutex( &OnsetMutex );
+
+   Stop = 0;
+   Running = 1;
+   if ( StartThreadWithArg( Refiner, NULL, (unsigned) THREAD_STACK, &OnsetTid ) == -1 )
+   {
+      logit( "et", "pick_ew: Cannot start the onset refinement thread; "
+             "onsets will be refined by the picking thread\n" );
+      Running = 0;
+   }
+}
+
+
+  /***************************************************************
+   *                          SetOnsetRate()                     *
+   *                                                             *
+   *  Give a channel its history ring, if it has none, sized     *
+   *  for its sample rate.  Called for every message picked;     *
+   *  does nothing if the rate is unchanged.  If there is no     *
+   *  memory, the channel's onsets aren't refined.               *
+   ***************************************************************/
+
+void SetOnsetRate( STATION *Sta, double samprate )
+{
+   ONSETSTATE *On = Sta->On;
+   int        npre, npost, hlen;
+
+   if ( !Enabled ) return;
+   if ( (On != NULL) && (On->samprate == samprate) ) return;
+
+/* New rate.  If the thread is still refining the
+   last window, leave it the old state to free.
+   **********************************************/
+   if ( On != NULL )
+   {
+      CancelOnset( On );
+      if ( OnsetBusy( On ) )
+      {
+         FreeOnset( Sta );
+         On = NULL;
+      }
+   }
+   if ( On == NULL )
+   {
+      if ( (On = (ONSETSTATE *) calloc( 1, sizeof(ONSETSTATE) )) == NULL )
+      {
+         NoOnsetMem( Sta );
+         return;
+      }
+      Sta->On = On;
+   }
+
+/* Resize the ring and start over
+   ******************************/
+   npre  = (int) (Pre * samprate + 0.5);
+   npost = (int) (Post * samprate + 0.5);
+   for ( hlen = 64; hlen < npre + npost + 1; hlen *= 2 );
+   if ( hlen != On->hlen )
+   {
+      free( On->hist );
+      free( On->win );
+      On->hist = (double *) malloc( hlen * sizeof(double) );
+      On->win  = (double *) malloc( hlen * sizeof(double) );
+      if ( (On->hist == NULL) || (On->win == NULL) )
+      {
+         free( On->hist );
+         free( On->win );
+         free( On );
+         Sta->On = NULL;
+         NoOnsetMem( Sta );
+         return;
+      }
+      On->hlen = hlen;
+   }
+   On->npre     = npre;
+   On->npost    = npost;
+   On->nkurt    = (int) (Kurt * samprate + 0.5);
+   if ( On->nkurt < 4 ) On->nkurt = 4;
+   On->samprate = samprate;
+   On->n        = 0;
+   On->pending  = 0;
+}
+
+
+  /***************************************************************
+   *                          OnsetSample()                      *
+   *                                                             *
+   *  Keep one raw sample, and hand the window of a trigger to   *
+   *  the refinement thread once OnsetPost seconds have come     *
+   *  in after it.  Called by Sample().                          *
+   ***************************************************************/
+
+void OnsetSample( double x, ONSETSTATE *On )
+{
+   On->hist[On->n++ & (On->hlen - 1)] = x;
+   if ( On->pending && (On->n - On->trig >= (unsigned long) On->npost) )
+      SubmitOnset( On );
+}
+
+
+  /***************************************************************
+   *                            ArmOnset()                       *
+   *                                                             *
+   *  Note a trigger at the sample just passed to Sample().      *
+   *  The result of any earlier trigger is dropped.              *
+   ***************************************************************/
+
+void ArmOnset( ONSETSTATE *On )
+{
+   CancelOnset( On );
+   On->trig    = On->n;
+   On->pending = 1;
+}
+
+
+  /***************************************************************
+   *                           RefineOnset()                     *
+   *                                                             *
+   *  Move the time of a pick about to be reported to the        *
+   *  refined onset of its trigger.  Called by ReportPick().     *
+   ***************************************************************/
+
+void RefineOnset( STATION *Sta, PICK *Pick )
+{
+   ONSETSTATE *On = Sta->On;
+   int        state;
+   int        i;
+
+   if ( On == NULL ) return;
+   if ( On->pending ) SubmitOnset( On );     /* Picked before OnsetPost was in */
+
+/* Refine the window here if the refinement thread
+   hasn't taken it yet.  If it is refining it now,
+   don't wait: keep the trigger time.
+   ************************************************/
+   RequestSpecificMutex( &OnsetMutex );
+   state = On->state;
+   if ( state == ONSET_QUEUED )
+   {
+      for ( i = 0; i < qCount; i++ )
+         if ( Queue[(qHead + i) % ONSET_QLEN] == On )
+            Queue[(qHead + i) % ONSET_QLEN] = NULL;
+      On->state = ONSET_IDLE;
+   }
+   else if ( state == ONSET_RUNNING )
+      On->state = Running ? ONSET_DROPPED : ONSET_IDLE;
+   else if ( state == ONSET_DONE )
+      On->state = ONSET_IDLE;
+   ReleaseSpecificMutex( &OnsetMutex );
+
+   if ( state == ONSET_RUNNING )
+   {
+      nLate++;
+      return;
+   }
+   if ( (state != ONSET_QUEUED) && (state != ONSET_DONE) ) return;
+   if ( state == ONSET_QUEUED )
+   {
+      On->ionset = FindOnset( On->win, On->nwin, On->itrig, On->nkurt );
+      nInline++;
+   }
+
+/* Only move the pick earlier
+   **************************/
+   if ( (On->ionset >= 0) && (On->ionset < On->itrig) )
+   {
+      double shift = (On->itrig - On->ionset) / On->samprate;
+
+      Pick->time -= shift;
+      ShiftSum   += shift;
+      if ( shift > ShiftMax ) ShiftMax = shift;
+      nMoved++;
+   }
+   else
+      nKept++;
+}
+
+
+  /***************************************************************
+   *                           ResetOnset()                      *
+   *                                                             *
+   *  Forget a channel's samples and trigger, as after a         *
+   *  restart.                                                   *
+   ***************************************************************/
+
+void ResetOnset( ONSETSTATE *On )
+{
+   CancelOnset( On );
+   On->n       = 0;
+   On->pending = 0;
+}
+
+
+  /***************************************************************
+   *                           CancelOnset()                     *
+   *                                                             *
+   *  Take back a channel's queued window, or drop the result    *
+   *  of the one being refined.  Doesn't wait for the thread.    *
+   ***************************************************************/
+
+void CancelOnset( ONSETSTATE *On )
+{
+   int i;
+
+   On->pending = 0;
+   if ( !Enabled ) return;
+
+   RequestSpecificMutex( &OnsetMutex );
+   if ( On->state == ONSET_QUEUED )
+   {
+      for ( i = 0; i < qCount; i++ )
+         if ( Queue[(qHead + i) % ONSET_QLEN] == On )
+            Queue[(qHead + i) % ONSET_QLEN] = NULL;
+      On->state = ONSET_IDLE;
+   }
+   else if ( On->state == ONSET_RUNNING )
+      On->state = Running ? ONSET_DROPPED : ONSET_IDLE;
+   else if ( On->state == ONSET_DONE )
+      On->state = ONSET_IDLE;
+   ReleaseSpecificMutex( &OnsetMutex );
+}
+
+
+  /***************************************************************
+   *                            FreeOnset()                      *
+   *                                                             *
+   *  Free a channel's state, or, if the refinement thread is    *
+   *  still working on its window, leave it to the thread.       *
+   ***************************************************************/
+
+void FreeOnset( STATION *Sta )
+{
+   ONSETSTATE *On = Sta->On;
+   int        orphan = 0;
+
+   if ( On == NULL ) return;
+   Sta->On = NULL;
+   CancelOnset( On );
+   if ( Enabled )
+   {
+      RequestSpecificMutex( &OnsetMutex );
+      if ( Running && (On->state == ONSET_DROPPED) )
+      {
+         On->state = ONSET_ORPHAN;
+         orphan = 1;
+      }
+      ReleaseSpecificMutex( &OnsetMutex );
+   }
+   if ( orphan ) return;
+   free( On->hist );
+   free( On->win );
+   free( On );
+}
+
+
+  /***************************************************************
+   *                            StopOnset()                      *
+   *                                                             *
+   *  Ask the refinement thread to exit, waiting up to a few     *
+   *  seconds for it.  Windows still queued are refined by the   *
+   *  picking thread if their picks are reported.                *
+   ***************************************************************/
+
+void StopOnset( void )
+{
+   int i;
+
+   if ( !Enabled || !Running ) return;
+
+   Stop = 1;
+   for ( i = 0; (i < 500) && Running; i++ )
+      sleep_ew( 10 );
+   if ( Running )
+   {
+      logit( "et", "pick_ew: Onset refinement thread didn't stop; killing it.\n" );
+      KillThread( OnsetTid );
+      Running = 0;
+   }
+}
+
+
+  /***************************************************************
+   *                          LogOnsetStats()                    *
+   ***************************************************************/
+
+void LogOnsetStats( void )
+{
+   if ( !Enabled ) return;
+
+   logit( "t", "pick_ew: Onsets: %lu windows queued, %lu not (queue full), "
+          "%lu not (last window in use); %lu refined by the picking thread, "
+          "%lu not refined in time\n", nQueued, nFull, nBusy, nInline, nLate );
+   logit( "", "pick_ew: Onsets: %lu pick times moved (mean %.3lf s, max %.3lf s), "
+          "%lu kept; %lu allocations failed\n", nMoved,
+          (nMoved > 0) ? ShiftSum / nMoved : 0., ShiftMax, nKept, nFailed );
+}
+
+
+/* Copy a trigger's window out of the ring and queue it.
+   The window ends at the newest sample.
+   *****************************************************/
+static void SubmitOnset( ONSETSTATE *On )
+{
+   unsigned long start, first, i;
+
+   On->pending = 0;
+   if ( OnsetBusy( On ) )              /* The last window is still in use */
+   {
+      nBusy++;
+      return;
+   }
+
+   start = (On->trig - 1 > (unsigned long) On->npre) ? On->trig - 1 - On->npre : 0;
+   first = (On->n > (unsigned long) On->hlen) ? On->n - On->hlen : 0;
+   if ( start < first ) start = first;
+   for ( i = start; i < On->n; i++ )
+      On->win[i - start] = On->hist[i & (On->hlen - 1)];
+   On->nwin   = (int) (On->n - start);
+   On->itrig  = (int) (On->trig - 1 - start);
+   On->ionset = -1;
+
+   RequestSpecificMutex( &OnsetMutex );
+   if ( !Running )
+      On->state = ONSET_QUEUED;        /* For RefineOnset() to refine */
+   else if ( qCount < ONSET_QLEN )
+   {
+      Queue[(qHead + qCount++) % ONSET_QLEN] = On;
+      On->state = ONSET_QUEUED;
+      nQueued++;
+   }
+   else
+   {
+      On->state = ONSET_IDLE;
+      nFull++;
+   }
+   ReleaseSpecificMutex( &OnsetMutex );
+}
+
+
+/* Count, and log the first, failure to allocate a channel's state
+   ****************************************************************/
+static void NoOnsetMem( STATION *Sta )
+{
+   if ( nFailed++ == 0 )
+      logit( "et", "pick_ew: Cannot allocate onset refinement for %s.%s.%s.%s; "
+             "its picks keep the trigger time\n", Sta->sta, Sta->chan, Sta->net,
+             Sta->loc );
+}
+
+
+/* Return 1 if the refinement thread is still working
+   on a channel's window, which mustn't then be touched
+   ****************************************************/
+static int OnsetBusy( ONSETSTATE *On )
+{
+   int state;
+
+   RequestSpecificMutex( &OnsetMutex );
+   state = On->state;
+   ReleaseSpecificMutex( &OnsetMutex );
+   return Running && ((state == ONSET_RUNNING) || (state == ONSET_DROPPED));
+}
+
+
+/* Find the onset in a window of n samples with the trigger
+   at itrig.  Returns its index, or -1 if the window is too
+   short or flat.
+   *********************************************************/
+static int FindOnset( double *x, int n, int itrig, int nk )
+{
+   double mean = 0.;
+   double s1 = 0., s2 = 0., s3 = 0., s4 = 0.;
+   double t1, t2;
+   double kmax = 0., aicmin = 0.;
+   int    imax = -1, ionset = -1;
+   int    i, lo;
+
+   if ( n < 2 * nk ) return -1;
+
+/* Remove the mean, so the running sums keep their precision
+   *********************************************************/
+   for ( i = 0; i < n; i++ )
+      mean += x[i];
+   mean /= n;
+   for ( i = 0; i < n; i++ )
+      x[i] -= mean;
+
+/* Pass 1: sliding kurtosis from running sums of the
+   first four powers.  Find where it peaks, no more than
+   a kurtosis window before the trigger, so a spike in
+   the noise well before it isn't taken for the onset.
+   *****************************************************/
+   for ( i = 0; i < n; i++ )
+   {
+      double y = x[i], y2 = y * y;
+
+      s1 += y;
+      s2 += y2;
+      s3 += y2 * y;
+      s4 += y2 * y2;
+      if ( i >= nk )
+      {
+         double z = x[i - nk], z2 = z * z;
+
+         s1 -= z;
+         s2 -= z2;
+         s3 -= z2 * z;
+         s4 -= z2 * z2;
+      }
+      if ( (i >= nk - 1) && (i >= itrig - nk) )
+      {
+         double mu = s1 / nk;
+         double m2 = s2 / nk - mu * mu;
+         double m4 = s4 / nk - 4. * mu * s3 / nk + 6. * mu * mu * s2 / nk -
+                     3. * mu * mu * mu * mu;
+
+         if ( (m2 > 0.) && (m4 / (m2 * m2) > kmax) )
+         {
+            kmax = m4 / (m2 * m2);
+            imax = i;
+         }
+      }
+   }
+   if ( imax < 0 ) return -1;
+
+/* Pass 2: AIC of a split before sample k, over the
+   kurtosis window ending at the peak.  The sums of the
+   first part grow with k; those of the second part are
+   the totals less them.
+   ****************************************************/
+   t1 = t2 = 0.;
+   for ( i = 0; i < n; i++ )
+   {
+      t1 += x[i];
+      t2 += x[i] * x[i];
+   }
+   lo = imax - nk + 1;
+   if ( lo < 2 ) lo = 2;
+   s1 = s2 = 0.;
+   for ( i = 0; i < imax && i < n - 2; i++ )
+   {
+      s1 += x[i];
+      s2 += x[i] * x[i];
+      if ( i + 1 >= lo )
+      {
+         int    k  = i + 1;                     /* Samples before the split */
+         double v1 = s2 / k - (s1 / k) * (s1 / k);
+         double v2 = (t2 - s2) / (n - k) - ((t1 - s1) / (n - k)) * ((t1 - s1) / (n - k));
+         double aic;
+
+         if ( (v1 <= 0.) || (v2 <= 0.) ) continue;
+         aic = k * log( v1 ) + (n - k - 1) * log( v2 );
+         if ( (ionset < 0) || (aic < aicmin) )
+         {
+            aicmin = aic;
+            ionset = k;
+         }
+      }
+   }
+   return ionset;
+}
+
+
+/* The refinement thread.  Refines the queued
+   windows, oldest first.
+   ******************************************/
+static thr_ret Refiner( void *arg )
+{
+   (void) arg;
+   PinThread( THR_ONSET );
+
+   while ( !Stop )
+   {
+      ONSETSTATE *On = NULL;
+      int        state;
+
+      RequestSpecificMutex( &OnsetMutex );
+      while ( (qCount > 0) && (On == NULL) )
+      {
+         On = Queue[qHead];
+         qHead = (qHead + 1) % ONSET_QLEN;
+         qCount--;
+      }
+      if ( On != NULL ) On->state = ONSET_RUNNING;
+      ReleaseSpecificMutex( &OnsetMutex );
+
+      if ( On == NULL )
+      {
+         sleep_ew( 10 );
+         continue;
+      }
+
+      On->ionset = FindOnset( On->win, On->nwin, On->itrig, On->nkurt );
+
+   /* The channel may have dropped the result, or its state
+      *****************************************************/
+      RequestSpecificMutex( &OnsetMutex );
+      state = On->state;
+      if ( state == ONSET_RUNNING )
+         On->state = ONSET_DONE;
+      else if ( state == ONSET_DROPPED )
+         On->state = ONSET_IDLE;
+      ReleaseSpecificMutex( &OnsetMutex );
+      if ( state == ONSET_ORPHAN )
+      {
+         free( On->hist );
+         free( On->win );
+         free( On );
+      }
+   }
+   Running = 0;
+   return THR_NULL_RET;
+}
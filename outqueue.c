@@ -0,0 +1,436 @@
+  /**********************************************************************
+   *                             outqueue.c                             *
+   *                                                                    *
+   *              Output queue and ring publisher thread                *
+   *                                                                    *
+   *  This file contains functions InitOutQueue(), PutOutMsg(),         *
+   *  StopOutQueue() and LogOutQueueStats().                            *
+   *                                                                    *
+   *  Picks, codas, errors and heartbeats are handed to PutOutMsg().    *
+   *  If OutQueueSize is 0 the message goes straight to the output      *
+   *  ring, as it always did.  Otherwise it is copied into a fixed      *
+   *  pool of OutQueueSize slots and a publisher thread writes it to    *
+   *  OutRegion, so a slow ring never stalls the picking thread.        *
+   *  Slots come in up to three sizes: most hold one text line, an      *
+   *  eighth hold a partial binary batch and a sixty-fourth a full      *
+   *  one.  A message takes the smallest free slot it fits in.          *
+   *  Each message type has its own FIFO and the publisher always       *
+   *  takes the highest-priority message first (picks, then codas,      *
+   *  errors, heartbeats).  When the pool is full, a new message        *
+   *  replaces the oldest queued message of lower priority in a slot    *
+   *  big enough; if there is none, the new message is dropped.  Drops  *
+   *  are counted.                                                      *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <earthworm.h>
+#include <transport.h>
+#include <time_ew.h>
+#include "nn_pick_ew.h"
+
+#define THREAD_STACK  65536
+#define NCLASS        3        /* Slot sizes */
+
+typedef struct {
+   MSG_LOGO logo;
+   long     len;
+   double   tqueued;        /* hrtime_ew() when queued */
+   int      next;           /* Next slot in the same list, or -1 */
+   int      cls;            /* Size class of the slot */
+   char     *msg;
+} OUTSLOT;
+
+typedef struct {
+   int head;                /* Oldest slot, or -1 */
+   int tail;                /* Newest slot, or -1 */
+} OUTLIST;
+
+static OUTSLOT *Slot = NULL;         /* Slot pool */
+static char    *SlotBuf = NULL;      /* Message storage for all slots */
+static int      nSlot;               /* Slots of all sizes */
+static int      nClass;              /* Slot sizes in use */
+static long     ClassLen[NCLASS];    /* Largest message each size holds */
+static int      ClassSlots[NCLASS];  /* Slots of each size */
+static int      Batch;               /* Messages published per pass */
+static OUTLIST  Queue[NOUTPRIO];     /* One FIFO per priority */
+static OUTLIST  Free[NCLASS];        /* Unused slots of each size */
+static mutex_t  QueueMutex;          /* Guards the lists and counters */
+static SHM_INFO *OutRegion;
+static volatile int Stop    = 0;     /* Set to ask the publisher to quit */
+static volatile int Running = 0;     /* Set while the publisher runs */
+static ew_thread_t  PubTid;
+
+static OUTQSTATS Stats;              /* Counters, guarded by QueueMutex */
+
+static const char *PrioName[NOUTPRIO] = { "pick", "coda", "error", "heartbeat" };
+
+/* Function prototypes
+   *******************/
+void           PinThread( int );              /* function in placement.c */
+static thr_ret Publisher( void * );
+static int     PopSlot( OUTLIST * );
+static int     TakeSlot( OUTLIST *, int );
+static void    PushSlot( OUTLIST *, int );
+
+
+  /***************************************************************
+   *                         InitOutQueue()                      *
+   *                                                             *
+   *  Allocate the slot pool and start the publisher thread.     *
+   *  msgmax is the largest message that will be queued.  Text   *
+   *  lines take LINELEN-byte slots; only a few slots are big    *
+   *  enough for msgmax.                                         *
+   *  Returns -1 if an error is encountered.                     *
+   ***************************************************************/
+
+int InitOutQueue( GPARM *Gparm, long msgmax )
+{
+   size_t nbyte = 0;
+   char   *buf;
+   int    i, c;
+
+   memset( &Stats, 0, sizeof(Stats) );
+   OutRegion = &Gparm->OutRegion;
+   nSlot     = Gparm->OutQueueSize;
+   if ( nSlot == 0 ) return 0;             /* Publish inline */
+
+/* Size the classes.  Without binary batches every
+   message is a text line and one size will do.
+   ***********************************************/
+   if ( msgmax <= LINELEN )
+   {
+      nClass        = 1;
+      ClassLen[0]   = LINELEN;
+      ClassSlots[0] = nSlot;
+   }
+   else
+   {
+      nClass        = NCLASS;
+      ClassLen[0]   = LINELEN;
+      ClassLen[1]   = (msgmax / 8 > LINELEN) ? msgmax / 8 : LINELEN;
+      ClassLen[2]   = msgmax;
+      ClassSlots[2] = (nSlot / 64 > 0) ? nSlot / 64 : 1;
+      ClassSlots[1] = (nSlot / 8  > 0) ? nSlot / 8  : 1;
+      ClassSlots[0] = nSlot - ClassSlots[1] - ClassSlots[2];
+      if ( ClassSlots[0] < 1 ) ClassSlots[0] = 1;
+      nSlot = ClassSlots[0] + ClassSlots[1] + ClassSlots[2];
+   }
+   for ( c = 0; c < nClass; c++ )
+      nbyte += (size_t) ClassSlots[c] * (size_t) ClassLen[c];
+
+   Batch   = Gparm->OutBatch;
+   Slot    = (OUTSLOT *) calloc( nSlot, sizeof(OUTSLOT) );
+   SlotBuf = (char *) malloc( nbyte );
+   if ( (Slot == NULL) || (SlotBuf == NULL) )
+   {
+      logit( "et", "pick_ew: Cannot allocate %d output queue slots\n", nSlot );
+      free( Slot );
+      free( SlotBuf );
+      Slot = NULL;
+      SlotBuf = NULL;
+      return -1;
+   }
+
+   for ( i = 0; i < NOUTPRIO; i++ )
+      Queue[i].head = Queue[i].tail = -1;
+   buf = SlotBuf;
+   i   = 0;
+   for ( c = 0; c < nClass; c++ )
+   {
+      int n;
+
+      Free[c].head = Free[c].tail = -1;
+      for ( n = 0; n < ClassSlots[c]; n++, i++ )
+      {
+         Slot[i].msg = buf;
+         Slot[i].cls = c;
+         buf += ClassLen[c];
+         PushSlot( &Free[c], i );
+      }
+   }
+   CreateSpecificMutex( &QueueMutex );
+
+   Stop = 0;
+   Running = 1;
+   if ( StartThreadWithArg( Publisher, NULL, (unsigned) THREAD_STACK, &PubTid ) == -1 )
+   {
+      logit( "et", "pick_ew: Cannot start the output publisher thread\n" );
+      Running = 0;
+      return -1;
+   }
+   logit( "", "pick_ew: Output queue of %d slots (%ld bytes) started\n",
+          nSlot, (long) nbyte );
+   for ( c = 0; c < nClass; c++ )
+      logit( "", "   %6d slots of %ld bytes\n", ClassSlots[c], ClassLen[c] );
+   return 0;
+}
+
+
+  /***************************************************************
+   *                          PutOutMsg()                        *
+   *                                                             *
+   *  Queue one message for the output ring, or write it now if  *
+   *  there is no queue.  Returns PUT_OK if the message was      *
+   *  written or queued.                                         *
+   ***************************************************************/
+
+int PutOutMsg( MSG_LOGO *logo, int prio, long len, char *msg )
+{
+   int s, p, c, k;
+
+   if ( nSlot == 0 )
+      return tport_putmsg( OutRegion, logo, len, msg );
+
+   for ( c = 0; c < nClass; c++ )
+      if ( len <= ClassLen[c] ) break;
+   if ( (c == nClass) || (prio < 0) || (prio >= NOUTPRIO) )
+   {
+      logit( "et", "pick_ew: Bad %ld-byte message for output queue; not sent.\n", len );
+      return -1;
+   }
+
+   RequestSpecificMutex( &QueueMutex );
+
+/* Find the smallest free slot the message fits in.  If none
+   is free, take the oldest big-enough message from the lowest
+   priority below this one that has one.
+   ***********************************************************/
+   s = -1;
+   for ( k = c; (s == -1) && (k < nClass); k++ )
+      s = PopSlot( &Free[k] );
+   if ( s == -1 )
+   {
+      for ( p = NOUTPRIO - 1; p > prio; p-- )
+         if ( (s = TakeSlot( &Queue[p], c )) != -1 ) break;
+
+      if ( s == -1 )
+      {
+         Stats.dropped[prio]++;
+         ReleaseSpecificMutex( &QueueMutex );
+         return -1;
+      }
+      Stats.dropped[p]++;
+      Stats.depth--;
+   }
+
+   Slot[s].logo = *logo;
+   Slot[s].len  = len;
+   memcpy( Slot[s].msg, msg, (size_t) len );
+   hrtime_ew( &Slot[s].tqueued );
+   PushSlot( &Queue[prio], s );
+
+   Stats.queued[prio]++;
+   if ( ++Stats.depth > Stats.maxdepth ) Stats.maxdepth = Stats.depth;
+
+   ReleaseSpecificMutex( &QueueMutex );
+   return PUT_OK;
+}
+
+
+  /***************************************************************
+   *                         StopOutQueue()                      *
+   *                                                             *
+   *  Ask the publisher to write whatever is left and exit,      *
+   *  waiting up to a few seconds for it.                        *
+   ***************************************************************/
+
+void StopOutQueue( void )
+{
+   int i;
+
+   if ( nSlot == 0 ) return;
+
+   Stop = 1;
+   for ( i = 0; (i < 500) && Running; i++ )
+      sleep_ew( 10 );
+   if ( Running )
+   {
+      logit( "et", "pick_ew: Output publisher didn't stop; killing it.\n" );
+      KillThread( PubTid );
+   }
+   else
+   {
+      CloseSpecificMutex( &QueueMutex );
+      free( Slot );
+      free( SlotBuf );
+      Slot = NULL;
+      SlotBuf = NULL;
+   }
+   nSlot = 0;
+}
+
+
+  /***************************************************************
+   *                       GetOutQueueStats()                    *
+   *                                                             *
+   *  Copy the current counters.                                 *
+   ***************************************************************/
+
+void GetOutQueueStats( OUTQSTATS *s )
+{
+   if ( nSlot == 0 )
+   {
+      *s = Stats;
+      return;
+   }
+   RequestSpecificMutex( &QueueMutex );
+   *s = Stats;
+   ReleaseSpecificMutex( &QueueMutex );
+}
+
+
+  /***************************************************************
+   *                       LogOutQueueStats()                    *
+   ***************************************************************/
+
+void LogOutQueueStats( void )
+{
+   OUTQSTATS s;
+   int       i;
+
+   if ( nSlot == 0 ) return;
+
+   GetOutQueueStats( &s );
+   logit( "t", "pick_ew: Output queue depth %d (max %d of %d); "
+          "latency mean %.1lf ms, max %.1lf ms\n",
+          s.depth, s.maxdepth, nSlot,
+          (s.npublished > 0) ? 1000. * s.latsum / s.npublished : 0.,
+          1000. * s.latmax );
+   for ( i = 0; i < NOUTPRIO; i++ )
+      logit( "", "   %-9s queued %lu  published %lu  dropped %lu  failed %lu\n",
+             PrioName[i], s.queued[i], s.published[i], s.dropped[i], s.failed[i] );
+}
+
+
+/* The publisher thread.  Takes up to Batch messages off the
+   queues, highest priority first, writes them to the output
+   ring and returns their slots to the pool.
+   **********************************************************/
+static thr_ret Publisher( void *arg )
+{
+   int *take = (int *) malloc( Batch * sizeof(int) );
+   int *prio = (int *) malloc( Batch * sizeof(int) );
+
+   (void) arg;
+   PinThread( THR_PUBLISHER );
+   if ( (take == NULL) || (prio == NULL) )
+   {
+      logit( "et", "pick_ew: Output publisher can't allocate its batch.\n" );
+      free( take );
+      free( prio );
+      Running = 0;
+      return THR_NULL_RET;
+   }
+
+   while ( 1 )
+   {
+      int    n = 0;
+      int    i, p;
+      int    stopping = Stop;
+      double now;
+
+      RequestSpecificMutex( &QueueMutex );
+      for ( p = 0; (p < NOUTPRIO) && (n < Batch); p++ )
+         while ( (n < Batch) && (Queue[p].head != -1) )
+         {
+            prio[n]   = p;
+            take[n++] = PopSlot( &Queue[p] );
+         }
+      ReleaseSpecificMutex( &QueueMutex );
+
+      if ( n == 0 )
+      {
+         if ( stopping ) break;
+         sleep_ew( 10 );
+         continue;
+      }
+
+      for ( i = 0; i < n; i++ )
+      {
+         OUTSLOT *sl = &Slot[take[i]];
+
+         if ( tport_putmsg( OutRegion, &sl->logo, sl->len, sl->msg ) != PUT_OK )
+         {
+            logit( "et", "pick_ew: Error sending %s to output ring.\n", PrioName[prio[i]] );
+            take[i] = -1 - take[i];        /* Mark as failed */
+         }
+      }
+      hrtime_ew( &now );
+
+      RequestSpecificMutex( &QueueMutex );
+      for ( i = 0; i < n; i++ )
+      {
+         int s = (take[i] < 0) ? -1 - take[i] : take[i];
+
+         if ( take[i] < 0 )
+            Stats.failed[prio[i]]++;
+         else
+         {
+            double lat = now - Slot[s].tqueued;
+            Stats.published[prio[i]]++;
+            Stats.npublished++;
+            Stats.latsum += lat;
+            if ( lat > Stats.latmax ) Stats.latmax = lat;
+         }
+         Stats.depth--;
+         PushSlot( &Free[Slot[s].cls], s );
+      }
+      ReleaseSpecificMutex( &QueueMutex );
+   }
+
+   free( take );
+   free( prio );
+   Running = 0;
+   return THR_NULL_RET;
+}
+
+
+/* Remove and return the oldest slot of a list; -1 if empty
+   ********************************************************/
+static int PopSlot( OUTLIST *list )
+{
+   int s = list->head;
+
+   if ( s != -1 )
+   {
+      list->head = Slot[s].next;
+      if ( list->head == -1 ) list->tail = -1;
+   }
+   return s;
+}
+
+
+/* Remove and return the oldest slot of a list that is of size
+   class c or bigger; -1 if there is none
+   ************************************************************/
+static int TakeSlot( OUTLIST *list, int c )
+{
+   int prev = -1;
+   int s;
+
+   for ( s = list->head; s != -1; prev = s, s = Slot[s].next )
+      if ( Slot[s].cls >= c ) break;
+   if ( s == -1 ) return -1;
+
+   if ( prev == -1 )
+      list->head = Slot[s].next;
+   else
+      Slot[prev].next = Slot[s].next;
+   if ( list->tail == s ) list->tail = prev;
+   return s;
+}
+
+
+/* Append a slot to a list
+   ***********************/
+static void PushSlot( OUTLIST *list, int s )
+{
+   Slot[s].next = -1;
+   if ( list->tail == -1 )
+      list->head = s;
+   else
+      Slot[list->tail].next = s;
+   list->tail = s;
+}
@@ -47,9 +47,17 @@
    *******************/
 void   ReportPick( PICK *, CODA *, STATION *, GPARM *, EWH * );
 void   ReportCoda( CODA *, GPARM *, EWH * );
+void   ReportEarlyPick( PICK *, CODA *, STATION *, GPARM *, EWH * );
+void   RetractPick( CODA *, GPARM *, EWH * );
 int    ScanForEvent( STATION *, GPARM *, char *, int * );
 int    EventActive( STATION *, char *, GPARM *, EWH *, int * );
 double Sign( double, double );
+void   ClassifyPick( STATION *, int *, int * );
+int    ShedSkip( int );
+void   AmpSample( double, STATION *, GPARM *, EWH * );     /* functions in amp.c */
+void   EndAmp( STATION *, int, GPARM *, EWH * );
+void   PickSnr( STATION * );                               /* functions in noise.c */
+int    SnrWeight( STATION *, int );
 
 
  /***********************************************************************
@@ -65,6 +73,10 @@ double Sign( double, double );
   *  after it's corresponding pick is reported, even if the coda        *
   *  calculation is finished before the pick is ready to report.        *
   *  Codas are released from 3 to 144 seconds after the pick time.      *
+  *                                                                     *
+  *  With EarlyPick set, a pick is reported as soon as it is valid,     *
+  *  and its coda later.  If the coda turns out shorter than            *
+  *  MinCodaLen, a retraction with the pick's index follows instead.    *
   ***********************************************************************/
 
 /* pick and coda "status" attribute value explained:
@@ -80,15 +92,16 @@ void PickRA( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh )
    int  event_found;               /* 1 if an event was found */
    int  event_active;              /* 1 if an event is active */
    int  sample_index = -1;         /* Sample index */
-   PICK *Pick = &Sta->Pick;        /* Pointer to pick variables */
-   CODA *Coda = &Sta->Coda;        /* Pointer to coda variables */
+   STAEVENT *Ev = Sta->Ev;         /* Pointer to event variables */
+   PICK *Pick = &Ev->Pick;         /* Pointer to pick variables */
+   CODA *Coda = &Ev->Coda;         /* Pointer to coda variables */
 
 /* A pick is active; continue it's calculation
    *******************************************/
    if ( Gparm->Debug ) logit( "e", "\n%s.%s.%s  Pick->status: %d  Coda->status: %d\n",
           Sta->sta, Sta->chan, Sta->net, Pick->status, Coda->status );
 
-   if ( (Pick->status > 0) || (Coda->status > 0) )
+   if ( Sta->active )
    {
       if ( Gparm->Debug ) logit( "e", "Still in active mode.\n" );
 
@@ -96,6 +109,7 @@ void PickRA( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh )
 
       if ( event_active == 1 )           /* Event active at end of message */
          return;
+      EndAmp( Sta, event_active, Gparm, Ewh );
 
       if ( (event_active == -1) && Gparm->Debug )
          logit( "e", "Coda too short. Event aborted.\n" );
@@ -113,6 +127,8 @@ void PickRA( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh )
          logit( "e", "Leaving active mode.\n" );
 
       /* Next, go into search mode */
+      Pick->status = Coda->status = 0;
+      Sta->active  = 0;
    }
 
 /* Search mode
@@ -139,6 +155,7 @@ void PickRA( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh )
 
       if ( event_active == 1 )           /* Event active at end of message */
          return;
+      EndAmp( Sta, event_active, Gparm, Ewh );
 
       if ( (event_active == -1) && Gparm->Debug )
          logit( "e", "Coda too short. Event aborted.\n" );
@@ -151,6 +168,9 @@ void PickRA( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh )
 
       if ( (event_active == 0) && Gparm->Debug )
          logit( "e", "Event over. Picks/codas reported.\n" );
+
+      Pick->status = Coda->status = 0;
+      Sta->active  = 0;
    } /* end of search mode while loop */
 }
 
@@ -172,27 +192,33 @@ void PickRA( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh )
 int EventActive( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh,
                  int *sample_index )
 {
-   PICK *Pick = &Sta->Pick;        /* Pointer to pick variables */
-   CODA *Coda = &Sta->Coda;        /* Pointer to coda variables */
-   PARM *Parm = &Sta->Parm;        /* Pointer to config parameters */
+   STAEVENT *Ev = Sta->Ev;         /* Pointer to event variables */
+   PICK *Pick = &Ev->Pick;         /* Pointer to pick variables */
+   CODA *Coda = &Ev->Coda;         /* Pointer to coda variables */
+   PARM *Parm = Sta->Parm;         /* Pointer to config parameters */
 
    TRACE_HEADER *WaveHead = (TRACE_HEADER *) WaveBuf;
-   int         *WaveLong = (int *) (WaveBuf + sizeof(TRACE_HEADER));
+   double      *WaveData = (double *) (WaveBuf + sizeof(TRACE_HEADER));
 
 /* An event (pick and/or coda) is active.
    See if it should be declared over.
    *************************************/
    while ( ++(*sample_index) < WaveHead->nsamp )
    {
-      int new_sample;         /* Current sample */
+      double new_sample;      /* Current sample */
 
-      new_sample = WaveLong[*sample_index];
+      new_sample = WaveData[*sample_index];
 
 /* Update Sta.rold, Sta.rdat, Sta.old_sample, Sta.esta,
    Sta.elta, Sta.eref, and Sta.eabs using the current sample
    *********************************************************/
       Sample( new_sample, Sta );
 
+/* Follow the peak amplitudes, if AmpWindow is set
+   ***********************************************/
+      if ( Sta->Amp != NULL )
+         AmpSample( new_sample, Sta, Gparm, Ewh );
+
      /********************************************************
       *                 BEGIN CODA CALCULATION               *
       ********************************************************/
@@ -207,22 +233,22 @@ int EventActive( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh,
 
          if ( Coda->len_win != 72 ) lwindow *= 2;
 
-         Sta->rsrdat += fabs( Sta->rdat );
+         Ev->rsrdat += fabs( Sta->rdat );
 
 /* Save windows specified in the pwin array
    ****************************************/
-         if ( ++Sta->ndrt >= lwindow )
+         if ( ++Ev->ndrt >= lwindow )
          {
             double ave_abs_val;
             const int pwin[] = {1, 2, 3, 4, 5, 6, 7, 8, 10, 12, 16, 20, 24,
                                 28, 32, 36, 40, 44, 48, 56, 64, 70, 73};
 
-            if ( Coda->len_win++ == pwin[Sta->k] )
+            if ( Coda->len_win++ == pwin[Ev->k] )
             {
                int i;                              /* Window index */
                for ( i = 5; i > 0; i-- )
                   Coda->aav[i] = Coda->aav[i-1];
-               Sta->k++;
+               Ev->k++;
             }
 
 /* Compute coda length in seconds
@@ -230,39 +256,48 @@ int EventActive( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh,
             Coda->len_sec = (2 * Coda->len_win) - 1;
             if ( Coda->len_sec == 145 ) Coda->len_sec = 144;
 
-/* Flush pick from buffer if coda is long enough
-   *********************************************/
-            if ( (Pick->status == 2) && (Coda->len_sec >= Parm->MinCodaLen) )
+/* Flush pick from buffer if coda is long enough.
+   An early pick is confirmed.
+   **********************************************/
+            if ( ((Pick->status == 2) || Ev->early) && (Coda->len_sec >= Parm->MinCodaLen) )
             {
                if ( Gparm->Debug )
                   logit( "et", "Coda->len_sec: %d\n", Coda->len_sec );
 
-               ReportPick( Pick, Coda, Sta, Gparm, Ewh );
+               if ( Pick->status == 2 )
+                  ReportPick( Pick, Coda, Sta, Gparm, Ewh );
                Pick->status = 0;
-	       if (Gparm->NoCoda || (Gparm->NoCodaHorizontal && Sta->chan[2] !='Z')) 
+               Ev->early    = 0;
+	       if (Gparm->NoCoda || (Gparm->NoCodaHorizontal && Sta->chan[2] !='Z') ||
+	           ShedSkip( SHED_CODA )) 
  	       {
                   Coda->status = 0;	/* artificially terminate coda calculation */
                   if ( Gparm->Debug )
-                     logit( "et", "Debug: NoCodaHorizontal or NoCoda set for %s, Coda status set to 0, pick flushed\n", Coda->chan);
+                     logit( "et", "Debug: NoCodaHorizontal, NoCoda or load shedding for %s, Coda status set to 0, pick flushed\n", Coda->chan);
 	       }
             }
 
 /* Compute and save average absolute value
    ***************************************/
-            ave_abs_val = Sta->rsrdat / (double)lwindow;
+            ave_abs_val = Ev->rsrdat / (double)lwindow;
             Coda->aav[0] = (int) (ave_abs_val + .5);
 
 /* Initialize counter and coda amp sum
    ***********************************/
-            Sta->ndrt   = 0;
-            Sta->rsrdat = 0.0;
+            Ev->ndrt   = 0;
+            Ev->rsrdat = 0.0;
 
 /* See if the coda calculation is over.  The coda is flagged 2.
    It won't be reported until after the pick is reported.
    ************************************************************/
-            if ( (Coda->len_win == 73) || (ave_abs_val < Sta->cocrit) )
+            if ( (Coda->len_win == 73) || (ave_abs_val < Ev->cocrit) )
             {
                if ( Coda->len_sec < Parm->MinCodaLen ) {
+                  if ( Ev->early )
+                  {
+                     RetractPick( Coda, Gparm, Ewh );
+                     Ev->early = 0;
+                  }
                   return -1;
                }
 
@@ -302,6 +337,7 @@ int EventActive( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh,
          int    i;              /* Peak index */
          int    k;              /* Index into sarray */
          int    noise;          /* 1 if ievent is noise */
+         int    weight;         /* Pick weight */
          int    itrm;           /* Number of small counts allowed before */
                                 /*   pick is declared over */
          double xon;            /* Used in pick weight calculation */
@@ -310,16 +346,16 @@ int EventActive( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh,
 
 /* Save first 10 points after pick for first motion determination
    **************************************************************/
-         if ( ++Sta->evlen < 10 )
-            Sta->sarray[Sta->evlen] = new_sample;
+         if ( ++Ev->evlen < 10 )
+            Ev->sarray[Ev->evlen] = new_sample;
 
 /* Store current data if it is a new extreme value
    ***********************************************/
-         if ( Sta->next < 3 )
+         if ( Ev->next < 3 )
          {
             double adata;
             adata = fabs( Sta->rdat );
-            if ( adata > Sta->tmax ) Sta->tmax = adata;
+            if ( adata > Ev->tmax ) Ev->tmax = adata;
          }
 
 /* Test for large zero crossing.  Large zero-crossing
@@ -327,22 +363,22 @@ int EventActive( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh,
    crossing of opposite polarity to previous crossing.
    **************************************************/
 /*       printf( "pick_ew: rdat, rbig, rlast: %.2lf %.2lf %.2lf\n",
-                 Sta->rdat, Sta->rbig, Sta->rlast ); */
+                 Sta->rdat, Ev->rbig, Ev->rlast ); */
 
-         if ( fabs( Sta->rdat ) >= Sta->rbig )
+         if ( fabs( Sta->rdat ) >= Ev->rbig )
          {
-            if ( Sign( Sta->rdat, Sta->rlast ) != Sta->rdat )
+            if ( Sign( Sta->rdat, Ev->rlast ) != Sta->rdat )
             {
-               Sta->nzero++;
-               Sta->rlast = Sta->rdat;
-/*             printf( "nzero: %d\n", Sta->nzero ); */
+               Ev->nzero++;
+               Ev->rlast = Sta->rdat;
+/*             printf( "nzero: %d\n", Ev->nzero ); */
             }
          }
 
 /* Increment zero crossing interval counter.  Terminate
    pick if no zero crossings have occurred recently.
    ****************************************************/
-         if ( ++Sta->mint > Parm->MaxMint )
+         if ( ++Ev->mint > Parm->MaxMint )
             return -2;
 
 /* Test for small zero crossing
@@ -353,30 +389,30 @@ int EventActive( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh,
 /* Small zero crossing found.
    Reset zero crossing interval counter.
    ************************************/
-         Sta->mint = 0;
+         Ev->mint = 0;
 
 /* Update ecrit and determine whether at this crossing esta is still
    above ecrit.  If not, increment isml, the number of successive
    small crossings.  If esta is greater than ecrit, reset isml to 0.
    *****************************************************************/
-         Sta->ecrit += Sta->crtinc;
-         Sta->isml++;
-         if ( Sta->esta > Sta->ecrit ) Sta->isml = 0;
+         Ev->ecrit += Ev->crtinc;
+         Ev->isml++;
+         if ( Sta->esta > Ev->ecrit ) Ev->isml = 0;
 
 /* Store extrema of preceeding half cycle
    **************************************/
-         if ( Sta->next < 3 )
+         if ( Ev->next < 3 )
          {
-            Pick->xpk[Sta->next++] = Sta->tmax;
+            Pick->xpk[Ev->next++] = Ev->tmax;
 
-            if ( Sta->next == 1 )
+            if ( Ev->next == 1 )
             {
                double vt3;
-               vt3 = Sta->tmax / 3.;
-               Sta->rbig = ( vt3 > Sta->rbig ) ? vt3 : Sta->rbig;
+               vt3 = Ev->tmax / 3.;
+               Ev->rbig = ( vt3 > Ev->rbig ) ? vt3 : Ev->rbig;
             }
 
-            Sta->tmax = 0.;
+            Ev->tmax = 0.;
          }
 
 /* Compute itrm, the number of small zero crossings
@@ -384,13 +420,13 @@ int EventActive( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh,
    pick over.  This will start out quite small
    and increase during the event to a maximum of 50.
    ************************************************/
-         itrm = Parm->Itr1 + (Sta->m / Parm->Itr1);
+         itrm = Parm->Itr1 + (Ev->m / Parm->Itr1);
 
-         if ( Sta->m > 150 ) itrm = 50;
+         if ( Ev->m > 150 ) itrm = 50;
 
 /*  See if the pick is over
     ***********************/
-         if ( (++Sta->m != Parm->MinSmallZC) && (Sta->isml < itrm) )
+         if ( (++Ev->m != Parm->MinSmallZC) && (Ev->isml < itrm) )
             continue;                    /* It's not over */
 
 /*  See if the pick was a noise pick.
@@ -399,20 +435,53 @@ int EventActive( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh,
          if ( Gparm->Debug )
             logit( "e", "xpk: %.0lf %.0lf %.0lf  m: %d  nzero: %d\n", 
                    Pick->xpk[0], Pick->xpk[1], Pick->xpk[2], 
-                   Sta->m, Sta->nzero );
+                   Ev->m, Ev->nzero );
          noise = 1;
 
          for ( i = 0; i < 3; i++ )
             if ( Pick->xpk[i] >= (double) Parm->MinPeakSize )
             {
-               if ( (Sta->m == Parm->MinSmallZC) &&
-                    (Sta->nzero >= Parm->MinBigZC) )
+               if ( (Ev->m == Parm->MinSmallZC) &&
+                    (Ev->nzero >= Parm->MinBigZC) )
                   noise = 0;
                break;
             }
 
+/* Pick weight calculation
+   ***********************/
+         xpc = ( Pick->xpk[0] > fabs( Ev->sarray[0] ) ) ?
+               Pick->xpk[0] : Pick->xpk[1];
+         xon = fabs( Ev->xdot / Ev->xfrz );
+         xp0 = Pick->xpk[0] / Ev->xfrz;
+         xp1 = Pick->xpk[1] / Ev->xfrz;
+         xp2 = Pick->xpk[2] / Ev->xfrz;
+
+         weight = 3;
+
+         if ( (xp0 > 2.) && (xon > .5) && (xpc > 25.) )
+            weight = 2;
+
+         if ( (xp0 > 3.) && ((xp1 > 3.) || (xp2 > 3.)) && (xon > .5)
+         && (xpc > 100.) )
+            weight = 1;
+
+         if ( (xp0 > 4.) && ((xp1 > 6.) || (xp2 > 6.)) && (xon > .5)
+         && (xpc > 200.) )
+            weight = 0;
+
+/* If a pick classifier is loaded, it overrides the
+   noise test and the weight computed above.  The SNR,
+   if NoisePSD is set, is one of its features.
+   ************************************************/
+         PickSnr( Sta );
+         ClassifyPick( Sta, &noise, &weight );
+
          if ( noise ) return -3;
 
+/* A pick barely out of the noise gets a lower weight
+   **************************************************/
+         weight = SnrWeight( Sta, weight );
+
 /* A valid pick was found.
    Determine the first motion.
    ***************************/
@@ -420,9 +489,9 @@ int EventActive( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh,
 
          for ( k = 0; 1; k++ )
          {
-            if ( Sta->xdot <= 0 )
+            if ( Ev->xdot <= 0 )
             {
-               if ( (Sta->sarray[k+1] > Sta->sarray[k]) || (k == 8) )
+               if ( (Ev->sarray[k+1] > Ev->sarray[k]) || (k == 8) )
                {
                   if ( k == 0 ) break;
                   Pick->FirstMotion = 'D';   /* First motion is down */
@@ -431,7 +500,7 @@ int EventActive( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh,
             }
             else
             {
-               if ( (Sta->sarray[k+1] < Sta->sarray[k]) || (k == 8) )
+               if ( (Ev->sarray[k+1] < Ev->sarray[k]) || (k == 8) )
                {
                   if ( k == 0 ) break;
                   Pick->FirstMotion = 'U';   /* First motion is up */
@@ -440,28 +509,7 @@ int EventActive( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh,
             }
          }
 
-/* Pick weight calculation
-   ***********************/
-         xpc = ( Pick->xpk[0] > fabs( (double)Sta->sarray[0] ) ) ?
-               Pick->xpk[0] : Pick->xpk[1];
-         xon = fabs( (double)Sta->xdot / Sta->xfrz );
-         xp0 = Pick->xpk[0] / Sta->xfrz;
-         xp1 = Pick->xpk[1] / Sta->xfrz;
-         xp2 = Pick->xpk[2] / Sta->xfrz;
-
-         Pick->weight = 3;
-
-         if ( (xp0 > 2.) && (xon > .5) && (xpc > 25.) )
-            Pick->weight = 2;
-
-         if ( (xp0 > 3.) && ((xp1 > 3.) || (xp2 > 3.)) && (xon > .5)
-         && (xpc > 100.) )
-            Pick->weight = 1;
-
-         if ( (xp0 > 4.) && ((xp1 > 6.) || (xp2 > 6.)) && (xon > .5)
-         && (xpc > 200.) )
-            Pick->weight = 0;
-
+         Pick->weight = weight;
          Pick->status = 2;               /* Pick calculated but not reported */
 
 /* Report pick and coda
@@ -472,6 +520,15 @@ int EventActive( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh,
             ReportCoda( Coda, Gparm, Ewh );
             Pick->status = Coda->status = 0;
          }
+
+/* Or report the pick now, and the coda when it's done
+   ***************************************************/
+         else if ( Gparm->EarlyPick )
+         {
+            ReportEarlyPick( Pick, Coda, Sta, Gparm, Ewh );
+            Pick->status = 0;
+            Ev->early    = 1;
+         }
       }
 
      /******************************************************
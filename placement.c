@@ -0,0 +1,335 @@
+  /**********************************************************************
+   *                            placement.c                             *
+   *                                                                    *
+   *                  CPU placement of pick_ew's threads                *
+   *                                                                    *
+   *  This file contains functions InitPlacement(), PinThread(),        *
+   *  PinNearPicker() and UnpinNearPicker().                            *
+   *                                                                    *
+   *  The CpuSet command gives the CPUs a kind of thread may run on:    *
+   *  the picking thread, the input ring readers, the output            *
+   *  publisher, the station list reloader or the onset refiner.  Each  *
+   *  thread pins itself when it starts.  Threads are started by the    *
+   *  picking thread, so a kind without a CpuSet runs where the         *
+   *  picking thread does.                                              *
+   *                                                                    *
+   *  The picking thread is pinned before the station table, the        *
+   *  decode buffer and the classifier are allocated.  It is the first  *
+   *  to write to them, so on Linux, whose default policy puts a page   *
+   *  on the node of the CPU that first touches it, they end up in the  *
+   *  memory of the node it runs on.  The reload thread builds a new    *
+   *  table for it on the other CPUs of the picking thread's node, so   *
+   *  the table is in the same memory without the reload taking cpu     *
+   *  from the picking thread.                                          *
+   *                                                                    *
+   *  At startup, the NUMA nodes and their CPUs are logged (from /sys,  *
+   *  on Linux), with the CPUs and nodes chosen for each thread kind.   *
+   **********************************************************************/
+
+#if defined( _LINUX ) && !defined( _GNU_SOURCE )
+#define _GNU_SOURCE                  /* For sched_setaffinity() */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <earthworm.h>
+#include <transport.h>
+#include "nn_pick_ew.h"
+
+#if defined( _LINUX )
+ #include <sched.h>
+#elif defined( _WINNT )
+ #include <windows.h>
+#endif
+
+#define MAX_CPU   1024
+#define MAX_NODE  64
+#define CPUBYTES  (MAX_CPU / 8)
+
+typedef struct {
+   unsigned char bit[CPUBYTES];
+} CPUMASK;
+
+static const char *RoleName[NTHREADROLE] = { "picker", "reader", "publisher", "reload",
+                                             "onset", "noise" };
+static CPUMASK Mask[NTHREADROLE];    /* CPUs of each thread kind */
+static int     Pinned[NTHREADROLE];  /* Set if the kind has a CpuSet */
+static CPUMASK NodeCpus[MAX_NODE];   /* CPUs of each NUMA node */
+static int     nNode = 0;            /* Nodes found; 0 if not known */
+static CPUMASK Near;                 /* Picker's nodes, less the picker's CPUs */
+static int     HaveNear = 0;         /* Set if Near has any CPUs */
+
+/* Function prototypes
+   *******************/
+static int  ParseCpuList( const char *, CPUMASK * );
+static void FormatCpuList( CPUMASK *, char *, int );
+static void ReadTopology( void );
+static void SetAffinity( CPUMASK *, const char * );
+
+
+  /***************************************************************
+   *                         InitPlacement()                     *
+   *                                                             *
+   *  Parse the CpuSet lists and log the topology and the        *
+   *  placement of each thread kind.  Returns -1 if a list is    *
+   *  bad.                                                       *
+   ***************************************************************/
+
+int InitPlacement( GPARM *Gparm )
+{
+   char list[256];
+   int  i, n;
+
+   for ( i = 0; i < NTHREADROLE; i++ )
+   {
+      Pinned[i] = 0;
+      if ( Gparm->CpuSet[i] == NULL ) continue;
+      if ( ParseCpuList( Gparm->CpuSet[i], &Mask[i] ) == -1 )
+      {
+         logit( "e", "pick_ew: Bad CpuSet list <%s> for %s threads.\n",
+                Gparm->CpuSet[i], RoleName[i] );
+         return -1;
+      }
+      Pinned[i] = 1;
+   }
+
+   ReadTopology();
+   if ( nNode == 0 )
+      logit( "", "pick_ew: NUMA topology not known\n" );
+   for ( n = 0; n < nNode; n++ )
+   {
+      FormatCpuList( &NodeCpus[n], list, sizeof(list) );
+      if ( list[0] != '\0' )
+         logit( "", "pick_ew: NUMA node %d: cpus %s\n", n, list );
+   }
+
+   for ( i = 0; i < NTHREADROLE; i++ )
+   {
+      char nodes[128];
+      int  len = 0;
+
+      if ( !Pinned[i] )
+      {
+         logit( "", "pick_ew: %-9s threads: %s\n", RoleName[i],
+                (i == THR_PICKER) ? "not pinned" : "where the picker runs" );
+         continue;
+      }
+
+/* Nodes the set touches
+   *********************/
+      nodes[0] = '\0';
+      for ( n = 0; n < nNode; n++ )
+      {
+         int b;
+
+         for ( b = 0; b < CPUBYTES; b++ )
+            if ( Mask[i].bit[b] & NodeCpus[n].bit[b] ) break;
+         if ( (b < CPUBYTES) && (len < (int) sizeof(nodes) - 8) )
+            len += sprintf( nodes + len, "%s%d", (len > 0) ? "," : "", n );
+      }
+      FormatCpuList( &Mask[i], list, sizeof(list) );
+      logit( "", "pick_ew: %-9s threads: cpus %s%s%s%s\n", RoleName[i], list,
+             (len > 0) ? " (node " : "", nodes, (len > 0) ? ")" : "" );
+      if ( strchr( nodes, ',' ) != NULL )
+         logit( "", "pick_ew: WARNING: %s cpus span NUMA nodes %s\n", RoleName[i], nodes );
+   }
+
+/* The other CPUs of the picker's nodes
+   ************************************/
+   memset( &Near, 0, sizeof(CPUMASK) );
+   HaveNear = 0;
+   if ( Pinned[THR_PICKER] )
+      for ( n = 0; n < nNode; n++ )
+      {
+         int b, touch = 0;
+
+         for ( b = 0; b < CPUBYTES; b++ )
+            if ( Mask[THR_PICKER].bit[b] & NodeCpus[n].bit[b] ) touch = 1;
+         if ( !touch ) continue;
+         for ( b = 0; b < CPUBYTES; b++ )
+         {
+            Near.bit[b] |= (unsigned char) (NodeCpus[n].bit[b] & ~Mask[THR_PICKER].bit[b]);
+            if ( Near.bit[b] ) HaveNear = 1;
+         }
+      }
+   if ( HaveNear )
+   {
+      FormatCpuList( &Near, list, sizeof(list) );
+      logit( "", "pick_ew: reloaded station tables are built on cpus %s\n", list );
+   }
+   return 0;
+}
+
+
+  /***************************************************************
+   *                           PinThread()                       *
+   *                                                             *
+   *  Restrict the calling thread to the CPUs of its kind, if    *
+   *  it has a CpuSet.  Failures are logged only.                *
+   ***************************************************************/
+
+void PinThread( int role )
+{
+   if ( (role < 0) || (role >= NTHREADROLE) || !Pinned[role] ) return;
+   SetAffinity( &Mask[role], RoleName[role] );
+}
+
+
+  /***************************************************************
+   *                        PinNearPicker()                      *
+   *                                                             *
+   *  Move the calling thread to the CPUs of the picking         *
+   *  thread's NUMA node, other than the picking thread's own,   *
+   *  so the memory it first touches is local to the picking     *
+   *  thread.  Returns 1 if the thread was moved, 0 if the       *
+   *  picker isn't pinned, the topology isn't known or the node  *
+   *  has no other CPUs.                                         *
+   ***************************************************************/
+
+int PinNearPicker( void )
+{
+   if ( !HaveNear ) return 0;
+   SetAffinity( &Near, "reload" );
+   return 1;
+}
+
+
+  /***************************************************************
+   *                       UnpinNearPicker()                     *
+   *                                                             *
+   *  Move a thread PinNearPicker() moved back to the CPUs of    *
+   *  its kind, or, for a kind without a CpuSet, the picking     *
+   *  thread's, which it started with.                           *
+   ***************************************************************/
+
+void UnpinNearPicker( int role )
+{
+   PinThread( Pinned[role] ? role : THR_PICKER );
+}
+
+
+/* Parse a list like "0-3,8,10-11".  Returns -1 if
+   it is bad, empty, or names too high a CPU.
+   ***********************************************/
+static int ParseCpuList( const char *s, CPUMASK *m )
+{
+   int nset = 0;
+
+   memset( m, 0, sizeof(CPUMASK) );
+   while ( *s != '\0' )
+   {
+      char *e;
+      long lo, hi, c;
+
+      lo = strtol( s, &e, 10 );
+      if ( (e == s) || (lo < 0) ) return -1;
+      hi = lo;
+      s = e;
+      if ( *s == '-' )
+      {
+         s++;
+         hi = strtol( s, &e, 10 );
+         if ( (e == s) || (hi < lo) ) return -1;
+         s = e;
+      }
+      if ( hi >= MAX_CPU ) return -1;
+      for ( c = lo; c <= hi; c++, nset++ )
+         m->bit[c / 8] |= (unsigned char) (1 << (c % 8));
+
+      if ( (*s == ',') && (s[1] != '\0') )
+         s++;
+      else if ( *s != '\0' )
+         return -1;
+   }
+   return (nset > 0) ? 0 : -1;
+}
+
+
+/* Write a mask as a list like "0-3,8"
+   ***********************************/
+static void FormatCpuList( CPUMASK *m, char *out, int size )
+{
+   int c = 0, len = 0;
+
+   out[0] = '\0';
+   while ( c < MAX_CPU )
+   {
+      int lo;
+
+      if ( !(m->bit[c / 8] & (1 << (c % 8))) )
+      {
+         c++;
+         continue;
+      }
+      lo = c;
+      while ( (c + 1 < MAX_CPU) && (m->bit[(c + 1) / 8] & (1 << ((c + 1) % 8))) )
+         c++;
+      if ( len > size - 24 ) break;
+      if ( lo == c )
+         len += sprintf( out + len, "%s%d", (len > 0) ? "," : "", lo );
+      else
+         len += sprintf( out + len, "%s%d-%d", (len > 0) ? "," : "", lo, c );
+      c++;
+   }
+}
+
+
+/* Restrict the calling thread to a set of CPUs.
+   Failures are logged only.
+   **********************************************/
+static void SetAffinity( CPUMASK *m, const char *name )
+{
+#if defined( _LINUX )
+   cpu_set_t set;
+   int       c;
+
+   CPU_ZERO( &set );
+   for ( c = 0; (c < MAX_CPU) && (c < CPU_SETSIZE); c++ )
+      if ( m->bit[c / 8] & (1 << (c % 8)) )
+         CPU_SET( c, &set );
+   if ( sched_setaffinity( 0, sizeof(set), &set ) == -1 )
+      logit( "et", "pick_ew: Cannot pin %s thread to its CpuSet.\n", name );
+#elif defined( _WINNT )
+   DWORD_PTR mask = 0;
+   int       c;
+
+   for ( c = 0; c < (int) (8 * sizeof(DWORD_PTR)); c++ )
+      if ( m->bit[c / 8] & (1 << (c % 8)) )
+         mask |= (DWORD_PTR) 1 << c;
+   if ( SetThreadAffinityMask( GetCurrentThread(), mask ) == 0 )
+      logit( "et", "pick_ew: Cannot pin %s thread to its CpuSet.\n", name );
+#else
+   (void) m;
+   logit( "et", "pick_ew: CpuSet isn't supported here; %s thread not pinned.\n", name );
+#endif
+}
+
+
+/* Read the CPUs of each NUMA node from /sys.  Leaves nNode
+   at 0 if there is no such information.
+   ********************************************************/
+static void ReadTopology( void )
+{
+#if defined( _LINUX )
+   int n;
+
+   for ( n = 0; n < MAX_NODE; n++ )
+   {
+      char fname[64];
+      char line[1024];
+      FILE *fp;
+
+      memset( &NodeCpus[n], 0, sizeof(CPUMASK) );
+      sprintf( fname, "/sys/devices/system/node/node%d/cpulist", n );
+      if ( (fp = fopen( fname, "r" )) == NULL ) continue;
+      if ( fgets( line, sizeof(line), fp ) != NULL )
+      {
+         line[strcspn( line, "\n" )] = '\0';
+         if ( ParseCpuList( line, &NodeCpus[n] ) == 0 )
+            nNode = n + 1;
+      }
+      fclose( fp );
+   }
+#endif
+}
@@ -0,0 +1,302 @@
+  /**********************************************************************
+   *                             profile.c                              *
+   *                                                                    *
+   *            Shared picking parameters, profiles and rules           *
+   *                                                                    *
+   *  This file contains functions InternParm(), NumParm(),             *
+   *  AddProfile(), FindProfile(), AddRule(), MatchRule(),              *
+   *  FreeRuleSet(), WildMatch() and HashParm().                        *
+   *                                                                    *
+   *  Channels don't carry their own copy of PARM.  Every parameter     *
+   *  set is stored once, in a pool that is never freed while the       *
+   *  program runs, and each STATION points to its set.  Two channels   *
+   *  with the same parameters always get the same pointer, so          *
+   *  parameter sets can be compared by pointer.                        *
+   *                                                                    *
+   *  A station list may name parameter sets ("Profile" lines) and      *
+   *  give wildcard SCNL rules that supply parameters to channels       *
+   *  listed without any.  Profiles and rules are kept in a RULESET.    *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <earthworm.h>
+#include <transport.h>
+#include "nn_pick_ew.h"
+
+typedef struct parmnode {
+   PARM            Parm;
+   unsigned int    hash;
+   struct parmnode *next;   /* Next node in the same bucket */
+} PARMNODE;
+
+static PARMNODE **Bucket = NULL;     /* Hash table of parameter sets */
+static int        nBucket = 0;
+static int        nParm = 0;         /* Parameter sets in the pool */
+static mutex_t    PoolMutex;
+
+/* Function prototypes
+   *******************/
+int   WildMatch( const char *, const char * );
+PARM *FindProfile( RULESET *, char * );
+unsigned int HashParm( PARM * );
+static int          Grow( void **, int *, int, size_t );
+
+
+  /***************************************************************
+   *                         InternParm()                        *
+   *                                                             *
+   *  Return the pool's copy of a parameter set, adding it if    *
+   *  it isn't there yet.  Returns NULL if out of memory.  The   *
+   *  first call must be made before any other thread starts.    *
+   ***************************************************************/
+
+PARM *InternParm( PARM *Parm )
+{
+   unsigned int h = HashParm( Parm );
+   PARMNODE     *node;
+
+   if ( Bucket == NULL )
+   {
+      nBucket = 256;
+      if ( (Bucket = (PARMNODE **) calloc( nBucket, sizeof(PARMNODE *) )) == NULL )
+         return NULL;
+      CreateSpecificMutex( &PoolMutex );
+   }
+
+   RequestSpecificMutex( &PoolMutex );
+   for ( node = Bucket[h % nBucket]; node != NULL; node = node->next )
+      if ( (node->hash == h) && (memcmp( &node->Parm, Parm, sizeof(PARM) ) == 0) )
+      {
+         ReleaseSpecificMutex( &PoolMutex );
+         return &node->Parm;
+      }
+
+/* Rehash into a bigger table when the chains get long.
+   The nodes themselves never move.
+   ****************************************************/
+   if ( nParm >= 2 * nBucket )
+   {
+      int      n = 4 * nBucket;
+      PARMNODE **b = (PARMNODE **) calloc( n, sizeof(PARMNODE *) );
+      int      i;
+
+      if ( b != NULL )
+      {
+         for ( i = 0; i < nBucket; i++ )
+            while ( Bucket[i] != NULL )
+            {
+               PARMNODE *nd = Bucket[i];
+
+               Bucket[i]        = nd->next;
+               nd->next         = b[nd->hash % n];
+               b[nd->hash % n]  = nd;
+            }
+         free( Bucket );
+         Bucket  = b;
+         nBucket = n;
+      }
+   }
+
+   if ( (node = (PARMNODE *) malloc( sizeof(PARMNODE) )) == NULL )
+   {
+      ReleaseSpecificMutex( &PoolMutex );
+      return NULL;
+   }
+   node->Parm = *Parm;
+   node->hash = h;
+   node->next = Bucket[h % nBucket];
+   Bucket[h % nBucket] = node;
+   nParm++;
+   ReleaseSpecificMutex( &PoolMutex );
+   return &node->Parm;
+}
+
+
+  /***************************************************************
+   *                           NumParm()                         *
+   *                                                             *
+   *  Number of distinct parameter sets in the pool.             *
+   ***************************************************************/
+
+int NumParm( void )
+{
+   return nParm;
+}
+
+
+  /***************************************************************
+   *                          AddProfile()                       *
+   *                                                             *
+   *  Name a parameter set.  Returns -1 if the name is too long, *
+   *  already used, or there's no memory.                        *
+   ***************************************************************/
+
+int AddProfile( RULESET *rs, char *name, PARM *Parm )
+{
+   if ( (strlen( name ) >= PROFILE_LEN) || (FindProfile( rs, name ) != NULL) )
+      return -1;
+   if ( Grow( (void **) &rs->prof, &rs->maxprof, rs->nprof, sizeof(PROFILE) ) == -1 )
+      return -1;
+   strcpy( rs->prof[rs->nprof].name, name );
+   rs->prof[rs->nprof].Parm = Parm;
+   rs->nprof++;
+   return 0;
+}
+
+
+  /***************************************************************
+   *                         FindProfile()                       *
+   ***************************************************************/
+
+PARM *FindProfile( RULESET *rs, char *name )
+{
+   int i;
+
+   for ( i = 0; i < rs->nprof; i++ )
+      if ( strcmp( rs->prof[i].name, name ) == 0 )
+         return rs->prof[i].Parm;
+   return NULL;
+}
+
+
+  /***************************************************************
+   *                           AddRule()                         *
+   *                                                             *
+   *  Add a wildcard SCNL rule.  The patterns must fit the SCNL  *
+   *  fields.  Returns -1 on error.                              *
+   ***************************************************************/
+
+int AddRule( RULESET *rs, int pickflag, char *sta, char *chan, char *net,
+             char *loc, PARM *Parm )
+{
+   STARULE *r;
+
+   if ( Grow( (void **) &rs->rule, &rs->maxrule, rs->nrule, sizeof(STARULE) ) == -1 )
+      return -1;
+   r = &rs->rule[rs->nrule];
+   if ( (strlen( sta )  >= sizeof(r->sta))  || (strlen( chan ) >= sizeof(r->chan)) ||
+        (strlen( net )  >= sizeof(r->net))  || (strlen( loc )  >= sizeof(r->loc)) )
+      return -1;
+   strcpy( r->sta,  sta );
+   strcpy( r->chan, chan );
+   strcpy( r->net,  net );
+   strcpy( r->loc,  loc );
+   r->pickflag = pickflag;
+   r->Parm     = Parm;
+   rs->nrule++;
+   return 0;
+}
+
+
+  /***************************************************************
+   *                          MatchRule()                        *
+   *                                                             *
+   *  Return the first rule matching an SCNL, or NULL.           *
+   ***************************************************************/
+
+STARULE *MatchRule( RULESET *rs, char *sta, char *chan, char *net, char *loc )
+{
+   int i;
+
+   for ( i = 0; i < rs->nrule; i++ )
+   {
+      STARULE *r = &rs->rule[i];
+
+      if ( WildMatch( r->sta, sta ) && WildMatch( r->chan, chan ) &&
+           WildMatch( r->net, net ) && WildMatch( r->loc, loc ) )
+         return r;
+   }
+   return NULL;
+}
+
+
+  /***************************************************************
+   *                         FreeRuleSet()                       *
+   *                                                             *
+   *  Free the profile and rule lists.  The parameter sets they  *
+   *  point to stay in the pool.                                 *
+   ***************************************************************/
+
+void FreeRuleSet( RULESET *rs )
+{
+   free( rs->prof );
+   free( rs->rule );
+   memset( rs, 0, sizeof(RULESET) );
+}
+
+
+  /***************************************************************
+   *                          WildMatch()                        *
+   *                                                             *
+   *  Match a string against a pattern in which '*' matches any  *
+   *  run of characters and '?' matches any one character.       *
+   *  Returns 1 if it matches.                                   *
+   ***************************************************************/
+
+int WildMatch( const char *pat, const char *s )
+{
+   const char *star = NULL;         /* Last '*' seen in pat */
+   const char *retry = NULL;        /* Where in s that '*' resumes */
+
+   while ( *s != '\0' )
+   {
+      if ( (*pat == '?') || (*pat == *s) )
+      {
+         pat++;
+         s++;
+      }
+      else if ( *pat == '*' )
+      {
+         star  = pat++;
+         retry = s;
+      }
+      else if ( star != NULL )
+      {
+         pat = star + 1;
+         s   = ++retry;
+      }
+      else
+         return 0;
+   }
+   while ( *pat == '*' ) pat++;
+   return *pat == '\0';
+}
+
+
+  /***************************************************************
+   *                          HashParm()                         *
+   *                                                             *
+   *  FNV-1a hash of a parameter set.                            *
+   ***************************************************************/
+
+unsigned int HashParm( PARM *Parm )
+{
+   const unsigned char *p = (const unsigned char *) Parm;
+   unsigned int        h = 2166136261u;
+   size_t              i;
+
+   for ( i = 0; i < sizeof(PARM); i++ )
+   {
+      h ^= p[i];
+      h *= 16777619u;
+   }
+   return h;
+}
+
+
+/* Make room for one more element in a growable array
+   ***************************************************/
+static int Grow( void **array, int *max, int n, size_t size )
+{
+   void *tmp;
+   int  newmax;
+
+   if ( n < *max ) return 0;
+   newmax = (*max < 16) ? 16 : 2 * *max;
+   if ( (tmp = realloc( *array, newmax * size )) == NULL ) return -1;
+   *array = tmp;
+   *max   = newmax;
+   return 0;
+}
@@ -0,0 +1,343 @@
+  /**********************************************************************
+   *                              reload.c                              *
+   *                                                                    *
+   *                     Live station list reloading                    *
+   *                                                                    *
+   *  This file contains functions StartStaReload(), SwapStaList() and  *
+   *  StopStaReload().                                                  *
+   *                                                                    *
+   *  With StaReloadInt set, a thread checks the station files every    *
+   *  StaReloadInt seconds.  When one has changed, the thread builds    *
+   *  and sorts a new station table and works out which old channel     *
+   *  each new channel corresponds to.  The picking thread then calls   *
+   *  SwapStaList() between messages, which copies the state of the     *
+   *  unchanged channels into the new table and switches to it.  New    *
+   *  channels, and channels whose parameters changed, start in         *
+   *  restart mode.  Channels no longer listed are dropped.  A dropped  *
+   *  or retuned channel in the middle of an event has its early pick   *
+   *  taken back and the amplitude of its reported pick sent, as an     *
+   *  evicted auto channel does.  The rules of the new list replace     *
+   *  the ones used to add channels.                                    *
+   *                                                                    *
+   *  The thread builds the new table on the other CPUs of the          *
+   *  picker's NUMA node, so that on Linux the table, like the one      *
+   *  built at startup, is in the memory of that node, while the        *
+   *  picker's own CPUs go on picking.                                  *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <earthworm.h>
+#include <transport.h>
+#include <time_ew.h>
+#include "nn_pick_ew.h"
+
+#define THREAD_STACK  65536
+
+#define MAP_NEW      -1     /* No old channel with this SCNL */
+#define MAP_RETUNED  -2     /* Old channel found; parameters differ */
+
+static GPARM    ReloadParm;          /* Copy of Gparm with our own StaFile list */
+static GPARM   *Gp;                  /* For messages sent when channels are dropped */
+static EWH     *Ew;
+static STATION *CurSta;              /* Table in use by the picking thread */
+static int      CurNsta;
+static STATION *NewSta = NULL;       /* Table waiting to be swapped in */
+static int      NewNsta;
+static int     *Map = NULL;          /* Old index for each new channel, or MAP_* */
+static int     *OldIndex = NULL;     /* Old index of retuned channels */
+static RULESET  NewRules;            /* Rules of the waiting table */
+static volatile int Ready   = 0;     /* Set when NewSta is waiting */
+static volatile int Stop    = 0;
+static volatile int Running = 0;
+static mutex_t      ReloadMutex;
+static ew_thread_t  ReloadTid;
+
+/* Function prototypes
+   *******************/
+int  GetStaList( STATION **, int *, RULESET *, GPARM * );
+void FreeRuleSet( RULESET * );                     /* function in profile.c */
+void SetAutoRules( RULESET * );                    /* function in autosta.c */
+int  CompareSCNL( const void *, const void * );
+void CopyStaState( STATION *, STATION * );        /* function in statable.c */
+void FreeReorder( STATION * );                     /* function in reorder.c */
+void FreeBank( STATION * );                        /* function in bank.c */
+void FreeOnset( STATION * );                       /* function in onset.c */
+void FreeAmp( STATION * );                         /* function in amp.c */
+void FreeNoise( STATION * );                       /* function in noise.c */
+void EndAmp( STATION *, int, GPARM *, EWH * );     /* function in amp.c */
+void RetractPick( CODA *, GPARM *, EWH * );        /* function in report.c */
+void PinThread( int );                             /* functions in placement.c */
+int  PinNearPicker( void );
+void UnpinNearPicker( int );
+static thr_ret Reloader( void * );
+static int     StaFilesChanged( void );
+
+
+  /***************************************************************
+   *                        StartStaReload()                     *
+   *                                                             *
+   *  Start the reload thread, if StaReloadInt is set.  Sta is   *
+   *  the sorted table read at startup.                          *
+   *  Returns -1 if an error is encountered.                     *
+   ***************************************************************/
+
+int StartStaReload( GPARM *Gparm, EWH *Ewh, STATION *Sta, int Nsta )
+{
+   if ( Gparm->StaReloadInt <= 0 ) return 0;
+
+   Gp = Gparm;
+   Ew = Ewh;
+   ReloadParm = *Gparm;
+   ReloadParm.StaFile = (STAFILE *) malloc( Gparm->nStaFile * sizeof(STAFILE) );
+   if ( ReloadParm.StaFile == NULL )
+   {
+      logit( "et", "pick_ew: Cannot allocate the station reload file list\n" );
+      return -1;
+   }
+   memcpy( ReloadParm.StaFile, Gparm->StaFile, Gparm->nStaFile * sizeof(STAFILE) );
+
+   CurSta  = Sta;
+   CurNsta = Nsta;
+   CreateSpecificMutex( &ReloadMutex );
+
+   Stop    = 0;
+   Running = 1;
+   if ( StartThreadWithArg( Reloader, NULL, (unsigned) THREAD_STACK, &ReloadTid ) == -1 )
+   {
+      logit( "et", "pick_ew: Cannot start the station reload thread\n" );
+      Running = 0;
+      return -1;
+   }
+   return 0;
+}
+
+
+  /***************************************************************
+   *                         SwapStaList()                       *
+   *                                                             *
+   *  Called by the picking thread between messages.  If a new   *
+   *  station table is ready, carry the channel state over to    *
+   *  it, switch to it and free the old one.  Returns 1 if the   *
+   *  table was swapped.                                         *
+   ***************************************************************/
+
+int SwapStaList( STATION **Sta, int *Nsta )
+{
+   STATION *old = *Sta;
+   int     nold = *Nsta;
+   int     i;
+   int     nkept = 0, nretuned = 0, nnew = 0;
+   double  t0, t1;
+
+   if ( !Ready ) return 0;
+
+   hrtime_ew( &t0 );
+   RequestSpecificMutex( &ReloadMutex );
+
+   for ( i = 0; i < NewNsta; i++ )
+   {
+      if ( Map[i] >= 0 )
+      {
+         CopyStaState( &NewSta[i], &old[Map[i]] );
+         old[Map[i]].Ev->early = 0;          /* The event goes on in the new table */
+         old[Map[i]].Ro   = NULL;
+         old[Map[i]].Bank = NULL;
+         old[Map[i]].On   = NULL;
+         old[Map[i]].Amp  = NULL;
+         old[Map[i]].Noise = NULL;
+         nkept++;
+      }
+      else if ( Map[i] == MAP_RETUNED )
+      {
+         *NewSta[i].Gap = *old[OldIndex[i]].Gap;
+         *NewSta[i].Dup = *old[OldIndex[i]].Dup;
+         nretuned++;
+      }
+      else
+         nnew++;
+   }
+
+   SetAutoRules( &NewRules );
+   *Sta    = CurSta  = NewSta;
+   *Nsta   = CurNsta = NewNsta;
+   NewSta  = NULL;
+   free( Map );
+   free( OldIndex );
+   Map = OldIndex = NULL;
+   Ready = 0;
+
+   ReleaseSpecificMutex( &ReloadMutex );
+
+/* Messages held for channels that weren't kept are dropped.
+   Their events will never end, so an early pick is taken back,
+   and the amplitude of a pick that was reported is sent.
+   ************************************************************/
+   for ( i = 0; i < nold; i++ )
+   {
+      int how = 0;
+
+      if ( old[i].active && old[i].Ev->early )
+      {
+         RetractPick( &old[i].Ev->Coda, Gp, Ew );
+         old[i].Ev->early = 0;
+         how = -1;
+      }
+      EndAmp( &old[i], how, Gp, Ew );
+      FreeReorder( &old[i] );
+      FreeBank( &old[i] );
+      FreeOnset( &old[i] );
+      FreeAmp( &old[i] );
+      FreeNoise( &old[i] );
+   }
+   hrtime_ew( &t1 );
+
+   logit( "t", "pick_ew: Station list reloaded in %.1lf ms: %d channels; %d kept, "
+          "%d retuned, %d new, %d removed\n", 1000. * (t1 - t0), *Nsta, nkept,
+          nretuned, nnew, nold - nkept - nretuned );
+   free( old );
+   return 1;
+}
+
+
+  /***************************************************************
+   *                        StopStaReload()                      *
+   ***************************************************************/
+
+void StopStaReload( void )
+{
+   int i;
+
+   if ( !Running ) return;
+
+   Stop = 1;
+   for ( i = 0; (i < 500) && Running; i++ )
+      sleep_ew( 10 );
+   if ( Running )
+   {
+      logit( "et", "pick_ew: Station reload thread didn't stop; killing it.\n" );
+      KillThread( ReloadTid );
+      return;
+   }
+   CloseSpecificMutex( &ReloadMutex );
+   free( NewSta );
+   free( Map );
+   free( OldIndex );
+   free( ReloadParm.StaFile );
+   FreeRuleSet( &NewRules );
+   NewSta = NULL;
+   Map = OldIndex = NULL;
+}
+
+
+/* The reload thread.  Checks the station files every
+   StaReloadInt seconds and prepares a new table when
+   one of them has changed.
+   ***************************************************/
+static thr_ret Reloader( void *arg )
+{
+   time_t then, now;
+
+   (void) arg;
+   PinThread( THR_RELOAD );
+   time( &then );
+   while ( !Stop )
+   {
+      STATION *sta = NULL;
+      int     nsta = 0;
+      RULESET rs;
+      int     *map, *oldidx;
+      int     i;
+      int     moved;
+
+      sleep_ew( 200 );
+      time( &now );
+      if ( Ready || ((now - then) < ReloadParm.StaReloadInt) ) continue;
+      then = now;
+
+      if ( !StaFilesChanged() ) continue;
+
+   /* Build and sort the new table on the picker's node,
+      so its pages are first touched there
+      **************************************************/
+      logit( "t", "pick_ew: Station list changed; reloading.\n" );
+      moved = PinNearPicker();
+      if ( (GetStaList( &sta, &nsta, &rs, &ReloadParm ) == -1) ||
+           ((nsta == 0) && (ReloadParm.AutoMax == 0)) )
+      {
+         if ( moved ) UnpinNearPicker( THR_RELOAD );
+         logit( "et", "pick_ew: Station list reload failed; keeping the old list.\n" );
+         free( sta );
+         FreeRuleSet( &rs );
+         continue;
+      }
+      qsort( sta, nsta, sizeof(STATION), CompareSCNL );
+      if ( moved ) UnpinNearPicker( THR_RELOAD );
+
+   /* Match the new channels to the old ones.  CurSta can't
+      change until we set Ready, and its SCNLs and parameters
+      are never written by the picking thread.
+      *******************************************************/
+      map    = (int *) malloc( nsta * sizeof(int) );
+      oldidx = (int *) malloc( nsta * sizeof(int) );
+      if ( (map == NULL) || (oldidx == NULL) )
+      {
+         logit( "et", "pick_ew: Cannot allocate the station reload map.\n" );
+         free( map );
+         free( oldidx );
+         free( sta );
+         FreeRuleSet( &rs );
+         continue;
+      }
+      for ( i = 0; i < nsta; i++ )
+      {
+         STATION *o = (STATION *) bsearch( &sta[i], CurSta, CurNsta, sizeof(STATION),
+                                           CompareSCNL );
+         if ( o == NULL )
+            map[i] = MAP_NEW;
+         else if ( o->Parm == sta[i].Parm )          /* Shared, so compare pointers */
+            map[i] = (int)(o - CurSta);
+         else
+         {
+            map[i]    = MAP_RETUNED;
+            oldidx[i] = (int)(o - CurSta);
+         }
+      }
+
+      RequestSpecificMutex( &ReloadMutex );
+      NewSta   = sta;
+      NewNsta  = nsta;
+      Map      = map;
+      OldIndex = oldidx;
+      NewRules = rs;
+      Ready    = 1;
+      ReleaseSpecificMutex( &ReloadMutex );
+   }
+
+   Running = 0;
+   return THR_NULL_RET;
+}
+
+
+/* Return 1 if any station file's size or modification
+   time differs from when it was last read
+   ****************************************************/
+static int StaFilesChanged( void )
+{
+   int         i;
+   struct stat st;
+
+   for ( i = 0; i < ReloadParm.nStaFile; i++ )
+   {
+      STAFILE *sf = &ReloadParm.StaFile[i];
+
+      if ( stat( sf->name, &st ) != 0 ) continue;     /* Being replaced? */
+      if ( ((double) st.st_mtime != sf->mtime) ||
+           ((unsigned int) st.st_size != sf->size) )
+         return 1;
+   }
+   return 0;
+}
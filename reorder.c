@@ -0,0 +1,377 @@
+  /**********************************************************************
+   *                              reorder.c                             *
+   *                                                                    *
+   *                  Reordering of late and early messages             *
+   *                                                                    *
+   *  This file contains functions InitReorder(), ReorderMsg(),         *
+   *  ReleaseExpired(), FreeReorder() and LogReorderStats().            *
+   *                                                                    *
+   *  Telemetry with more than one path can deliver a channel's         *
+   *  messages out of order.  A message that starts where the data      *
+   *  processed so far ends is picked at once.  A message that starts   *
+   *  later is held, for at most ReorderHoldMs, in the channel's        *
+   *  reorder buffer, in case the missing messages are still on their   *
+   *  way.  Held messages are picked as soon as they line up with the   *
+   *  channel's data.  When a held message has waited long enough, it   *
+   *  is picked anyway, and its gap is interpolated or starts a         *
+   *  restart as usual.  Messages lying entirely within data already    *
+   *  processed are duplicates, and are dropped.  Messages partly       *
+   *  within it overlap, and the samples already processed are cut     *
+   *  off, by moving the header forward over them.  This is done with   *
+   *  or without a reorder buffer.  A message starting further back     *
+   *  than MaxGap samples, four message lengths and ReorderHoldMs all   *
+   *  can't be a late or repeated one: the digitizer's clock has been   *
+   *  set back.  The channel drops what it holds and restarts at the    *
+   *  new time, as it would after a big gap.                            *
+   *                                                                    *
+   *  Buffers are allocated the first time a channel needs one.  The    *
+   *  buffers holding messages are kept on a list, so ReleaseExpired()  *
+   *  need not look at the other channels.                              *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <earthworm.h>
+#include <transport.h>
+#include <trace_buf.h>
+#include <time_ew.h>
+#include "nn_pick_ew.h"
+
+#define SWEEP_INT  0.05     /* Look for expired messages this often (s) */
+
+static REORDER *Waiting = NULL;      /* Buffers holding messages */
+static int      nWaiting = 0;        /* Messages held in all of them */
+static double   HoldSec = 0.;        /* ReorderHoldMs in seconds */
+static int      MaxHeld = 0;
+static size_t   Room;                /* Kept in front of held messages */
+static double   LastSweep = 0.;
+static int      MaxGap;
+
+static unsigned long nHeld    = 0;   /* Messages held */
+static unsigned long nHealed  = 0;   /* Held messages picked without a gap */
+static unsigned long nExpired = 0;   /* Held messages picked after the hold time */
+static unsigned long nForced  = 0;   /* Held messages picked to make room */
+static unsigned long nDup     = 0;   /* Duplicates dropped */
+static unsigned long nOverlap = 0;   /* Overlaps dropped */
+static unsigned long nReset   = 0;   /* Clocks set back */
+
+/* Function prototypes
+   *******************/
+void   PickMsg( STATION *, char *, GPARM *, EWH * );  /* function in nn_pick_ew.c */
+size_t DecodeRoom( GPARM * );                         /* function in decode.c */
+void   InitVar( STATION * );
+void   RetractPick( CODA *, GPARM *, EWH * );         /* function in report.c */
+static int  ClockReset( STATION *, char *, GPARM *, EWH * );
+static char *Trim( STATION *, char * );
+static int  Hold( STATION *, char * );
+static int  Release( STATION *, GPARM *, EWH * );
+static void Drain( STATION *, GPARM *, EWH * );
+
+
+  /***************************************************************
+   *                          InitReorder()                      *
+   ***************************************************************/
+
+void InitReorder( GPARM *Gparm )
+{
+   HoldSec = Gparm->ReorderHoldMs / 1000.;
+   MaxHeld = (Gparm->ReorderHoldMs > 0) ? Gparm->ReorderMax : 0;
+   Room    = DecodeRoom( Gparm );
+   MaxGap  = Gparm->MaxGap;
+}
+
+
+  /***************************************************************
+   *                          ReorderMsg()                       *
+   *                                                             *
+   *  Pick a message, hold it, or drop it, depending on where    *
+   *  it lies relative to the channel's data.  WaveBuf is a      *
+   *  decoded message (see decode.c).                            *
+   ***************************************************************/
+
+void ReorderMsg( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh )
+{
+   TRACE2_HEADER *th;
+
+/* Restart the channel if its clock went back, or else
+   drop what has been processed already
+   ***************************************************/
+   if ( !ClockReset( Sta, WaveBuf, Gparm, Ewh ) &&
+        ((WaveBuf = Trim( Sta, WaveBuf )) == NULL) ) return;
+   th = (TRACE2_HEADER *) WaveBuf;
+
+/* Next in line, or we aren't holding messages
+   *******************************************/
+   if ( (th->starttime < Sta->endtime + 1.5 / th->samprate) || (MaxHeld == 0) )
+   {
+      PickMsg( Sta, WaveBuf, Gparm, Ewh );
+      Drain( Sta, Gparm, Ewh );
+      return;
+   }
+
+/* Early.  If the buffer is full, pick the earliest
+   held message to make room and look again.
+   ************************************************/
+   if ( (Sta->Ro != NULL) && (Sta->Ro->nheld == MaxHeld) )
+   {
+      nForced += Release( Sta, Gparm, Ewh );
+      Drain( Sta, Gparm, Ewh );
+      ReorderMsg( Sta, WaveBuf, Gparm, Ewh );
+      return;
+   }
+   Hold( Sta, WaveBuf );
+}
+
+
+  /***************************************************************
+   *                        ReleaseExpired()                     *
+   *                                                             *
+   *  Pick the held messages that have waited ReorderHoldMs,     *
+   *  and any that line up after them.  Called by the picking   *
+   *  thread between messages, whether or not one arrived.       *
+   ***************************************************************/
+
+void ReleaseExpired( GPARM *Gparm, EWH *Ewh )
+{
+   REORDER *ro, *next;
+   double  now;
+
+   if ( nWaiting == 0 ) return;
+
+   hrtime_ew( &now );
+   if ( (now - LastSweep) < SWEEP_INT ) return;
+   LastSweep = now;
+
+   for ( ro = Waiting; ro != NULL; ro = next )
+   {
+      next = ro->next;
+      while ( (ro->nheld > 0) && ((now - ro->held[0].arrival) >= HoldSec) )
+      {
+         nExpired += Release( ro->Sta, Gparm, Ewh );
+         Drain( ro->Sta, Gparm, Ewh );
+      }
+   }
+}
+
+
+  /***************************************************************
+   *                          FreeReorder()                      *
+   *                                                             *
+   *  Drop a channel's held messages and free its buffer.        *
+   ***************************************************************/
+
+void FreeReorder( STATION *Sta )
+{
+   REORDER *ro = Sta->Ro;
+   int     i;
+
+   if ( ro == NULL ) return;
+
+   if ( ro->nheld > 0 )
+   {
+      if ( ro->prev != NULL ) ro->prev->next = ro->next;
+      else                    Waiting = ro->next;
+      if ( ro->next != NULL ) ro->next->prev = ro->prev;
+      nWaiting -= ro->nheld;
+   }
+   for ( i = 0; i < ro->nheld; i++ )
+      free( ro->held[i].mem );
+   free( ro->held );
+   free( ro );
+   Sta->Ro = NULL;
+}
+
+
+  /***************************************************************
+   *                        LogReorderStats()                    *
+   ***************************************************************/
+
+void LogReorderStats( void )
+{
+   if ( (MaxHeld == 0) && (nDup == 0) && (nOverlap == 0) && (nReset == 0) ) return;
+
+   logit( "t", "pick_ew: Reorder: %lu msgs held, %d now; %lu picked in order, "
+          "%lu after the hold time, %lu to make room; dropped %lu duplicates, "
+          "%lu overlaps; %lu clocks set back\n", nHeld, nWaiting, nHealed, nExpired,
+          nForced, nDup, nOverlap, nReset );
+}
+
+
+/* If a message starts so far before the end of the channel's
+   data that it can't be a late or repeated message, the
+   channel's clock was set back.  Take back an early pick, drop
+   the held messages, which are from the old time line, and
+   restart the channel so that the message is picked in restart
+   mode.  Returns 1 if the channel was restarted.
+   *************************************************************/
+static int ClockReset( STATION *Sta, char *WaveBuf, GPARM *Gparm, EWH *Ewh )
+{
+   TRACE2_HEADER *th = (TRACE2_HEADER *) WaveBuf;
+   double        back = Sta->endtime - th->starttime;
+   double        limit = th->nsamp * 4. / th->samprate;
+
+   if ( MaxGap / th->samprate > limit ) limit = MaxGap / th->samprate;
+   if ( HoldSec > limit )               limit = HoldSec;
+   if ( back <= limit ) return 0;
+
+   if ( nReset++ < 100 )
+      logit( "t", "pick_ew: %s.%s.%s.%s time went back %.1lf s; restarting channel\n",
+             Sta->sta, Sta->chan, Sta->net, Sta->loc, back );
+   if ( Sta->active && Sta->Ev->early )
+      RetractPick( &Sta->Ev->Coda, Gparm, Ewh );
+   FreeReorder( Sta );
+   InitVar( Sta );
+   Sta->first   = 0;
+   Sta->endtime = th->starttime - 1. / th->samprate;
+   return 1;
+}
+
+
+/* Cut off the samples of a message that the channel has
+   processed already, by moving the header forward over
+   them.  Returns the new start of the message, or NULL if
+   that leaves nothing.
+   *******************************************************/
+static char *Trim( STATION *Sta, char *WaveBuf )
+{
+   TRACE2_HEADER *th = (TRACE2_HEADER *) WaveBuf;
+   double        half = 0.5 / th->samprate;
+   int           nskip;
+   char          *NewBuf;
+
+   if ( th->starttime >= Sta->endtime + half ) return WaveBuf;
+
+   if ( th->endtime < Sta->endtime + half )
+   {
+      nDup++;
+      return NULL;
+   }
+   nOverlap++;
+   nskip = (int) ((Sta->endtime - th->starttime) * th->samprate + 0.5) + 1;
+   th->nsamp -= nskip;
+   th->starttime += nskip / th->samprate;
+   NewBuf = WaveBuf + nskip * sizeof(double);
+   memmove( NewBuf, WaveBuf, sizeof(TRACE2_HEADER) );
+   return NewBuf;
+}
+
+
+/* Put a copy of an early message in the channel's buffer, in
+   order of start time.  Exact duplicates of held messages are
+   dropped.  Overlaps are trimmed when the messages are picked.
+   The caller makes sure there is room.  Returns -1 if out of
+   memory, in which case the message is lost.
+   ***********************************************************/
+static int Hold( STATION *Sta, char *WaveBuf )
+{
+   TRACE2_HEADER *th = (TRACE2_HEADER *) WaveBuf;
+   double        half = 0.5 / th->samprate;
+   REORDER       *ro = Sta->Ro;
+   size_t        len;
+   char          *mem;
+   int           i;
+
+   if ( ro == NULL )
+   {
+      if ( (ro = (REORDER *) calloc( 1, sizeof(REORDER) )) == NULL ||
+           (ro->held = (HELDMSG *) calloc( MaxHeld, sizeof(HELDMSG) )) == NULL )
+      {
+         logit( "et", "pick_ew: Cannot allocate reorder buffer for %s.%s.%s.%s\n",
+                Sta->sta, Sta->chan, Sta->net, Sta->loc );
+         free( ro );
+         return -1;
+      }
+      ro->Sta = Sta;
+      Sta->Ro = ro;
+   }
+
+/* Find its place
+   ***************/
+   for ( i = 0; i < ro->nheld; i++ )
+   {
+      TRACE2_HEADER *h = (TRACE2_HEADER *) ro->held[i].msg;
+
+      if ( th->starttime < h->starttime - half ) break;
+      if ( (th->starttime < h->starttime + half) &&
+           (th->endtime > h->endtime - half) && (th->endtime < h->endtime + half) )
+      {
+         nDup++;
+         return 0;
+      }
+   }
+
+/* Copy it with room in front for the
+   samples Interpolate() may put there
+   ***********************************/
+   len = sizeof(TRACE2_HEADER) + th->nsamp * sizeof(double);
+   if ( (mem = (char *) malloc( Room + len )) == NULL )
+   {
+      logit( "et", "pick_ew: Cannot hold message of %s.%s.%s.%s\n",
+             Sta->sta, Sta->chan, Sta->net, Sta->loc );
+      return -1;
+   }
+   memcpy( mem + Room, WaveBuf, len );
+
+   memmove( &ro->held[i+1], &ro->held[i], (ro->nheld - i) * sizeof(HELDMSG) );
+   hrtime_ew( &ro->held[i].arrival );
+   ro->held[i].msg = mem + Room;
+   ro->held[i].mem = mem;
+   if ( ro->nheld++ == 0 )
+   {
+      ro->prev = NULL;
+      ro->next = Waiting;
+      if ( Waiting != NULL ) Waiting->prev = ro;
+      Waiting = ro;
+   }
+   nWaiting++;
+   nHeld++;
+   return 0;
+}
+
+
+/* Take the earliest held message out of the channel's buffer
+   and pick whatever of it hasn't been picked since it was held.
+   Returns 1 if any of it was picked.
+   *************************************************************/
+static int Release( STATION *Sta, GPARM *Gparm, EWH *Ewh )
+{
+   REORDER       *ro  = Sta->Ro;
+   char          *msg = ro->held[0].msg;
+   char          *mem = ro->held[0].mem;
+
+   memmove( &ro->held[0], &ro->held[1], --ro->nheld * sizeof(HELDMSG) );
+   nWaiting--;
+   if ( ro->nheld == 0 )
+   {
+      if ( ro->prev != NULL ) ro->prev->next = ro->next;
+      else                    Waiting = ro->next;
+      if ( ro->next != NULL ) ro->next->prev = ro->prev;
+   }
+
+   if ( (msg = Trim( Sta, msg )) == NULL )
+   {
+      free( mem );
+      return 0;
+   }
+   PickMsg( Sta, msg, Gparm, Ewh );
+   free( mem );
+   return 1;
+}
+
+
+/* Pick the held messages that now follow on from
+   the channel's data without a gap
+   **********************************************/
+static void Drain( STATION *Sta, GPARM *Gparm, EWH *Ewh )
+{
+   REORDER *ro = Sta->Ro;
+
+   while ( (ro != NULL) && (ro->nheld > 0) )
+   {
+      TRACE2_HEADER *th = (TRACE2_HEADER *) ro->held[0].msg;
+
+      if ( th->starttime >= Sta->endtime + 1.5 / th->samprate ) break;
+      nHealed += Release( Sta, Gparm, Ewh );
+   }
+}
@@ -41,7 +41,10 @@
    *                                                                    *
    *                 Pick and coda buffering functions                  *
    *                                                                    *
-   *  This file contains functions ReportPick(), ReportCoda().          *
+   *  This file contains functions ReportPick(), ReportCoda(),          *
+   *  ReportEarlyPick(), RetractPick(), ReportAmp() and                 *
+   *  LogEarlyStats().  The message text is built by FormatPick(),      *
+   *  FormatCoda(), FormatRetract() and FormatAmp().                    *
    **********************************************************************/
 
 #include <stdlib.h>
@@ -52,13 +55,26 @@
 #include <earthworm.h>
 #include <chron3.h>
 #include <transport.h>
+#include <time_ew.h>
 #include "nn_pick_ew.h"
 
-static char line[LINELEN];   /* Buffer to hold picks and codas */
-
 /* Function prototypes
    *******************/
-int GetPickIndex( unsigned char modid , char * dir);  /* function in index.c */
+int GetPickIndex( void );                   /* function in index.c */
+int FormatPick( char *, int, PICK *, int, STATION *, GPARM *, EWH * );
+int FormatCoda( char *, int, CODA *, GPARM *, EWH * );
+int FormatRetract( char *, int, CODA *, GPARM *, EWH * );
+int FormatAmp( char *, int, AMPSTATE *, int, STATION *, GPARM *, EWH * );
+int PutOutMsg( MSG_LOGO *, int, long, char * );    /* function in outqueue.c */
+void BinaryPick( PICK *, int, STATION * );         /* functions in binmsg.c */
+void BinaryCoda( CODA * );
+void BinaryRetract( CODA * );
+void BinaryAmp( AMPSTATE *, STATION * );
+void RefineOnset( STATION *, PICK * );              /* function in onset.c */
+
+static int FirstPickLogged = 0;
+static unsigned long nEarly   = 0;     /* EarlyPicks sent */
+static unsigned long nRetract = 0;     /* EarlyPicks retracted */
 
 
      /**************************************************************
@@ -68,59 +84,54 @@ int GetPickIndex( unsigned char modid , char * dir);  /* function in index.c */
 void ReportPick( PICK *Pick, CODA *Coda, STATION *Sta, GPARM *Gparm, EWH *Ewh )
 {
    MSG_LOGO    logo;      /* Logo of message to send to output ring */
+   char        line[LINELEN];   /* Buffer to hold the pick */
    int         lineLen;
-   struct Greg g;
-   int         tsec, thun;
    int         PickIndex;
-   char        firstMotion = Pick->FirstMotion;
+
+/* Move the pick time to the refined onset, if OnsetRefine is set
+   **************************************************************/
+   RefineOnset( Sta, Pick );
 
 /* Get the pick index and the SNC (station, network, component).
    They will be reported later, with the coda.
    ************************************************************/
-   PickIndex = GetPickIndex( Gparm->MyModId , Gparm->PickIndexDir);
+   PickIndex = GetPickIndex();
    Coda->PickIndex = PickIndex;
+   if ( Sta->Amp != NULL )
+      Sta->Amp->pickindex = PickIndex;   /* For the amplitudes (see amp.c) */
+
+/* Log how long it took to get from startup to the first pick
+   **********************************************************/
+   if ( !FirstPickLogged )
+   {
+      double now;
+
+      hrtime_ew( &now );
+      logit( "t", "pick_ew: First pick %.3lf s after startup\n", now - Gparm->StartTime );
+      FirstPickLogged = 1;
+   }
    strcpy( Coda->sta,  Sta->sta );
    strcpy( Coda->net,  Sta->net );
    strcpy( Coda->chan, Sta->chan );
    strcpy( Coda->loc,  Sta->loc );
 
-/* Convert julian seconds to date and time.
-   Round pick time to nearest hundred'th
-   of a second.
-   ***************************************/
-   datime( Pick->time, &g );
-   tsec = (int)floor( (double) g.second );
-   thun = (int)((100.*(g.second - tsec)) + 0.5);
-   if ( thun == 100 )
-      tsec++, thun = 0;
-
-/* First motions aren't allowed to be blank
-   ****************************************/
-   if ( firstMotion == ' ' ) firstMotion = '?';
-
-/* Convert pick to space-delimited text string.
-   This is a bit risky, since the buffer could overflow.
-   Milliseconds are always set to zero.
-   ****************************************************/
-   sprintf( line,              "%d",  (int) Ewh->TypePickScnl );
-   sprintf( line+strlen(line), " %d", (int) Gparm->MyModId );
-   sprintf( line+strlen(line), " %d", (int) Ewh->MyInstId );
-   sprintf( line+strlen(line), " %d", PickIndex );
-   sprintf( line+strlen(line), " %s", Sta->sta );
-   sprintf( line+strlen(line), ".%s", Sta->chan );
-   sprintf( line+strlen(line), ".%s", Sta->net );
-   sprintf( line+strlen(line), ".%s", Sta->loc );
-
-   sprintf( line+strlen(line), " %c%d", firstMotion, Pick->weight );
-
-   sprintf( line+strlen(line), " %4d%02d%02d%02d%02d%02d.%02d0",
-            g.year, g.month, g.day, g.hour, g.minute, tsec, thun );
-
-   sprintf( line+strlen(line), " %d", (int)(Pick->xpk[0] + 0.5) );
-   sprintf( line+strlen(line), " %d", (int)(Pick->xpk[1] + 0.5) );
-   sprintf( line+strlen(line), " %d", (int)(Pick->xpk[2] + 0.5) );
-   strcat( line, "\n" );
-   lineLen = strlen(line);
+/* Add the pick to the binary message, if requested
+   ************************************************/
+   if ( Gparm->BinaryOutput )
+   {
+      BinaryPick( Pick, PickIndex, Sta );
+      if ( Gparm->BinaryOutput == 2 ) return;
+   }
+
+/* Convert pick to space-delimited text string
+   *******************************************/
+   lineLen = FormatPick( line, LINELEN, Pick, PickIndex, Sta, Gparm, Ewh );
+   if ( lineLen < 0 )
+   {
+      logit( "et", "pick_ew: Pick for %s.%s.%s.%s too long for buffer; not sent.\n",
+             Sta->sta, Sta->chan, Sta->net, Sta->loc );
+      return;
+   }
 
 /* Print the pick
    **************/
@@ -134,7 +145,7 @@ void ReportPick( PICK *Pick, CODA *Coda, STATION *Sta, GPARM *Gparm, EWH *Ewh )
    logo.mod    = Gparm->MyModId;
    logo.instid = Ewh->MyInstId;
 
-   if ( tport_putmsg( &Gparm->OutRegion, &logo, lineLen, line ) != PUT_OK )
+   if ( PutOutMsg( &logo, OUT_PICK, lineLen, line ) != PUT_OK )
       logit( "et", "pick_ew: Error sending pick to output ring.\n" );
    return;
 }
@@ -147,6 +158,7 @@ void ReportPick( PICK *Pick, CODA *Coda, STATION *Sta, GPARM *Gparm, EWH *Ewh )
 void ReportCoda( CODA *Coda, GPARM *Gparm, EWH *Ewh )
 {
    MSG_LOGO logo;      /* Logo of message to send to output ring */
+   char     line[LINELEN];   /* Buffer to hold the coda */
    int      lineLen;
 
    if (Gparm->NoCoda) {  
@@ -166,26 +178,23 @@ void ReportCoda( CODA *Coda, GPARM *Gparm, EWH *Ewh )
 		return; 
    }
 
-/* Convert coda to space-delimited text string.
-   This is a bit risky, since the buffer could overflow.
-   ****************************************************/
-   sprintf( line,              "%d",  (int) Ewh->TypeCodaScnl );
-   sprintf( line+strlen(line), " %d", (int) Gparm->MyModId );
-   sprintf( line+strlen(line), " %d", (int) Ewh->MyInstId );
-   sprintf( line+strlen(line), " %d", Coda->PickIndex );
-   sprintf( line+strlen(line), " %s", Coda->sta );
-   sprintf( line+strlen(line), ".%s", Coda->chan );
-   sprintf( line+strlen(line), ".%s", Coda->net );
-   sprintf( line+strlen(line), ".%s", Coda->loc );
-   sprintf( line+strlen(line), " %d", Coda->aav[0] );
-   sprintf( line+strlen(line), " %d", Coda->aav[1] );
-   sprintf( line+strlen(line), " %d", Coda->aav[2] );
-   sprintf( line+strlen(line), " %d", Coda->aav[3] );
-   sprintf( line+strlen(line), " %d", Coda->aav[4] );
-   sprintf( line+strlen(line), " %d", Coda->aav[5] );
-   sprintf( line+strlen(line), " %d", Coda->len_out );
-   strcat( line, "\n" );
-   lineLen = strlen(line);
+/* Add the coda to the binary message, if requested
+   ************************************************/
+   if ( Gparm->BinaryOutput )
+   {
+      BinaryCoda( Coda );
+      if ( Gparm->BinaryOutput == 2 ) return;
+   }
+
+/* Convert coda to space-delimited text string
+   *******************************************/
+   lineLen = FormatCoda( line, LINELEN, Coda, Gparm, Ewh );
+   if ( lineLen < 0 )
+   {
+      logit( "et", "pick_ew: Coda for %s.%s.%s.%s too long for buffer; not sent.\n",
+             Coda->sta, Coda->chan, Coda->net, Coda->loc );
+      return;
+   }
 
 /* Print the coda
    **************/
@@ -199,7 +208,111 @@ void ReportCoda( CODA *Coda, GPARM *Gparm, EWH *Ewh )
    logo.mod    = Gparm->MyModId;
    logo.instid = Ewh->MyInstId;
 
-   if ( tport_putmsg( &Gparm->OutRegion, &logo, lineLen, line ) != PUT_OK )
+   if ( PutOutMsg( &logo, OUT_CODA, lineLen, line ) != PUT_OK )
       logit( "et", "pick_ew: Error sending coda to output ring.\n" );
    return;
 }
+
+
+  /**************************************************************
+   *                      ReportEarlyPick()                     *
+   *                                                            *
+   *  Report a pick as soon as it is validated, before its coda *
+   *  is MinCodaLen long (EarlyPick).  The coda follows with    *
+   *  the same pick index, or a retraction if it is too short.  *
+   **************************************************************/
+
+void ReportEarlyPick( PICK *Pick, CODA *Coda, STATION *Sta, GPARM *Gparm, EWH *Ewh )
+{
+   ReportPick( Pick, Coda, Sta, Gparm, Ewh );
+   nEarly++;
+}
+
+
+  /**************************************************************
+   *                        RetractPick()                       *
+   *                                                            *
+   *  Take back an early pick whose coda ended, or was cut off  *
+   *  by a gap, before it was MinCodaLen long.  Coda holds the  *
+   *  pick index and SCNL ReportPick() gave it.                 *
+   **************************************************************/
+
+void RetractPick( CODA *Coda, GPARM *Gparm, EWH *Ewh )
+{
+   MSG_LOGO logo;
+   char     line[LINELEN];
+   int      lineLen;
+
+   nRetract++;
+   if ( Gparm->Debug )
+      logit( "t", "Debug: retracting pick %d of %s.%s.%s.%s\n", Coda->PickIndex,
+             Coda->sta, Coda->chan, Coda->net, Coda->loc );
+
+   if ( Gparm->BinaryOutput )
+   {
+      BinaryRetract( Coda );
+      if ( Gparm->BinaryOutput == 2 ) return;
+   }
+
+   lineLen = FormatRetract( line, LINELEN, Coda, Gparm, Ewh );
+   if ( lineLen < 0 )
+   {
+      logit( "et", "pick_ew: Retraction for %s.%s.%s.%s too long for buffer; not sent.\n",
+             Coda->sta, Coda->chan, Coda->net, Coda->loc );
+      return;
+   }
+
+   logo.type   = Ewh->TypePickRetract;
+   logo.mod    = Gparm->MyModId;
+   logo.instid = Ewh->MyInstId;
+
+   if ( PutOutMsg( &logo, OUT_PICK, lineLen, line ) != PUT_OK )
+      logit( "et", "pick_ew: Error sending pick retraction to output ring.\n" );
+}
+
+
+  /**************************************************************
+   *                         ReportAmp()                        *
+   *                                                            *
+   *  Report the peak amplitudes of a pick's event (AmpWindow). *
+   **************************************************************/
+
+void ReportAmp( AMPSTATE *Amp, STATION *Sta, GPARM *Gparm, EWH *Ewh )
+{
+   MSG_LOGO logo;
+   char     line[LINELEN];
+   int      lineLen;
+
+   if ( Gparm->BinaryOutput )
+   {
+      BinaryAmp( Amp, Sta );
+      if ( Gparm->BinaryOutput == 2 ) return;
+   }
+
+   lineLen = FormatAmp( line, LINELEN, Amp, Amp->pickindex, Sta, Gparm, Ewh );
+   if ( lineLen < 0 )
+   {
+      logit( "et", "pick_ew: Amplitudes for %s.%s.%s.%s too long for buffer; not sent.\n",
+             Sta->sta, Sta->chan, Sta->net, Sta->loc );
+      return;
+   }
+
+   logo.type   = Ewh->TypePickAmp;
+   logo.mod    = Gparm->MyModId;
+   logo.instid = Ewh->MyInstId;
+
+   if ( PutOutMsg( &logo, OUT_CODA, lineLen, line ) != PUT_OK )
+      logit( "et", "pick_ew: Error sending amplitudes to output ring.\n" );
+}
+
+
+  /**************************************************************
+   *                       LogEarlyStats()                      *
+   **************************************************************/
+
+void LogEarlyStats( void )
+{
+   if ( nEarly == 0 ) return;
+
+   logit( "t", "pick_ew: Early picks: %lu sent, %lu retracted\n", nEarly, nRetract );
+}
@@ -18,6 +18,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <earthworm.h>
 #include <trace_buf.h>
@@ -76,28 +77,33 @@ int Restart( STATION *Sta, GPARM *Gparm, int nsamp, int GapSize )
     *                       Interpolate()                       *
     *                                                           *
     *  Interpolate samples and insert them at the beginning of  *
-    *  the waveform.                                            *
+    *  the waveform.  The samples aren't moved.  The header is  *
+    *  moved down instead, into the room decoded messages have  *
+    *  in front of them (see decode.c), and the interpolated    *
+    *  samples are written between it and the data.  Returns   *
+    *  the new start of the message.                            *
     *************************************************************/
 
-void Interpolate( STATION *Sta, char *WaveBuf, int GapSize )
+char *Interpolate( STATION *Sta, char *WaveBuf, int GapSize )
 {
    int      i;
    int      j = 0;
    int      nInterp = GapSize - 1;
-   TRACE_HEADER *WaveHead  = (TRACE_HEADER *) WaveBuf;
-   int         *WaveLong  = (int *) (WaveBuf + sizeof(TRACE_HEADER));
-   double   SampleInterval = 1. / WaveHead->samprate;
-   double   delta = (double)(WaveLong[0] - Sta->enddata) / GapSize;
+   double   *WaveData = (double *) (WaveBuf + sizeof(TRACE_HEADER));
+   double   delta = (WaveData[0] - Sta->enddata) / GapSize;
+   char     *NewBuf = WaveBuf - nInterp * sizeof(double);
+   TRACE_HEADER *WaveHead = (TRACE_HEADER *) NewBuf;
 
 /* logit( "et", "Found %4d sample gap. Interpolating station ", GapSize );
    logit( "e", "%-5s%-2s%-3s\n", Sta->name, Sta->net, Sta->chan ); */
 
-   for ( i = WaveHead->nsamp - 1; i >= 0; i-- )
-      WaveLong[i + nInterp] = WaveLong[i];
+   memmove( NewBuf, WaveBuf, sizeof(TRACE_HEADER) );
+   WaveData -= nInterp;
 
    for ( i = 0; i < nInterp; i++ )
-      WaveLong[i] = (int) (Sta->enddata + (++j * delta) + 0.5);
+      WaveData[i] = Sta->enddata + (++j * delta);
 
    WaveHead->nsamp += nInterp;
-   WaveHead->starttime = Sta->endtime + SampleInterval;
+   WaveHead->starttime = Sta->endtime + 1. / WaveHead->samprate;
+   return NewBuf;
 }
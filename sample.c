@@ -21,24 +21,32 @@
 #include <transport.h>
 #include "nn_pick_ew.h"
 
+/* Function prototypes
+   *******************/
+void BankSample( double, BANKSTATE * );     /* function in bank.c */
+void OnsetSample( double, ONSETSTATE * );   /* function in onset.c */
+void NoiseSample( double, STATION * );      /* function in noise.c */
+
 
   /******************************************************************
    *                             Sample()                           *
    *                    Process one digital sample.                 *
    *                                                                *
    *  Arguments:                                                    *
-   *    LongSample  One waveform data sample                        *
+   *    NewSample   One waveform data sample                        *
    *    Sta         Station list                                    *
    *                                                                *
    *  The constant SmallDouble is used to avoid underflow in the    *
    *  calculation of rdat.                                          *
    *                                                                *
    *  Modifies: rold, rdat, old_sample, esta, elta, eref, eabs      *
+   *  and the filter bank, onset history and noise state, if the    *
+   *  channel has them (see bank.c, onset.c and noise.c)            *
    ******************************************************************/
 
-void Sample( int LongSample, STATION *Sta )
+void Sample( double NewSample, STATION *Sta )
 {
-   PARM *Parm = &Sta->Parm;
+   PARM *Parm = Sta->Parm;
    static double rdif;                    /* First difference */
    static double edat;                    /* Characteristic function */
    const  double small_double = 1.0e-10;
@@ -48,13 +56,13 @@ void Sample( int LongSample, STATION *Sta )
 
 /* Compute new value of filtered data */
    Sta->rdat = (Sta->rdat * Parm->RawDataFilt) +
-               (double) (LongSample - Sta->old_sample) + small_double;
+               (NewSample - Sta->old_sample) + small_double;
 
 /* Compute 1'st difference of filtered data */
    rdif = Sta->rdat - Sta->rold;
 
-/* Store integer data value */
-   Sta->old_sample = LongSample;
+/* Store data value */
+   Sta->old_sample = NewSample;
 
 /* Compute characteristic function */
    edat = (Sta->rdat * Sta->rdat) + (Parm->CharFuncFilt * rdif * rdif);
@@ -71,4 +79,16 @@ void Sample( int LongSample, STATION *Sta )
 /* Compute eabs, the running mean absolute value of rdat */
    Sta->eabs = (Parm->RmavFilt * Sta->eabs) +
                 (( 1.0 - Parm->RmavFilt ) * fabs( Sta->rdat ));
+
+/* Run the sample through the filter bank */
+   if ( Sta->Bank != NULL )
+      BankSample( NewSample, Sta->Bank );
+
+/* Keep the raw sample for onset refinement */
+   if ( Sta->On != NULL )
+      OnsetSample( NewSample, Sta->On );
+
+/* Decimate the sample for the noise spectrum or the event's SNR */
+   if ( Sta->Noise != NULL )
+      NoiseSample( NewSample, Sta );
 }
@@ -1 +1 @@
-void Sample( int, STATION * );
+void Sample( double, STATION * );
@@ -35,6 +35,11 @@
 #include "nn_pick_ew.h"
 #include "sample.h"
 
+/* Function prototypes
+   *******************/
+void ArmOnset( ONSETSTATE * );          /* function in onset.c */
+void StartAmp( STATION *, double );     /* function in amp.c */
+
 
      /*****************************************************
       *                   ScanForEvent()                  *
@@ -46,26 +51,23 @@
 
 int ScanForEvent( STATION *Sta, GPARM *Gparm, char *WaveBuf, int *sample_index )
 {
-   PICK *Pick = &Sta->Pick;        /* Pointer to pick variables */
-   CODA *Coda = &Sta->Coda;        /* Pointer to coda variables */
-   PARM *Parm = &Sta->Parm;        /* Pointer to config parameters */
+   STAEVENT *Ev = Sta->Ev;         /* Pointer to event variables */
+   PICK *Pick = &Ev->Pick;         /* Pointer to pick variables */
+   CODA *Coda = &Ev->Coda;         /* Pointer to coda variables */
+   PARM *Parm = Sta->Parm;         /* Pointer to config parameters */
 
    TRACE_HEADER *WaveHead = (TRACE_HEADER *) WaveBuf;
-   int         *WaveLong = (int *) (WaveBuf + sizeof(TRACE_HEADER));
-
-/* Set pick and coda calculations to inactive mode
-   ***********************************************/
-   Pick->status = Coda->status = 0;
+   double      *WaveData = (double *) (WaveBuf + sizeof(TRACE_HEADER));
 
 /* Loop through all samples in the message
    ***************************************/
    while ( ++(*sample_index) < WaveHead->nsamp )
    {
-      int   old_sample;                  /* Previous sample */
-      int   new_sample;                  /* Current sample */
+      double old_sample;                  /* Previous sample */
+      double new_sample;                  /* Current sample */
       double old_eref;                    /* Old value of eref */
 
-      new_sample = WaveLong[*sample_index];
+      new_sample = WaveData[*sample_index];
       old_sample = Sta->old_sample;
       old_eref   = Sta->eref;
 
@@ -79,9 +81,11 @@ int ScanForEvent( STATION *Sta, GPARM *Gparm, char *WaveBuf, int *sample_index )
       if ( Parm->DeadSta > 0.0 && Sta->eabs > Parm->DeadSta ) continue;
 
 /* Has the short-term average abruptly increased
-   with respect to the long-term average?
+   with respect to the long-term average?  With
+   PickEngine bank, has any band of the filter
+   bank jumped out of its range instead?
    *********************************************/
-      if ( Sta->esta > Sta->eref )
+      if ( (Sta->Bank != NULL) ? Sta->Bank->trig : (Sta->esta > Sta->eref) )
       {
          int wi;                              /* Window index */
 
@@ -95,49 +99,60 @@ int ScanForEvent( STATION *Sta, GPARM *Gparm, char *WaveBuf, int *sample_index )
             logit( "e", "Pick time: %.3lf  %s\n", Pick->time, datestr );
          }
 
+/* The onset is looked for around the trigger
+   once enough data have come in (see onset.c)
+   *******************************************/
+         if ( Sta->On != NULL )
+            ArmOnset( Sta->On );
+         if ( Sta->Amp != NULL )
+            StartAmp( Sta, Pick->time );
+
+         Pick->prob    = -1.;           /* No classifier verdict yet */
          Coda->len_win = 0;             /* Coda length in windows */
          Coda->len_sec = 0;             /* Coda length in seconds */
 
          for ( wi = 0; wi < 6; wi++ )
                Coda->aav[wi] = 0;
 
-         Sta->crtinc    = Sta->eref / Parm->Erefs;
-         Sta->ecrit     = old_eref;
-         Sta->evlen     = 0;
-         Sta->isml      = 0;
-         Sta->k         = 0;
-         Sta->m         = 1;
-         Sta->mint      = 0;
-         Sta->ndrt      = 0;
-         Sta->next      = 0;
-         Sta->nzero     = 0;
-         Sta->rlast     = Sta->rdat;
-         Sta->rsrdat    = 0.;
-         Sta->sarray[0] = new_sample;
-         Sta->tmax      = fabs( Sta->rdat );
-         Sta->xfrz      = 1.6 * Sta->eabs;
+         Ev->crtinc    = Sta->eref / Parm->Erefs;
+         Ev->ecrit     = old_eref;
+         Ev->evlen     = 0;
+         Ev->isml      = 0;
+         Ev->k         = 0;
+         Ev->m         = 1;
+         Ev->mint      = 0;
+         Ev->ndrt      = 0;
+         Ev->next      = 0;
+         Ev->nzero     = 0;
+         Ev->rlast     = Sta->rdat;
+         Ev->rsrdat    = 0.;
+         Ev->sarray[0] = new_sample;
+         Ev->tmax      = fabs( Sta->rdat );
+         Ev->xfrz      = 1.6 * Sta->eabs;
+         Ev->early     = 0;
 
 /* Compute threshold for big zero crossings
    ****************************************/
-         Sta->xdot = new_sample - old_sample;
-         Sta->rbig = ( (Sta->xdot < 0) ? -Sta->xdot : Sta->xdot ) / 3.;
-         Sta->rbig = (Sta->eabs > Sta->rbig) ? Sta->eabs : Sta->rbig;
+         Ev->xdot = new_sample - old_sample;
+         Ev->rbig = fabs( Ev->xdot ) / 3.;
+         Ev->rbig = (Sta->eabs > Ev->rbig) ? Sta->eabs : Ev->rbig;
 
 /* Compute cocrit and the sign of
    Coda->len_out for big and small events
    **************************************/
          if ( Sta->eabs > (Parm->AltCoda * Parm->CodaTerm) )  /* Big */
          {
-            Sta->cocrit = Parm->PreEvent * Sta->eabs;
+            Ev->cocrit = Parm->PreEvent * Sta->eabs;
             Coda->len_out = -1;
          }
          else                                                 /* Small */
          {
-            Sta->cocrit  = Parm->CodaTerm;
+            Ev->cocrit  = Parm->CodaTerm;
             Coda->len_out = 1;
          }
 
          Pick->status = Coda->status = 1;   /* Picks/codas are now active */
+         Sta->active  = 1;
          return 1;
       }
    }
@@ -0,0 +1,151 @@
+  /**********************************************************************
+   *                              shard.c                               *
+   *                                                                    *
+   *                 Splitting the channels among instances             *
+   *                                                                    *
+   *  This file contains functions InitShard(), ShardOwns(),            *
+   *  ShardMsg(), ShardStaList() and LogShardStats().                   *
+   *                                                                    *
+   *  With ShardCount set, each of ShardCount instances of pick_ew      *
+   *  picks the channels whose SCNL hashes to its ShardId, and drops    *
+   *  the others.  The hash depends on the SCNL alone, so instances     *
+   *  reading the same rings agree on who owns a channel without        *
+   *  talking to each other.  Channels another shard owns are taken     *
+   *  out of the station table when it is loaded, and their messages    *
+   *  are dropped by looking at the SCNL in the header, before the      *
+   *  header is swapped or the channel looked up.                       *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <earthworm.h>
+#include <transport.h>
+#include <trace_buf.h>
+#include "nn_pick_ew.h"
+
+static int           ShardId    = 0;
+static int           ShardCount = 1;
+static unsigned long nOwned  = 0;    /* Messages of our channels */
+static unsigned long nOthers = 0;    /* Messages dropped */
+
+/* Function prototypes
+   *******************/
+static unsigned int HashField( unsigned int, const char *, int );
+
+
+  /***************************************************************
+   *                           InitShard()                       *
+   ***************************************************************/
+
+void InitShard( GPARM *Gparm )
+{
+   ShardId    = Gparm->ShardId;
+   ShardCount = Gparm->ShardCount;
+}
+
+
+  /***************************************************************
+   *                           ShardOwns()                       *
+   *                                                             *
+   *  Returns 1 if this shard picks the channel.  Only as much   *
+   *  of each field is used as the station table keeps.          *
+   ***************************************************************/
+
+int ShardOwns( const char *sta, const char *chan, const char *net, const char *loc )
+{
+   unsigned int h = 2166136261u;        /* FNV-1a */
+
+   if ( ShardCount <= 1 ) return 1;
+
+   h = HashField( h, sta,  5 );
+   h = HashField( h, chan, 3 );
+   h = HashField( h, net,  2 );
+   h = HashField( h, loc,  2 );
+
+/* Mix the bits, so the low ones don't decide alone
+   ************************************************/
+   h ^= h >> 16;
+   h *= 0x85ebca6bu;
+   h ^= h >> 13;
+   return (int) (h % (unsigned int) ShardCount) == ShardId;
+}
+
+
+  /***************************************************************
+   *                           ShardMsg()                        *
+   *                                                             *
+   *  Returns 1 if this shard picks the channel of a waveform    *
+   *  message.  Only the SCNL strings of the header are used,    *
+   *  so the header may still be in the sender's byte order.     *
+   *  TYPE_TRACEBUF messages (tb2 == 0) have location "--".      *
+   ***************************************************************/
+
+int ShardMsg( char *TraceBuf, int tb2 )
+{
+   TRACE2_HEADER *th = (TRACE2_HEADER *) TraceBuf;
+
+   if ( ShardCount <= 1 ) return 1;
+
+   if ( ShardOwns( th->sta, th->chan, th->net, tb2 ? th->loc : "--" ) )
+   {
+      nOwned++;
+      return 1;
+   }
+   nOthers++;
+   return 0;
+}
+
+
+  /***************************************************************
+   *                         ShardStaList()                      *
+   *                                                             *
+   *  Take the channels other shards pick out of a station       *
+   *  array.  Returns the number of channels left.               *
+   ***************************************************************/
+
+int ShardStaList( STATION *Sta, int Nsta )
+{
+   int i, n = 0;
+
+   if ( ShardCount <= 1 ) return Nsta;
+
+   for ( i = 0; i < Nsta; i++ )
+      if ( ShardOwns( Sta[i].sta, Sta[i].chan, Sta[i].net, Sta[i].loc ) )
+      {
+         if ( n != i ) Sta[n] = Sta[i];
+         n++;
+      }
+   logit( "", "pick_ew: Shard %d of %d picks %d of %d channels\n",
+          ShardId, ShardCount, n, Nsta );
+   return n;
+}
+
+
+  /***************************************************************
+   *                         LogShardStats()                     *
+   ***************************************************************/
+
+void LogShardStats( void )
+{
+   if ( ShardCount <= 1 ) return;
+
+   logit( "t", "pick_ew: Shard %d of %d: %lu msgs of our channels, %lu of others dropped\n",
+          ShardId, ShardCount, nOwned, nOthers );
+}
+
+
+/* Hash at most len characters of a field, and a terminator
+   ********************************************************/
+static unsigned int HashField( unsigned int h, const char *s, int len )
+{
+   int i;
+
+   for ( i = 0; (i < len) && (s[i] != '\0'); i++ )
+   {
+      h ^= (unsigned char) s[i];
+      h *= 16777619u;
+   }
+   h ^= 0xff;
+   h *= 16777619u;
+   return h;
+}
@@ -0,0 +1,222 @@
+  /**********************************************************************
+   *                              shed.c                                *
+   *                                                                    *
+   *                     Load shedding under overload                   *
+   *                                                                    *
+   *  This file contains functions InitShed(), UpdateShed(),            *
+   *  ShedSkip(), ShedChannel() and LogShedStats().                     *
+   *                                                                    *
+   *  When the picker can't keep up, the data it reads gets older and   *
+   *  older.  The lag of a message is the wall clock minus the end      *
+   *  time of its data.  Every SHED_INT seconds the median lag of the   *
+   *  messages read since the last look is compared to the ShedLevel    *
+   *  thresholds.  The median, not the mean, so that a few channels     *
+   *  with slow telemetry don't count as overload.  A level starts      *
+   *  when the lag reaches its start lag and ends when the lag drops    *
+   *  below its end lag, so the picker doesn't flap between levels.     *
+   *  Each level also does what the levels below it do:                 *
+   *                                                                    *
+   *     1  Codas aren't measured.  Picks are reported as usual, but    *
+   *        the coda is dropped once its pick is out, as with NoCoda.   *
+   *     2  The pick classifier isn't run.  Picks keep the verdict of   *
+   *        the built-in noise test.                                    *
+   *     3  The messages of ShedChannel channels are dropped unpicked.  *
+   *        When the level ends, their data has a gap, and they go      *
+   *        through restart as after any other outage.                  *
+   *                                                                    *
+   *  Every change of level is logged, and counted with the time        *
+   *  spent at each level.                                              *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <earthworm.h>
+#include <transport.h>
+#include <time_ew.h>
+#include "nn_pick_ew.h"
+
+#define SHED_INT   1.0       /* Look at the lag this often (s) */
+#define NLAG       512       /* Lags kept for the median */
+
+static int      Enabled = 0;             /* Set if any ShedLevel was given */
+static double   Enter[NSHEDLEVEL];       /* Start lag of each level; 0 = unused */
+static double   Leave[NSHEDLEVEL];       /* End lag of each level */
+static int      nShedChan = 0;
+static SCNLPAT *ShedChan = NULL;         /* Channels dropped at SHED_CHANNELS */
+static int      Level = 0;               /* Level now */
+static double   LevelStart = 0.;         /* hrtime_ew() when it started */
+static double   Lag[NLAG];               /* Lags since the last look */
+static int      nLag = 0;
+static double   LastLook = 0.;
+static double   LastMedian = 0.;
+
+static unsigned long nEntered[NSHEDLEVEL];   /* Times each level started */
+static double        TimeIn[NSHEDLEVEL];     /* Seconds spent at each level */
+static unsigned long nSkipped[NSHEDLEVEL];   /* Codas, classifications, messages shed */
+
+/* Function prototypes
+   *******************/
+int  WildMatch( const char *, const char * );           /* function in profile.c */
+static double MedianLag( void );
+static int    CompareDouble( const void *, const void * );
+
+
+  /***************************************************************
+   *                            InitShed()                       *
+   ***************************************************************/
+
+void InitShed( GPARM *Gparm )
+{
+   int i;
+
+   for ( i = 0; i < NSHEDLEVEL; i++ )
+   {
+      Enter[i] = Gparm->ShedEnter[i];
+      Leave[i] = Gparm->ShedLeave[i];
+      if ( Enter[i] > 0. ) Enabled = 1;
+      nEntered[i] = 0;
+      TimeIn[i]   = 0.;
+      nSkipped[i] = 0;
+   }
+   nShedChan = Gparm->nShedChan;
+   ShedChan  = Gparm->ShedChan;
+   Level = 0;
+   hrtime_ew( &LevelStart );
+   LastLook = LevelStart;
+}
+
+
+  /***************************************************************
+   *                           UpdateShed()                      *
+   *                                                             *
+   *  Note the lag of a message, given the end time of its data, *
+   *  and every SHED_INT seconds change level if the median lag  *
+   *  calls for it.  Called by the picking thread for every      *
+   *  message read.                                              *
+   ***************************************************************/
+
+void UpdateShed( double endtime )
+{
+   double now;
+   double lag;
+   int    want;
+   int    i;
+
+   if ( !Enabled ) return;
+
+   hrtime_ew( &now );
+   Lag[nLag++ % NLAG] = now - endtime;      /* Keep the latest NLAG */
+   if ( (now - LastLook) < SHED_INT ) return;
+   LastLook = now;
+
+   lag = LastMedian = MedianLag();
+   nLag = 0;
+
+/* Go up to the highest level whose start lag is reached,
+   and down past each level whose end lag is passed
+   ******************************************************/
+   want = Level;
+   for ( i = NSHEDLEVEL - 1; i > Level; i-- )
+      if ( (Enter[i] > 0.) && (lag >= Enter[i]) )
+      {
+         want = i;
+         break;
+      }
+   if ( want == Level )
+      while ( (want > 0) && ((Enter[want] == 0.) || (lag < Leave[want])) )
+         want--;
+   if ( want == Level ) return;
+
+   TimeIn[Level] += now - LevelStart;
+   logit( "t", "pick_ew: Load shedding level %d -> %d (median data lag %.1lf s)\n",
+          Level, want, lag );
+   Level = want;
+   LevelStart = now;
+   nEntered[Level]++;
+}
+
+
+  /***************************************************************
+   *                            ShedSkip()                       *
+   *                                                             *
+   *  Returns 1 if the work of the given level (SHED_CODA or     *
+   *  SHED_CLASSIFY) is to be skipped now, and counts it.        *
+   ***************************************************************/
+
+int ShedSkip( int what )
+{
+   if ( Level < what ) return 0;
+   nSkipped[what]++;
+   return 1;
+}
+
+
+  /***************************************************************
+   *                           ShedChannel()                     *
+   *                                                             *
+   *  Returns 1 if a message of this channel is to be dropped    *
+   *  unpicked, because the level is SHED_CHANNELS and the       *
+   *  channel matches a ShedChannel command.                     *
+   ***************************************************************/
+
+int ShedChannel( STATION *Sta )
+{
+   int i;
+
+   if ( Level < SHED_CHANNELS ) return 0;
+
+   for ( i = 0; i < nShedChan; i++ )
+      if ( WildMatch( ShedChan[i].sta,  Sta->sta )  &&
+           WildMatch( ShedChan[i].chan, Sta->chan ) &&
+           WildMatch( ShedChan[i].net,  Sta->net )  &&
+           WildMatch( ShedChan[i].loc,  Sta->loc ) )
+      {
+         nSkipped[SHED_CHANNELS]++;
+         return 1;
+      }
+   return 0;
+}
+
+
+  /***************************************************************
+   *                          LogShedStats()                     *
+   ***************************************************************/
+
+void LogShedStats( void )
+{
+   double now;
+   int    i;
+
+   if ( !Enabled ) return;
+
+   hrtime_ew( &now );
+   logit( "t", "pick_ew: Load shedding: level %d, median data lag %.1lf s; "
+          "%lu codas, %lu classifications, %lu msgs shed\n", Level, LastMedian,
+          nSkipped[SHED_CODA], nSkipped[SHED_CLASSIFY], nSkipped[SHED_CHANNELS] );
+   for ( i = 1; i < NSHEDLEVEL; i++ )
+      if ( Enter[i] > 0. )
+         logit( "", "pick_ew:   level %d: entered %lu times, %.0lf s in all\n", i,
+                nEntered[i], TimeIn[i] + ((i == Level) ? now - LevelStart : 0.) );
+}
+
+
+/* Median of the lags noted since the last look
+   ********************************************/
+static double MedianLag( void )
+{
+   int n = (nLag < NLAG) ? nLag : NLAG;
+
+   if ( n == 0 ) return 0.;
+   qsort( Lag, n, sizeof(double), CompareDouble );
+   return (n % 2) ? Lag[n/2] : 0.5 * (Lag[n/2 - 1] + Lag[n/2]);
+}
+
+
+static int CompareDouble( const void *a, const void *b )
+{
+   double x = *(const double *) a;
+   double y = *(const double *) b;
+
+   return (x > y) - (x < y);
+}
@@ -0,0 +1,456 @@
+  /**********************************************************************
+   *                             snapshot.c                             *
+   *                                                                    *
+   *                      Filter-state snapshots                        *
+   *                                                                    *
+   *  This file contains functions InitSnapshot(), ResumeChannel(),     *
+   *  WriteSnapshot() and CloseSnapshot().                              *
+   *                                                                    *
+   *  With FilterSnapshot set, the filter state of every warmed-up      *
+   *  channel (rdat, esta, elta, eabs, the last sample and the end      *
+   *  time of the last message), and with PickEngine bank the filter    *
+   *  bank's band filters and averages, is copied every SnapInt         *
+   *  seconds, and at exit, into a memory-mapped file.  The copy costs  *
+   *  no system calls, and the pages survive a crash of the module.     *
+   *                                                                    *
+   *  At startup the snapshot is loaded into the channels that are      *
+   *  still listed with the same parameters.  When the first message    *
+   *  of such a channel starts no more than SnapMaxAge seconds after    *
+   *  the snapshot's end time, the channel carries on picking with the  *
+   *  saved state, skipping restart mode; its filter bank is restored   *
+   *  too if its sample rate and the bank settings are the same.        *
+   *  Otherwise it starts cold, as before.  Channels added by rule      *
+   *  always start cold.                                                *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <earthworm.h>
+#include <transport.h>
+#include "nn_pick_ew.h"
+
+#if defined(_WINNT)
+ #include <windows.h>
+#else
+ #include <sys/types.h>
+ #include <sys/stat.h>
+ #include <sys/mman.h>
+ #include <fcntl.h>
+ #include <unistd.h>
+#endif
+
+#define SNAP_MAGIC    "PKSNAPSH"
+#define SNAP_VERSION  3         /* 2: old_sample is a double; 3: filter bank */
+
+typedef struct {
+   char   magic[8];
+   int    version;
+   int    reclen;           /* sizeof(SNAPREC) */
+   int    nrec;             /* Records that follow */
+   volatile int complete;   /* 0 while the records are being written */
+   double time;             /* When the snapshot was taken */
+} SNAPHDR;
+
+typedef struct {
+   char   sta[6];
+   char   chan[4];
+   char   net[3];
+   char   loc[3];
+   unsigned int parmhash;   /* HashParm() of the channel's parameters */
+   int    pad;
+   double old_sample;
+   double rdat;
+   double esta;
+   double elta;
+   double eabs;
+   double endtime;          /* End time of the last message */
+   double bankrate;         /* Sample rate of the filter bank; 0 = no bank */
+   double aLong;            /* Its long-term coefficient */
+   double xold;
+   int    nband;            /* Bands in use */
+   int    nsamp;            /* Samples since the bank was reset */
+   double hp[NBAND];        /* Band filters */
+   double l1[NBAND];
+   double l2[NBAND];
+   double env[NBAND];       /* Band power and its long-term averages */
+   double mean[NBAND];
+   double var[NBAND];
+} SNAPREC;
+
+static char    *SnapMap = NULL;      /* Mapped snapshot file */
+static size_t   SnapLen = 0;         /* Bytes mapped */
+static int      nWarm = 0;           /* Channels resumed from the snapshot */
+static int      nStale = 0;          /* Restored channels that started cold */
+static SNAPREC *Saved = NULL;        /* Restored records with a filter bank, */
+static int      nSaved = 0;          /*   sorted by SCNL, for ResumeChannel() */
+#if defined(_WINNT)
+static HANDLE   hSnapFile = INVALID_HANDLE_VALUE;
+static HANDLE   hSnapMap  = NULL;
+#endif
+
+/* Function prototypes
+   *******************/
+void InitVar( STATION * );
+int  CompareSCNL( const void *, const void * );
+unsigned int HashParm( PARM * );                    /* function in profile.c */
+void SetBankRate( STATION *, double );               /* function in bank.c */
+static int  MapSnapshot( char *, size_t );
+static void UnmapSnapshot( void );
+static void SaveBank( SNAPREC *, STATION * );
+static void RestoreBank( STATION *, double );
+static SNAPREC *FindSaved( STATION * );
+static int  CompareRec( const void *, const void * );
+
+
+  /***************************************************************
+   *                        InitSnapshot()                       *
+   *                                                             *
+   *  Map the snapshot file and load the saved state into the    *
+   *  channels of the sorted station table.  Restored channels   *
+   *  get first = 2 until their first message arrives.           *
+   *  Returns -1 if the file can't be mapped.                    *
+   ***************************************************************/
+
+int InitSnapshot( STATION *StaArray, int Nsta, GPARM *Gparm )
+{
+   SNAPHDR hdr;
+   FILE    *fp;
+   int     nrestored = 0;
+   int     nrec = 0;
+
+   if ( Gparm->SnapFile == NULL ) return 0;
+
+/* Read the last snapshot, if there is a complete one
+   **************************************************/
+   if ( (fp = fopen( Gparm->SnapFile, "rb" )) != NULL )
+   {
+      if ( (fread( &hdr, sizeof(hdr), 1, fp ) == 1) &&
+           (memcmp( hdr.magic, SNAP_MAGIC, sizeof(hdr.magic) ) == 0) &&
+           (hdr.version == SNAP_VERSION) && (hdr.reclen == (int) sizeof(SNAPREC)) &&
+           hdr.complete )
+      {
+         SNAPREC rec;
+
+         if ( hdr.nrec > 0 )
+            Saved = (SNAPREC *) malloc( hdr.nrec * sizeof(SNAPREC) );
+         for ( nrec = 0; (nrec < hdr.nrec) && (fread( &rec, sizeof(rec), 1, fp ) == 1); nrec++ )
+         {
+            STATION key;
+            STATION *Sta;
+
+            memcpy( key.sta,  rec.sta,  sizeof(key.sta) );
+            memcpy( key.chan, rec.chan, sizeof(key.chan) );
+            memcpy( key.net,  rec.net,  sizeof(key.net) );
+            memcpy( key.loc,  rec.loc,  sizeof(key.loc) );
+            Sta = (STATION *) bsearch( &key, StaArray, Nsta, sizeof(STATION), CompareSCNL );
+            if ( (Sta == NULL) || (HashParm( Sta->Parm ) != rec.parmhash) ) continue;
+
+            Sta->rdat       = rec.rdat;
+            Sta->rold       = rec.rdat;
+            Sta->esta       = rec.esta;
+            Sta->elta       = rec.elta;
+            Sta->eref       = rec.elta * Sta->Parm->EventThresh;
+            Sta->eabs       = rec.eabs;
+            Sta->old_sample = rec.old_sample;
+            Sta->enddata    = rec.old_sample;
+            Sta->endtime    = rec.endtime;
+            Sta->first      = 2;
+            nrestored++;
+            if ( (rec.bankrate > 0.) && (Saved != NULL) )
+               Saved[nSaved++] = rec;
+         }
+         if ( nSaved > 0 )
+            qsort( Saved, nSaved, sizeof(SNAPREC), CompareRec );
+         logit( "t", "pick_ew: Filter snapshot of %.0lf s ago: %d channels, %d restored\n",
+                (double) time( NULL ) - hdr.time, nrec, nrestored );
+      }
+      else
+         logit( "t", "pick_ew: Filter snapshot <%s> is incomplete or old; not used.\n",
+                Gparm->SnapFile );
+      fclose( fp );
+   }
+
+/* Map the file for writing new snapshots
+   **************************************/
+   if ( MapSnapshot( Gparm->SnapFile, sizeof(SNAPHDR) + Nsta * sizeof(SNAPREC) ) == -1 )
+   {
+      logit( "et", "pick_ew: Cannot map filter snapshot file <%s>.\n", Gparm->SnapFile );
+      return -1;
+   }
+   return 0;
+}
+
+
+  /***************************************************************
+   *                        ResumeChannel()                      *
+   *                                                             *
+   *  Called with the first message of a channel whose state     *
+   *  was restored.  If the message starts within SnapMaxAge     *
+   *  seconds of the saved end time, the channel goes straight   *
+   *  to picking, as if no samples had been missed, with its     *
+   *  filter bank as saved.  Otherwise the channel is reset and  *
+   *  treated as never seen.                                     *
+   ***************************************************************/
+
+void ResumeChannel( STATION *Sta, double starttime, double samprate, GPARM *Gparm )
+{
+   double age = starttime - Sta->endtime;
+
+   if ( (age >= 0.) && (age <= Gparm->SnapMaxAge) && (samprate > 0.) )
+   {
+      Sta->endtime    = starttime - 1. / samprate;
+      Sta->ns_restart = Gparm->RestartLength;
+      Sta->first      = 0;
+      RestoreBank( Sta, samprate );
+      nWarm++;
+   }
+   else
+   {
+      InitVar( Sta );
+      nStale++;
+   }
+   if ( Gparm->Debug )
+      logit( "e", "%s.%s.%s.%s: snapshot %.1lf s old; %s start\n", Sta->sta,
+             Sta->chan, Sta->net, Sta->loc, age, Sta->first ? "cold" : "warm" );
+}
+
+
+  /***************************************************************
+   *                        WriteSnapshot()                      *
+   *                                                             *
+   *  Copy the filter state of the warmed-up channels, and of    *
+   *  restored channels still waiting for data, into the map.    *
+   ***************************************************************/
+
+void WriteSnapshot( STATION *StaArray, int Nsta, GPARM *Gparm )
+{
+   SNAPHDR *hdr;
+   SNAPREC *rec;
+   size_t  len = sizeof(SNAPHDR) + Nsta * sizeof(SNAPREC);
+   int     i, n = 0;
+
+   if ( Gparm->SnapFile == NULL ) return;
+
+/* The table may have grown in a reload
+   ************************************/
+   if ( (SnapMap == NULL) || (len > SnapLen) )
+   {
+      UnmapSnapshot();
+      if ( MapSnapshot( Gparm->SnapFile, len ) == -1 )
+      {
+         logit( "et", "pick_ew: Cannot map filter snapshot file <%s>.\n", Gparm->SnapFile );
+         return;
+      }
+   }
+
+   hdr = (SNAPHDR *) SnapMap;
+   rec = (SNAPREC *) (SnapMap + sizeof(SNAPHDR));
+   hdr->complete = 0;
+
+   for ( i = 0; i < Nsta; i++ )
+   {
+      STATION *Sta = &StaArray[i];
+
+      if ( (Sta->first == 1) ||
+           ((Sta->first == 0) && (Sta->ns_restart < Gparm->RestartLength)) )
+         continue;
+
+      memcpy( rec[n].sta,  Sta->sta,  sizeof(rec[n].sta) );
+      memcpy( rec[n].chan, Sta->chan, sizeof(rec[n].chan) );
+      memcpy( rec[n].net,  Sta->net,  sizeof(rec[n].net) );
+      memcpy( rec[n].loc,  Sta->loc,  sizeof(rec[n].loc) );
+      rec[n].parmhash   = HashParm( Sta->Parm );
+      rec[n].pad        = 0;
+      rec[n].old_sample = Sta->old_sample;
+      rec[n].rdat       = Sta->rdat;
+      rec[n].esta       = Sta->esta;
+      rec[n].elta       = Sta->elta;
+      rec[n].eabs       = Sta->eabs;
+      rec[n].endtime    = Sta->endtime;
+      SaveBank( &rec[n], Sta );
+      n++;
+   }
+
+   memcpy( hdr->magic, SNAP_MAGIC, sizeof(hdr->magic) );
+   hdr->version  = SNAP_VERSION;
+   hdr->reclen   = (int) sizeof(SNAPREC);
+   hdr->nrec     = n;
+   hdr->time     = (double) time( NULL );
+   hdr->complete = 1;
+}
+
+
+  /***************************************************************
+   *                        CloseSnapshot()                      *
+   *                                                             *
+   *  Flush the snapshot to disk and unmap it.                   *
+   ***************************************************************/
+
+void CloseSnapshot( void )
+{
+   if ( nWarm + nStale > 0 )
+      logit( "t", "pick_ew: Channels resumed from the filter snapshot: %d warm, %d cold\n",
+             nWarm, nStale );
+   UnmapSnapshot();
+   free( Saved );
+   Saved  = NULL;
+   nSaved = 0;
+}
+
+
+/* Copy a channel's filter bank into its snapshot record.  A
+   restored channel still waiting for data keeps the bank it
+   was saved with.  The bank fields are last in the record.
+   ***********************************************************/
+static void SaveBank( SNAPREC *rec, STATION *Sta )
+{
+   BANKSTATE *B = Sta->Bank;
+   SNAPREC   *old;
+   int       b;
+
+   if ( (B != NULL) && (Sta->first == 0) )
+   {
+      rec->bankrate = B->samprate;
+      rec->aLong    = B->aLong;
+      rec->xold     = B->xold;
+      rec->nsamp    = B->nsamp;
+      for ( rec->nband = 0, b = 0; b < NBAND; b++ )
+         if ( B->aL[b] > 0. ) rec->nband++;
+      memcpy( rec->hp,   B->hp,   sizeof(B->hp) );
+      memcpy( rec->l1,   B->l1,   sizeof(B->l1) );
+      memcpy( rec->l2,   B->l2,   sizeof(B->l2) );
+      memcpy( rec->env,  B->env,  sizeof(B->env) );
+      memcpy( rec->mean, B->mean, sizeof(B->mean) );
+      memcpy( rec->var,  B->var,  sizeof(B->var) );
+   }
+   else if ( (Sta->first == 2) && ((old = FindSaved( Sta )) != NULL) )
+      memcpy( &rec->bankrate, &old->bankrate, sizeof(SNAPREC) - offsetof(SNAPREC, bankrate) );
+   else
+      memset( &rec->bankrate, 0, sizeof(SNAPREC) - offsetof(SNAPREC, bankrate) );
+}
+
+
+/* Give a resumed channel its saved filter bank, if the bank
+   was saved at this sample rate with the same settings.
+   **********************************************************/
+static void RestoreBank( STATION *Sta, double samprate )
+{
+   SNAPREC   *rec;
+   BANKSTATE *B;
+   int       b, nband = 0;
+
+   if ( (rec = FindSaved( Sta )) == NULL ) return;
+
+   SetBankRate( Sta, samprate );
+   if ( (B = Sta->Bank) == NULL ) return;
+   for ( b = 0; b < NBAND; b++ )
+      if ( B->aL[b] > 0. ) nband++;
+   if ( (B->samprate != rec->bankrate) || (B->aLong != rec->aLong) || (nband != rec->nband) )
+      return;
+
+   B->xold  = rec->xold;
+   B->nsamp = (rec->nsamp < B->nwarm) ? rec->nsamp : B->nwarm;
+   memcpy( B->hp,   rec->hp,   sizeof(B->hp) );
+   memcpy( B->l1,   rec->l1,   sizeof(B->l1) );
+   memcpy( B->l2,   rec->l2,   sizeof(B->l2) );
+   memcpy( B->env,  rec->env,  sizeof(B->env) );
+   memcpy( B->mean, rec->mean, sizeof(B->mean) );
+   memcpy( B->var,  rec->var,  sizeof(B->var) );
+}
+
+
+/* Find a channel's saved filter bank; NULL if none
+   ************************************************/
+static SNAPREC *FindSaved( STATION *Sta )
+{
+   SNAPREC key;
+
+   if ( nSaved == 0 ) return NULL;
+
+   memcpy( key.sta,  Sta->sta,  sizeof(key.sta) );
+   memcpy( key.chan, Sta->chan, sizeof(key.chan) );
+   memcpy( key.net,  Sta->net,  sizeof(key.net) );
+   memcpy( key.loc,  Sta->loc,  sizeof(key.loc) );
+   return (SNAPREC *) bsearch( &key, Saved, nSaved, sizeof(SNAPREC), CompareRec );
+}
+
+
+/* Compare the SCNLs of two snapshot records
+   *****************************************/
+static int CompareRec( const void *a, const void *b )
+{
+   const SNAPREC *ra = (const SNAPREC *) a;
+   const SNAPREC *rb = (const SNAPREC *) b;
+   int   rc;
+
+   if ( (rc = strcmp( ra->sta,  rb->sta ))  != 0 ) return rc;
+   if ( (rc = strcmp( ra->chan, rb->chan )) != 0 ) return rc;
+   if ( (rc = strcmp( ra->net,  rb->net ))  != 0 ) return rc;
+   return strcmp( ra->loc, rb->loc );
+}
+
+
+/* Flush and unmap the snapshot file
+   *********************************/
+static void UnmapSnapshot( void )
+{
+   if ( SnapMap == NULL ) return;
+
+#if defined(_WINNT)
+   FlushViewOfFile( SnapMap, SnapLen );
+   UnmapViewOfFile( SnapMap );
+   if ( hSnapMap  != NULL ) CloseHandle( hSnapMap );
+   if ( hSnapFile != INVALID_HANDLE_VALUE ) CloseHandle( hSnapFile );
+   hSnapMap  = NULL;
+   hSnapFile = INVALID_HANDLE_VALUE;
+#else
+   msync( SnapMap, SnapLen, MS_SYNC );
+   munmap( SnapMap, SnapLen );
+#endif
+   SnapMap = NULL;
+   SnapLen = 0;
+}
+
+
+/* Map len bytes of the snapshot file, growing the file if needed.
+   What is already in the file is left alone.  Returns -1 on error.
+   ****************************************************************/
+static int MapSnapshot( char *fname, size_t len )
+{
+#if defined(_WINNT)
+   hSnapFile = CreateFile( fname, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+                           NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+   if ( hSnapFile == INVALID_HANDLE_VALUE ) return -1;
+   if ( GetFileSize( hSnapFile, NULL ) < (DWORD) len )
+   {
+      SetFilePointer( hSnapFile, (LONG) len, NULL, FILE_BEGIN );
+      SetEndOfFile( hSnapFile );
+   }
+   hSnapMap = CreateFileMapping( hSnapFile, NULL, PAGE_READWRITE, 0, (DWORD) len, NULL );
+   if ( hSnapMap != NULL )
+      SnapMap = (char *) MapViewOfFile( hSnapMap, FILE_MAP_WRITE, 0, 0, len );
+#else
+   int         fd;
+   struct stat st;
+
+   if ( (fd = open( fname, O_RDWR | O_CREAT, 0644 )) == -1 ) return -1;
+   if ( (fstat( fd, &st ) == 0) &&
+        ((st.st_size >= (off_t) len) || (ftruncate( fd, (off_t) len ) == 0)) )
+   {
+      SnapMap = (char *) mmap( NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+      if ( SnapMap == (char *) MAP_FAILED ) SnapMap = NULL;
+   }
+   close( fd );
+#endif
+
+   SnapLen = len;
+   if ( SnapMap == NULL )
+   {
+      UnmapSnapshot();
+      return -1;
+   }
+   return 0;
+}
@@ -0,0 +1,259 @@
+  /**********************************************************************
+   *                             stacache.c                             *
+   *                                                                    *
+   *                  Compiled station table functions                  *
+   *                                                                    *
+   *  This file contains functions ReadStaCache() and WriteStaCache().  *
+   *                                                                    *
+   *  After the station files are parsed, the channel table (SCNL and   *
+   *  picking parameters of each channel, in file order) and the SCNL   *
+   *  rules are written to StaCacheFile, together with the size,        *
+   *  modification time and hash of every station file.  At the next    *
+   *  startup the table is read back instead of parsing the text,       *
+   *  provided the same files are configured in the same order and      *
+   *  none of them has changed.  The cache is in native byte order and  *
+   *  is only meant to be read by the machine that wrote it.            *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <earthworm.h>
+#include <transport.h>
+#include "nn_pick_ew.h"
+
+#define STACACHE_MAGIC    "PKSTACHE"
+#define STACACHE_VERSION  2
+
+typedef struct {
+   char magic[8];
+   int  version;
+   int  reclen;             /* sizeof(STAREC) */
+   int  nfile;              /* Station files */
+   int  nsta;               /* Channels in the table */
+   int  nrule;              /* SCNL rules */
+} STACACHE_HDR;
+
+typedef struct {
+   char   name[STAFILE_LEN];
+   double mtime;
+   unsigned int size;
+   unsigned int hash;
+   int    nsta;
+   int    pad;
+} STACACHE_FILE;
+
+typedef struct {
+   char   sta[6];
+   char   chan[4];
+   char   net[3];
+   char   loc[3];
+   PARM   Parm;
+} STAREC;
+
+typedef struct {
+   int    pickflag;
+   char   sta[6];
+   char   chan[4];
+   char   net[3];
+   char   loc[3];
+   PARM   Parm;
+} RULEREC;
+
+/* Function prototypes
+   *******************/
+PARM *InternParm( PARM * );                         /* functions in profile.c */
+int   AddRule( RULESET *, int, char *, char *, char *, char *, PARM * );
+
+
+  /***************************************************************
+   *                        ReadStaCache()                       *
+   *                                                             *
+   *  Load the station table from StaCacheFile.  The file sizes, *
+   *  times and hashes in Gparm->StaFile must already be set.    *
+   *  Returns 1 if the table was loaded, 0 if there is no cache  *
+   *  or it doesn't match the station files.                     *
+   ***************************************************************/
+
+int ReadStaCache( STATION **Sta, int *Nsta, RULESET *Rules, GPARM *Gparm )
+{
+   FILE          *fp;
+   STACACHE_HDR  hdr;
+   STACACHE_FILE cf;
+   STAREC        rec;
+   RULEREC       rr;
+   STATION       *sta;
+   PARM          *Parm;
+   int           i;
+
+   if ( Gparm->StaCacheFile == NULL ) return 0;
+   if ( (fp = fopen( Gparm->StaCacheFile, "rb" )) == NULL ) return 0;
+
+   if ( (fread( &hdr, sizeof(hdr), 1, fp ) != 1) ||
+        (memcmp( hdr.magic, STACACHE_MAGIC, sizeof(hdr.magic) ) != 0) ||
+        (hdr.version != STACACHE_VERSION) ||
+        (hdr.reclen != (int) sizeof(STAREC)) ||
+        (hdr.nfile != Gparm->nStaFile) || (hdr.nsta <= 0) )
+   {
+      logit( "", "pick_ew: Station cache <%s> is stale; parsing station files.\n",
+             Gparm->StaCacheFile );
+      fclose( fp );
+      return 0;
+   }
+
+   for ( i = 0; i < hdr.nfile; i++ )
+   {
+      STAFILE *sf = &Gparm->StaFile[i];
+
+      if ( (fread( &cf, sizeof(cf), 1, fp ) != 1) ||
+           (strncmp( cf.name, sf->name, STAFILE_LEN ) != 0) ||
+           (cf.mtime != sf->mtime) || (cf.size != sf->size) ||
+           (cf.hash != sf->hash) )
+      {
+         logit( "", "pick_ew: Station cache <%s> is stale; parsing station files.\n",
+                Gparm->StaCacheFile );
+         fclose( fp );
+         return 0;
+      }
+      sf->nsta = cf.nsta;
+   }
+
+   if ( (sta = (STATION *) calloc( hdr.nsta, sizeof(STATION) )) == NULL )
+   {
+      logit( "et", "pick_ew: Cannot allocate the station array\n" );
+      fclose( fp );
+      return 0;
+   }
+   for ( i = 0; i < hdr.nsta; i++ )
+   {
+      if ( fread( &rec, sizeof(rec), 1, fp ) != 1 )
+      {
+         logit( "et", "pick_ew: Station cache <%s> is truncated; parsing station files.\n",
+                Gparm->StaCacheFile );
+         free( sta );
+         fclose( fp );
+         return 0;
+      }
+      memcpy( sta[i].sta,  rec.sta,  sizeof(rec.sta) );
+      memcpy( sta[i].chan, rec.chan, sizeof(rec.chan) );
+      memcpy( sta[i].net,  rec.net,  sizeof(rec.net) );
+      memcpy( sta[i].loc,  rec.loc,  sizeof(rec.loc) );
+      if ( (sta[i].Parm = InternParm( &rec.Parm )) == NULL )
+      {
+         logit( "et", "pick_ew: Cannot allocate picking parameters\n" );
+         free( sta );
+         fclose( fp );
+         return 0;
+      }
+   }
+
+   for ( i = 0; i < hdr.nrule; i++ )
+   {
+      if ( (fread( &rr, sizeof(rr), 1, fp ) != 1) ||
+           ((Parm = InternParm( &rr.Parm )) == NULL) ||
+           (AddRule( Rules, rr.pickflag, rr.sta, rr.chan, rr.net, rr.loc, Parm ) == -1) )
+      {
+         logit( "et", "pick_ew: Can't load rules from station cache <%s>; "
+                "parsing station files.\n", Gparm->StaCacheFile );
+         free( sta );
+         fclose( fp );
+         return 0;
+      }
+   }
+   fclose( fp );
+
+   *Sta  = sta;
+   *Nsta = hdr.nsta;
+   return 1;
+}
+
+
+  /***************************************************************
+   *                        WriteStaCache()                      *
+   *                                                             *
+   *  Write the station table to StaCacheFile.  The cache is     *
+   *  written under a temporary name and renamed, so a reader    *
+   *  never sees a partial table.  Errors are logged only.       *
+   ***************************************************************/
+
+void WriteStaCache( STATION *Sta, int Nsta, RULESET *Rules, GPARM *Gparm )
+{
+   FILE          *fp;
+   STACACHE_HDR  hdr;
+   STACACHE_FILE cf;
+   STAREC        rec;
+   RULEREC       rr;
+   char          tmpname[1024];
+   int           i, ok = 1;
+
+   if ( Gparm->StaCacheFile == NULL ) return;
+
+   sprintf( tmpname, "%.1000s.tmp", Gparm->StaCacheFile );
+   if ( (fp = fopen( tmpname, "wb" )) == NULL )
+   {
+      logit( "et", "pick_ew: Error creating station cache <%s>.\n", tmpname );
+      return;
+   }
+
+   memset( &hdr, 0, sizeof(hdr) );
+   memcpy( hdr.magic, STACACHE_MAGIC, sizeof(hdr.magic) );
+   hdr.version = STACACHE_VERSION;
+   hdr.reclen  = (int) sizeof(STAREC);
+   hdr.nfile   = Gparm->nStaFile;
+   hdr.nsta    = Nsta;
+   hdr.nrule   = Rules->nrule;
+   ok = (fwrite( &hdr, sizeof(hdr), 1, fp ) == 1);
+
+   for ( i = 0; ok && (i < Gparm->nStaFile); i++ )
+   {
+      memset( &cf, 0, sizeof(cf) );
+      strcpy( cf.name, Gparm->StaFile[i].name );
+      cf.mtime = Gparm->StaFile[i].mtime;
+      cf.size  = Gparm->StaFile[i].size;
+      cf.hash  = Gparm->StaFile[i].hash;
+      cf.nsta  = Gparm->StaFile[i].nsta;
+      ok = (fwrite( &cf, sizeof(cf), 1, fp ) == 1);
+   }
+
+   for ( i = 0; ok && (i < Nsta); i++ )
+   {
+      memset( &rec, 0, sizeof(rec) );
+      memcpy( rec.sta,  Sta[i].sta,  sizeof(rec.sta) );
+      memcpy( rec.chan, Sta[i].chan, sizeof(rec.chan) );
+      memcpy( rec.net,  Sta[i].net,  sizeof(rec.net) );
+      memcpy( rec.loc,  Sta[i].loc,  sizeof(rec.loc) );
+      rec.Parm = *Sta[i].Parm;
+      ok = (fwrite( &rec, sizeof(rec), 1, fp ) == 1);
+   }
+
+   for ( i = 0; ok && (i < Rules->nrule); i++ )
+   {
+      STARULE *r = &Rules->rule[i];
+
+      memset( &rr, 0, sizeof(rr) );
+      rr.pickflag = r->pickflag;
+      memcpy( rr.sta,  r->sta,  sizeof(rr.sta) );
+      memcpy( rr.chan, r->chan, sizeof(rr.chan) );
+      memcpy( rr.net,  r->net,  sizeof(rr.net) );
+      memcpy( rr.loc,  r->loc,  sizeof(rr.loc) );
+      rr.Parm = *r->Parm;
+      ok = (fwrite( &rr, sizeof(rr), 1, fp ) == 1);
+   }
+
+   if ( (fclose( fp ) != 0) || !ok )
+   {
+      logit( "et", "pick_ew: Error writing station cache <%s>.\n", tmpname );
+      remove( tmpname );
+      return;
+   }
+
+#if defined(_WINNT)
+   remove( Gparm->StaCacheFile );
+#endif
+   if ( rename( tmpname, Gparm->StaCacheFile ) != 0 )
+      logit( "et", "pick_ew: Error renaming <%s> to <%s>.\n", tmpname,
+             Gparm->StaCacheFile );
+   else
+      logit( "", "pick_ew: Wrote %d channels to station cache:  %s\n",
+             Nsta, Gparm->StaCacheFile );
+}
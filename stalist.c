@@ -36,17 +36,71 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "earthworm.h"
 #include "transport.h"
 #include "nn_pick_ew.h"
 
-#define MAX_LEN_STRING_STALIST 512
+/* Station array that grows as channels are added
+   **********************************************/
+typedef struct {
+   STATION *sta;
+   int     n;                /* Channels in use */
+   int     max;              /* Channels allocated */
+} STAARENA;
+
+/* Picking parameter fields of a station or Profile line.
+   d = int, f = double.  Erefs, the last one, may be left out.
+   ***********************************************************/
+#define NPARMFIELD 17
+
+static const struct {
+   char   type;
+   size_t offset;
+} ParmField[NPARMFIELD] = {
+   { 'd', offsetof(PARM, Itr1) },
+   { 'd', offsetof(PARM, MinSmallZC) },
+   { 'd', offsetof(PARM, MinBigZC) },
+   { 'd', offsetof(PARM, MinPeakSize) },
+   { 'd', offsetof(PARM, MaxMint) },
+   { 'd', offsetof(PARM, MinCodaLen) },
+   { 'f', offsetof(PARM, RawDataFilt) },
+   { 'f', offsetof(PARM, CharFuncFilt) },
+   { 'f', offsetof(PARM, StaFilt) },
+   { 'f', offsetof(PARM, LtaFilt) },
+   { 'f', offsetof(PARM, EventThresh) },
+   { 'f', offsetof(PARM, RmavFilt) },
+   { 'f', offsetof(PARM, DeadSta) },
+   { 'f', offsetof(PARM, CodaTerm) },
+   { 'f', offsetof(PARM, AltCoda) },
+   { 'f', offsetof(PARM, PreEvent) },
+   { 'f', offsetof(PARM, Erefs) }
+};
+
+#define NSTAFIELD (6 + NPARMFIELD)   /* Flag, pin, SCNL and parameters */
 
 /* Function prototype
    ******************/
-void InitVar( STATION * );
 int  IsComment( char [] );
+STATION *NewStaTable( STATION *, int );            /* function in statable.c */
+int      ShardStaList( STATION *, int );            /* function in shard.c */
+int  ReadStaCache( STATION **, int *, RULESET *, GPARM * );  /* functions in stacache.c */
+void WriteStaCache( STATION *, int, RULESET *, GPARM * );
+PARM    *InternParm( PARM * );                     /* functions in profile.c */
+int      NumParm( void );
+int      AddProfile( RULESET *, char *, PARM * );
+PARM    *FindProfile( RULESET *, char * );
+int      AddRule( RULESET *, int, char *, char *, char *, char *, PARM * );
+STARULE *MatchRule( RULESET *, char *, char *, char *, char * );
+void     FreeRuleSet( RULESET * );
+static char *ReadStaFile( STAFILE * );
+static int   ParseStaFile( char *, STAFILE *, STAARENA *, RULESET * );
+static int   DecodeParm( char **, int, PARM * );
+static char *NextToken( char ** );
 
 
   /***************************************************************
@@ -54,109 +108,376 @@ int  IsComment( char [] );
    *                                                             *
    *                     Read the station list                   *
    *                                                             *
+   *  Each station file is read into memory once and parsed in   *
+   *  one pass.  If StaCacheFile is set and none of the station  *
+   *  files has changed since the cache was written, the table   *
+   *  is loaded from the cache instead.                          *
+   *                                                             *
+   *  Besides channel lines, a station file may contain:         *
+   *    Profile <name> <Itr1> ... <Erefs>                        *
+   *       names a parameter set;                                *
+   *    <flag> <pin> <S> <C> <N> <L> <name>                      *
+   *       a channel using a named parameter set;                *
+   *    <flag> <pin> <S> <C> <N> <L>                             *
+   *       a channel using the first matching rule;              *
+   *    a channel line whose SCNL contains '*' or '?'            *
+   *       a rule for the channels listed after it.              *
+   *  Channels with equal parameters share one PARM.  The        *
+   *  profiles and rules are returned in Rules; the caller frees *
+   *  them with FreeRuleSet().                                   *
+   *                                                             *
    *  Returns -1 if an error is encountered.                     *
    ***************************************************************/
 
-int GetStaList( STATION **Sta, int *Nsta, GPARM *Gparm )
+int GetStaList( STATION **Sta, int *Nsta, RULESET *Rules, GPARM *Gparm )
 {
-   char    string[MAX_LEN_STRING_STALIST];
-   int     i,ifile;
-   int     nstanew;
-   STATION *sta;
-   FILE    *fp;
+   char     **text;
+   int      ifile;
+   int      rc = 0;
+   STAARENA arena;
 
-/* Loop thru the station list file(s)
-   **********************************/
+   text = (char **) calloc( Gparm->nStaFile, sizeof(char *) );
+   if ( text == NULL )
+   {
+      logit( "et", "pick_ew: Cannot allocate station file buffers\n" );
+      return -1;
+   }
+   memset( Rules, 0, sizeof(RULESET) );
+
+/* Read the station list file(s), noting size, time and hash
+   *********************************************************/
    for( ifile=0; ifile<Gparm->nStaFile; ifile++ )
    {
-      if ( ( fp = fopen( Gparm->StaFile[ifile].name, "r") ) == NULL )
+      if ( (text[ifile] = ReadStaFile( &Gparm->StaFile[ifile] )) == NULL )
       {
-         logit( "et", "pick_ew: Error opening station list file <%s>.\n",
-                Gparm->StaFile[ifile].name );
-         return -1;
+         rc = -1;
+         goto done;
+      }
+   }
+
+/* Use the compiled table if it matches the files
+   **********************************************/
+   if ( (*Nsta == 0) && (ReadStaCache( Sta, Nsta, Rules, Gparm ) == 1) )
+   {
+      logit( "", "pick_ew: Loaded %d channels from station cache:  %s\n",
+             *Nsta, Gparm->StaCacheFile );
+      goto done;
+   }
+
+/* Parse the files into the station array
+   **************************************/
+   FreeRuleSet( Rules );              /* In case the cache was half read */
+   arena.sta = *Sta;
+   arena.n   = *Nsta;
+   arena.max = *Nsta;
+   for( ifile=0; ifile<Gparm->nStaFile; ifile++ )
+   {
+      int n0 = arena.n;
+
+      if ( ParseStaFile( text[ifile], &Gparm->StaFile[ifile], &arena, Rules ) == -1 )
+      {
+         rc = -1;
+         break;
+      }
+      logit( "", "pick_ew: Loaded %d channels from station list file:  %s\n",
+             arena.n - n0, Gparm->StaFile[ifile].name );
+      Gparm->StaFile[ifile].nsta = arena.n - n0;
+   }
+   *Sta  = arena.sta;
+   *Nsta = arena.n;
+
+   if ( rc == 0 )
+      WriteStaCache( *Sta, *Nsta, Rules, Gparm );
+
+done:
+/* Drop the channels other shards pick.  Lay the rest
+   out in their final table, with the event and gap blocks
+   *******************************************************/
+   if ( rc == 0 )
+   {
+      STATION *tab;
+
+      *Nsta = ShardStaList( *Sta, *Nsta );
+      tab = NewStaTable( *Sta, *Nsta );
+
+      if ( tab == NULL )
+      {
+         logit( "et", "pick_ew: Cannot allocate the station table\n" );
+         rc = -1;
+      }
+      else
+      {
+         free( *Sta );
+         *Sta = tab;
+      }
+   }
+   if ( rc == 0 )
+      logit( "", "pick_ew: %d distinct picking parameter sets in use\n", NumParm() );
+   for( ifile=0; ifile<Gparm->nStaFile; ifile++ )
+      free( text[ifile] );
+   free( text );
+   return rc;
+}
+
+
+/* Read a whole station file into a null-terminated buffer and
+   record its size, modification time and hash.  Returns NULL
+   on error.
+   ***********************************************************/
+static char *ReadStaFile( STAFILE *sf )
+{
+   FILE          *fp;
+   char          *buf;
+   long          len;
+   unsigned int  h = 2166136261u;          /* FNV-1a */
+   long          i;
+   struct stat   st;
+
+   if ( ( fp = fopen( sf->name, "rb") ) == NULL )
+   {
+      logit( "et", "pick_ew: Error opening station list file <%s>.\n", sf->name );
+      return NULL;
+   }
+   if ( (fseek( fp, 0L, SEEK_END ) != 0) || ((len = ftell( fp )) < 0) ||
+        (fseek( fp, 0L, SEEK_SET ) != 0) )
+   {
+      logit( "et", "pick_ew: Error sizing station list file <%s>.\n", sf->name );
+      fclose( fp );
+      return NULL;
+   }
+   if ( (buf = (char *) malloc( (size_t) len + 1 )) == NULL )
+   {
+      logit( "et", "pick_ew: Cannot allocate %ld bytes for <%s>.\n", len, sf->name );
+      fclose( fp );
+      return NULL;
+   }
+   if ( fread( buf, 1, (size_t) len, fp ) != (size_t) len )
+   {
+      logit( "et", "pick_ew: Error reading station list file <%s>.\n", sf->name );
+      fclose( fp );
+      free( buf );
+      return NULL;
+   }
+   fclose( fp );
+   buf[len] = '\0';
+
+   for ( i = 0; i < len; i++ )
+   {
+      h ^= (unsigned char) buf[i];
+      h *= 16777619u;
+   }
+   sf->size  = (unsigned int) len;
+   sf->hash  = h;
+   sf->mtime = (stat( sf->name, &st ) == 0) ? (double) st.st_mtime : 0.;
+   return buf;
+}
+
+
+/* Parse one station file, appending the channels with a
+   nonzero pick flag to the arena and the profiles and rules
+   to rs.  The buffer is modified.  Returns -1 on error.
+   *********************************************************/
+static int ParseStaFile( char *text, STAFILE *sf, STAARENA *arena, RULESET *rs )
+{
+   char *line = text;
+   int  lineno = 0;
+
+   while ( *line != '\0' )
+   {
+      char    *eol = strchr( line, '\n' );
+      char    *tok[NSTAFIELD];
+      int     ntok = 0;
+      int     ndecoded;
+      int     pickflag;
+      char    *e;
+      PARM    parm;
+      PARM    *Parm = NULL;
+      STATION *sta;
+
+      if ( eol != NULL ) *eol = '\0';
+      lineno++;
+      if ( IsComment( line ) )
+      {
+         line = (eol != NULL) ? eol + 1 : line + strlen( line );
+         continue;
       }
 
-   /* Count channels in the station file.
-      Ignore comment lines and lines consisting of all whitespace.
-      ***********************************************************/
-      nstanew = 0;
-      while ( fgets( string, MAX_LEN_STRING_STALIST, fp ) != NULL )
-         if ( !IsComment( string ) ) nstanew++;
+   /* Split the line into tokens
+      **************************/
+      while ( (ntok < NSTAFIELD) && ((tok[ntok] = NextToken( &line )) != NULL) )
+         ntok++;
+      line = (eol != NULL) ? eol + 1 : line + strlen( line );
+      if ( ntok == 0 ) continue;
 
-      rewind( fp );
+   /* Profile <name> <parameters>
+      ***************************/
+      if ( strcmp( tok[0], "Profile" ) == 0 )
+      {
+         ndecoded = (ntok > 2) ? DecodeParm( tok + 2, ntok - 2, &parm ) : 0;
+         if ( ndecoded < NPARMFIELD - 1 )
+         {
+            logit( "et", "pick_ew: Error decoding profile in <%s>, line %d.\n",
+                   sf->name, lineno );
+            return -1;
+         }
+         if ( ((Parm = InternParm( &parm )) == NULL) ||
+              (AddProfile( rs, tok[1], Parm ) == -1) )
+         {
+            logit( "et", "pick_ew: Can't add profile <%s> in <%s>, line %d.\n",
+                   tok[1], sf->name, lineno );
+            return -1;
+         }
+         continue;
+      }
 
-   /* Re-allocate the station list
-      ****************************/
-      sta = (STATION *) realloc( *Sta, (*Nsta+nstanew)*sizeof(STATION) );
-      if ( sta == NULL )
+   /* Pick flag, pin number and SCNL
+      ******************************/
+      pickflag = (int) strtol( tok[0], &e, 10 );
+      if ( (e == tok[0]) || (*e != '\0') || (ntok < 6) )
       {
-         logit( "et", "pick_ew: Cannot reallocate the station array\n" );
+         logit( "et", "pick_ew: Error decoding station file <%s>, line %d.\n",
+                sf->name, lineno );
          return -1;
       }
-      *Sta = sta;           /* point to newly realloc'd space */
-      sta  = *Sta + *Nsta;  /* point to next empty slot */
-
-   /* Initialize internal variables in station list
-      *********************************************/
-      for ( i = 0; i < nstanew; i++ ) InitVar( &sta[i] );
-
-   /* Read stations from the station list file into the station
-      array, including parameters used by the picking algorithm
-      *********************************************************/
-      i = 0;
-      while ( fgets( string, MAX_LEN_STRING_STALIST, fp ) != NULL )
+
+   /* The parameters are given in full, by profile name,
+      or not at all (then a rule must supply them)
+      ***************************************************/
+      if ( ntok == 6 )
+         Parm = NULL;
+      else if ( isalpha( (unsigned char) tok[6][0] ) || (tok[6][0] == '_') )
       {
-         int ndecoded;
-         int pickflag;
-         int pin;
-
-         if ( IsComment( string ) ) continue;
-         ndecoded = sscanf( string,
-                    "%d%d%s%s%s%s%d%d%d%d%d%d%lf%lf%lf%lf%lf%lf%lf%lf%lf%lf%lf",
-                 &pickflag,
-                 &pin,
-                  sta[i].sta,
-                  sta[i].chan,
-                  sta[i].net,
-                  sta[i].loc,
-                 &sta[i].Parm.Itr1,
-                 &sta[i].Parm.MinSmallZC,
-                 &sta[i].Parm.MinBigZC,
-                 &sta[i].Parm.MinPeakSize,
-                 &sta[i].Parm.MaxMint,
-                 &sta[i].Parm.MinCodaLen,
-                 &sta[i].Parm.RawDataFilt,
-                 &sta[i].Parm.CharFuncFilt,
-                 &sta[i].Parm.StaFilt,
-                 &sta[i].Parm.LtaFilt,
-                 &sta[i].Parm.EventThresh,
-                 &sta[i].Parm.RmavFilt,
-                 &sta[i].Parm.DeadSta,
-                 &sta[i].Parm.CodaTerm,
-                 &sta[i].Parm.AltCoda,
-                 &sta[i].Parm.PreEvent,
-                 &sta[i].Parm.Erefs );
-         if ( ndecoded < 22 )
+         if ( (Parm = FindProfile( rs, tok[6] )) == NULL )
          {
-            logit( "et", "pick_ew: Error decoding station file.\n" );
-            logit( "e", "ndecoded: %d\n", ndecoded );
-            logit( "e", "Offending line:\n" );
-            logit( "e", "%s\n", string );
+            logit( "et", "pick_ew: Unknown profile <%s> in <%s>, line %d.\n",
+                   tok[6], sf->name, lineno );
             return -1;
          }
-         if ( pickflag == 0 ) continue;
-         i++;
       }
-      fclose( fp );
-      logit( "", "pick_ew: Loaded %d channels from station list file:  %s\n",
-             i, Gparm->StaFile[ifile].name);
-      Gparm->StaFile[ifile].nsta = i;
-      *Nsta += i;
-   } /* end for over all StaFiles */
+      else
+      {
+         ndecoded = DecodeParm( tok + 6, ntok - 6, &parm );
+         if ( ndecoded < NPARMFIELD - 1 )
+         {
+            logit( "et", "pick_ew: Error decoding station file <%s>, line %d.\n",
+                   sf->name, lineno );
+            logit( "e", "ndecoded: %d\n", ndecoded + 6 );
+            return -1;
+         }
+         if ( (Parm = InternParm( &parm )) == NULL )
+         {
+            logit( "et", "pick_ew: Cannot allocate picking parameters\n" );
+            return -1;
+         }
+      }
+
+   /* A wildcard SCNL is a rule, not a channel
+      ****************************************/
+      if ( strpbrk( tok[2], "*?" ) || strpbrk( tok[3], "*?" ) ||
+           strpbrk( tok[4], "*?" ) || strpbrk( tok[5], "*?" ) )
+      {
+         if ( (Parm == NULL) ||
+              (AddRule( rs, pickflag, tok[2], tok[3], tok[4], tok[5], Parm ) == -1) )
+         {
+            logit( "et", "pick_ew: Bad SCNL rule in <%s>, line %d.\n", sf->name, lineno );
+            return -1;
+         }
+         continue;
+      }
+
+      if ( Parm == NULL )
+      {
+         STARULE *r = MatchRule( rs, tok[2], tok[3], tok[4], tok[5] );
+
+         if ( r == NULL )
+         {
+            logit( "et", "pick_ew: No parameters or matching rule for %s.%s.%s.%s "
+                   "in <%s>, line %d.\n", tok[2], tok[3], tok[4], tok[5],
+                   sf->name, lineno );
+            return -1;
+         }
+         Parm = r->Parm;
+      }
+      if ( pickflag == 0 ) continue;
+
+   /* Grow the station array
+      **********************/
+      if ( arena->n == arena->max )
+      {
+         int     max = (arena->max < 256) ? 256 : 2 * arena->max;
+         STATION *tmp = (STATION *) realloc( arena->sta, max * sizeof(STATION) );
+
+         if ( tmp == NULL )
+         {
+            logit( "et", "pick_ew: Cannot reallocate the station array\n" );
+            return -1;
+         }
+         arena->sta = tmp;
+         arena->max = max;
+      }
+      sta = &arena->sta[arena->n];
+      memset( sta, 0, sizeof(STATION) );
+
+      if ( (strlen( tok[2] ) >= sizeof(sta->sta))  ||
+           (strlen( tok[3] ) >= sizeof(sta->chan)) ||
+           (strlen( tok[4] ) >= sizeof(sta->net))  ||
+           (strlen( tok[5] ) >= sizeof(sta->loc)) )
+      {
+         logit( "et", "pick_ew: SCNL too long in <%s>, line %d.\n", sf->name, lineno );
+         return -1;
+      }
+      strcpy( sta->sta,  tok[2] );
+      strcpy( sta->chan, tok[3] );
+      strcpy( sta->net,  tok[4] );
+      strcpy( sta->loc,  tok[5] );
+      sta->Parm = Parm;
+      arena->n++;
+   }
    return 0;
 }
 
 
+/* Decode picking parameters in order, stopping at the first
+   bad one.  Returns the number of fields decoded.
+   *********************************************************/
+static int DecodeParm( char **tok, int ntok, PARM *Parm )
+{
+   int  i;
+   char *e;
+
+   memset( Parm, 0, sizeof(PARM) );
+   for ( i = 0; (i < ntok) && (i < NPARMFIELD); i++ )
+   {
+      char *field = (char *) Parm + ParmField[i].offset;
+
+      if ( ParmField[i].type == 'd' )
+         *(int *) field = (int) strtol( tok[i], &e, 10 );
+      else
+         *(double *) field = strtod( tok[i], &e );
+      if ( (e == tok[i]) || (*e != '\0') ) return i;
+   }
+   return i;
+}
+
+
+/* Return the next whitespace-delimited token and null-terminate
+   it, or NULL at the end of the string
+   *************************************************************/
+static char *NextToken( char **p )
+{
+   char *s = *p;
+   char *e;
+
+   while ( (*s == ' ') || (*s == '\t') || (*s == '\r') ) s++;
+   if ( *s == '\0' ) return NULL;
+
+   for ( e = s; (*e != '\0') && (*e != ' ') && (*e != '\t') && (*e != '\r'); e++ );
+   *p = (*e == '\0') ? e : e + 1;
+   *e = '\0';
+   return s;
+}
+
+
  /***********************************************************************
   *                             LogStaList()                            *
   *                                                                     *
@@ -177,22 +498,22 @@ void LogStaList( STATION *Sta, int Nsta )
       logit( "", " %-3s",    Sta[i].chan );
       logit( "", " %-2s",    Sta[i].net );
       logit( "", " %-2s",    Sta[i].loc );
-      logit( "", "  %1d",    Sta[i].Parm.Itr1 );
-      logit( "", "  %2d",    Sta[i].Parm.MinSmallZC );
-      logit( "", "  %1d",    Sta[i].Parm.MinBigZC );
-      logit( "", "  %2d",    Sta[i].Parm.MinPeakSize );
-      logit( "", "  %3d",    Sta[i].Parm.MaxMint );
-      logit( "", "  %5.3lf", Sta[i].Parm.RawDataFilt );
-      logit( "", "  %3.1lf", Sta[i].Parm.CharFuncFilt );
-      logit( "", "  %3.1lf", Sta[i].Parm.StaFilt );
-      logit( "", "  %4.2lf", Sta[i].Parm.LtaFilt );
-      logit( "", "  %3.1lf", Sta[i].Parm.EventThresh );
-      logit( "", "  %5.3lf", Sta[i].Parm.RmavFilt );
-      logit( "", "  %4.0lf", Sta[i].Parm.DeadSta );
-      logit( "", "  %5.2lf", Sta[i].Parm.CodaTerm );
-      logit( "", "  %3.1lf", Sta[i].Parm.AltCoda );
-      logit( "", "  %3.1lf", Sta[i].Parm.PreEvent );
-      logit( "", "  %7.1lf", Sta[i].Parm.Erefs );
+      logit( "", "  %1d",    Sta[i].Parm->Itr1 );
+      logit( "", "  %2d",    Sta[i].Parm->MinSmallZC );
+      logit( "", "  %1d",    Sta[i].Parm->MinBigZC );
+      logit( "", "  %2d",    Sta[i].Parm->MinPeakSize );
+      logit( "", "  %3d",    Sta[i].Parm->MaxMint );
+      logit( "", "  %5.3lf", Sta[i].Parm->RawDataFilt );
+      logit( "", "  %3.1lf", Sta[i].Parm->CharFuncFilt );
+      logit( "", "  %3.1lf", Sta[i].Parm->StaFilt );
+      logit( "", "  %4.2lf", Sta[i].Parm->LtaFilt );
+      logit( "", "  %3.1lf", Sta[i].Parm->EventThresh );
+      logit( "", "  %5.3lf", Sta[i].Parm->RmavFilt );
+      logit( "", "  %4.0lf", Sta[i].Parm->DeadSta );
+      logit( "", "  %5.2lf", Sta[i].Parm->CodaTerm );
+      logit( "", "  %3.1lf", Sta[i].Parm->AltCoda );
+      logit( "", "  %3.1lf", Sta[i].Parm->PreEvent );
+      logit( "", "  %7.1lf", Sta[i].Parm->Erefs );
       logit( "", "\n" );
    }
    logit( "", "\n" );
@@ -215,7 +536,7 @@ int IsComment( char string[] )
    {
       char test = string[i];
 
-      if ( test!=' ' && test!='\t' && test!='\n' )
+      if ( test!=' ' && test!='\t' && test!='\n' && test!='\r' )
       {
          if ( test == '#'  )
             return 1;          /* It's a comment line */
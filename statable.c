@@ -0,0 +1,95 @@
+  /**********************************************************************
+   *                             statable.c                             *
+   *                                                                    *
+   *                        Station table layout                        *
+   *                                                                    *
+   *  This file contains functions NewStaTable() and CopyStaState().    *
+   *                                                                    *
+   *  For every sample the picker reads and writes only the filter      *
+   *  state at the top of STATION and the channel's (shared) PARM.      *
+   *  The variables of an active pick or coda, and the gap counters,    *
+   *  are kept out of the way in blocks of their own, so a table of     *
+   *  many idle channels is a dense array of small records.  A table    *
+   *  is one allocation: Nsta STATIONs, then Nsta STAEVENTs, then Nsta  *
+   *  GAPSTATs, then Nsta DUPKEYS.  It is freed with free(), and        *
+   *  sorting it keeps each channel's blocks, since only the STATION    *
+   *  records move.                                                     *
+   **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <earthworm.h>
+#include <transport.h>
+#include "nn_pick_ew.h"
+
+/* Function prototypes
+   *******************/
+void InitVar( STATION * );
+
+
+  /***************************************************************
+   *                         NewStaTable()                       *
+   *                                                             *
+   *  Build a station table from Nsta channels of which only     *
+   *  the SCNL and Parm are set.  The channels are initialized.  *
+   *  Sta is left alone.  Returns NULL if out of memory.         *
+   ***************************************************************/
+
+STATION *NewStaTable( STATION *Sta, int Nsta )
+{
+   STATION  *tab;
+   STAEVENT *ev;
+   GAPSTAT  *gap;
+   DUPKEYS  *dup;
+   int      i;
+
+   tab = (STATION *) calloc( 1, (Nsta > 0 ? Nsta : 1) * (sizeof(STATION) +
+                             sizeof(STAEVENT) + sizeof(GAPSTAT) + sizeof(DUPKEYS)) );
+   if ( tab == NULL ) return NULL;
+   ev  = (STAEVENT *) (tab + Nsta);
+   gap = (GAPSTAT *) (ev + Nsta);
+   dup = (DUPKEYS *) (gap + Nsta);
+
+   for ( i = 0; i < Nsta; i++ )
+   {
+      memcpy( tab[i].sta,  Sta[i].sta,  sizeof(tab[i].sta) );
+      memcpy( tab[i].chan, Sta[i].chan, sizeof(tab[i].chan) );
+      memcpy( tab[i].net,  Sta[i].net,  sizeof(tab[i].net) );
+      memcpy( tab[i].loc,  Sta[i].loc,  sizeof(tab[i].loc) );
+      tab[i].Parm = Sta[i].Parm;
+      tab[i].Ev   = &ev[i];
+      tab[i].Gap  = &gap[i];
+      tab[i].Dup  = &dup[i];
+      InitVar( &tab[i] );
+   }
+   return tab;
+}
+
+
+  /***************************************************************
+   *                         CopyStaState()                      *
+   *                                                             *
+   *  Copy the whole state of a channel, including its event,    *
+   *  gap and duplicate blocks, into a channel of another        *
+   *  table.  The reorder buffer, the filter bank, the onset     *
+   *  history, the amplitude state and the noise state are       *
+   *  handed over, not copied.                                   *
+   ***************************************************************/
+
+void CopyStaState( STATION *dst, STATION *src )
+{
+   STAEVENT *ev  = dst->Ev;
+   GAPSTAT  *gap = dst->Gap;
+   DUPKEYS  *dup = dst->Dup;
+
+   *dst      = *src;
+   dst->Ev   = ev;
+   dst->Gap  = gap;
+   dst->Dup  = dup;
+   *dst->Ev  = *src->Ev;
+   *dst->Gap = *src->Gap;
+   *dst->Dup = *src->Dup;
+   if ( dst->Ro != NULL )              /* The reorder buffer moves along */
+      dst->Ro->Sta = dst;
+}